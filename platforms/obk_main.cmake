@@ -29,6 +29,7 @@ set(OBKM_SRC
 	${OBK_SRCS}hal/generic/hal_generic.c
 	${OBK_SRCS}hal/generic/hal_main_generic.c
 	${OBK_SRCS}hal/generic/hal_ota_generic.c
+	${OBK_SRCS}hal/generic/hal_ota_pipeline.c
 	${OBK_SRCS}hal/generic/hal_pins_generic.c
 	${OBK_SRCS}hal/generic/hal_wifi_generic.c
 	${OBK_SRCS}hal/generic/hal_uart_generic.c
@@ -43,12 +44,14 @@ set(OBKM_SRC
 	${OBK_SRCS}mqtt/new_mqtt_deduper.c
 	${OBK_SRCS}jsmn/jsmn.c
 	${OBK_SRCS}logging/logging.c
+	${OBK_SRCS}memory/mem_pool.c
 	${OBK_SRCS}mqtt/new_mqtt.c
 	${OBK_SRCS}new_cfg.c
 	${OBK_SRCS}new_common.c
 	${OBK_SRCS}new_ping.c
 	${OBK_SRCS}new_pins.c
 	${OBK_SRCS}rgb2hsv.c
+	${OBK_SRCS}tick_profiler.c
 	${OBK_SRCS}tiny_crc8.c
 	${OBK_SRCS}httpclient/http_client.c
 	${OBK_SRCS}httpclient/utils_net.c
@@ -59,6 +62,7 @@ set(OBKM_SRC
 
 	${OBK_SRCS}driver/drv_adcButton.c
 	${OBK_SRCS}driver/drv_adcSmoother.c
+	${OBK_SRCS}driver/drv_adcSampler.c
 	${OBK_SRCS}driver/drv_aht2x.c
 	${OBK_SRCS}driver/drv_battery.c
 	${OBK_SRCS}driver/drv_bl0937.c
@@ -97,6 +101,7 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_max72xx_clock.c
 	${OBK_SRCS}driver/drv_max72xx_internal.c
 	${OBK_SRCS}driver/drv_max72xx_single.c
+	${OBK_SRCS}driver/drv_meterFrame.c
 	${OBK_SRCS}driver/drv_mcp9808.c
 	${OBK_SRCS}driver/drv_multiPinI2CScanner.c
 	${OBK_SRCS}driver/drv_ntp.c
@@ -160,6 +165,7 @@ set(OBKM_SRC
 if(NOT DEFINED SDK_CJSON)
 	set(OBKM_SRC ${OBKM_SRC} ${OBK_SRCS}cJSON/cJSON.c)
 endif()
+set(OBKM_SRC ${OBKM_SRC} ${OBK_SRCS}cJSON/cJSON_arena.c)
 
 if(NOT DEFINED SDK_LFS)
 	set(OBKM_SRC ${OBKM_SRC} ${OBK_SRCS}littlefs/lfs.c ${OBK_SRCS}littlefs/lfs_util.c)
@@ -19,6 +19,7 @@ OBKM_SRC  += $(OBK_SRCS)base64/base64.c
 OBKM_SRC  += $(OBK_SRCS)bitmessage/bitmessage_read.c
 OBKM_SRC  += $(OBK_SRCS)bitmessage/bitmessage_write.c
 OBKM_SRC  += $(OBK_SRCS)cJSON/cJSON.c
+OBKM_SRC  += $(OBK_SRCS)cJSON/cJSON_arena.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_berry.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_channels.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_enums.c
@@ -44,6 +45,7 @@ OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashVars_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_main_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_ota_generic.c
+OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_ota_pipeline.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_pins_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_wifi_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_uart_generic.c
@@ -58,12 +60,14 @@ OBKM_SRC  += $(OBK_SRCS)httpserver/rest_interface.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt_deduper.c
 OBKM_SRC  += $(OBK_SRCS)jsmn/jsmn.c
 OBKM_SRC  += $(OBK_SRCS)logging/logging.c
+OBKM_SRC  += $(OBK_SRCS)memory/mem_pool.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt.c
 OBKM_SRC  += $(OBK_SRCS)new_cfg.c
 OBKM_SRC  += $(OBK_SRCS)new_common.c
 OBKM_SRC  += $(OBK_SRCS)new_ping.c
 OBKM_SRC  += $(OBK_SRCS)new_pins.c
 OBKM_SRC  += $(OBK_SRCS)rgb2hsv.c
+OBKM_SRC  += $(OBK_SRCS)tick_profiler.c
 OBKM_SRC  += $(OBK_SRCS)tiny_crc8.c
 OBKM_SRC  += $(OBK_SRCS)httpclient/http_client.c
 OBKM_SRC  += $(OBK_SRCS)httpclient/utils_net.c
@@ -76,6 +80,7 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_main.c
 
 OBKM_SRC  += $(OBK_SRCS)driver/drv_adcButton.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_adcSmoother.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_adcSampler.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_aht2x.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_battery.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bl0937.c
@@ -116,6 +121,7 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_max6675.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_max72xx_clock.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_max72xx_internal.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_max72xx_single.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_meterFrame.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_mcp9808.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_multiPinI2CScanner.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ntp.c
@@ -56,7 +56,130 @@ static int mode_to_flags(const char *mode) {
 	return -1;
 }
 
+//
+// Bytecode cache.
+// Compiled bytecode of "name.be" is kept in "name.be.bc" (so Berry's own module
+// search never picks it up unchecked), with the hash of the source it was built
+// from stored as a LittleFS custom attribute.
+// While Berry_ImportFile imports a source with fresh cache, be_fopen opens the
+// cache instead of that one source; Berry detects the bytecode magic and skips
+// the parser entirely. Any other open, including scripts reading .be files as
+// data, gets the file that was asked for.
+//
+#define BERRY_BYTECODE_CACHE_ATTR	0x42
+
+static int g_berryBytecodeCacheHits = 0;
+// source currently imported through its cache, or NULL
+static const char *g_berryImportSource = NULL;
+
+int Berry_GetBytecodeCacheHits() {
+	return g_berryBytecodeCacheHits;
+}
+bool Berry_GetBytecodeCacheName(const char *src, char *out, int outSize) {
+	int len = strlen(src);
+	if (len < 3 || strcmp(src + len - 3, ".be")) {
+		return false;
+	}
+	if (len + 4 > outSize) {
+		return false;
+	}
+	strcpy(out, src);
+	strcat(out, ".bc");
+	return true;
+}
+// module search may put "/" or "./" in front of the name
+static const char *Berry_SkipPathPrefix(const char *s) {
+	if (s[0] == '.' && s[1] == '/') {
+		s += 2;
+	}
+	while (*s == '/') {
+		s++;
+	}
+	return s;
+}
+void Berry_SetImportSource(const char *src) {
+	g_berryImportSource = src;
+}
+// Streams the file through FNV-1a, seeded with VM version so an upgraded firmware
+// never loads bytecode built by an older Berry
+static bool Berry_HashFile(const char *filename, unsigned int *hash) {
+	lfs_file_t file;
+	byte buffer[64];
+	const char *v;
+	unsigned int h = 2166136261u;
+	int i, r;
+
+#ifdef BERRY_VERSION
+	for (v = BERRY_VERSION; *v; v++) {
+		h ^= (byte)*v;
+		h *= 16777619u;
+	}
+#endif
+	memset(&file, 0, sizeof(file));
+	if (lfs_file_open(&lfs, &file, filename, LFS_O_RDONLY) < 0) {
+		return false;
+	}
+	while ((r = lfs_file_read(&lfs, &file, buffer, sizeof(buffer))) > 0) {
+		for (i = 0; i < r; i++) {
+			h ^= buffer[i];
+			h *= 16777619u;
+		}
+	}
+	lfs_file_close(&lfs, &file);
+	*hash = h;
+	return true;
+}
+// Returns true if bytecode cache exists and was built from current source.
+// bSourceExists (optional) is set if the source file exists.
+// srcHash (optional) receives hash of the source, so a following
+// Berry_MarkBytecodeCacheFresh does not read it again; source is hashed
+// only if cache has a stored hash or srcHash is asked for.
+bool Berry_IsBytecodeCacheFresh(const char *src, bool *bSourceExists, unsigned int *srcHash) {
+	struct lfs_info info;
+	char cacheName[64];
+	unsigned int hash, stored;
+	bool bHasCache;
+
+	if (bSourceExists) {
+		*bSourceExists = false;
+	}
+	if (!lfs_present()) {
+		return false;
+	}
+	if (!Berry_GetBytecodeCacheName(src, cacheName, sizeof(cacheName))) {
+		return false;
+	}
+	if (lfs_stat(&lfs, src, &info) < 0) {
+		return false;
+	}
+	if (bSourceExists) {
+		*bSourceExists = true;
+	}
+	bHasCache = lfs_getattr(&lfs, cacheName, BERRY_BYTECODE_CACHE_ATTR, &stored, sizeof(stored)) == sizeof(stored);
+	if (bHasCache == false && srcHash == NULL) {
+		return false;
+	}
+	if (!Berry_HashFile(src, &hash)) {
+		return false;
+	}
+	if (srcHash) {
+		*srcHash = hash;
+	}
+	return bHasCache && stored == hash;
+}
+// Called after the cache was written, binds it to source with given hash
+bool Berry_MarkBytecodeCacheFresh(const char *src, unsigned int srcHash) {
+	char cacheName[64];
+
+	if (!Berry_GetBytecodeCacheName(src, cacheName, sizeof(cacheName))) {
+		return false;
+	}
+	return lfs_setattr(&lfs, cacheName, BERRY_BYTECODE_CACHE_ATTR, &srcHash, sizeof(srcHash)) >= 0;
+}
+
 void *be_fopen(const char *filename, const char *modes) {
+	char cacheName[64];
+
 	if (!lfs_present())
 		init_lfs(1);
 	if (lfs_present()) {
@@ -64,6 +187,13 @@ void *be_fopen(const char *filename, const char *modes) {
 		if (flags == -1) {
 			return NULL;
 		}
+		// import loading the source that was checked fresh? Give Berry the bytecode
+		if (flags == LFS_O_RDONLY && g_berryImportSource
+			&& !strcmp(Berry_SkipPathPrefix(filename), Berry_SkipPathPrefix(g_berryImportSource))
+			&& Berry_GetBytecodeCacheName(g_berryImportSource, cacheName, sizeof(cacheName))) {
+			filename = cacheName;
+			g_berryBytecodeCacheHits++;
+		}
 		lfs_file_t *file = malloc(sizeof(lfs_file_t));
 		memset(file, 0, sizeof(lfs_file_t));
 		int err = lfs_file_open(&lfs, file, filename, flags);
@@ -139,6 +269,24 @@ size_t be_fsize(void *hfile) {
 
 #else // !ENABLE_LITTLEFS
 
+int Berry_GetBytecodeCacheHits() {
+	return 0;
+}
+bool Berry_GetBytecodeCacheName(const char *src, char *out, int outSize) {
+	return false;
+}
+void Berry_SetImportSource(const char *src) {
+}
+bool Berry_IsBytecodeCacheFresh(const char *src, bool *bSourceExists, unsigned int *srcHash) {
+	if (bSourceExists) {
+		*bSourceExists = false;
+	}
+	return false;
+}
+bool Berry_MarkBytecodeCacheFresh(const char *src, unsigned int srcHash) {
+	return false;
+}
+
 void *be_fopen(const char *filename, const char *modes) {
 	return NULL;
 }
@@ -72,6 +72,49 @@ err:
 	return success;
 }
 
+static int berrySaveCodeNative(bvm *vm) {
+	// args: cache file name, closure on top of the stack
+	be_savecode(vm, be_tostring(vm, 1));
+	be_return_nil(vm);
+}
+// Compiles Berry source file into its bytecode cache. srcHash is the hash
+// Berry_IsBytecodeCacheFresh returned for the source, caller checks freshness.
+// Returns true if up to date bytecode is available afterwards.
+bool berryCompileFile(bvm *vm, const char *fname, unsigned int srcHash) {
+	char cacheName[64];
+	int ret;
+
+	if (!Berry_GetBytecodeCacheName(fname, cacheName, sizeof(cacheName))) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "berryCompileFile: %s is not a .be file", fname);
+		return false;
+	}
+	// cache is stale, so this goes through the parser
+	ret = be_loadmode(vm, fname, bfalse);
+	if (ret != 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "berryCompileFile: %s failed to compile, retcode %d", fname, ret);
+		be_dumpstack(vm);
+		be_error_pop_all(vm);
+		return false;
+	}
+	// bytecode saver raises on I/O errors, so run it in protected mode
+	be_pushntvfunction(vm, berrySaveCodeNative);
+	be_pushstring(vm, cacheName);
+	be_pushvalue(vm, -3);
+	ret = be_pcall(vm, 2);
+	if (ret != 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "berryCompileFile: failed to save %s, retcode %d", cacheName, ret);
+		be_error_pop_all(vm);
+		return false;
+	}
+	// native function, its two arguments and compiled closure
+	be_pop(vm, 4);
+	if (!Berry_MarkBytecodeCacheFresh(fname, srcHash)) {
+		return false;
+	}
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "berryCompileFile: %s compiled to %s", fname, cacheName);
+	return true;
+}
+
 void berryRunClosure(bvm *vm, int closureId) {
 	//int s1 = Berry_GetStackSizeCurrent();
 	if (!be_getglobal(vm, "run_closure")) {
@@ -6,6 +6,12 @@ extern const char berryPrelude[];
 void be_dumpstack(bvm *vm);
 
 bool berryRun(bvm *vm, const char *prog);
+bool berryCompileFile(bvm *vm, const char *fname, unsigned int srcHash);
+int Berry_GetBytecodeCacheHits();
+bool Berry_GetBytecodeCacheName(const char *src, char *out, int outSize);
+void Berry_SetImportSource(const char *src);
+bool Berry_IsBytecodeCacheFresh(const char *src, bool *bSourceExists, unsigned int *srcHash);
+bool Berry_MarkBytecodeCacheFresh(const char *src, unsigned int srcHash);
 void berryRunClosure(bvm* vm, int closureId);
 void berryRunClosureBytes(bvm *vm, int closureId, byte *data, int len);
 void berryRunClosureIntBytes(bvm *vm, int closureId, int x, const byte *data, int len);
@@ -0,0 +1,253 @@
+#include "../new_common.h"
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "cJSON.h"
+#include "cJSON_arena.h"
+
+#define JSONARENA_ALIGN		8
+#define JSONARENA_ROUND(x)	(((x) + JSONARENA_ALIGN - 1) & ~(JSONARENA_ALIGN - 1))
+// small chunks are easy to find in fragmented heap, unlike one large block
+#define JSONARENA_CHUNK		512
+
+// hooks are global, so allocations of other tasks must not land in arena
+#if WINDOWS
+// simulator runs everything from its main loop
+#define JSONARENA_CURRENT_TASK()	((void*)1)
+#elif PLATFORM_TXW81X
+#define JSONARENA_CURRENT_TASK()	((void*)csi_kernel_task_get_cur())
+#elif PLATFORM_RDA5981
+#define JSONARENA_CURRENT_TASK()	((void*)osThreadGetId())
+#else
+#define JSONARENA_CURRENT_TASK()	((void*)xTaskGetCurrentTaskHandle())
+#endif
+
+static const char *g_jsonArenaNames[JSONARENA_CALLERS] = {
+	"HASS",
+	"Energy",
+	"Test",
+};
+
+typedef struct jsonChunk_s {
+	struct jsonChunk_s *next;
+	int used;
+} jsonChunk_t;
+
+#define JSONARENA_HEADER	JSONARENA_ROUND((int)sizeof(jsonChunk_t))
+#define JSONARENA_PAYLOAD	(JSONARENA_CHUNK - JSONARENA_HEADER)
+
+typedef struct jsonArena_s {
+	jsonChunk_t *first;
+	// chunk being filled, the ones after it are free
+	jsonChunk_t *cur;
+	int chunks;
+	// allocations from chunks not freed yet
+	int live;
+	// bytes taken since last reset, including those that went to heap
+	int want;
+	int depth;
+	int caller;
+	// task inside the scope, 0 if none
+	void *owner;
+} jsonArena_t;
+
+static jsonArena_t g_jsonArena;
+static jsonArenaStats_t g_jsonArenaStats[JSONARENA_CALLERS];
+static SemaphoreHandle_t g_jsonArenaMutex = 0;
+
+static void *JSONArena_HeapMalloc(size_t sz) {
+#if PLATFORM_TXW81X
+	return _os_malloc(sz);
+#else
+	return os_malloc(sz);
+#endif
+}
+
+static void JSONArena_HeapFree(void *p) {
+#if PLATFORM_TXW81X
+	_os_free(p);
+#else
+	os_free(p);
+#endif
+}
+
+static void JSONArena_Want(int bytes) {
+	jsonArena_t *a = &g_jsonArena;
+
+	a->want += bytes;
+	if (a->want > g_jsonArenaStats[a->caller].peak)
+		g_jsonArenaStats[a->caller].peak = a->want;
+}
+
+// next chunk to fill, reused from an earlier document or new one
+static jsonChunk_t *JSONArena_NextChunk() {
+	jsonArena_t *a = &g_jsonArena;
+	jsonArenaStats_t *st = &g_jsonArenaStats[a->caller];
+	jsonChunk_t *c;
+
+	c = a->cur ? a->cur->next : a->first;
+	if (c == 0) {
+		c = (jsonChunk_t*)JSONArena_HeapMalloc(JSONARENA_CHUNK);
+		if (c == 0)
+			return 0;
+		st->heapAllocs++;
+		c->next = 0;
+		if (a->cur)
+			a->cur->next = c;
+		else
+			a->first = c;
+		a->chunks++;
+		if (a->chunks > st->chunks)
+			st->chunks = a->chunks;
+	}
+	c->used = 0;
+	a->cur = c;
+	return c;
+}
+
+static void *JSONArena_Malloc(size_t sz) {
+	jsonArena_t *a = &g_jsonArena;
+	jsonChunk_t *c;
+	int n;
+	void *p;
+
+	if (a->owner == 0 || a->owner != JSONARENA_CURRENT_TASK())
+		return JSONArena_HeapMalloc(sz);
+	n = JSONARENA_ROUND((int)sz);
+	JSONArena_Want(n);
+	if (n <= JSONARENA_PAYLOAD) {
+		c = a->cur;
+		if (c == 0 || c->used + n > JSONARENA_PAYLOAD)
+			c = JSONArena_NextChunk();
+		if (c) {
+			p = (byte*)c + JSONARENA_HEADER + c->used;
+			c->used += n;
+			a->live++;
+			return p;
+		}
+	}
+	g_jsonArenaStats[a->caller].overflows++;
+	g_jsonArenaStats[a->caller].heapAllocs++;
+	return JSONArena_HeapMalloc(sz);
+}
+
+static void JSONArena_FreeChunks() {
+	jsonArena_t *a = &g_jsonArena;
+	jsonChunk_t *c;
+
+	while (a->first) {
+		c = a->first;
+		a->first = c->next;
+		JSONArena_HeapFree(c);
+	}
+	a->cur = 0;
+	a->chunks = 0;
+}
+
+static void JSONArena_Free(void *p) {
+	jsonArena_t *a = &g_jsonArena;
+	jsonChunk_t *c;
+
+	if (p == 0)
+		return;
+	// chunks outlive a scope that did not free everything, so a pointer
+	// into them may come back from anywhere, even after the scope ended
+	for (c = a->first; c; c = c->next) {
+		if ((byte*)p >= (byte*)c && (byte*)p < (byte*)c + JSONARENA_CHUNK)
+			break;
+	}
+	if (c == 0) {
+		JSONArena_HeapFree(p);
+		return;
+	}
+	a->live--;
+	if (a->live == 0) {
+		// whole document is gone, start over from first chunk
+		a->cur = 0;
+		a->want = 0;
+		// last leftover of an ended scope, give chunks back unless a scope
+		// is being opened right now; then its End does it
+		if (a->depth == 0 && xSemaphoreTake(g_jsonArenaMutex, 0)) {
+			if (a->depth == 0 && a->live == 0)
+				JSONArena_FreeChunks();
+			xSemaphoreGive(g_jsonArenaMutex);
+		}
+	}
+}
+
+void JSONArena_Init() {
+	cJSON_Hooks hooks;
+
+	if (g_jsonArenaMutex == 0) {
+		g_jsonArenaMutex = xSemaphoreCreateMutex();
+	}
+	// installed once, outside of a scope they go straight to heap
+	hooks.malloc_fn = JSONArena_Malloc;
+	hooks.free_fn = JSONArena_Free;
+	cJSON_InitHooks(&hooks);
+}
+
+void JSONArena_Begin(int caller) {
+	jsonArena_t *a = &g_jsonArena;
+	void *self = JSONARENA_CURRENT_TASK();
+
+	if (a->depth > 0 && a->owner == self) {
+		a->depth++;
+		return;
+	}
+	// other task in its scope, wait for it to end
+	xSemaphoreTake(g_jsonArenaMutex, portMAX_DELAY);
+	if (caller < 0 || caller >= JSONARENA_CALLERS)
+		caller = JSONARENA_TEST;
+	a->caller = caller;
+	a->depth = 1;
+	a->want = 0;
+	g_jsonArenaStats[caller].scopes++;
+	// chunks left from a scope that did not free everything are still in use
+	if (a->live == 0)
+		a->cur = 0;
+	a->owner = self;
+}
+
+void JSONArena_End() {
+	jsonArena_t *a = &g_jsonArena;
+
+	if (a->depth == 0 || a->owner != JSONARENA_CURRENT_TASK())
+		return;
+	if (--a->depth > 0)
+		return;
+	a->owner = 0;
+	if (a->live) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "JSONArena: %s left %i allocations, chunks kept",
+			g_jsonArenaNames[a->caller], a->live);
+	}
+	else {
+		JSONArena_FreeChunks();
+	}
+	xSemaphoreGive(g_jsonArenaMutex);
+}
+
+const jsonArenaStats_t *JSONArena_GetStats(int caller) {
+	if (caller < 0 || caller >= JSONARENA_CALLERS)
+		return 0;
+	return &g_jsonArenaStats[caller];
+}
+
+static commandResult_t CMD_JSONArena(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	jsonArenaStats_t *st;
+	int i;
+
+	for (i = 0; i < JSONARENA_CALLERS; i++) {
+		st = &g_jsonArenaStats[i];
+		ADDLOG_INFO(LOG_FEATURE_CMD, "JSONArena %s: scopes %i, peak %i, chunks %i of %i bytes, overflows %i, heap allocs %i",
+			g_jsonArenaNames[i], st->scopes, st->peak, st->chunks, JSONARENA_CHUNK, st->overflows, st->heapAllocs);
+	}
+	return CMD_RES_OK;
+}
+
+void JSONArena_AddCommands() {
+	//cmddetail:{"name":"JSONArena","args":"",
+	//cmddetail:"descr":"Prints JSON arena stats for each caller (HASS discovery, energy stats, tests): largest document in bytes, most chunks one scope used, allocations that had to go to heap.",
+	//cmddetail:"fn":"CMD_JSONArena","file":"cJSON/cJSON_arena.c","requires":"",
+	//cmddetail:"examples":"JSONArena"}
+	CMD_RegisterCommand("JSONArena", CMD_JSONArena, NULL);
+}
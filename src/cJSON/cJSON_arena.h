@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../new_common.h"
+
+// Scoped arena for cJSON. Between JSONArena_Begin and JSONArena_End all
+// cJSON allocations of the calling task are taken from a chain of small
+// chunks by moving a pointer, frees only count down, and the chunks are
+// reused once everything taken from them was freed, so documents built one
+// after another reuse the same memory. Allocations bigger than a chunk go to
+// the heap as before, and so do allocations of other tasks. One task at a
+// time is in a scope, others wait in JSONArena_Begin. Everything printed or
+// built inside the scope must be freed (cJSON_Delete, cJSON_free) before it ends.
+
+// callers, each keeps its own stats and block size
+#define JSONARENA_HASS			0
+#define JSONARENA_ENERGY		1
+#define JSONARENA_TEST			2
+#define JSONARENA_CALLERS		3
+
+typedef struct jsonArenaStats_s {
+	int scopes;
+	// most bytes one document needed, arena and heap together
+	int peak;
+	// most chunks one scope held
+	int chunks;
+	// allocations that did not fit in the block
+	int overflows;
+	// heap allocations made for the arena: chunks and overflows
+	int heapAllocs;
+} jsonArenaStats_t;
+
+/// @brief Create scope mutex and install cJSON hooks, heap is used outside of scopes.
+void JSONArena_Init();
+/// @brief Route cJSON allocations of this task to the arena. Nested scopes share the outer one.
+void JSONArena_Begin(int caller);
+/// @brief Give the chunks back and let next task in.
+void JSONArena_End();
+const jsonArenaStats_t *JSONArena_GetStats(int caller);
+void JSONArena_AddCommands();
@@ -34,19 +34,127 @@ typedef struct berryInstance_s
 	int closureId;
 	eventWait_t wait;
 	bool bFire;
+	// 'm' relation argument, either int value or hash of the string
+	unsigned int argHash;
+	bool bArgIsStr;
+	// index list this instance is linked into (event bucket, argument bucket or timers)
+	struct berryInstance_s **indexList;
+	struct berryInstance_s *nextIndexed;
+	struct berryInstance_s *nextFired;
 
 	struct berryInstance_s* next;
 } berryInstance_t;
 
+// all allocated instances, used for allocation and for stopping scripts
 berryInstance_t *g_berryThreads = 0;
 
+//
+// Event index.
+// Instead of walking all threads for every event, waiters are kept in buckets:
+// - per event code for 'a' (any argument) handlers and change handlers (=, <, >, !),
+// - per event code + argument for 'm' handlers, int argument or hashed string,
+// - timers (setTimeout/setInterval) are in a separate list, so Berry_RunThreads
+//   doesn't touch event waiters at all. Change handlers that matched are put on a fired list.
+// Removal is lazy: completed instances are only marked (uniqueID == 0) and unlinked
+// by Berry_SweepIndex, so lists are never modified while a closure runs during a walk.
+//
+#define BERRY_EVENT_BUCKETS		16
+#define BERRY_ARG_BUCKETS		32
+
+static berryInstance_t *g_berryEventBuckets[BERRY_EVENT_BUCKETS];
+static berryInstance_t *g_berryArgBuckets[BERRY_ARG_BUCKETS];
+static berryInstance_t *g_berryTimers = 0;
+static berryInstance_t *g_berryFired = 0;
+static bool g_berryIndexDirty = false;
+
+static unsigned int Berry_HashStr(const char *s) {
+	// case insensitive FNV-1a, to match stricmp
+	unsigned int h = 2166136261u;
+	while (*s) {
+		h ^= (unsigned char)tolower((unsigned char)*s);
+		h *= 16777619u;
+		s++;
+	}
+	return h;
+}
+static berryInstance_t **Berry_GetEventBucket(int eventCode) {
+	return &g_berryEventBuckets[eventCode & (BERRY_EVENT_BUCKETS - 1)];
+}
+static berryInstance_t **Berry_GetArgBucket(int eventCode, unsigned int argHash) {
+	unsigned int h = (argHash ^ (eventCode * 40503u)) * 2654435761u;
+	return &g_berryArgBuckets[(h >> 16) & (BERRY_ARG_BUCKETS - 1)];
+}
+// Links a freshly set up instance into the proper index list
+static void Berry_IndexThread(berryInstance_t *t) {
+	berryInstance_t **list;
+
+	if (t->wait.waitingForEvent == 0) {
+		list = &g_berryTimers;
+	}
+	else if (t->wait.waitingForRelation == 'm') {
+		list = Berry_GetArgBucket(t->wait.waitingForEvent, t->argHash);
+	}
+	else {
+		list = Berry_GetEventBucket(t->wait.waitingForEvent);
+	}
+	t->indexList = list;
+	t->nextIndexed = *list;
+	*list = t;
+}
+static void Berry_SweepList(berryInstance_t **list) {
+	berryInstance_t *t;
+
+	while (*list) {
+		t = *list;
+		if (t->uniqueID == 0) {
+			*list = t->nextIndexed;
+			t->nextIndexed = 0;
+			t->indexList = 0;
+		}
+		else {
+			list = &t->nextIndexed;
+		}
+	}
+}
+// Unlinks completed instances. Must not be called while any index list is being walked.
+static void Berry_SweepIndex() {
+	berryInstance_t **pf;
+	berryInstance_t *t;
+	int i;
+
+	if (g_berryIndexDirty == false) {
+		return;
+	}
+	g_berryIndexDirty = false;
+	for (i = 0; i < BERRY_EVENT_BUCKETS; i++) {
+		Berry_SweepList(&g_berryEventBuckets[i]);
+	}
+	for (i = 0; i < BERRY_ARG_BUCKETS; i++) {
+		Berry_SweepList(&g_berryArgBuckets[i]);
+	}
+	Berry_SweepList(&g_berryTimers);
+	pf = &g_berryFired;
+	while (*pf) {
+		t = *pf;
+		if (t->uniqueID == 0) {
+			*pf = t->nextFired;
+			t->nextFired = 0;
+			t->bFire = false;
+		}
+		else {
+			pf = &t->nextFired;
+		}
+	}
+}
+
 berryInstance_t *Berry_RegisterThread() {
 	berryInstance_t *r;
 
 	r = g_berryThreads;
 
 	while (r) {
-		if (r->uniqueID == 0) {
+		// instance can be reused only after it was unlinked from index
+		if (r->uniqueID == 0 && r->indexList == 0 && r->bFire == false) {
 			break;
 		}
 		r = r->next;
@@ -59,20 +167,29 @@ berryInstance_t *Berry_RegisterThread() {
 	}
 	r->uniqueID = 0;
 	r->currentDelayMS = 0;
+	r->argHash = 0;
+	r->bArgIsStr = false;
+	r->wait.waitingForArgument = 0;
+	r->wait.waitingForEvent = 0;
+	r->wait.waitingForRelation = 0;
+	r->wait.waitingForArgumentStr[0] = 0;
 	return r;
 }
 
 void CMD_Berry_ProcessWaitersForEvent(byte eventCode, int argument) {
 	berryInstance_t *t;
 
-
-	t = g_berryThreads;
+	t = *Berry_GetEventBucket(eventCode);
 
 	while (t) {
-		if (CheckEventCondition(&t->wait, eventCode, argument)) {
+		if (t->uniqueID > 0 && t->bFire == false
+			&& t->wait.waitingForRelation != 'a'
+			&& CheckEventCondition(&t->wait, eventCode, argument)) {
 			t->bFire = true;
+			t->nextFired = g_berryFired;
+			g_berryFired = t;
 		}
-		t = t->next;
+		t = t->nextIndexed;
 	}
 	// TODO: better
 	CMD_Berry_RunEventHandlers_IntInt(eventCode, argument, 0);
@@ -80,39 +197,49 @@ void CMD_Berry_ProcessWaitersForEvent(byte eventCode, int argument) {
 void CMD_Berry_RunEventHandlers_IntInt(byte eventCode, int argument, int argument2) {
 	berryInstance_t *t;
 
-	t = g_berryThreads;
-
+	t = *Berry_GetEventBucket(eventCode);
 	while (t) {
-		if (t->wait.waitingForEvent == eventCode
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureIntInt(g_vm, t->closureId, argument, argument2);
-		} else if (t->wait.waitingForEvent == eventCode
-			&& t->wait.waitingForRelation == 'm'
+		}
+		t = t->nextIndexed;
+	}
+	t = *Berry_GetArgBucket(eventCode, (unsigned int)argument);
+	while (t) {
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
+			&& t->bArgIsStr == false
 			&& t->wait.waitingForArgument == argument) {
 			berryRunClosureInt(g_vm, t->closureId, argument2);
 		}
-		t = t->next;
+		t = t->nextIndexed;
 	}
 }
 
 int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void* argument2) {
 	berryInstance_t *t;
-
-	t = g_berryThreads;
+	unsigned int h;
 
 	int calls = 0;
+	t = *Berry_GetEventBucket(eventCode);
 	while (t) {
-		if (t->wait.waitingForEvent == eventCode
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureStr(g_vm, t->closureId, argument, argument2);
 			calls++;
-		} else if (t->wait.waitingForEvent == eventCode
-			&& t->wait.waitingForRelation == 'm'
+		}
+		t = t->nextIndexed;
+	}
+	h = Berry_HashStr(argument);
+	t = *Berry_GetArgBucket(eventCode, h);
+	while (t) {
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
+			&& t->bArgIsStr && t->argHash == h
 			&& !stricmp(t->wait.waitingForArgumentStr,argument)) {
 			berryRunClosurePtr(g_vm, t->closureId, argument2);
 			calls++;
 		}
-		t = t->next;
+		t = t->nextIndexed;
 	}
 	return calls;
 }
@@ -120,40 +247,48 @@ int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void
 void CMD_Berry_RunEventHandlers_IntBytes(byte eventCode, int argument, const byte *data, int size) {
 	berryInstance_t *t;
 
-	t = g_berryThreads;
-
+	t = *Berry_GetEventBucket(eventCode);
 	while (t) {
-		if (t->wait.waitingForEvent == eventCode
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureIntBytes(g_vm, t->closureId, argument, data, size);
 		}
-		else if (t->wait.waitingForEvent == eventCode
-			&& t->wait.waitingForRelation == 'm'
+		t = t->nextIndexed;
+	}
+	t = *Berry_GetArgBucket(eventCode, (unsigned int)argument);
+	while (t) {
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
+			&& t->bArgIsStr == false
 			&& t->wait.waitingForArgument == argument) {
 			berryRunClosureBytes(g_vm, t->closureId, data, size);
 		}
-		t = t->next;
+		t = t->nextIndexed;
 	}
 }
 int CMD_Berry_RunEventHandlers_Str(byte eventCode, const char *argument, const char *argument2) {
 	berryInstance_t *t;
-
-	t = g_berryThreads;
+	unsigned int h;
 
 	int c_run = 0;
+	t = *Berry_GetEventBucket(eventCode);
 	while (t) {
-		if (t->wait.waitingForEvent == eventCode
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureStr(g_vm, t->closureId, argument, argument2);
 			c_run++;
 		}
-		else if (t->wait.waitingForEvent == eventCode
-			&& t->wait.waitingForRelation == 'm'
+		t = t->nextIndexed;
+	}
+	h = Berry_HashStr(argument);
+	t = *Berry_GetArgBucket(eventCode, h);
+	while (t) {
+		if (t->uniqueID > 0 && t->wait.waitingForEvent == eventCode
+			&& t->bArgIsStr && t->argHash == h
 			&& !stricmp(t->wait.waitingForArgumentStr,argument)) {
 			berryRunClosureStr(g_vm, t->closureId, argument2, "");
 			c_run++;
 		}
-		t = t->next;
+		t = t->nextIndexed;
 	}
 	return c_run;
 }
@@ -189,12 +324,18 @@ int be_addClosure(bvm *vm, const char *eventName, int relation, int reqArg, cons
 		th->wait.waitingForArgument = reqArg;
 		if (reqArgStr) {
 			strcpy_safe(th->wait.waitingForArgumentStr, reqArgStr, sizeof(th->wait.waitingForArgumentStr));
+			// hash what was stored, so lookups agree with stricmp on the stored string
+			th->argHash = Berry_HashStr(th->wait.waitingForArgumentStr);
+			th->bArgIsStr = true;
 		}
 		else {
 			th->wait.waitingForArgumentStr[0] = 0;
+			th->argHash = (unsigned int)reqArg;
+			th->bArgIsStr = false;
 		}
 		th->wait.waitingForRelation = relation;
 		th->closureId = closure_id;
+		Berry_IndexThread(th);
 
 		// remove the 2 values we pushed on the stack
 		be_pop(vm, 2);
@@ -294,6 +435,7 @@ int be_setTimeoutInternal(bvm *vm, int repeats) {
 			th->totalDelayMS = delay_ms;
 			th->closureId = closure_id;
 			th->delayRepeats = repeats;
+			Berry_IndexThread(th);
 
 			// remove the 2 values we pushed on the stack
 			be_pop(vm, 2);
@@ -455,6 +597,53 @@ static commandResult_t CMD_Berry(const void *context, const char *cmd, const cha
 	}
 	return CMD_RES_ERROR;
 }
+// Brings bytecode cache of a .be file up to date, so Berry_ImportFile skips the parser.
+// Does nothing (and doesn't start the VM) if there is no such source file.
+bool Berry_CompileFile(const char *fname) {
+	bool bSourceExists;
+	unsigned int hash;
+
+	if (Berry_IsBytecodeCacheFresh(fname, &bSourceExists, &hash)) {
+		return true;
+	}
+	if (bSourceExists == false) {
+		return false;
+	}
+	if (BasicInit()) {
+		return berryCompileFile(g_vm, fname, hash);
+	}
+	return false;
+}
+// "berry import name" for name.be, loading bytecode cache when it is up to date
+void Berry_ImportFile(const char *fname, int cmdFlags) {
+	char tmp[64];
+
+	// berry does not like slash?
+	if (*fname == '/' || *fname == '\\') {
+		fname++;
+	}
+	snprintf(tmp, sizeof(tmp), "berry import %s", fname);
+	tmp[sizeof(tmp) - 1] = 0;
+	// strip .be
+	if (strlen(tmp) > 3 && !stricmp(tmp + strlen(tmp) - 3, ".be")) {
+		tmp[strlen(tmp) - 3] = 0;
+	}
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry_ImportFile: will run %s", tmp);
+	// cache is checked once here, be_fopen only swaps the file for this import
+	if (Berry_CompileFile(fname)) {
+		Berry_SetImportSource(fname);
+	}
+	CMD_ExecuteCommand(tmp, cmdFlags);
+	Berry_SetImportSource(NULL);
+}
+// berryCompile autoexec.be
+static commandResult_t CMD_BerryCompile(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	return Berry_CompileFile(Tokenizer_GetArg(0)) ? CMD_RES_OK : CMD_RES_ERROR;
+}
 void eval_berry_snippet(const char *s) {
 	if (BasicInit()) {
 		berryRun(g_vm, s);
@@ -487,6 +676,8 @@ void berryThreadComplete(berryInstance_t *thread) {
 	thread->wait.waitingForArgument = 0;
 	thread->wait.waitingForEvent = 0;
 	thread->wait.waitingForRelation = 0;
+	// unlinked from index later, see Berry_SweepIndex
+	g_berryIndexDirty = true;
 }
 
 // Useful for testing things that affect global state:
@@ -560,53 +751,58 @@ int Berry_GetStackSizeCurrent() {
 }
 
 void Berry_RunThreads(int deltaMS) {
-	int c_sleep, c_run;
+	berryInstance_t *t, *next;
 
-	c_sleep = 0;
-	c_run = 0;
+	Berry_SweepIndex();
 
+	// change handlers fired by CMD_Berry_ProcessWaitersForEvent
+	t = g_berryFired;
+	g_berryFired = 0;
+	while (t) {
+		next = t->nextFired;
+		t->nextFired = 0;
+		t->bFire = false;
+		if (t->uniqueID > 0) {
+			berryRunClosure(g_vm, t->closureId);
+		}
+		t = next;
+	}
 
-	berryInstance_t *g_activeThread = g_berryThreads;
-	while (g_activeThread) {
-		if (g_activeThread->uniqueID > 0) {
-			if (g_activeThread->wait.waitingForEvent) {
-				if (g_activeThread->bFire) {
-					berryRunClosure(g_vm, g_activeThread->closureId);
-					g_activeThread->bFire = false;
+	// timers; event waiters are not on this list
+	t = g_berryTimers;
+	while (t) {
+		if (t->uniqueID > 0) {
+			if (t->currentDelayMS > 0) {
+				t->currentDelayMS -= deltaMS;
+				// the following block is needed to handle with long freezes on simulator
+				if (t->currentDelayMS <= 0) {
+					if (t->delayRepeats == -1) {
+						berryRunClosure(g_vm, t->closureId);
+						t->currentDelayMS = t->totalDelayMS;
+					}
+					else if (t->delayRepeats > 0) {
+						t->delayRepeats--;
+						berryRunClosure(g_vm, t->closureId);
+						t->currentDelayMS = t->totalDelayMS;
+					}
+					else {
+						// finish totally
+						berryRunClosure(g_vm, t->closureId);
+						berryRemoveClosure(g_vm, t->closureId);
+						t->closureId = 0;
+						t->uniqueID = 0;//free
+						g_berryIndexDirty = true;
+					}
 				}
-				// do nothing
 			}
 			else {
-				if (g_activeThread->currentDelayMS > 0) {
-					g_activeThread->currentDelayMS -= deltaMS;
-					// the following block is needed to handle with long freezes on simulator
-					if (g_activeThread->currentDelayMS <= 0) {
-						if (g_activeThread->delayRepeats == -1) {
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->currentDelayMS = g_activeThread->totalDelayMS;
-						}
-						else if (g_activeThread->delayRepeats > 0) {
-							g_activeThread->delayRepeats--;
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->currentDelayMS = g_activeThread->totalDelayMS;
-						}
-						else {
-							// finish totally
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							berryRemoveClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->closureId = 0;
-							g_activeThread->uniqueID = 0;//free
-						}
-					}
-				}
-				else {
-					Berry_RunThread(g_activeThread);
-				}
+				Berry_RunThread(t);
 			}
 		}
-		g_activeThread = g_activeThread->next;
+		t = t->nextIndexed;
 	}
 
+	Berry_SweepIndex();
 }
 void CMD_InitBerry() {
 	//cmddetail:{"name":"berry","args":"[Berry code]",
@@ -619,6 +815,11 @@ void CMD_InitBerry() {
 	//cmddetail:"fn":"CMD_StopBerryCommand","file":"cmnds/cmd_berry.c","requires":"",
 	//cmddetail:"examples":"stopBerry"}
 	CMD_RegisterCommand("stopBerry", CMD_StopBerryCommand, NULL);
+	//cmddetail:{"name":"berryCompile","args":"[FileName]",
+	//cmddetail:"descr":"Compiles given .be file from LittleFS to bytecode (FileName.bc). autoexec.be and startScript of that file load bytecode instead of parsing source, as long as source is unchanged.",
+	//cmddetail:"fn":"CMD_BerryCompile","file":"cmnds/cmd_berry.c","requires":"",
+	//cmddetail:"examples":"berryCompile autoexec.be"}
+	CMD_RegisterCommand("berryCompile", CMD_BerryCompile, NULL);
 }
 
 #endif
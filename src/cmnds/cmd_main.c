@@ -6,6 +6,8 @@
 #include "cmd_local.h"
 #include "../driver/drv_ir.h"
 #include "../driver/drv_uart.h"
+#include "../driver/drv_adcSampler.h"
+#include "../driver/drv_meterFrame.h"
 #if ENABLE_DRIVER_BL0942
 #include "../driver/drv_bl0942.h"
 #endif
@@ -14,6 +16,9 @@
 #include "../hal/hal_flashVars.h"
 #include "../httpserver/http_tcp_server.h"
 #include "../hal/hal_generic.h"
+#include "../tick_profiler.h"
+#include "../memory/mem_pool.h"
+#include "../cJSON/cJSON_arena.h"
 
 int cmd_uartInitIndex = 0;
 
@@ -1132,6 +1137,20 @@ void CMD_Init_Early() {
 #endif
 #if ENABLE_OBK_BERRY
 	CMD_InitBerry();
+#endif
+#if ENABLE_TICK_PROFILER
+	TickProf_AddCommands();
+#endif
+#if ENABLE_MEM_POOL
+	MemPool_AddCommands();
+#endif
+	ADCSampler_AddCommands();
+#if ENABLE_DRIVER_BL0942 || ENABLE_DRIVER_CSE7766
+	MeterFrame_AddCommands();
+#endif
+	JSONArena_AddCommands();
+#if ENABLE_TASMOTA_JSON
+	JSON_AddCommands();
 #endif
 	if (!bSafeMode) {
 		if (CFG_HasFlag(OBK_FLAG_CMD_ACCEPT_UART_COMMANDS)) {
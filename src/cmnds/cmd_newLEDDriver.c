@@ -541,6 +541,7 @@ void apply_smart_light() {
 	int value_brightness = 0;
 	int value_cold_or_warm = 0;
 
+	JSON_BumpStateVersion();
 
 	firstChannelIndex = LED_GetFirstChannelIndex();
 
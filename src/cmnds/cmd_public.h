@@ -250,6 +250,8 @@ int EventHandlers_GetActiveCount();
 int taslike_commands_init();
 // cmd_newLEDDriver.c
 #if ENABLE_LED_BASIC
+// current dimmer, 0..100, also used by pixel strips
+extern float g_brightness0to100;
 void NewLED_InitCommands();
 void NewLED_RestoreSavedStateIfNeeded();
 float LED_GetDimmer();
@@ -321,6 +323,8 @@ void CMD_StartTCPCommandLine();
 int CMD_GetCountActiveScriptThreads();
 // cmd_berry.c
 void CMD_InitBerry();
+bool Berry_CompileFile(const char *fname);
+void Berry_ImportFile(const char *fname, int cmdFlags);
 void CMD_Berry_RunEventHandlers_IntInt(byte eventCode, int argument, int argument2);
 void CMD_Berry_RunEventHandlers_IntBytes(byte eventCode, int argument, const byte *data, int size);
 int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void* argument2);
@@ -5,6 +5,7 @@
 #include "../logging/logging.h"
 #include "../new_pins.h"
 #include "../new_cfg.h"
+#include "../memory/mem_pool.h"
 
 // addRepeatingEvent	interval_seconds	  repeats	command top run
 // addRepeatingEvent		1				 -1			led_basecolor_rgb rand
@@ -65,15 +66,15 @@ void RepeatingEvents_AddRepeatingEvent(const char *command, float secondsInterva
 		}
 	}
 	// create new
-	ev = malloc(sizeof(repeatingEvent_t));
+	ev = MemPool_Malloc(sizeof(repeatingEvent_t));
 	if(ev == 0) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: failed to malloc new event");
 		return;
 	}
-	cmd_copy = strdup(command);
+	cmd_copy = MemPool_StrDup(command);
 	if(cmd_copy == 0) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: failed to malloc command text copy");
-		free(ev);
+		MemPool_Free(ev);
 		return;
 	}
 
@@ -209,8 +210,8 @@ commandResult_t RepeatingEvents_Cmd_ClearRepeatingEvents(const void *context, co
 	while (cur) {
 		rem = cur;
 		cur = cur->next;
-		free(rem->command);
-		free(rem);
+		MemPool_Free(rem->command);
+		MemPool_Free(rem);
 		c++;
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i rep. events", c);
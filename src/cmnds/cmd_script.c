@@ -644,17 +644,7 @@ scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniq
 	// allow "startScript test.be" as a shorthand for "berry import test"
 #if ENABLE_OBK_BERRY
 	if (hasExtension(fname, ".be")) {
-		// berry does not like slash?
-		if (*fname == '/' || *fname == '\\') {
-			fname++;
-		}
-		char tmp[64];
-		snprintf(tmp, sizeof(tmp), "berry import %s",fname);
-		tmp[sizeof(tmp) - 1] = 0;
-		// strip .be
-		tmp[strlen(tmp) - 3] = 0;
-		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: will run %s", tmp);
-		CMD_ExecuteCommand(tmp,0);
+		Berry_ImportFile(fname, 0);
 		return NULL;
 	}
 #endif
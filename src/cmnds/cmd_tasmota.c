@@ -200,9 +200,16 @@ byte *LFS_ReadFile(const char *fname) {
 		int len;
 		int cnt;
 		byte *res, *at;
+		unsigned int generation;
 
 		cnt = 0;
 
+		res = LFS_FileCache_Get(fname);
+		if (res) {
+			return res;
+		}
+		generation = LFS_FileCache_GetGeneration();
+
 		memset(&file, 0, sizeof(lfs_file_t));
 		lfsres = lfs_file_open(&lfs, &file, fname, LFS_O_RDONLY);
 
@@ -251,6 +258,9 @@ byte *LFS_ReadFile(const char *fname) {
 				}
 #endif
 				res[len] = 0;
+				if (lfsres == len) {
+					LFS_FileCache_Put(fname, res, len, generation);
+				}
 				ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: Loaded %i bytes\n",len);
 				//ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: Loaded %s\n",res);
 			}
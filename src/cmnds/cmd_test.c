@@ -5,6 +5,7 @@
 #include "../new_common.h"
 #include "../obk_config.h"
 #include "../cJSON/cJSON.h"
+#include "../cJSON/cJSON_arena.h"
 #include <ctype.h>
 #include "cmd_local.h"
 #if ENABLE_LITTLEFS
@@ -206,6 +207,7 @@ static commandResult_t testJSON(const void * context, const char *cmd, const cha
 
 	totalCalls++;
 
+	JSONArena_Begin(JSONARENA_TEST);
 	for(rep = 0; rep < repeats; rep++) {
 		ra1 = rand() % 1000;
 		ra2 = rand() % 1000;
@@ -231,8 +233,9 @@ static commandResult_t testJSON(const void * context, const char *cmd, const cha
 
 		msg = cJSON_Print(root);
 		cJSON_Delete(root);
-		os_free(msg);
+		cJSON_free(msg);
 	}
+	JSONArena_End();
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "testJSON has been tested! Total calls %i, reps now %i",totalCalls,repeats);
 
@@ -327,6 +330,7 @@ static commandResult_t cmnd_json_test(const void * context, const char *cmd, con
 	char *msg;
 	float dailyStats[4] = { 95.44071197f, 171.84954833f, 181.58737182f, 331.35061645f };
 
+	JSONArena_Begin(JSONARENA_TEST);
 	root = cJSON_CreateObject();
 	{
 		stats = cJSON_CreateArray();
@@ -340,7 +344,8 @@ static commandResult_t cmnd_json_test(const void * context, const char *cmd, con
 	msg = cJSON_PrintUnformatted(root);
 	cJSON_Delete(root);
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Test JSON reads: %s", msg);
-	free(msg);
+	cJSON_free(msg);
+	JSONArena_End();
 	return CMD_RES_OK;
 }
 // Usage for continous test: addRepeatingEvent 1 -1 lfs_test3 ir.bat
@@ -18,7 +18,8 @@ typedef struct dgrCallbacks_s {
 	void (*processLightBrightness)(byte brightness);
 	void (*processLightFixedColor)(byte colorCode);
 	void (*processRGBCW)(byte *rgbcw);
-	int (*checkSequence)(uint16_t seq);
+	// source address is passed explicitly, so the receiver can track per-member sequence
+	int (*checkSequence)(const struct sockaddr *addr, uint16_t seq);
 } dgrCallbacks_t;
 
 typedef struct dgrGroupDef_s {
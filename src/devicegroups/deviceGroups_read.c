@@ -44,7 +44,7 @@ int DGR_Parse(const byte *data, int len, dgrDevice_t *dev, struct sockaddr *addr
 		return 1;
 	}
 
-	if(dev->cbs.checkSequence(sequence)) {
+	if(dev->cbs.checkSequence(addr, sequence)) {
 		addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR,"DGR ignoring message from duplicate or older sequence %i",sequence);
 		return 1;
 	}
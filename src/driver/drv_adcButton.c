@@ -8,12 +8,13 @@
 #include "../hal/hal_pins.h"
 #include "../hal/hal_adc.h"
 #include "../mqtt/new_mqtt.h"
+#include "drv_adcSampler.h"
 
 // Like: 450 1250 2900
 static int *g_ranges = 0;
 static int g_numRanges = 0;
 static int g_prevButton = -1;
-static int g_timeAccum = 0;
+static int g_adcPin = -1;
 
 static int chooseButton(int value) {
 	int i;
@@ -56,34 +57,40 @@ void DRV_ADCButton_Init() {
 	//cmddetail:"fn":"Cmd_ADCButtonMap","file":"driver/drv_adcButton.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("AB_Map", Cmd_ADCButtonMap, NULL);
+	DRV_ADCButton_OnEverySecond();
 }
 
-void DRV_ADCButtonDoMeasurement() {
+static void ADCButton_OnSample(int pin, int adcValue) {
 	int newButton;
-	int adcValue;
-	int adcPin;
-
-	adcPin = PIN_FindPinIndexForRole(IOR_ADC_Button, -1);
-
-	if (adcPin == -1) {
-		return;
-	}
-	adcValue = HAL_ADC_Read(adcPin);
 
 	newButton = chooseButton(adcValue);
 
-	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "ADC %i -> button %i (total %i)\r\n", adcValue, newButton, g_numRanges);
-
 	if (newButton != g_prevButton) {
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "ADC %i -> button %i (total %i)\r\n", adcValue, newButton, g_numRanges);
 		EventHandlers_FireEvent(CMD_EVENT_ADC_BUTTON, newButton);
 		g_prevButton = newButton;
 	}
 }
-void DRV_ADCButton_RunFrame() {
-	g_timeAccum += g_deltaTimeMS;
-	if (g_timeAccum > 100) {
-		DRV_ADCButtonDoMeasurement();
-		g_timeAccum = 0;
+// pin role may be assigned after driver start
+void DRV_ADCButton_OnEverySecond() {
+	int adcPin;
+
+	adcPin = PIN_FindPinIndexForRole(IOR_ADC_Button, -1);
+	if (adcPin == g_adcPin) {
+		return;
+	}
+	if (g_adcPin != -1) {
+		ADCSampler_Remove(g_adcPin, ADCButton_OnSample);
+	}
+	g_adcPin = adcPin;
+	if (g_adcPin != -1) {
+		ADCSampler_Register(g_adcPin, 100, ADCButton_OnSample);
+	}
+}
+void DRV_ADCButton_Stop() {
+	if (g_adcPin != -1) {
+		ADCSampler_Remove(g_adcPin, ADCButton_OnSample);
 	}
+	g_adcPin = -1;
+	g_prevButton = -1;
 }
-
@@ -0,0 +1,351 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../new_cfg.h"
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "../hal/hal_adc.h"
+#include "drv_adcSampler.h"
+
+typedef struct adcSlot_s {
+	byte used;
+	// created for IOR_ADC role, dropped when role goes away
+	byte automatic;
+	byte published;
+	byte pin;
+	short channel;
+	int flags;
+	int deadband;
+	int lastPublished;
+	int intervalMS;
+	int timeAccum;
+	adcSamplerCallback_t cb;
+	adcFilter_t filter;
+	adcSamplerStats_t st;
+} adcSlot_t;
+
+static adcSlot_t g_adcSlots[ADCSAMPLER_MAX_SLOTS];
+static bool g_adcPinsDirty = true;
+
+void ADCFilter_Init(adcFilter_t *f, int mode, int size, int median) {
+	memset(f, 0, sizeof(*f));
+	if (mode == ADCFILTER_AVERAGE) {
+		if (size < 1)
+			size = 1;
+		if (size > ADCFILTER_WINDOW_MAX)
+			size = ADCFILTER_WINDOW_MAX;
+	}
+	else if (mode == ADCFILTER_EMA) {
+		if (size < 1)
+			size = 1;
+		if (size > 8)
+			size = 8;
+	}
+	else {
+		mode = ADCFILTER_NONE;
+		size = 0;
+	}
+	if (median >= 5)
+		median = 5;
+	else if (median >= 3)
+		median = 3;
+	else
+		median = 0;
+	f->mode = mode;
+	f->size = size;
+	f->median = median;
+}
+
+static int ADCFilter_Median(adcFilter_t *f, int raw) {
+	unsigned short tmp[ADCFILTER_MEDIAN_MAX];
+	unsigned short v;
+	int i, j;
+
+	f->med[f->medNext] = raw;
+	f->medNext = (f->medNext + 1) % f->median;
+	if (f->medCount < f->median)
+		f->medCount++;
+	// at most 5 entries, insertion sort is fine
+	for (i = 0; i < f->medCount; i++) {
+		v = f->med[i];
+		for (j = i; j > 0 && tmp[j - 1] > v; j--) {
+			tmp[j] = tmp[j - 1];
+		}
+		tmp[j] = v;
+	}
+	return tmp[f->medCount / 2];
+}
+
+int ADCFilter_Get(const adcFilter_t *f) {
+	switch (f->mode) {
+	case ADCFILTER_AVERAGE:
+		if (f->count == 0)
+			return 0;
+		return (f->acc + f->count / 2) / f->count;
+	case ADCFILTER_EMA:
+		return (f->acc + 128) >> 8;
+	}
+	return f->acc;
+}
+
+int ADCFilter_Add(adcFilter_t *f, int raw) {
+	if (raw < 0)
+		raw = 0;
+	if (raw > 0xFFFF)
+		raw = 0xFFFF;
+	if (f->median)
+		raw = ADCFilter_Median(f, raw);
+	switch (f->mode) {
+	case ADCFILTER_AVERAGE:
+		// running sum, oldest sample leaves as new one comes in
+		if (f->count == f->size)
+			f->acc -= f->window[f->next];
+		else
+			f->count++;
+		f->window[f->next] = raw;
+		f->acc += raw;
+		f->next = (f->next + 1) % f->size;
+		break;
+	case ADCFILTER_EMA:
+		if (f->count == 0) {
+			f->acc = raw << 8;
+			f->count = 1;
+		}
+		else {
+			f->acc += ((raw << 8) - f->acc) / (1 << f->size);
+		}
+		break;
+	default:
+		f->acc = raw;
+		break;
+	}
+	return ADCFilter_Get(f);
+}
+
+// one slot per pin and consumer, so a driver on IOR_ADC pin
+// does not take over the slot that publishes pin channel
+static adcSlot_t *ADCSampler_Find(int pin, adcSamplerCallback_t cb) {
+	int i;
+
+	for (i = 0; i < ADCSAMPLER_MAX_SLOTS; i++) {
+		if (g_adcSlots[i].used && g_adcSlots[i].pin == pin && g_adcSlots[i].cb == cb)
+			return &g_adcSlots[i];
+	}
+	return 0;
+}
+
+int ADCSampler_Register(int pin, int intervalMS, adcSamplerCallback_t cb) {
+	adcSlot_t *s;
+	int i;
+
+	if (pin < 0 || pin >= PLATFORM_GPIO_MAX)
+		return -1;
+	s = ADCSampler_Find(pin, cb);
+	if (s) {
+		s->intervalMS = intervalMS > 0 ? intervalMS : 1;
+		return s - g_adcSlots;
+	}
+	for (i = 0; s == 0 && i < ADCSAMPLER_MAX_SLOTS; i++) {
+		if (g_adcSlots[i].used == 0)
+			s = &g_adcSlots[i];
+	}
+	if (s == 0) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_DRV, "ADCSampler: no free slot for pin %i", pin);
+		return -1;
+	}
+	memset(s, 0, sizeof(*s));
+	s->used = 1;
+	s->pin = pin;
+	s->channel = ADCSAMPLER_CHANNEL_NONE;
+	s->intervalMS = intervalMS > 0 ? intervalMS : 1;
+	s->cb = cb;
+	return s - g_adcSlots;
+}
+
+void ADCSampler_Remove(int pin, adcSamplerCallback_t cb) {
+	adcSlot_t *s = ADCSampler_Find(pin, cb);
+
+	if (s)
+		s->used = 0;
+}
+
+void ADCSampler_SetFilter(int pin, adcSamplerCallback_t cb, int mode, int size, int median) {
+	adcSlot_t *s = ADCSampler_Find(pin, cb);
+
+	if (s)
+		ADCFilter_Init(&s->filter, mode, size, median);
+}
+
+void ADCSampler_SetPublish(int pin, adcSamplerCallback_t cb, int channel, int deadband, int flags) {
+	adcSlot_t *s = ADCSampler_Find(pin, cb);
+
+	if (s == 0)
+		return;
+	s->channel = channel;
+	s->deadband = deadband;
+	s->flags = flags;
+	s->published = 0;
+}
+
+int ADCSampler_GetStats(int pin, adcSamplerCallback_t cb, adcSamplerStats_t *out) {
+	adcSlot_t *s = ADCSampler_Find(pin, cb);
+
+	if (s == 0)
+		return 0;
+	*out = s->st;
+	return 1;
+}
+
+int ADCSampler_CountSlots(int pin) {
+	int i, r = 0;
+
+	for (i = 0; i < ADCSAMPLER_MAX_SLOTS; i++) {
+		if (g_adcSlots[i].used && g_adcSlots[i].pin == pin)
+			r++;
+	}
+	return r;
+}
+
+void ADCSampler_InvalidatePins() {
+	g_adcPinsDirty = true;
+}
+
+// IOR_ADC pins are sampled once per second and go to their channel
+static void ADCSampler_SyncPins() {
+	adcSlot_t *s;
+	int i;
+
+	g_adcPinsDirty = false;
+	for (i = 0; i < ADCSAMPLER_MAX_SLOTS; i++) {
+		s = &g_adcSlots[i];
+		if (s->used && s->automatic && g_cfg.pins.roles[s->pin] != IOR_ADC)
+			s->used = 0;
+	}
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_cfg.pins.roles[i] != IOR_ADC)
+			continue;
+		s = ADCSampler_Find(i, 0);
+		if (s) {
+			// channel may have changed
+			s->published = 0;
+			continue;
+		}
+		if (ADCSampler_Register(i, 1000, 0) < 0)
+			continue;
+		ADCSampler_SetPublish(i, 0, ADCSAMPLER_CHANNEL_PIN, 0, CHANNEL_SET_FLAG_SILENT);
+		ADCSampler_Find(i, 0)->automatic = 1;
+	}
+}
+
+static void ADCSampler_Publish(adcSlot_t *s, int value) {
+	int ch = s->channel;
+	int delta;
+
+	if (ch == ADCSAMPLER_CHANNEL_NONE)
+		return;
+	if (ch == ADCSAMPLER_CHANNEL_PIN)
+		ch = g_cfg.pins.channels[s->pin];
+	delta = value - s->lastPublished;
+	if (delta < 0)
+		delta = -delta;
+	if (s->published && delta <= s->deadband)
+		return;
+	s->published = 1;
+	s->lastPublished = value;
+	s->st.publishes++;
+	CHANNEL_Set(ch, value, s->flags);
+}
+
+void ADCSampler_RunQuickTick(int deltaMS) {
+	adcSlot_t *s;
+	int i, value;
+
+	if (g_adcPinsDirty)
+		ADCSampler_SyncPins();
+	for (i = 0; i < ADCSAMPLER_MAX_SLOTS; i++) {
+		s = &g_adcSlots[i];
+		if (s->used == 0)
+			continue;
+		s->timeAccum += deltaMS;
+		if (s->timeAccum < s->intervalMS)
+			continue;
+		s->timeAccum -= s->intervalMS;
+		// do not try to catch up after a long stall
+		if (s->timeAccum >= s->intervalMS)
+			s->timeAccum = 0;
+		value = ADCFilter_Add(&s->filter, HAL_ADC_Read(s->pin));
+		s->st.value = value;
+		s->st.samples++;
+		ADCSampler_Publish(s, value);
+		// callback may remove or re-register this slot
+		if (s->cb)
+			s->cb(s->pin, value);
+	}
+}
+
+static int ADCSampler_ParseFilter(const char *s) {
+	if (!stricmp(s, "avg") || !stricmp(s, "average"))
+		return ADCFILTER_AVERAGE;
+	if (!stricmp(s, "ema"))
+		return ADCFILTER_EMA;
+	if (!stricmp(s, "none"))
+		return ADCFILTER_NONE;
+	return atoi(s);
+}
+
+// ADCSampler [Pindex] [IntervalMS] [none/avg/ema] [Size] [Median] [Deadband]
+// Without arguments past Pindex, prints pin state.
+// ADCSampler 23 200 avg 8 3 10
+// samples pin 23 every 200ms, median of 3 against spikes, 8 sample average,
+// channel is set when average moves by more than 10
+static commandResult_t CMD_ADCSampler(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	adcSlot_t *s;
+	int pin;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	pin = Tokenizer_GetArgInteger(0);
+	if (pin < 0 || pin >= PLATFORM_GPIO_MAX)
+		return CMD_RES_BAD_ARGUMENT;
+	if (g_adcPinsDirty)
+		ADCSampler_SyncPins();
+	// pin channel slot, driver slots are set up by their own commands
+	s = ADCSampler_Find(pin, 0);
+	if (Tokenizer_GetArgsCount() == 1) {
+		if (s == 0) {
+			ADDLOG_INFO(LOG_FEATURE_DRV, "ADCSampler: pin %i is not sampled to channel, %i driver slots", pin, ADCSampler_CountSlots(pin));
+			return CMD_RES_OK;
+		}
+		ADDLOG_INFO(LOG_FEATURE_DRV, "ADCSampler: pin %i every %ims, filter %i/%i, median %i, deadband %i, value %i, samples %u, publishes %u, %i driver slots",
+			pin, s->intervalMS, s->filter.mode, s->filter.size, s->filter.median, s->deadband,
+			s->st.value, s->st.samples, s->st.publishes, ADCSampler_CountSlots(pin) - 1);
+		return CMD_RES_OK;
+	}
+	if (s == 0) {
+		if (ADCSampler_Register(pin, 1000, 0) < 0)
+			return CMD_RES_ERROR;
+		s = ADCSampler_Find(pin, 0);
+		ADCSampler_SetPublish(pin, 0, ADCSAMPLER_CHANNEL_PIN, 0, CHANNEL_SET_FLAG_SILENT);
+		HAL_ADC_Init(pin);
+	}
+	s->intervalMS = Tokenizer_GetArgIntegerDefault(1, s->intervalMS);
+	if (s->intervalMS < 1)
+		s->intervalMS = 1;
+	if (Tokenizer_GetArgsCount() > 2) {
+		ADCFilter_Init(&s->filter, ADCSampler_ParseFilter(Tokenizer_GetArg(2)),
+			Tokenizer_GetArgIntegerDefault(3, 1), Tokenizer_GetArgIntegerDefault(4, 0));
+	}
+	s->deadband = Tokenizer_GetArgIntegerDefault(5, s->deadband);
+	s->published = 0;
+
+	return CMD_RES_OK;
+}
+
+void ADCSampler_AddCommands() {
+	//cmddetail:{"name":"ADCSampler","args":"[Pindex] [IntervalMS] [none/avg/ema] [Size] [Median] [Deadband]",
+	//cmddetail:"descr":"Sets sampling of ADC pin. Size is window length for avg, or weight shift for ema (each sample moves value by 1/2^Size). Median 3 or 5 rejects single spikes. Channel is set only when value moves by more than Deadband. ADC pins are sampled once per second by default. With only Pindex, prints pin state.",
+	//cmddetail:"fn":"CMD_ADCSampler","file":"driver/drv_adcSampler.c","requires":"",
+	//cmddetail:"examples":"ADCSampler 23 200 avg 8 3 10"}
+	CMD_RegisterCommand("ADCSampler", CMD_ADCSampler, NULL);
+}
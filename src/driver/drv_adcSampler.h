@@ -0,0 +1,70 @@
+#pragma once
+
+// Shared ADC sampling for ADC pins, ADC buttons and the ADC smoother.
+// Every pin and consumer (callback) has a slot with its own interval, filter
+// and (optionally) a target channel that is set only when value moves by more
+// than deadband. A driver on IOR_ADC pin gets its own slot next to pin one.
+// Slots are stepped from QuickTick, filters are O(1) per sample.
+// IOR_ADC pins get a slot automatically (once per second, published to
+// pin channel, callback 0), see ADCSampler command to change their filtering.
+
+#ifndef ADCSAMPLER_MAX_SLOTS
+#define ADCSAMPLER_MAX_SLOTS		8
+#endif
+#define ADCFILTER_WINDOW_MAX		16
+#define ADCFILTER_MEDIAN_MAX		5
+
+#define ADCFILTER_NONE				0
+// running window average, size is window length
+#define ADCFILTER_AVERAGE			1
+// exponential, size is weight shift: each sample moves value by 1/2^size
+#define ADCFILTER_EMA				2
+
+// publish to channel assigned to pin in config
+#define ADCSAMPLER_CHANNEL_PIN		-1
+#define ADCSAMPLER_CHANNEL_NONE		-2
+
+typedef void (*adcSamplerCallback_t)(int pin, int value);
+
+typedef struct adcFilter_s {
+	unsigned char mode;
+	unsigned char size;
+	// 0, 3 or 5, median of last N raw samples is fed to filter
+	unsigned char median;
+	unsigned char count;
+	unsigned char next;
+	unsigned char medCount;
+	unsigned char medNext;
+	// window sum, or EMA state scaled by 256
+	int acc;
+	unsigned short window[ADCFILTER_WINDOW_MAX];
+	unsigned short med[ADCFILTER_MEDIAN_MAX];
+} adcFilter_t;
+
+typedef struct adcSamplerStats_s {
+	int value;
+	unsigned int samples;
+	unsigned int publishes;
+} adcSamplerStats_t;
+
+void ADCFilter_Init(adcFilter_t *f, int mode, int size, int median);
+/// @brief Feed one raw sample, returns filtered value.
+int ADCFilter_Add(adcFilter_t *f, int raw);
+int ADCFilter_Get(const adcFilter_t *f);
+
+/// @brief Start sampling pin every intervalMS for cb, or update interval of its slot.
+/// New slot has no filter and publishing is off.
+/// @return slot index or -1 if table is full
+int ADCSampler_Register(int pin, int intervalMS, adcSamplerCallback_t cb);
+void ADCSampler_Remove(int pin, adcSamplerCallback_t cb);
+void ADCSampler_SetFilter(int pin, adcSamplerCallback_t cb, int mode, int size, int median);
+/// @brief Channel is a channel index or one of ADCSAMPLER_CHANNEL_*, flags go to CHANNEL_Set.
+void ADCSampler_SetPublish(int pin, adcSamplerCallback_t cb, int channel, int deadband, int flags);
+/// @return 1 if pin has a slot for cb
+int ADCSampler_GetStats(int pin, adcSamplerCallback_t cb, adcSamplerStats_t *out);
+/// @return number of consumers sampling pin
+int ADCSampler_CountSlots(int pin);
+/// @brief IOR_ADC slots are resynced with pin roles on next tick.
+void ADCSampler_InvalidatePins();
+void ADCSampler_RunQuickTick(int deltaMS);
+void ADCSampler_AddCommands();
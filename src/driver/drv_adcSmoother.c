@@ -8,15 +8,9 @@
 #include "../hal/hal_pins.h"
 #include "../hal/hal_adc.h"
 #include "../mqtt/new_mqtt.h"
+#include "drv_adcSampler.h"
 
-// smoothinng
-static int *g_samples = NULL;
-static int g_samplesCount = 0;
-static int g_nextSample = 0;
-static int g_sampleIntervalMS = 100;
-static int g_timeAccum = 0;
-// generic
-static int g_adcPin = 0;
+static int g_adcPin = -1;
 static int g_margin = 0;
 static int g_smoothed = -1;
 static int g_lh = -1;
@@ -24,25 +18,18 @@ static int g_lh = -1;
 static int g_channel_smoothed = 0;
 static int g_channel_lh = 0;
 
-void ADCSmoother_SetupWindow(int size) {
-	g_samples = realloc(g_samples, sizeof(int) * size);
-	memset(g_samples,0, sizeof(int) * size);
-	g_samplesCount = size;
-}
-void ADCSmoother_AppendSample(int val) {
-	if (g_samples == 0)
-		return;
-	g_samples[g_nextSample] = val;
-	g_nextSample++;
-	g_nextSample %= g_samplesCount;
-}
-float ADCSmoother_Sample() {
-	float s = 0;
-	for (int i = 0; i < g_samplesCount; i++) {
-		s += g_samples[i];
+static void ADCSmoother_OnSample(int pin, int smoothed) {
+	int lowHigh = smoothed > g_margin;
+
+	if (smoothed != g_smoothed) {
+		g_smoothed = smoothed;
+		CHANNEL_Set(g_channel_smoothed, g_smoothed, 0);
+	}
+	if (lowHigh != g_lh) {
+		g_lh = lowHigh;
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_DRV, "AS: smoothed %i, LowHigh %i\n", smoothed, lowHigh);
+		CHANNEL_Set(g_channel_lh, g_lh, 0);
 	}
-	s /= g_samplesCount;
-	return s;
 }
 
 // ADCSmoother [Pindex] [TotalSamples] [SampleIntervalMS] [TargetChannelADCValue] [MarginValue] [TargetChannel0or1]
@@ -63,15 +50,23 @@ commandResult_t Cmd_SetupADCSmoother(const void* context, const char* cmd, const
 	{
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
+	if (g_adcPin != -1)
+		ADCSampler_Remove(g_adcPin, ADCSmoother_OnSample);
 	g_adcPin = Tokenizer_GetArgInteger(0);
 	int size = Tokenizer_GetArgInteger(1);
-	ADCSmoother_SetupWindow(size);
-	g_sampleIntervalMS = Tokenizer_GetArgInteger(2);
+	int interval = Tokenizer_GetArgInteger(2);
 	g_channel_smoothed = Tokenizer_GetArgInteger(3);
 	g_margin = Tokenizer_GetArgInteger(4);
 	g_channel_lh = Tokenizer_GetArgInteger(5);
+	g_smoothed = -1;
+	g_lh = -1;
 
 	HAL_ADC_Init(g_adcPin);
+	if (size > ADCFILTER_WINDOW_MAX) {
+		addLogAdv(LOG_WARN, LOG_FEATURE_DRV, "AS: window %i clamped to %i\n", size, ADCFILTER_WINDOW_MAX);
+	}
+	ADCSampler_Register(g_adcPin, interval, ADCSmoother_OnSample);
+	ADCSampler_SetFilter(g_adcPin, ADCSmoother_OnSample, ADCFILTER_AVERAGE, size, 0);
 
 	return CMD_RES_OK;
 }
@@ -84,28 +79,8 @@ void DRV_ADCSmoother_Init() {
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("ADCSmoother", Cmd_SetupADCSmoother, NULL);
 }
-void DRV_ADCSmootherDoSmooth() {
-	int raw = HAL_ADC_Read(g_adcPin);
-	ADCSmoother_AppendSample(raw);
-	int smoothed = ADCSmoother_Sample();
-	int lowHigh = smoothed > g_margin;
-	addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "AS: raw %i, smoothed %i, LowHigh %i\n", raw, smoothed, lowHigh);
-	
-	if (smoothed != g_smoothed) {
-		g_smoothed = smoothed;
-		CHANNEL_Set(g_channel_smoothed, g_smoothed, 0);
-	}
-	if (lowHigh != g_lh) {
-		g_lh = lowHigh;
-		CHANNEL_Set(g_channel_lh, g_lh, 0);
-	}
-}
-
-void DRV_ADCSmoother_RunFrame() {
-	g_timeAccum += g_deltaTimeMS;
-	if (g_timeAccum > g_sampleIntervalMS) {
-		DRV_ADCSmootherDoSmooth();
-		g_timeAccum = 0;
-	}
+void DRV_ADCSmoother_Stop() {
+	if (g_adcPin != -1)
+		ADCSampler_Remove(g_adcPin, ADCSmoother_OnSample);
+	g_adcPin = -1;
 }
-
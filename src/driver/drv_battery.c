@@ -80,6 +80,7 @@ static void Batt_Measure() {
 #endif
 	g_lastbattlevel = (int)g_battlevel;
 	g_lastbattvoltage = (int)g_battvoltage;
+	JSON_BumpSensorVersion();
 	ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : battery voltage : %f and percentage %f%%", g_battvoltage, g_battlevel);
 }
 void Simulator_Force_Batt_Measure() {
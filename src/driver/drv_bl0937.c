@@ -14,6 +14,7 @@
 #include "../logging/logging.h"
 #include "../new_cfg.h"
 #include "../new_pins.h"
+#include "../quicktick.h"
 #include "drv_bl_shared.h"
 #include "drv_pwrCal.h"
 #include "drv_uart.h"
@@ -29,25 +30,134 @@ bool g_invertSEL = false;
 int GPIO_HLW_CF = 7;
 int GPIO_HLW_CF1 = 8;
 
+#ifdef WINDOWS
+#include "../sim/sim_import.h"
+// simulated pulses carry simulated time
+#define BL0937_GetTimeUs()		SIM_GetTimeUs()
+#else
+#include "../hal/hal_generic.h"
+#define BL0937_GetTimeUs()		HAL_GetTimeUs()
+#endif
+
+// CF and CF1 edges are timestamped in ISR, readings come from time between
+// pulses instead of pulse count per second. So a load giving one pulse every
+// few seconds still reads right, and reading never disables interrupts:
+// ISR stores stamp before bumping count, reader takes count before stamp,
+// so the newest stamp is always complete. Ring only has to outlive one read.
+#define BL0937_RING_SIZE			4
+// no pulse for that long reads as zero
+#define BL0937_PULSE_TIMEOUT_US		10000000
+// CF1 is switched between voltage and current after that many periods,
+// or after max dwell when current is low and pulses are slow
+#define BL0937_SEL_PERIODS			8
+#define BL0937_SEL_MAX_DWELL_MS		4000
+
+typedef struct blPulseRing_s {
+	volatile uint32_t count;
+	volatile uint32_t stamps[BL0937_RING_SIZE];
+} blPulseRing_t;
+
+typedef struct blPulseMeter_s {
+	// ring count and stamp of newest pulse already used
+	uint32_t seen;
+	uint32_t lastStamp;
+	bool anchored;
+	// full periods since anchor
+	uint32_t periods;
+	float hz;
+} blPulseMeter_t;
+
 bool g_sel = true;
-uint32_t res_v = 0;
-uint32_t res_c = 0;
-uint32_t res_p = 0;
 float BL0937_PMAX = 3680.0f;
 float last_p = 0.0f;
 
-volatile uint32_t g_vc_pulses = 0;
-volatile uint32_t g_p_pulses = 0;
-static portTickType pulseStamp;
-
+static blPulseRing_t g_cfRing;
+static blPulseRing_t g_cf1Ring;
+static blPulseMeter_t g_powerMeter;
+static blPulseMeter_t g_voltageMeter;
+static blPulseMeter_t g_currentMeter;
+// averaging window, readings are published once per window
+static int g_windowMS = 1000;
+static int g_timeAccum = 0;
+static int g_selDwellMS = 0;
+static int g_pinGeneration = -1;
+
+static void BL0937_RecordPulse(blPulseRing_t *r)
+{
+	uint32_t c = r->count;
 
+	r->stamps[c & (BL0937_RING_SIZE - 1)] = BL0937_GetTimeUs();
+	r->count = c + 1;
+}
 void HlwCf1Interrupt(int pinNum)
 {
-	g_vc_pulses++;
+	BL0937_RecordPulse(&g_cf1Ring);
 }
 void HlwCfInterrupt(int pinNum)
 {
-	g_p_pulses++;
+	BL0937_RecordPulse(&g_cfRing);
+}
+
+// start measuring from next pulse, pulses so far are ignored
+static void BL0937_ResetMeter(blPulseRing_t *r, blPulseMeter_t *m)
+{
+	m->seen = r->count;
+	m->anchored = false;
+	m->periods = 0;
+}
+
+static void BL0937_Measure(blPulseRing_t *r, blPulseMeter_t *m, uint32_t nowUs)
+{
+	uint32_t count = r->count;
+	uint32_t stamp, elapsed;
+
+	if(count != m->seen)
+	{
+		stamp = r->stamps[(count - 1) & (BL0937_RING_SIZE - 1)];
+		// first pulse only anchors, time before it is unknown
+		if(m->anchored && stamp != m->lastStamp)
+		{
+			m->hz = (count - m->seen) * 1000000.0f / (uint32_t)(stamp - m->lastStamp);
+			m->periods += count - m->seen;
+		}
+		m->anchored = true;
+		m->seen = count;
+		m->lastStamp = stamp;
+		return;
+	}
+	if(m->anchored == false)
+		return;
+	// no new pulse, so period is at least that long
+	elapsed = nowUs - m->lastStamp;
+	if(elapsed >= BL0937_PULSE_TIMEOUT_US)
+	{
+		m->hz = 0;
+	}
+	else if(m->hz * elapsed > 1000000.0f)
+	{
+		m->hz = 1000000.0f / elapsed;
+	}
+}
+
+static bool BL0937_IsMeasuringVoltage()
+{
+	return g_sel != g_invertSEL;
+}
+
+static void BL0937_SwitchSel()
+{
+	blPulseMeter_t *m = BL0937_IsMeasuringVoltage() ? &g_voltageMeter : &g_currentMeter;
+
+	// not a single pulse in whole dwell
+	if(m->anchored == false)
+	{
+		m->hz = 0;
+	}
+	g_sel = !g_sel;
+	HAL_PIN_SetOutputValue(GPIO_HLW_SEL, g_sel);
+	g_selDwellMS = 0;
+	m = BL0937_IsMeasuringVoltage() ? &g_voltageMeter : &g_currentMeter;
+	BL0937_ResetMeter(&g_cf1Ring, m);
 }
 
 commandResult_t BL0937_PowerMax(const void* context, const char* cmd, const char* args, int cmdFlags)
@@ -74,13 +184,33 @@ commandResult_t BL0937_PowerMax(const void* context, const char* cmd, const char
 	return CMD_RES_OK;
 }
 
-void BL0937_Shutdown_Pins()
+// BL0937Window [ms]
+// Without argument, prints measured pulse frequencies.
+commandResult_t BL0937_Window(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	if(Tokenizer_GetArgsCount() == 0)
+	{
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Window %i ms, CF %.3f Hz, CF1 voltage %.3f Hz, current %.3f Hz, measuring %s",
+			g_windowMS, g_powerMeter.hz, g_voltageMeter.hz, g_currentMeter.hz,
+			BL0937_IsMeasuringVoltage() ? "voltage" : "current");
+		return CMD_RES_OK;
+	}
+	g_windowMS = Tokenizer_GetArgInteger(0);
+	if(g_windowMS < 100)
+		g_windowMS = 100;
+	if(g_windowMS > 10000)
+		g_windowMS = 10000;
+	return CMD_RES_OK;
+}
+
+void BL0937_Shutdown_Pins(void)
 {
 	HAL_DetachInterrupt(GPIO_HLW_CF);
 	HAL_DetachInterrupt(GPIO_HLW_CF1);
 }
 
-void BL0937_Init_Pins()
+static void BL0937_FindPins(int *sel, bool *invertSEL, int *cf, int *cf1)
 {
 	int tmp;
 
@@ -88,16 +218,22 @@ void BL0937_Init_Pins()
 	tmp = PIN_FindPinIndexForRole(IOR_BL0937_SEL_n, -1);
 	if(tmp != -1)
 	{
-		g_invertSEL = true;
-		GPIO_HLW_SEL = tmp;
+		*invertSEL = true;
+		*sel = tmp;
 	}
 	else
 	{
-		g_invertSEL = false;
-		GPIO_HLW_SEL = PIN_FindPinIndexForRole(IOR_BL0937_SEL, GPIO_HLW_SEL);
+		*invertSEL = false;
+		*sel = PIN_FindPinIndexForRole(IOR_BL0937_SEL, GPIO_HLW_SEL);
 	}
-	GPIO_HLW_CF = PIN_FindPinIndexForRole(IOR_BL0937_CF, GPIO_HLW_CF);
-	GPIO_HLW_CF1 = PIN_FindPinIndexForRole(IOR_BL0937_CF1, GPIO_HLW_CF1);
+	*cf = PIN_FindPinIndexForRole(IOR_BL0937_CF, GPIO_HLW_CF);
+	*cf1 = PIN_FindPinIndexForRole(IOR_BL0937_CF1, GPIO_HLW_CF1);
+}
+
+void BL0937_Init_Pins()
+{
+	g_pinGeneration = PIN_GetConfigGeneration();
+	BL0937_FindPins(&GPIO_HLW_SEL, &g_invertSEL, &GPIO_HLW_CF, &GPIO_HLW_CF1);
 
 	BL0937_PMAX = CFG_GetPowerMeasurementCalibrationFloat(CFG_OBK_POWER_MAX, BL0937_PMAX);
 
@@ -107,12 +243,14 @@ void BL0937_Init_Pins()
 	HAL_PIN_Setup_Input_Pullup(GPIO_HLW_CF1);
 	HAL_PIN_Setup_Input_Pullup(GPIO_HLW_CF);
 
-	HAL_AttachInterrupt(GPIO_HLW_CF, INTERRUPT_STUB, HlwCfInterrupt);
-	HAL_AttachInterrupt(GPIO_HLW_CF1, INTERRUPT_STUB, HlwCf1Interrupt);
+	BL0937_ResetMeter(&g_cfRing, &g_powerMeter);
+	BL0937_ResetMeter(&g_cf1Ring, &g_voltageMeter);
+	BL0937_ResetMeter(&g_cf1Ring, &g_currentMeter);
+	g_selDwellMS = 0;
+	g_timeAccum = 0;
 
-	g_vc_pulses = 0;
-	g_p_pulses = 0;
-	pulseStamp = xTaskGetTickCount();
+	HAL_AttachInterrupt(GPIO_HLW_CF, INTERRUPT_FALLING, HlwCfInterrupt);
+	HAL_AttachInterrupt(GPIO_HLW_CF1, INTERRUPT_FALLING, HlwCf1Interrupt);
 }
 
 void BL0937_Init(void)
@@ -127,117 +265,37 @@ void BL0937_Init(void)
 	//cmddetail:"fn":"BL0937_PowerMax","file":"driver/drv_bl0937.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("PowerMax", BL0937_PowerMax, NULL);
-
+	//cmddetail:{"name":"BL0937Window","args":"[WindowMS]",
+	//cmddetail:"descr":"Sets how often BL0937 readings are updated, 100 to 10000 ms, default 1000. Readings are averaged over pulses in that time, or taken from time between last two pulses at low loads. Without argument, prints measured pulse frequencies.",
+	//cmddetail:"fn":"BL0937_Window","file":"driver/drv_bl0937.c","requires":"",
+	//cmddetail:"examples":"BL0937Window 500"}
+	CMD_RegisterCommand("BL0937Window", BL0937_Window, NULL);
+
+	g_powerMeter.hz = 0;
+	g_voltageMeter.hz = 0;
+	g_currentMeter.hz = 0;
 	BL0937_Init_Pins();
 }
 
-void BL0937_RunEverySecond(void)
+static void BL0937_Update(void)
 {
 	float final_v;
 	float final_c;
 	float final_p;
-	bool bNeedRestart;
-	portTickType ticksElapsed;
-	portTickType xPassedTicks;
-
-	bNeedRestart = false;
-	if(g_invertSEL)
-	{
-		if(GPIO_HLW_SEL != PIN_FindPinIndexForRole(IOR_BL0937_SEL_n, GPIO_HLW_SEL))
-		{
-			bNeedRestart = true;
-		}
-	}
-	else
-	{
-		if(GPIO_HLW_SEL != PIN_FindPinIndexForRole(IOR_BL0937_SEL, GPIO_HLW_SEL))
-		{
-			bNeedRestart = true;
-		}
-	}
-	if(GPIO_HLW_CF != PIN_FindPinIndexForRole(IOR_BL0937_CF, GPIO_HLW_CF))
+	uint32_t now;
+	blPulseMeter_t *m;
+
+	now = BL0937_GetTimeUs();
+	BL0937_Measure(&g_cfRing, &g_powerMeter, now);
+	m = BL0937_IsMeasuringVoltage() ? &g_voltageMeter : &g_currentMeter;
+	BL0937_Measure(&g_cf1Ring, m, now);
+	g_selDwellMS += g_windowMS;
+	if(m->periods >= BL0937_SEL_PERIODS || g_selDwellMS >= BL0937_SEL_MAX_DWELL_MS)
 	{
-		bNeedRestart = true;
+		BL0937_SwitchSel();
 	}
-	if(GPIO_HLW_CF1 != PIN_FindPinIndexForRole(IOR_BL0937_CF1, GPIO_HLW_CF1))
-	{
-		bNeedRestart = true;
-	}
-
-
-#if PLATFORM_BEKEN
-	GLOBAL_INT_DECLARATION();
-	GLOBAL_INT_DISABLE();
-#else
-
-#endif
 
-#if 1
-	if(bNeedRestart)
-	{
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "BL0937 pins have changed, will reset the interrupts");
-
-		BL0937_Shutdown_Pins();
-		BL0937_Init_Pins();
-#if PLATFORM_BEKEN
-		GLOBAL_INT_RESTORE();
-#else
-
-#endif
-		return;
-	}
-
-
-#endif
-	if(g_sel)
-	{
-		if(g_invertSEL)
-		{
-			res_c = g_vc_pulses;
-		}
-		else
-		{
-			res_v = g_vc_pulses;
-		}
-		g_sel = false;
-	}
-	else
-	{
-		if(g_invertSEL)
-		{
-			res_v = g_vc_pulses;
-		}
-		else
-		{
-			res_c = g_vc_pulses;
-		}
-		g_sel = true;
-	}
-	HAL_PIN_SetOutputValue(GPIO_HLW_SEL, g_sel);
-	g_vc_pulses = 0;
-
-	res_p = g_p_pulses;
-	g_p_pulses = 0;
-#if PLATFORM_BEKEN
-	GLOBAL_INT_RESTORE();
-#else
-
-#endif
-	xPassedTicks = xTaskGetTickCount();
-	ticksElapsed = (xPassedTicks - pulseStamp);
-	pulseStamp = xPassedTicks;
-	//addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"Voltage pulses %i, current %i, power %i\n", res_v, res_c, res_p);
-
-	PwrCal_Scale(res_v, res_c, res_p, &final_v, &final_c, &final_p);
-
-	final_v *= (1000.0f / (float)portTICK_PERIOD_MS);
-	final_v /= (float)ticksElapsed;
-
-	final_c *= (1000.0f / (float)portTICK_PERIOD_MS);
-	final_c /= (float)ticksElapsed;
-
-	final_p *= (1000.0f / (float)portTICK_PERIOD_MS);
-	final_p /= (float)ticksElapsed;
+	PwrCal_Scale(g_voltageMeter.hz, g_currentMeter.hz, g_powerMeter.hz, &final_v, &final_c, &final_p);
 
 	/* patch to limit max power reading, filter random reading errors */
 	if(final_p > BL0937_PMAX)
@@ -255,16 +313,35 @@ void BL0937_RunEverySecond(void)
 		/* Valid value save for next time */
 		last_p = final_p;
 	}
-#if 0
+	BL_ProcessUpdate(final_v, final_c, final_p, NAN, NAN);
+}
+
+void BL0937_RunQuickTick(void)
+{
+	int sel, cf, cf1;
+	bool invertSEL;
+
+	// pins are looked up again only after pin config changed
+	if(g_pinGeneration != PIN_GetConfigGeneration())
 	{
-		char dbg[128];
-		snprintf(dbg, sizeof(dbg), "Voltage %f, current %f, power %f\n", final_v, final_c, final_p);
-		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, dbg);
+		g_pinGeneration = PIN_GetConfigGeneration();
+		BL0937_FindPins(&sel, &invertSEL, &cf, &cf1);
+		if(sel != GPIO_HLW_SEL || invertSEL != g_invertSEL || cf != GPIO_HLW_CF || cf1 != GPIO_HLW_CF1)
+		{
+			addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "BL0937 pins have changed, will reset the interrupts");
+			BL0937_Shutdown_Pins();
+			BL0937_Init_Pins();
+			return;
+		}
 	}
-#endif
-	BL_ProcessUpdate(final_v, final_c, final_p, NAN, NAN);
+	g_timeAccum += g_deltaTimeMS;
+	if(g_timeAccum < g_windowMS)
+		return;
+	g_timeAccum -= g_windowMS;
+	if(g_timeAccum >= g_windowMS)
+		g_timeAccum = 0;
+	BL0937_Update();
 }
 
 // close ENABLE_DRIVER_BL0937
 #endif
-
@@ -1,4 +1,5 @@
 #pragma once
 
 void BL0937_Init(void);
-void BL0937_RunEverySecond(void);
+void BL0937_RunQuickTick(void);
+void BL0937_Shutdown_Pins(void);
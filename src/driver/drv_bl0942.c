@@ -12,7 +12,9 @@
 #include "../new_cfg.h"
 #include "../new_pins.h"
 #include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
 #include "drv_bl_shared.h"
+#include "drv_meterFrame.h"
 #include "drv_pwrCal.h"
 #include "drv_spi.h"
 #include "drv_uart.h"
@@ -34,8 +36,6 @@ static unsigned short bl0942_opts= 0;
 #define BL0942_UART_CMD_READ(addr) (0x58 | addr)
 #define BL0942_UART_CMD_WRITE(addr) (0xA8 | addr)
 #define BL0942_UART_REG_PACKET 0xAA
-#define BL0942_UART_PACKET_HEAD 0x55
-#define BL0942_UART_PACKET_LEN 23
 
 // Datasheet says 900 kHz is supported, but it produced ~50% check sum errors  
 #define BL0942_SPI_BAUD_RATE 800000 // 900000
@@ -111,137 +111,73 @@ static void ScaleAndUpdate(bl0942_data_t * data) {
     //    adeviceindex, voltage, current, power, frequency, energyWh);
 }
 
-#if !ENABLE_BL_TWIN
-static int BL0942_UART_TryToGetNextPacket() {
-  int cs;
-  int i;
-  int c_garbage_consumed = 0;
-  byte checksum;
-
-  cs = UART_GetDataSize();
-
-  if(cs < BL0942_UART_PACKET_LEN) {
-    return 0;
-  }
-  // skip garbage data (should not happen)
-  while(cs > 0) {
-    if (UART_GetByte(0) != BL0942_UART_PACKET_HEAD) {
-      UART_ConsumeBytes(1);
-      c_garbage_consumed++;
-      cs--;
-    } else {
-      break;
-    }
-  }
-  if(c_garbage_consumed > 0){
-    ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-      "Consumed %i unwanted non-header byte in BL0942 buffer\n",
-      c_garbage_consumed);
-  }
-  if(cs < BL0942_UART_PACKET_LEN) {
-    return 0;
-  }
-  if (UART_GetByte(0) != 0x55)
-    return 0;
-  checksum = BL0942_UART_CMD_READ(BL0942_UART_ADDR);
-
-  for(i = 0; i < BL0942_UART_PACKET_LEN-1; i++) {
-    checksum += UART_GetByte(i);
-  }
-  checksum ^= 0xFF;
-
-  if (checksum != UART_GetByte(BL0942_UART_PACKET_LEN - 1)) {
-    ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-      "Skipping packet with bad checksum %02X wanted %02X\n",
-      UART_GetByte(BL0942_UART_PACKET_LEN - 1), checksum);
-    UART_ConsumeBytes(BL0942_UART_PACKET_LEN);
-    return 1;
-  }
-
-  bl0942_data_t data;
-  data.i_rms =
-    (UART_GetByte(3) << 16) | (UART_GetByte(2) << 8) | UART_GetByte(1);
-  data.v_rms =
-    (UART_GetByte(6) << 16) | (UART_GetByte(5) << 8) | UART_GetByte(4);
-  data.watt = Int24ToInt32((UART_GetByte(12) << 16) |
-    (UART_GetByte(11) << 8) | UART_GetByte(10));
-  data.cf_cnt =
-    (UART_GetByte(15) << 16) | (UART_GetByte(14) << 8) | UART_GetByte(13);
-  data.freq = (UART_GetByte(17) << 8) | UART_GetByte(16);
-  ScaleAndUpdate(&data);
-
-  UART_ConsumeBytes(BL0942_UART_PACKET_LEN);
-  return BL0942_UART_PACKET_LEN;
-}
-
+#if ENABLE_BL_TWIN
+#define BL0942_UART_DEVICES 2
 #else
-static int BL0942_UART_TryToGetNextPacket(int adeviceindex, int auartindex) {
-	int cs;
-	int i;
-	int c_garbage_consumed = 0;
-	byte checksum;
+#define BL0942_UART_DEVICES 1
+#endif
+// frames between updates are averaged, sums must not overflow
+#define BL0942_UART_AVERAGE_MAX 128
 
-	cs = UART_GetDataSizeEx(auartindex);
+typedef struct {
+    bool active;
+    // meter frame instance
+    int frame;
+    int uartIndex;
+    // UART init counter after our init, differs if port was taken over
+    int uartInitCounter;
+    int sinceRequestMS;
+    // sums of frames received since last update
+    int count;
+    uint32_t i_rms;
+    uint32_t v_rms;
+    int32_t watt;
+    // latest ones, not averaged
+    uint32_t cf_cnt;
+    uint32_t freq;
+} bl0942_uart_t;
 
-	if(cs < BL0942_UART_PACKET_LEN) {
-		return 0;
-	}
-	// skip garbage data (should not happen)
-	while(cs > 0) {
-        if (UART_GetByteEx(auartindex,0) != BL0942_UART_PACKET_HEAD) {
-			UART_ConsumeBytesEx(auartindex, 1);
-			c_garbage_consumed++;
-			cs--;
-		} else {
-			break;
-		}
-	}
-	if(c_garbage_consumed > 0){
-        ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-                    "Consumed %i unwanted non-header byte in BL0942 buffer\n",
-                    c_garbage_consumed);
-	}
-	if(cs < BL0942_UART_PACKET_LEN) {
-		return 0;
-	}
-    if (UART_GetByteEx(auartindex, 0) != 0x55)
-		return 0;
-    checksum = BL0942_UART_CMD_READ(BL0942_UART_ADDR);
+static bl0942_uart_t bl0942_uarts[BL0942_UART_DEVICES];
+static int bl0942_requestIntervalMS = 1000;
 
-    for(i = 0; i < BL0942_UART_PACKET_LEN-1; i++) {
-        checksum += UART_GetByteEx(auartindex, i);
-	}
-	checksum ^= 0xFF;
+static void BL0942_UART_OnFrame(int instance, const byte *frame, int adeviceindex) {
+    bl0942_uart_t *dev = &bl0942_uarts[adeviceindex];
 
-    if (checksum != UART_GetByteEx(auartindex, BL0942_UART_PACKET_LEN - 1)) {
-        ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-                    "Skipping packet with bad checksum %02X wanted %02X\n",
-                    UART_GetByteEx(auartindex, BL0942_UART_PACKET_LEN - 1), checksum);
-        UART_ConsumeBytesEx(auartindex, BL0942_UART_PACKET_LEN);
-		return 1;
-	}
+    if (dev->count >= BL0942_UART_AVERAGE_MAX)
+        dev->count = 0;
+    if (dev->count == 0) {
+        dev->i_rms = 0;
+        dev->v_rms = 0;
+        dev->watt = 0;
+    }
+    dev->i_rms += (frame[3] << 16) | (frame[2] << 8) | frame[1];
+    dev->v_rms += (frame[6] << 16) | (frame[5] << 8) | frame[4];
+    dev->watt += Int24ToInt32((frame[12] << 16) | (frame[11] << 8) | frame[10]);
+    dev->cf_cnt = (frame[15] << 16) | (frame[14] << 8) | frame[13];
+    dev->freq = (frame[17] << 8) | frame[16];
+    dev->count++;
+}
 
+static void BL0942_UART_Update(int adeviceindex) {
+    bl0942_uart_t *dev = &bl0942_uarts[adeviceindex];
     bl0942_data_t data;
-    data.i_rms =
-        (UART_GetByteEx(auartindex, 3) << 16) | (UART_GetByteEx(auartindex, 2) << 8) | UART_GetByteEx(auartindex, 1);
-    data.v_rms =
-        (UART_GetByteEx(auartindex, 6) << 16) | (UART_GetByteEx(auartindex, 5) << 8) | UART_GetByteEx(auartindex, 4);
-    data.watt = Int24ToInt32((UART_GetByteEx(auartindex, 12) << 16) |
-                             (UART_GetByteEx(auartindex, 11) << 8) | UART_GetByteEx(auartindex, 10));
-    data.cf_cnt =
-        (UART_GetByteEx(auartindex, 15) << 16) | (UART_GetByteEx(auartindex, 14) << 8) | UART_GetByteEx(auartindex, 13);
-    data.freq = (UART_GetByteEx(auartindex, 17) << 8) | UART_GetByteEx(auartindex, 16);
+
+    if (dev->count == 0)
+        return;
+    data.i_rms = (dev->i_rms + dev->count / 2) / dev->count;
+    data.v_rms = (dev->v_rms + dev->count / 2) / dev->count;
+    data.watt = dev->watt / dev->count;
+    data.cf_cnt = dev->cf_cnt;
+    data.freq = dev->freq;
+    dev->count = 0;
+#if ENABLE_BL_TWIN
     ScaleAndUpdate(adeviceindex, &data);
-    UART_ConsumeBytesEx(auartindex, BL0942_UART_PACKET_LEN);
-	return BL0942_UART_PACKET_LEN;
-}
+#else
+    ScaleAndUpdate(&data);
 #endif
+}
 
-#if ENABLE_BL_TWIN
 static void UART_WriteReg(int auartindex, uint8_t reg, uint32_t val) {
-#else  
-static void UART_WriteReg(uint8_t reg, uint32_t val) {
-#endif
     uint8_t send[5];
     send[0] = BL0942_UART_CMD_WRITE(BL0942_UART_ADDR);
     send[1] = reg;
@@ -251,19 +187,16 @@ static void UART_WriteReg(uint8_t reg, uint32_t val) {
     uint8_t crc = 0;
 
     for (int i = 0; i < sizeof(send); i++) {
-#if ENABLE_BL_TWIN
-      UART_SendByteEx(auartindex, send[i]);
-#else
-      UART_SendByte(send[i]);
-#endif
+        UART_SendByteEx(auartindex, send[i]);
         crc += send[i];
     }
 
-#if ENABLE_BL_TWIN
     UART_SendByteEx(auartindex, crc ^ 0xFF);
-#else
-    UART_SendByte(crc ^ 0xFF);
-#endif
+}
+
+static void UART_RequestPacket(int auartindex) {
+    UART_SendByteEx(auartindex, BL0942_UART_CMD_READ(BL0942_UART_ADDR));
+    UART_SendByteEx(auartindex, BL0942_UART_REG_PACKET);
 }
 
 static int SPI_ReadReg(uint8_t reg, uint32_t *val) {
@@ -329,88 +262,102 @@ static void BL0942_Init(void) {
 
 // THIS IS called by 'startDriver BL0942' command
 // You can set alternate baud with 'startDriver BL0942 9600' syntax
-#if !ENABLE_BL_TWIN
-void BL0942_UART_Init(void) {
-  BL0942_Init();
-
-  bl0942_baudRate = Tokenizer_GetArgIntegerDefault(1, 4800);
-
-  UART_InitUART(bl0942_baudRate, 0, false);
-  UART_InitReceiveRingBuffer(BL0942_UART_RECEIVE_BUFFER_SIZE);
+// and packet request interval with 'startDriver BL0942 4800 200',
+// frames received between updates are averaged
+static void BL0942_UART_InitEx(int adeviceindex, int auartindex) {
+    bl0942_uart_t *dev = &bl0942_uarts[adeviceindex];
+    int mode = BL0942_MODE_DEFAULT;
 
-  UART_WriteReg(BL0942_REG_USR_WRPROT, BL0942_USR_WRPROT_DISABLE);
-  UART_WriteReg(BL0942_REG_MODE,
-    BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
-}
-#else
-void BL0942_UART_InitEx(int auartindex) {
 	BL0942_Init();
 
 	bl0942_baudRate = Tokenizer_GetArgIntegerDefault(1, 4800);
+	bl0942_requestIntervalMS = Tokenizer_GetArgIntegerDefault(2, 1000);
+	if (bl0942_requestIntervalMS < 50)
+		bl0942_requestIntervalMS = 50;
+	// no point asking more often than registers are refreshed
+	if (bl0942_requestIntervalMS >= 800)
+		mode |= BL0942_MODE_RMS_UPDATE_SEL_800_MS;
 
 	UART_InitUARTEx(auartindex, bl0942_baudRate, 0, false);
 	UART_InitReceiveRingBufferEx(auartindex, BL0942_UART_RECEIVE_BUFFER_SIZE);
 
+	if (dev->active)
+		MeterFrame_Close(dev->frame);
+	memset(dev, 0, sizeof(*dev));
+	dev->frame = MeterFrame_Open(METERFRAME_BL0942, auartindex, BL0942_UART_OnFrame, adeviceindex);
+	dev->uartIndex = auartindex;
+	dev->uartInitCounter = UART_GetInitCounterEx(auartindex);
+	dev->active = dev->frame >= 0;
+
     UART_WriteReg(auartindex, BL0942_REG_USR_WRPROT, BL0942_USR_WRPROT_DISABLE);
-    UART_WriteReg(auartindex, BL0942_REG_MODE,
-                  BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
+    UART_WriteReg(auartindex, BL0942_REG_MODE, mode);
 }
 
+#if ENABLE_BL_TWIN
 void BL0942_UART_Init(void) {
   if (!bl0942_opts) {
     int fuartindex = UART_GetSelectedPortIndex();
-    BL0942_UART_InitEx(fuartindex);
+    BL0942_UART_InitEx(BL0942_DEVICE_INDEX_0, fuartindex);
   }
   else {
     if (bl0942_opts & BL0942_OPTBIT0_UART1) {
-      BL0942_UART_InitEx(UART_PORT_INDEX_0);
+      BL0942_UART_InitEx(BL0942_DEVICE_INDEX_0, UART_PORT_INDEX_0);
     }
     if (bl0942_opts & BL0942_OPTBIT1_UART2) {
-      BL0942_UART_InitEx(UART_PORT_INDEX_1);
+      BL0942_UART_InitEx(BL0942_DEVICE_INDEX_1, UART_PORT_INDEX_1);
     }
   }
 }
+#else
+void BL0942_UART_Init(void) {
+  BL0942_UART_InitEx(BL0942_DEVICE_INDEX_0, UART_GetSelectedPortIndex());
+}
 #endif
 
-#if ENABLE_BL_TWIN
-void BL0942_UART_RunEverySecondEx(int adeviceindex, int auartindex) {
-  BL0942_UART_TryToGetNextPacket(adeviceindex, auartindex);
+// frames are taken as soon as they arrive, next one is requested every interval
+void BL0942_UART_RunQuickTick(void) {
+  bl0942_uart_t *dev;
+  int i;
 
-  UART_InitUARTEx(auartindex, bl0942_baudRate, 0, false);
-  UART_SendByteEx(auartindex, BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByteEx(auartindex, BL0942_UART_REG_PACKET);
+  for (i = 0; i < BL0942_UART_DEVICES; i++) {
+    dev = &bl0942_uarts[i];
+    if (!dev->active)
+      continue;
+    MeterFrame_Poll(dev->frame);
+    dev->sinceRequestMS += g_deltaTimeMS;
+    if (dev->sinceRequestMS >= bl0942_requestIntervalMS) {
+      dev->sinceRequestMS = 0;
+      UART_RequestPacket(dev->uartIndex);
+    }
+  }
 }
 
 void BL0942_UART_RunEverySecond(void) {
-  if (!bl0942_opts) {
-    int fuartindex = UART_GetSelectedPortIndex();
-    BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_0, fuartindex);
-  }
-  else {
-    if (bl0942_opts & BL0942_OPTBIT0_UART1) {
-      BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_0, UART_PORT_INDEX_0);
-    }
-    if (bl0942_opts & BL0942_OPTBIT1_UART2) {
-      BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_1, UART_PORT_INDEX_1);
+  bl0942_uart_t *dev;
+  int i;
+
+  for (i = 0; i < BL0942_UART_DEVICES; i++) {
+    dev = &bl0942_uarts[i];
+    if (!dev->active)
+      continue;
+    MeterFrame_Poll(dev->frame);
+    BL0942_UART_Update(i);
+    // UART may have been taken over in the meantime, requests are sent from quick tick
+    if (UART_GetInitCounterEx(dev->uartIndex) != dev->uartInitCounter) {
+      dev->uartInitCounter = UART_InitUARTEx(dev->uartIndex, bl0942_baudRate, 0, false);
     }
   }
 }
-#else
-void BL0942_UART_RunEverySecond(void) {
-#if ENABLE_BL_TWIN
-  int fuartindex = UART_GetSelectedPortIndex();
-  BL0942_UART_TryToGetNextPacket(BL0942_DEVICE_INDEX_0, fuartindex);
-  UART_InitUARTEx(fuartindex, bl0942_baudRate, 0, false);
-  UART_SendByteEx(fuartindex, BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByteEx(fuartindex, BL0942_UART_REG_PACKET);
-#else
-  BL0942_UART_TryToGetNextPacket();
-  UART_InitUART(bl0942_baudRate, 0, false);
-  UART_SendByte(BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByte(BL0942_UART_REG_PACKET);
-#endif
+
+void BL0942_UART_Stop(void) {
+  int i;
+
+  for (i = 0; i < BL0942_UART_DEVICES; i++) {
+    if (bl0942_uarts[i].active)
+      MeterFrame_Close(bl0942_uarts[i].frame);
+    bl0942_uarts[i].active = false;
+  }
 }
-#endif
 
 void BL0942_SPI_Init(void) {
 	BL0942_Init();
@@ -4,9 +4,11 @@
 
 void BL0942_UART_Init(void);
 void BL0942_UART_RunEverySecond(void);
+void BL0942_UART_RunQuickTick(void);
+void BL0942_UART_Stop(void);
 void BL0942_SPI_Init(void);
 void BL0942_SPI_RunEverySecond(void);
 #if ENABLE_BL_TWIN
 void BL0942_AddCommands(void);
 #endif
-#endif
\ No newline at end of file
+#endif
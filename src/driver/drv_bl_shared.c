@@ -6,6 +6,7 @@
 #include "../new_cfg.h"
 #include "../new_pins.h"
 #include "../cJSON/cJSON.h"
+#include "../cJSON/cJSON_arena.h"
 #include "../hal/hal_flashVars.h"
 #include "../logging/logging.h"
 #include "../mqtt/new_mqtt.h"
@@ -329,6 +330,7 @@ commandResult_t BL09XX_ResetEnergyCounterEx(int asensdatasetix, float* pvalue)
       energyCounterStamp[asensdatasetix] = xTaskGetTickCount();
     }
     ConsumptionResetTime = (time_t)TIME_GetCurrentTime();
+    JSON_BumpSensorVersion();
     if (OTA_GetProgress()==-1)
     { 
       BL09XX_SaveEmeteringStatistics();
@@ -663,6 +665,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
   current = XJ_MovingAverage_float((float)sensdataset->sensors[OBK_CURRENT].lastReading, current);
 #endif
 
+  JSON_BumpSensorVersion();
   sensdataset->sensors[OBK_VOLTAGE].lastReading = voltage;
   sensdataset->sensors[OBK_CURRENT].lastReading = current;
   sensdataset->sensors[OBK_POWER].lastReading = power;
@@ -752,6 +755,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 #if ENABLE_MQTT
         if ((energyCounterStatsJSONEnable == true) && (MQTT_IsReady() == true))
         {
+          JSONArena_Begin(JSONARENA_ENERGY);
           root = cJSON_CreateObject();
           cJSON_AddNumberToObject(root, "uptime", g_secondsElapsed);
           cJSON_AddNumberToObject(root, "consumption_total", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_TOTAL)));
@@ -821,7 +825,8 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 
           MQTT_PublishMain_StringString("consumption_stats", msg, 0);
           stat_updatesSent[asensdatasetix]++;
-          os_free(msg);
+          cJSON_free(msg);
+          JSONArena_End();
         }
 #endif
 
@@ -2,3 +2,5 @@
 
 void CSE7766_Init(void);
 void CSE7766_RunEverySecond(void);
+void CSE7766_RunQuickTick(void);
+void CSE7766_Stop(void);
@@ -16,26 +16,77 @@
 #include "lwip/inet.h"
 #include "../httpserver/new_http.h"
 #include "drv_local.h"
+#include "drv_ddpSend.h"
 #include "../quicktick.h"
 
 
 static int g_socket_ddpSend = -1;
-static int stat_sendBytes = 0;
-static int stat_sendPackets = 0;
-static int stat_failedPackets = 0;
+static ddpSendStats_t g_ddpStats;
+// one datagram, header and fragment of pixel data
+static byte *g_ddpPacket = 0;
+static byte g_ddpSequence = 0;
+
+typedef struct ddpTarget_s {
+	char ip[16];
+	struct sockaddr_in adr;
+} ddpTarget_t;
+
+static ddpTarget_t g_ddpTargets[DDPSEND_MAX_TARGETS];
+static int g_ddpTargetsCount = 0;
+// next entry to replace when table is full
+static int g_ddpTargetsNext = 0;
 
 typedef struct ddpQueueItem_s {
-	int curSize;
-	int totalSize;
-	byte *data;
-	int delay;
 	struct sockaddr_in adr;
-	struct ddpQueueItem_s *next;
+	unsigned int deadline;
+	int pixelSize;
+	int size;
+	// buffer is kept for the next frame that lands in this slot
+	int capacity;
+	byte *data;
 } ddpQueueItem_t;
 
-ddpQueueItem_t *g_queue = 0;
+static ddpQueueItem_t g_ddpRing[DDPSEND_RING_SIZE];
+static int g_ddpRingHead = 0;
+static int g_ddpRingCount = 0;
+
+// ddp as in WLED
+#define DDP_TYPE_RGB24  0x0B // 00 001 011 (RGB , 8 bits per channel, 3 channels)
+#define DDP_TYPE_RGBW32 0x1B // 00 011 011 (RGBW, 8 bits per channel, 4 channels)
+#define DDP_FLAGS1_VER1 0x40 // version=1
+#define DDP_FLAGS1_PUSH 0x01
+#define DDP_ID_DISPLAY  1
+
+// https://github.com/wled/WLED/blob/main/wled00/udp.cpp
+static void DDP_SetHeader(byte *data, int pixelSize, uint32_t offset, int bytesCount, bool push) {
+	// set ident
+	data[0] = DDP_FLAGS1_VER1;
+	if (push) {
+		data[0] |= DDP_FLAGS1_PUSH;
+	}
+	data[1] = g_ddpSequence;
 
-int DRV_DDPSend_SendInternal(struct sockaddr_in *adr, const byte *frame, int numBytes) {
+	// set pixel size
+	if (pixelSize == 4) {
+		data[2] = DDP_TYPE_RGBW32;
+	}
+	else {
+		data[2] = DDP_TYPE_RGB24;
+	}
+	data[3] = DDP_ID_DISPLAY;
+
+	// data offset in bytes, big endian
+	data[4] = (byte)((offset >> 24) & 0xFF);
+	data[5] = (byte)((offset >> 16) & 0xFF);
+	data[6] = (byte)((offset >> 8) & 0xFF);
+	data[7] = (byte)(offset & 0xFF);
+
+	// set bytes count
+	data[8] = (byte)((bytesCount >> 8) & 0xFF); // MSB
+	data[9] = (byte)(bytesCount & 0xFF);        // LSB
+}
+
+static int DRV_DDPSend_SendInternal(struct sockaddr_in *adr, const byte *frame, int numBytes) {
 	int nbytes = sendto(
 		g_socket_ddpSend,
 		(const char*)frame,
@@ -45,143 +96,192 @@ int DRV_DDPSend_SendInternal(struct sockaddr_in *adr, const byte *frame, int num
 		sizeof(*adr)
 	);
 	if (nbytes == numBytes) {
-		stat_sendBytes += numBytes;
-		stat_sendPackets++;
+		g_ddpStats.bytes += numBytes;
+		g_ddpStats.packets++;
 		return numBytes;
 	}
-	stat_failedPackets++;
+	g_ddpStats.failedPackets++;
 	return 0;
 }
-void DRV_DDPSend_Send(const char *ip, int port, const byte *frame, int numBytes, int delay) {
-	struct sockaddr_in adr;
-	memset(&adr, 0, sizeof(adr));
-	adr.sin_family = AF_INET;
-	adr.sin_addr.s_addr = inet_addr(ip);
-	adr.sin_port = htons(port);
+static int DRV_DDPSend_SendFragments(struct sockaddr_in *adr, int pixelSize, const byte *pixels, int numBytes) {
+	int offset = 0;
+	int n, sent = 0;
 
-	if (delay <= 0) {
-		DRV_DDPSend_SendInternal(&adr, frame, numBytes);
-		return;
+	if (g_socket_ddpSend < 0 || g_ddpPacket == 0) {
+		g_ddpStats.failedPackets++;
+		return 0;
 	}
+	// sequence 1..15, 0 would mean not used
+	g_ddpSequence = (g_ddpSequence % 15) + 1;
+	g_ddpStats.frames++;
+	do {
+		n = numBytes - offset;
+		if (n > DDPSEND_FRAGMENT_DATA)
+			n = DDPSEND_FRAGMENT_DATA;
+		DDP_SetHeader(g_ddpPacket, pixelSize, offset, n, offset + n >= numBytes);
+		memcpy(g_ddpPacket + DDPSEND_HEADER_SIZE, pixels + offset, n);
+		if (DRV_DDPSend_SendInternal(adr, g_ddpPacket, DDPSEND_HEADER_SIZE + n))
+			sent++;
+		offset += n;
+	} while (offset < numBytes);
+	return sent;
+}
+int DDPSend_AddTarget(const char *ip, int port) {
+	ddpTarget_t *t;
+	uint32_t addr;
+	int i;
 
-	ddpQueueItem_t *it = g_queue;
-	while (it) {
-		if (it->curSize == 0) {
-			break; // found empty
-		}
-		it = it->next;
+	for (i = 0; i < g_ddpTargetsCount; i++) {
+		t = &g_ddpTargets[i];
+		if (t->adr.sin_port == htons(port) && !strcmp(t->ip, ip))
+			return i;
 	}
-	if (it == 0) {
-		it = (ddpQueueItem_t*)malloc(sizeof(ddpQueueItem_t));
-		if (it == 0) {
-			// malloc failed
-			return;
-		}
-		memset(it,0,sizeof(ddpQueueItem_t));
-		it->adr = adr;
-		it->totalSize = it->curSize = numBytes;
-		it->data = malloc(numBytes);
-		if (it->data == 0) {
-			// malloc failed
-			free(it);
-			return;
-		}
-		it->next = g_queue;
-		g_queue = it;
+	if (strlen(ip) >= sizeof(t->ip))
+		return -1;
+	addr = inet_addr(ip);
+	if (addr == INADDR_NONE) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_DDP, "DDPSend: bad address %s", ip);
+		return -1;
+	}
+	if (g_ddpTargetsCount < DDPSEND_MAX_TARGETS) {
+		i = g_ddpTargetsCount++;
 	}
-	if (it->totalSize < numBytes) {
+	else {
+		i = g_ddpTargetsNext;
+		g_ddpTargetsNext = (g_ddpTargetsNext + 1) % DDPSEND_MAX_TARGETS;
+	}
+	t = &g_ddpTargets[i];
+	memset(t, 0, sizeof(*t));
+	strcpy(t->ip, ip);
+	t->adr.sin_family = AF_INET;
+	t->adr.sin_addr.s_addr = addr;
+	t->adr.sin_port = htons(port);
+	return i;
+}
+int DDPSend_SendFrame(int target, int pixelSize, const byte *pixels, int numBytes, int delayMS) {
+	ddpQueueItem_t *it, *prev, tmp;
+	int pos;
+
+	if (target < 0 || target >= g_ddpTargetsCount || numBytes <= 0)
+		return 0;
+	if (delayMS <= 0) {
+		return DRV_DDPSend_SendFragments(&g_ddpTargets[target].adr, pixelSize, pixels, numBytes);
+	}
+	if (g_ddpRingCount == DDPSEND_RING_SIZE) {
+		// drop the one due first
+		g_ddpRingHead = (g_ddpRingHead + 1) % DDPSEND_RING_SIZE;
+		g_ddpRingCount--;
+		g_ddpStats.droppedFrames++;
+	}
+	it = &g_ddpRing[(g_ddpRingHead + g_ddpRingCount) % DDPSEND_RING_SIZE];
+	if (it->capacity < numBytes) {
 		byte *r = (byte*)realloc(it->data, numBytes);
 		if (r == 0) {
 			// realloc failed
-			return;
+			g_ddpStats.droppedFrames++;
+			return 0;
 		}
 		it->data = r;
-		it->totalSize = numBytes;
+		it->capacity = numBytes;
 	}
-	it->delay = delay;
-	memcpy(it->data, frame, numBytes);
-	it->curSize = numBytes;
+	// table entry may be replaced before frame is sent
+	it->adr = g_ddpTargets[target].adr;
+	it->deadline = g_timeMs + delayMS;
+	it->pixelSize = pixelSize;
+	it->size = numBytes;
+	memcpy(it->data, pixels, numBytes);
+	// keep ring sorted by deadline, so RunFrame only has to look at head;
+	// slots are swapped whole, buffers go along with them
+	for (pos = g_ddpRingCount; pos > 0; pos--) {
+		prev = &g_ddpRing[(g_ddpRingHead + pos - 1) % DDPSEND_RING_SIZE];
+		if ((int)(prev->deadline - it->deadline) <= 0)
+			break;
+		tmp = *prev;
+		*prev = *it;
+		*it = tmp;
+		it = prev;
+	}
+	g_ddpRingCount++;
+	return 0;
+}
+int DDPSend_GetQueuedFrames() {
+	return g_ddpRingCount;
+}
+const ddpSendStats_t *DDPSend_GetStats() {
+	return &g_ddpStats;
 }
 void DRV_DDPSend_RunFrame() {
 	ddpQueueItem_t *t;
-	t = g_queue;
-	while (t) {
-		if (t->curSize > 0) {
-			t->delay -= g_deltaTimeMS;
-			if (t->delay <= 0) {
-				int sendBytes = DRV_DDPSend_SendInternal(&t->adr, t->data, t->curSize);
-				// TODO - do not clear if didn't send?
-				t->curSize = 0; // mark as empty
-			}
-		}
-		t = t->next;
+
+	while (g_ddpRingCount > 0) {
+		t = &g_ddpRing[g_ddpRingHead];
+		if ((int)(g_timeMs - t->deadline) < 0)
+			break;
+		DRV_DDPSend_SendFragments(&t->adr, t->pixelSize, t->data, t->size);
+		g_ddpRingHead = (g_ddpRingHead + 1) % DDPSEND_RING_SIZE;
+		g_ddpRingCount--;
 	}
 }
 void DRV_DDPSend_Shutdown()
 {
+	int i;
+
 	if (g_socket_ddpSend >= 0) {
 		close(g_socket_ddpSend);
 		g_socket_ddpSend = -1;
 	}
-	ddpQueueItem_t *it = g_queue;
-	while (it) {
-		ddpQueueItem_t *n = it->next;
-		free(it->data);
-		free(it);
-		it = n;
+	for (i = 0; i < DDPSEND_RING_SIZE; i++) {
+		free(g_ddpRing[i].data);
 	}
-	g_queue = 0;
+	memset(g_ddpRing, 0, sizeof(g_ddpRing));
+	g_ddpRingHead = 0;
+	g_ddpRingCount = 0;
+	g_ddpTargetsCount = 0;
+	g_ddpTargetsNext = 0;
+	free(g_ddpPacket);
+	g_ddpPacket = 0;
 }
 void DRV_DDPSend_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
-	hprintf255(request, "<h2>DDP sent: %i packets, %i bytes, errored packets: %i</h2>", 
-		stat_sendPackets, stat_sendBytes, stat_failedPackets);
+	hprintf255(request, "<h2>DDP sent: %i frames, %i packets, %i bytes, errored packets: %i, dropped frames: %i</h2>",
+		g_ddpStats.frames, g_ddpStats.packets, g_ddpStats.bytes, g_ddpStats.failedPackets, g_ddpStats.droppedFrames);
 }
 
-// ddp as in WLED
-#define DDP_TYPE_RGB24  0x0B // 00 001 011 (RGB , 8 bits per channel, 3 channels)
-#define DDP_TYPE_RGBW32 0x1B // 00 011 011 (RGBW, 8 bits per channel, 4 channels)
-#define DDP_FLAGS1_VER1 0x40 // version=1
-
-// https://github.com/wled/WLED/blob/main/wled00/udp.cpp
-void DDP_SetHeader(byte *data, int pixelSize, int bytesCount) {
-	// set ident
-	data[0] = DDP_FLAGS1_VER1;
-
-	// set pixel size
-	if (pixelSize == 4) {
-		data[2] = DDP_TYPE_RGBW32;
-	}
-	else if (pixelSize == 3) {
-		data[2] = DDP_TYPE_RGB24;
-	}
-
-	// set bytes count
-	data[8] = (byte)((bytesCount >> 8) & 0xFF); // MSB
-	data[9] = (byte)(bytesCount & 0xFF);        // LSB
-}
 // startDriver DDPSend
 // DDP_Send 192.168.0.226 3 0 FF000000
+// DDP_Send 192.168.0.226:4049 3 100 FF000000
 commandResult_t DDP_Send(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	char ip[24];
+	const char *p;
 	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES | TOKENIZER_DONT_EXPAND);
 	if (Tokenizer_GetArgsCount() < 1) {
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
-	const char *ip = Tokenizer_GetArg(0);
-	int port = 4048;// Tokenizer_GetArgInteger(1);
+	int port = DDPSEND_DEFAULT_PORT;
+	strcpy_safe(ip, Tokenizer_GetArg(0), sizeof(ip));
+	p = strchr(ip, ':');
+	if (p) {
+		port = atoi(p + 1);
+		ip[p - ip] = 0;
+	}
+	int target = DDPSend_AddTarget(ip, port);
+	if (target < 0) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
 	int pixelSize = Tokenizer_GetArgInteger(1);
 	int delay = Tokenizer_GetArgInteger(2);
 	const char *pData = Tokenizer_GetArg(3);
 	int numBytes = strlen(pData) / 2;
-	int headerSize = 10;
-	byte *data = malloc(headerSize+numBytes);
-	int cur = headerSize;
-	while (*pData) {
+	byte *data = malloc(numBytes + 1);
+	if (data == 0) {
+		return CMD_RES_ERROR;
+	}
+	int cur = 0;
+	while (*pData && cur < numBytes) {
 		data[cur] = CMD_ParseOrExpandHexByte(&pData);
 		cur++;
 	}
-	DDP_SetHeader(data, pixelSize, (cur- headerSize));
-	DRV_DDPSend_Send(ip, port, data, cur, delay);
+	DDPSend_SendFrame(target, pixelSize, data, cur, delay);
 	free(data);
 	return CMD_RES_OK;
 }
@@ -195,8 +295,9 @@ void DRV_DDPSend_Init()
 		addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "DRV_DDPSend_Init: failed to do socket\n");
 		return;
 	}
-	//cmddetail:{"name":"DDP_Send","args":"IP host pixelsize delay pData",
-	//cmddetail:"descr":"",
+	g_ddpPacket = (byte*)malloc(DDPSEND_HEADER_SIZE + DDPSEND_FRAGMENT_DATA);
+	//cmddetail:{"name":"DDP_Send","args":"IP[:Port] pixelsize delay pData",
+	//cmddetail:"descr":"Sends pixel data over DDP, now or after delay in ms. Port is 4048 by default. Frames longer than 1440 bytes are sent in fragments.",
 	//cmddetail:"fn":"DDP_Send","file":"driver/drv_ddpSend.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("DDP_Send", DDP_Send, NULL);
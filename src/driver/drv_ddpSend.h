@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../new_common.h"
+
+// DDP sender. Destination addresses are parsed once into a small table,
+// frames longer than one datagram are split into DDPSEND_FRAGMENT_DATA
+// byte fragments with data offset set, PUSH flag only on the last one.
+// Delayed frames wait in a fixed ring of reused buffers and are sent
+// from QuickTick once their deadline has passed, in order they came in.
+
+#ifndef DDPSEND_MAX_TARGETS
+#define DDPSEND_MAX_TARGETS		8
+#endif
+#ifndef DDPSEND_RING_SIZE
+#define DDPSEND_RING_SIZE		8
+#endif
+#define DDPSEND_HEADER_SIZE		10
+// as in WLED, fits in ethernet MTU and holds whole RGB and RGBW pixels
+#define DDPSEND_FRAGMENT_DATA	1440
+#define DDPSEND_DEFAULT_PORT	4048
+
+typedef struct ddpSendStats_s {
+	int frames;
+	int packets;
+	int bytes;
+	int failedPackets;
+	// ring was full, oldest waiting frame was dropped
+	int droppedFrames;
+} ddpSendStats_t;
+
+/// @brief Find or add destination, address is parsed only when it is added.
+/// When table is full, the oldest entry is replaced.
+/// @return target index or -1 for bad address
+int DDPSend_AddTarget(const char *ip, int port);
+/// @brief Send pixel data (pixelSize 3 or 4 bytes per pixel) to target,
+/// now or after delayMS.
+/// @return number of datagrams sent, 0 when frame was queued or failed
+int DDPSend_SendFrame(int target, int pixelSize, const byte *pixels, int numBytes, int delayMS);
+int DDPSend_GetQueuedFrames();
+const ddpSendStats_t *DDPSend_GetStats();
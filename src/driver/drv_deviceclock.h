@@ -42,6 +42,8 @@ void TIME_setLongitude(float longi);
 #if ENABLE_CALENDAR_EVENTS
 void TIME_CalculateSunrise(byte *outHour, byte *outMinute);	
 void TIME_CalculateSunset(byte *outHour, byte *outMinute);
+// how many times solar position was really calculated (and not taken from cache)
+int TIME_GetSunCalculationsCount();
 #endif	// to #if ENABLE_CALENDAR_EVENTS
 #endif
 uint32_t TIME_GetCurrentTime(); 			// might replace for NTP_GetCurrentTime() to return time regardless of NTP present/running
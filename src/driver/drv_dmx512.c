@@ -91,6 +91,15 @@ void DMX_setByte(int idx, byte color) {
 		return;
 	g_dmxBuffer[1 + idx] = color;
 }
+void DMX_setBytes(uint32_t idx, const byte *data, int len) {
+	if (idx >= DMX_CHANNELS_SIZE)
+		return;
+	if (len <= 0)
+		return;
+	if ((uint32_t)len > DMX_CHANNELS_SIZE - idx)
+		len = (int)(DMX_CHANNELS_SIZE - idx);
+	memcpy(g_dmxBuffer + 1 + idx, data, len);
+}
 
 void DMX_SetLEDCount(int pixel_count, int pixel_size) {
 	dmx_pixelCount = pixel_count;
@@ -108,6 +117,7 @@ void DMX_Init() {
 	ws_export.getByte = DMX_GetByte;
 	ws_export.setByte = DMX_setByte;
 	ws_export.setLEDCount = DMX_SetLEDCount;
+	ws_export.setBytes = DMX_setBytes;
 
 	LEDS_InitShared(&ws_export);
 
@@ -6,6 +6,7 @@
 #include "drv_ds1820_common.h"
 #include "../hal/hal_generic.h"
 #include "../hal/hal_pins.h"
+#include "../quicktick.h"
 #if PLATFORM_ESPIDF
 #include "freertos/task.h"
 #define noInterrupts() portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;taskENTER_CRITICAL(&mux)
@@ -30,6 +31,353 @@
 	static bool testus_initialized = false;
 #endif
 
+#if WINDOWS
+// Simulated 1-Wire bus with DS18B20 models in place of the bit timing layer,
+// so the drivers above can be tested without hardware
+
+#define DS1820_MOCK_MAX_SENSORS	24
+
+enum {
+	OWMOCK_IDLE,
+	OWMOCK_ROM_CMD,
+	OWMOCK_MATCH_ROM,
+	OWMOCK_SEARCH_ROM,
+	OWMOCK_FUNC_CMD,
+	OWMOCK_CONVERTING,
+	OWMOCK_READ,
+	OWMOCK_WRITE_SCRATCHPAD,
+	OWMOCK_READ_POWER,
+};
+
+typedef struct ds1820MockSensor_s {
+	int pin;
+	uint8_t rom[8];
+	uint8_t scratchPad[9];
+	float tempC;
+	bool bPresent;
+	bool bParasite;
+	bool bSelected;
+	bool bConverting;
+	unsigned int convertStart;
+	int corruptReads;
+} ds1820MockSensor_t;
+
+typedef struct ds1820MockBus_s {
+	int state;
+	uint8_t acc;
+	int accBits;
+	uint8_t buf[9];
+	int bufLen;
+	int outBits;
+	int outPos;
+	int searchBit;
+	int searchPhase;
+} ds1820MockBus_t;
+
+static ds1820MockSensor_t g_mockSensors[DS1820_MOCK_MAX_SENSORS];
+static int g_mockSensorsCount = 0;
+static ds1820MockBus_t g_mockBuses[PLATFORM_GPIO_MAX];
+static int g_mockResets = 0;
+static int g_mockConverts = 0;
+static int g_mockScratchpadReads = 0;
+
+static void DS1820_Mock_UpdateScratchPad(ds1820MockSensor_t *s, int raw) {
+	s->scratchPad[TEMP_LSB] = raw & 0xFF;
+	s->scratchPad[TEMP_MSB] = (raw >> 8) & 0xFF;
+	s->scratchPad[SCRATCHPAD_CRC] = Crc8CQuick(s->scratchPad, 8);
+}
+// conversion time and truncation depend on resolution, like a real DS18B20
+static int DS1820_Mock_GetResolutionShift(ds1820MockSensor_t *s) {
+	return 3 - ((s->scratchPad[CONFIGURATION] & 0x60) >> 5);
+}
+static void DS1820_Mock_FinishConversion(ds1820MockSensor_t *s) {
+	int raw;
+
+	if (s->bConverting == false)
+		return;
+	if (g_timeMs - s->convertStart < (unsigned int)(750 >> DS1820_Mock_GetResolutionShift(s)))
+		return;
+	s->bConverting = false;
+	raw = (int)(s->tempC * 16.0f + (s->tempC < 0 ? -0.5f : 0.5f));
+	raw &= ~((1 << DS1820_Mock_GetResolutionShift(s)) - 1);
+	DS1820_Mock_UpdateScratchPad(s, raw);
+}
+void DS1820_Mock_Clear() {
+	g_mockSensorsCount = 0;
+	g_mockResets = 0;
+	g_mockConverts = 0;
+	g_mockScratchpadReads = 0;
+	memset(g_mockBuses, 0, sizeof(g_mockBuses));
+}
+int DS1820_Mock_AddSensor(int pin, const uint8_t *rom, float tempC) {
+	ds1820MockSensor_t *s;
+
+	if (g_mockSensorsCount >= DS1820_MOCK_MAX_SENSORS || pin < 0 || pin >= PLATFORM_GPIO_MAX)
+		return -1;
+	s = &g_mockSensors[g_mockSensorsCount];
+	memset(s, 0, sizeof(*s));
+	s->pin = pin;
+	memcpy(s->rom, rom, 8);
+	s->tempC = tempC;
+	s->bPresent = true;
+	s->scratchPad[HIGH_ALARM_TEMP] = 0x4B;
+	s->scratchPad[LOW_ALARM_TEMP] = 0x46;
+	s->scratchPad[CONFIGURATION] = TEMP_12_BIT;
+	s->scratchPad[INTERNAL_BYTE] = 0xFF;
+	s->scratchPad[COUNT_REMAIN] = 0x0C;
+	s->scratchPad[COUNT_PER_C] = 0x10;
+	// power-on value is 85C
+	DS1820_Mock_UpdateScratchPad(s, 85 * 16);
+	return g_mockSensorsCount++;
+}
+void DS1820_Mock_SetTemperature(int index, float tempC) {
+	if (index >= 0 && index < g_mockSensorsCount)
+		g_mockSensors[index].tempC = tempC;
+}
+void DS1820_Mock_SetPresent(int index, bool bPresent) {
+	if (index >= 0 && index < g_mockSensorsCount)
+		g_mockSensors[index].bPresent = bPresent;
+}
+void DS1820_Mock_SetParasite(int index, bool bParasite) {
+	if (index >= 0 && index < g_mockSensorsCount)
+		g_mockSensors[index].bParasite = bParasite;
+}
+void DS1820_Mock_CorruptNextReads(int index, int count) {
+	if (index >= 0 && index < g_mockSensorsCount)
+		g_mockSensors[index].corruptReads = count;
+}
+int DS1820_Mock_GetSensorsCount(int pin) {
+	int r = 0;
+	for (int i = 0; i < g_mockSensorsCount; i++) {
+		if (pin == -1 || g_mockSensors[i].pin == pin)
+			r++;
+	}
+	return r;
+}
+int DS1820_Mock_GetResetsCount() {
+	return g_mockResets;
+}
+int DS1820_Mock_GetConvertsCount() {
+	return g_mockConverts;
+}
+int DS1820_Mock_GetScratchpadReadsCount() {
+	return g_mockScratchpadReads;
+}
+
+static bool DS1820_Mock_IsOnBus(ds1820MockSensor_t *s, int Pin) {
+	return s->pin == Pin && s->bPresent;
+}
+// selected devices drive the bus together, so the result is a wired AND
+static void DS1820_Mock_StartOutput(ds1820MockBus_t *bus, int Pin, bool bRom) {
+	int len = bRom ? 8 : 9;
+
+	memset(bus->buf, 0xFF, sizeof(bus->buf));
+	for (int i = 0; i < g_mockSensorsCount; i++) {
+		ds1820MockSensor_t *s = &g_mockSensors[i];
+		if (!DS1820_Mock_IsOnBus(s, Pin) || !s->bSelected)
+			continue;
+		DS1820_Mock_FinishConversion(s);
+		for (int j = 0; j < len; j++) {
+			bus->buf[j] &= bRom ? s->rom[j] : s->scratchPad[j];
+		}
+		if (!bRom && s->corruptReads > 0) {
+			s->corruptReads--;
+			bus->buf[TEMP_LSB] ^= 0x01;
+		}
+	}
+	bus->outBits = len * 8;
+	bus->outPos = 0;
+	bus->state = OWMOCK_READ;
+}
+static void DS1820_Mock_ProcessByte(ds1820MockBus_t *bus, int Pin, uint8_t data) {
+	int i;
+
+	switch (bus->state) {
+	case OWMOCK_ROM_CMD:
+		if (data == SKIP_ROM || data == SEARCH_ROM || data == READ_ROM) {
+			for (i = 0; i < g_mockSensorsCount; i++) {
+				g_mockSensors[i].bSelected = DS1820_Mock_IsOnBus(&g_mockSensors[i], Pin);
+			}
+		}
+		if (data == SKIP_ROM) {
+			bus->state = OWMOCK_FUNC_CMD;
+		}
+		else if (data == SELECT_DEVICE) {
+			bus->bufLen = 0;
+			bus->state = OWMOCK_MATCH_ROM;
+		}
+		else if (data == SEARCH_ROM) {
+			bus->searchBit = 0;
+			bus->searchPhase = 0;
+			bus->state = OWMOCK_SEARCH_ROM;
+		}
+		else if (data == READ_ROM) {
+			DS1820_Mock_StartOutput(bus, Pin, true);
+		}
+		else {
+			// alarm search and others: nobody answers
+			bus->state = OWMOCK_IDLE;
+		}
+		break;
+	case OWMOCK_MATCH_ROM:
+		bus->buf[bus->bufLen++] = data;
+		if (bus->bufLen == 8) {
+			for (i = 0; i < g_mockSensorsCount; i++) {
+				ds1820MockSensor_t *s = &g_mockSensors[i];
+				s->bSelected = DS1820_Mock_IsOnBus(s, Pin) && !memcmp(s->rom, bus->buf, 8);
+			}
+			bus->state = OWMOCK_FUNC_CMD;
+		}
+		break;
+	case OWMOCK_FUNC_CMD:
+		if (data == CONVERT_T) {
+			for (i = 0; i < g_mockSensorsCount; i++) {
+				ds1820MockSensor_t *s = &g_mockSensors[i];
+				if (!DS1820_Mock_IsOnBus(s, Pin) || !s->bSelected)
+					continue;
+				s->bConverting = true;
+				s->convertStart = g_timeMs;
+			}
+			g_mockConverts++;
+			bus->state = OWMOCK_CONVERTING;
+		}
+		else if (data == READ_SCRATCHPAD) {
+			g_mockScratchpadReads++;
+			DS1820_Mock_StartOutput(bus, Pin, false);
+		}
+		else if (data == WRITE_SCRATCHPAD) {
+			bus->bufLen = 0;
+			bus->state = OWMOCK_WRITE_SCRATCHPAD;
+		}
+		else if (data == READ_POWER_SUPPLY) {
+			bus->state = OWMOCK_READ_POWER;
+		}
+		else {
+			bus->state = OWMOCK_IDLE;
+		}
+		break;
+	case OWMOCK_WRITE_SCRATCHPAD:
+		bus->buf[bus->bufLen++] = data;
+		if (bus->bufLen == 3) {
+			for (i = 0; i < g_mockSensorsCount; i++) {
+				ds1820MockSensor_t *s = &g_mockSensors[i];
+				if (!DS1820_Mock_IsOnBus(s, Pin) || !s->bSelected)
+					continue;
+				s->scratchPad[HIGH_ALARM_TEMP] = bus->buf[0];
+				s->scratchPad[LOW_ALARM_TEMP] = bus->buf[1];
+				s->scratchPad[CONFIGURATION] = bus->buf[2] | 0x1F;
+				s->scratchPad[SCRATCHPAD_CRC] = Crc8CQuick(s->scratchPad, 8);
+			}
+			bus->state = OWMOCK_IDLE;
+		}
+		break;
+	}
+}
+
+int OWReset(int Pin)
+{
+	ds1820MockBus_t *bus = &g_mockBuses[Pin];
+	int result = 0;
+
+	g_mockResets++;
+	memset(bus, 0, sizeof(*bus));
+	bus->state = OWMOCK_ROM_CMD;
+	for (int i = 0; i < g_mockSensorsCount; i++) {
+		ds1820MockSensor_t *s = &g_mockSensors[i];
+		if (s->pin == Pin) {
+			s->bSelected = false;
+			if (s->bPresent)
+				result = 1;
+		}
+	}
+	return result;
+}
+
+void OWWriteBit(int Pin, int bit)
+{
+	ds1820MockBus_t *bus = &g_mockBuses[Pin];
+
+	if (bus->state == OWMOCK_SEARCH_ROM) {
+		if (bus->searchPhase != 2)
+			return;
+		// devices that don't match the chosen direction drop out
+		for (int i = 0; i < g_mockSensorsCount; i++) {
+			ds1820MockSensor_t *s = &g_mockSensors[i];
+			if (s->pin != Pin || !s->bSelected)
+				continue;
+			if (((s->rom[bus->searchBit >> 3] >> (bus->searchBit & 7)) & 1) != (bit & 1))
+				s->bSelected = false;
+		}
+		bus->searchPhase = 0;
+		bus->searchBit++;
+		if (bus->searchBit == 64)
+			bus->state = OWMOCK_FUNC_CMD;
+		return;
+	}
+	if (bus->state == OWMOCK_IDLE || bus->state == OWMOCK_CONVERTING || bus->state == OWMOCK_READ)
+		return;
+	if (bit)
+		bus->acc |= 1 << bus->accBits;
+	bus->accBits++;
+	if (bus->accBits == 8) {
+		uint8_t data = bus->acc;
+		bus->acc = 0;
+		bus->accBits = 0;
+		DS1820_Mock_ProcessByte(bus, Pin, data);
+	}
+}
+
+int OWReadBit(int Pin)
+{
+	ds1820MockBus_t *bus = &g_mockBuses[Pin];
+	int result = 1;
+
+	switch (bus->state) {
+	case OWMOCK_SEARCH_ROM:
+		if (bus->searchPhase == 2)
+			return 1;
+		for (int i = 0; i < g_mockSensorsCount; i++) {
+			ds1820MockSensor_t *s = &g_mockSensors[i];
+			if (!DS1820_Mock_IsOnBus(s, Pin) || !s->bSelected)
+				continue;
+			int b = (s->rom[bus->searchBit >> 3] >> (bus->searchBit & 7)) & 1;
+			// first the bit, then its complement
+			if (bus->searchPhase == 1)
+				b = !b;
+			result &= b;
+		}
+		bus->searchPhase++;
+		return result;
+	case OWMOCK_CONVERTING:
+		for (int i = 0; i < g_mockSensorsCount; i++) {
+			ds1820MockSensor_t *s = &g_mockSensors[i];
+			if (!DS1820_Mock_IsOnBus(s, Pin))
+				continue;
+			DS1820_Mock_FinishConversion(s);
+			// parasite powered sensor does not drive the line while converting
+			if (s->bConverting && !s->bParasite)
+				result = 0;
+		}
+		return result;
+	case OWMOCK_READ_POWER:
+		for (int i = 0; i < g_mockSensorsCount; i++) {
+			ds1820MockSensor_t *s = &g_mockSensors[i];
+			if (DS1820_Mock_IsOnBus(s, Pin) && s->bSelected && s->bParasite)
+				result = 0;
+		}
+		return result;
+	case OWMOCK_READ:
+		if (bus->outPos >= bus->outBits)
+			return 1;
+		result = (bus->buf[bus->outPos >> 3] >> (bus->outPos & 7)) & 1;
+		bus->outPos++;
+		return result;
+	}
+	return 1;
+}
+
+#else
+
 int OWReset(int Pin)
 {
 	int result;
@@ -104,6 +452,8 @@ int OWReadBit(int Pin)
 	return result;
 }
 
+#endif // WINDOWS
+
 //-----------------------------------------------------------------------------
 // Poll if DS1820 temperature conversion is complete
 //-----------------------------------------------------------------------------
@@ -19,11 +19,11 @@
 #define READ_SCRATCHPAD		0xBE	// Read scratchpad
 #define WRITE_SCRATCHPAD	0x4E	// Write scratchpad
 #define SELECT_DEVICE		0x55	// (Match ROM) address a single devices on the bus
+#define READ_POWER_SUPPLY	0xB4	// Determine if device needs parasite power, parasite powered ones pull the read slot low
 /*
 //unused for now
 #define COPY_SCRATCHPAD	0x48		// Copy scratchpad to EEPROM
 #define RECALL_E2		0xB8	// Recall from EEPROM to scratchpad
-#define READ_POWER_SUPPLY	0xB4	// Determine if device needs parasite power
 */
 
 // Scratchpad locations
@@ -68,5 +68,20 @@ int OWReadByte(int Pin);
 int OWTouchByte(int Pin, int data);
 uint8_t Crc8CQuick(uint8_t* Buffer, uint8_t Size);
 
+#if WINDOWS
+// simulated sensors behind OWReset/OWWriteBit/OWReadBit, for selftests
+void DS1820_Mock_Clear();
+int DS1820_Mock_AddSensor(int pin, const uint8_t *rom, float tempC);
+void DS1820_Mock_SetTemperature(int index, float tempC);
+void DS1820_Mock_SetPresent(int index, bool bPresent);
+// parasite powered sensor can't signal end of conversion, read slots return 1
+void DS1820_Mock_SetParasite(int index, bool bParasite);
+void DS1820_Mock_CorruptNextReads(int index, int count);
+int DS1820_Mock_GetSensorsCount(int pin);
+int DS1820_Mock_GetResetsCount();
+int DS1820_Mock_GetConvertsCount();
+int DS1820_Mock_GetScratchpadReadsCount();
+#endif
+
 
 
@@ -15,6 +15,7 @@
 #include "drv_local.h"
 #include "../httpserver/new_http.h"
 #include "../hal/hal_pins.h"
+#include "../quicktick.h"
 
 #define DEVSTR		"0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X"
 #define DEV2STR(T)	T[0],T[1],T[2],T[3],T[4],T[5],T[6],T[7]
@@ -23,14 +24,38 @@
 
 
 
-static uint8_t dsread = 0;
-static int Pin = -1;
-//static int t = -127;
 static int errcount = 0;
 static int lastconv; // secondsElapsed on last successfull reading
 static uint8_t ds18_family = 0;
 static int ds18_conversionPeriod = 0;
 
+// Reading is a non-blocking state machine per GPIO bus, driven from QuickTick:
+// skip-ROM convert on all sensors at once, poll for conversion done,
+// then read one scratchpad per tick, so no tick holds the bus for long.
+// Buses with a parasite powered sensor can't be polled (the line is only
+// pulled up, so read slot gives 1 at once), those wait the full 12 bit time.
+#define DS18B20_CONV_MIN_MS		90		// shortest (9 bit) conversion time
+#define DS18B20_CONV_MAX_MS		750		// 12 bit conversion time
+#define DS18B20_CONV_TIMEOUT_MS	1000
+#define DS18B20_READ_RETRIES	5
+
+enum {
+	DS18B20_BUS_IDLE,
+	DS18B20_BUS_CONVERTING,
+	DS18B20_BUS_READING,
+};
+
+typedef struct {
+	uint8_t state;
+	bool bConvertRequested;
+	bool bParasite;		// some sensor on this GPIO is parasite powered
+	int elapsed;		// ms since conversion start
+	int nextSensor;		// next index in ds18b20devices to read
+	int retries;
+} ds18b20bus_t;
+
+static ds18b20bus_t ds18b20buses[DS18B20MAX_GPIOS];
+
 typedef uint8_t ScratchPad[9];
 typedef uint8_t DeviceAddress[8];		// we need to distinguish sensors by their address
 
@@ -162,7 +187,10 @@ static commandResult_t Cmd_DS18B20_SetResolution(const void* context, const char
 
 
 	//temperature conversion was interrupted
-	dsread = 0;
+	for (int i = 0; i < DS18B20MAX_GPIOS; i++) {
+		ds18b20buses[i].state = DS18B20_BUS_IDLE;
+		ds18b20buses[i].bConvertRequested = true;
+	}
 
 	return CMD_RES_OK;
 }
@@ -173,6 +201,19 @@ void ds18b20_requestConvertT(int GPIO) {
 	OWWriteByte(GPIO,CONVERT_T);
 }
 
+// parasite powered sensors answer READ POWER SUPPLY with 0
+static bool ds18b20_isParasitePowered(int GPIO) {
+	bool bParasite;
+
+	if (!OWReset(GPIO))
+		return false;
+	OWWriteByte(GPIO,SKIP_ROM);
+	OWWriteByte(GPIO,READ_POWER_SUPPLY);
+	bParasite = OWReadBit(GPIO) == 0;
+	OWReset(GPIO);
+	return bParasite;
+}
+
 
 
 
@@ -504,6 +545,7 @@ void insertArray(DS1820devices *a, DeviceAddress devaddr) {
 	a->channel[ds18_count] = -1;
 	a->GPIO[ds18_count]=DS18B20_GPIO;
 	ds18_count++;
+	JSON_BumpSensorVersion();
 }
 
 // search DS18B20 devices on one GPIO pin
@@ -512,16 +554,17 @@ int DS18B20_fill_devicelist(int Pin)
 	DeviceAddress devaddr={0};
 	int ret=0;
 #if WINDOWS
-	// For Windows add some "fake" sensors with increasing addresses
+	// For Windows put some "fake" sensors with increasing addresses on the simulated bus,
+	// unless a selftest has set up its own
 	// 28 FF AA BB CC DD EE 01, 28 FF AA BB CC DD EE 02, ...
-	devaddr[0]=0x28; devaddr[1]=0xFF; devaddr[2]=0xAA; devaddr[3]=0xBB;devaddr[4]=0xCC;devaddr[5]=0xDD;devaddr[6]=0xEE;
-	while (ds18_count < 1+(DS18B20MAX/2) ){
-		devaddr[7]=++ret;
-		bk_printf("found device " DEVSTR " ",
-			DEV2STR(devaddr));
-		insertArray(&ds18b20devices,devaddr);
+	if (DS1820_Mock_GetSensorsCount(-1) == 0) {
+		devaddr[0]=0x28; devaddr[1]=0xFF; devaddr[2]=0xAA; devaddr[3]=0xBB;devaddr[4]=0xCC;devaddr[5]=0xDD;devaddr[6]=0xEE;
+		for (int i = 0; i < 1+(DS18B20MAX/2); i++) {
+			devaddr[7]=i+1;
+			DS1820_Mock_AddSensor(Pin, devaddr, 20.0f + i/10.0f);
+		}
 	}
-#else
+#endif
 	reset_search();
 	while (search(devaddr,1,Pin) && ds18_count < DS18B20MAX ){
 		bk_printf("found device " DEVSTR" ",
@@ -529,7 +572,6 @@ int DS18B20_fill_devicelist(int Pin)
 		insertArray(&ds18b20devices,devaddr);
 		ret++;
 	}
-#endif
 	return ret;
 };
 
@@ -559,6 +601,7 @@ int DS18B20_set_deviceGPIO(DeviceAddress devaddr,const int pin)
 int DS18B20_set_devicename(DeviceAddress devaddr,const char *name)
 {
 	int i=0;
+	JSON_BumpSensorVersion();
 	for (i=0; i < ds18_count; i++) {
 		if (! memcmp(devaddr,ds18b20devices.array[i],8)){	// found device
 			if (strlen(name)<DS18B20namel) sprintf(ds18b20devices.name[i],name);
@@ -684,6 +727,7 @@ commandResult_t CMD_DS18B20_setsensor(const void *context, const char *cmd, cons
 
 void scan_sensors(){
 	ds18_count=0;
+	JSON_BumpSensorVersion();
 	reset_search();
 	int i,j=0;
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
@@ -695,6 +739,15 @@ void scan_sensors(){
 	}
 	// fill unused "pins" with 99 as sign for unused
 	for (;j<DS18B20MAX_GPIOS;j++) DS18B20GPIOS[j]=99;
+	memset(ds18b20buses, 0, sizeof(ds18b20buses));
+	// once per bus, tells if end of conversion can be polled
+	for (j = 0; j < DS18B20MAX_GPIOS; j++) {
+		if (DS18B20GPIOS[j] == 99)
+			continue;
+		ds18b20buses[j].bParasite = ds18b20_isParasitePowered(DS18B20GPIOS[j]);
+		if (ds18b20buses[j].bParasite)
+			DS1820_LOG(INFO, "Parasite powered sensor on GPIO %i, waiting full conversion time\r\n", DS18B20GPIOS[j]);
+	}
 }
 
 commandResult_t CMD_DS18B20_scansensors(const void *context, const char *cmd, const char *args, int cmdFlags) {
@@ -708,7 +761,6 @@ void DS1820_full_driver_Init()
 {
 	ds18_conversionPeriod = Tokenizer_GetArgIntegerDefault(1, 15);
 	lastconv = 0;
-	dsread = 0;
 	ds18_family = 0;
 	scan_sensors();
 
@@ -918,94 +970,124 @@ int http_fn_cfg_ds18b20(http_request_t* request)
 	return 0;	
 }
 
-void DS1820_full_OnEverySecond()
+// find next sensor on the given GPIO, starting at index "from"
+static int DS1820_full_nextSensorOnBus(int from, int pin) {
+	for (int i = from; i < ds18_count; i++) {
+		if (ds18b20devices.GPIO[i] == pin)
+			return i;
+	}
+	return -1;
+}
+
+// one scratchpad read per call, failed reads are retried on the following ticks
+static void DS1820_full_readNextSensor(ds18b20bus_t *bus, int pin) {
+	const char * pinalias;
+	char gpioname[10];
+	float t_float;
+	int i;
+
+	i = DS1820_full_nextSensorOnBus(bus->nextSensor, pin);
+	if (i < 0) {
+		bus->state = DS18B20_BUS_IDLE;
+		return;
+	}
+	t_float = ds18b20_getTempC((const uint8_t*)ds18b20devices.array[i]);
+	DS1820_LOG(DEBUG, "Device %i (" DEVSTR ") reported %0.2f\r\n",i,
+		DEV2STR(ds18b20devices.array[i]),t_float);
+	if (t_float == -127) {
+		errcount++;
+		if (++bus->retries < DS18B20_READ_RETRIES)
+			return;
+	}
+	else {
+		pinalias = HAL_PIN_GetPinNameAlias(pin);
+		if (! pinalias ) {
+			sprintf(gpioname,"GPIO %u",pin);
+			pinalias = gpioname;
+		}
+		ds18b20devices.lasttemp[i] = t_float;
+		ds18b20devices.last_read[i] = 0;
+		errcount = 0;
+		JSON_BumpSensorVersion();
+		if (ds18b20devices.channel[i]>=0) CHANNEL_Set(ds18b20devices.channel[i], (int)(t_float*100), CHANNEL_SET_FLAG_SILENT);
+		lastconv = g_secondsElapsed;
+		DS1820_LOG(INFO, "Sensor " DEVSTR " on %s reported %0.2f\r\n",DEV2STR(ds18b20devices.array[i]),pinalias,t_float);
+	}
+	bus->retries = 0;
+	bus->nextSensor = i + 1;
+}
+
+void DS1820_full_OnQuickTick()
 {
-	// for now just find the pin used
-	Pin = PIN_FindPinIndexForRole(IOR_DS1820_IO, -1);
+	for (int b = 0; b < DS18B20MAX_GPIOS; b++) {
+		ds18b20bus_t *bus = &ds18b20buses[b];
+		int pin = DS18B20GPIOS[b];
+		if (pin == 99)
+			continue;
+		switch (bus->state) {
+		case DS18B20_BUS_IDLE:
+			if (bus->bConvertRequested == false)
+				break;
+			bus->bConvertRequested = false;
+			// all sensors on this GPIO convert at once
+			ds18b20_requestConvertT(pin);
+			bus->elapsed = 0;
+			bus->state = DS18B20_BUS_CONVERTING;
+			break;
+		case DS18B20_BUS_CONVERTING:
+			bus->elapsed += g_deltaTimeMS;
+			if (bus->bParasite) {
+				// polling would also end strong pull-up too early
+				if (bus->elapsed < DS18B20_CONV_MAX_MS)
+					break;
+			}
+			else {
+				if (bus->elapsed < DS18B20_CONV_MIN_MS)
+					break;
+				if (bus->elapsed < DS18B20_CONV_TIMEOUT_MS && !DS1820TConversionDone(pin))
+					break;
+			}
+			bus->nextSensor = 0;
+			bus->retries = 0;
+			bus->state = DS18B20_BUS_READING;
+			break;
+		case DS18B20_BUS_READING:
+			DS1820_full_readNextSensor(bus, pin);
+			break;
+		}
+	}
+}
 
+void DS1820_full_OnEverySecond()
+{
 	// only if (at least one) pin is set
-	if(Pin < 0) {
+	if(DS18B20GPIOS[0] == 99) {
 		DS1820_LOG(INFO, "No Pin found\r\n");
 		return;
 	}
-	//Temperature measurement is done in two repeatable steps. 
-	// Step 1 - dsread = 0. Sensor requested to do temperature conversion.
-	//          That requires some time - 15-100-750ms, depending on sensor family/vendor.
-	//          However, time between steps is always one second.
-	// Step 2 - dsread = 1. Sensor finished conversion, requesting conversion result.
-
-	// request temp if conversion was requested two seconds after request
-	// if (dsread == 1 && g_secondsElapsed % 5 == 2) {
-	// better if we don't use parasitic power, we can check if conversion is ready
-		DS1820_LOG(DEBUG, ".. Pin %i found! dsread=%i \r\n",Pin,dsread);
-		if(dsread == 1){ 
-#if WINDOWS
-			bk_printf("Reading temperature from fake DS18B20 sensor(s)\r\n");
-			for (int i=0; i < ds18_count; i++) {
-				ds18b20devices.last_read[i] += 1 ;
-				errcount = 0;
-				float t_float = 20.0 + i/10.0 + (float)(g_secondsElapsed%100)/100.0;
-					ds18b20devices.lasttemp[i] = t_float;
-					ds18b20devices.last_read[i] = 0;
-					if (ds18b20devices.channel[i]>=0) CHANNEL_Set(ds18b20devices.channel[i], (int)(t_float*100), CHANNEL_SET_FLAG_SILENT);
-					lastconv = g_secondsElapsed;
-			}
-#else	// to #if WINDOWS
-			float t_float = -127;
-			const char * pinalias; 
-			char gpioname[10];
-			DS1820_LOG(INFO, "Reading temperature from %i DS18B20 sensor(s)\r\n",ds18_count);
-			for (int i=0; i < ds18_count; i++) {
-				pinalias = HAL_PIN_GetPinNameAlias(ds18b20devices.GPIO[i]);
-				if (! pinalias ) {
-					sprintf(gpioname,"GPIO %u",ds18b20devices.GPIO[i]);
-					pinalias = gpioname;
-				}
-				ds18b20devices.last_read[i] += 1 ;
-				errcount = 0;
-				t_float = -127;
-				while ( t_float == -127 && errcount++ < 5){
-					t_float = ds18b20_getTempC((const uint8_t*)ds18b20devices.array[i]);
-					DS1820_LOG(DEBUG, "Device %i (" DEVSTR ") reported %0.2f\r\n",i,
-						DEV2STR(ds18b20devices.array[i]),t_float);
-				}
-				if (t_float != -127){
-					ds18b20devices.lasttemp[i] = t_float;
-					ds18b20devices.last_read[i] = 0;
-					if (ds18b20devices.channel[i]>=0) CHANNEL_Set(ds18b20devices.channel[i], (int)(t_float*100), CHANNEL_SET_FLAG_SILENT);
-					lastconv = g_secondsElapsed;
-					DS1820_LOG(INFO, "Sensor " DEVSTR " on %s reported %0.2f\r\n",DEV2STR(ds18b20devices.array[i]),pinalias,t_float);
-				} else{
-					if (ds18b20devices.last_read[i] > 60) {
-						DS1820_LOG(ERROR, "No temperature read for over 60 seconds for"
-							" device %i (" DEVSTR " on %s)! Setting to -127°C!\r\n",i,
-							DEV2STR(ds18b20devices.array[i]),pinalias);
-						ds18b20devices.lasttemp[i] = -127;
-						dsread=0;
-					}
-				}
-			}
-#endif	// to #if WINDOWS		
-			dsread=0;
+	for (int i=0; i < ds18_count; i++) {
+		ds18b20devices.last_read[i] += 1 ;
+		if (ds18b20devices.last_read[i] > 60 && ds18b20devices.lasttemp[i] != -127) {
+			DS1820_LOG(ERROR, "No temperature read for over 60 seconds for"
+				" device %i (" DEVSTR " on GPIO %i)! Setting to -127°C!\r\n",i,
+				DEV2STR(ds18b20devices.array[i]),ds18b20devices.GPIO[i]);
+			ds18b20devices.lasttemp[i] = -127;
+			JSON_BumpSensorVersion();
 		}
-		else{
-//			bk_printf("No tepms read! dsread=%i  -- isConversionComplete()=%i\r\n",dsread,isConversionComplete());
-//			DS1820_LOG(INFO, "No tepms read! dsread=%i  -- isConversionComplete()=%i\r\n",dsread,isConversionComplete());
-			for (int i=0; i < ds18_count; i++) {
-				ds18b20devices.last_read[i] += 1 ;
-			}
-			if(dsread == 0 && (g_secondsElapsed % ds18_conversionPeriod == 0 || lastconv == 0))
-			{
-				DS1820_LOG(INFO, "Starting conversion");
-				for (int i=0; i<DS18B20MAX_GPIOS; i++){
-					ds18b20_requestConvertT(DS18B20GPIOS[i]);
-				}
-				dsread = 1;
-				errcount = 0;
+	}
+	//Temperature measurement is done in two repeatable steps, see DS1820_full_OnQuickTick
+	// Step 1 - sensors requested to do temperature conversion.
+	//          That requires some time - 15-100-750ms, depending on sensor family/vendor.
+	// Step 2 - conversion finished, reading results one sensor per tick.
+	if(g_secondsElapsed % ds18_conversionPeriod == 0 || lastconv == 0)
+	{
+		for (int i=0; i<DS18B20MAX_GPIOS; i++){
+			if (DS18B20GPIOS[i] != 99 && ds18b20buses[i].state == DS18B20_BUS_IDLE) {
+				DS1820_LOG(DEBUG, "Starting conversion on GPIO %i", DS18B20GPIOS[i]);
+				ds18b20buses[i].bConvertRequested = true;
 			}
 		}
-
-
+	}
 }
 
 #endif // to #if (ENABLE_DRIVER_DS1820_FULL)
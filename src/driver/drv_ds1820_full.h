@@ -3,12 +3,13 @@
 
 void DS1820_full_driver_Init();
 void DS1820_full_OnEverySecond();
+void DS1820_full_OnQuickTick();
 void DS1820_full_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 
 #define DEVICE_DISCONNECTED_C -127
 
 // some defines needed to support multiple devices and GPIOs
-#define DS18B20MAX	10			// max numbe of sensors
+#define DS18B20MAX	16			// max numbe of sensors
 #define DS18B20namel	20			// length of description
 #define DS18B20MAX_GPIOS 2			// max GPIOs with sensors
 
@@ -13,6 +13,11 @@
 
 static ledStrip_t led_backend;
 
+// SPI backend needs 4 bytes of DMA buffer per color byte
+#ifndef STRIP_MAX_PIXELS
+#define STRIP_MAX_PIXELS 1024
+#endif
+
 #define DEFAULT_PIXEL_SIZE 3
 const enum ColorChannel default_color_channel_order[3] = {
 	COLOR_CHANNEL_RED,
@@ -134,7 +139,6 @@ void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push) {
 		Strip_Apply();
 	}
 }
-extern float g_brightness0to100;//TODO
 void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w) {
 	// scale brightness
 #if ENABLE_LED_BASIC
@@ -148,6 +152,48 @@ void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w) {
 }
 #define SCALE8_PIXEL(x, scale) (uint8_t)(((uint32_t)x * (uint32_t)scale) / 256)
 
+// bytes collected before passing them to backend
+#define STRIP_FRAME_CHUNK 60
+
+static void Strip_writeBytes(uint32_t idx, const byte *data, int len) {
+	int i;
+
+	if (led_backend.setBytes) {
+		led_backend.setBytes(idx, data, len);
+		return;
+	}
+	for (i = 0; i < len; i++) {
+		led_backend.setByte(idx + i, data[i]);
+	}
+}
+// Channel order and brightness are resolved once here, not per byte
+void Strip_setFrame(const byte *rgbcw, int count, int scale) {
+	byte chunk[STRIP_FRAME_CHUNK];
+	byte map[5];
+	uint32_t ofs = 0;
+	int pixel, i, n = 0;
+
+	if (count > pixel_count)
+		count = pixel_count;
+	if (pixel_size > 5)
+		return;
+	for (i = 0; i < pixel_size; i++) {
+		map[i] = color_channel_order[i];
+	}
+	for (pixel = 0; pixel < count; pixel++, rgbcw += 5) {
+		for (i = 0; i < pixel_size; i++) {
+			chunk[n++] = SCALE8_PIXEL(rgbcw[map[i]], scale);
+		}
+		if (n + pixel_size > STRIP_FRAME_CHUNK) {
+			Strip_writeBytes(ofs, chunk, n);
+			ofs += n;
+			n = 0;
+		}
+	}
+	if (n)
+		Strip_writeBytes(ofs, chunk, n);
+}
+
 void Strip_scaleAllPixels(int scale) {
 	int pixel;
 	byte b;
@@ -259,7 +305,7 @@ commandResult_t Strip_CMD_InitForLEDCount(const void *context, const char *cmd,
 	//SM16703P_Shutdown();
 
 	// First arg: number of pixel to address
-	pixel_count = Tokenizer_GetArgIntegerRange(0, 0, 255);
+	pixel_count = Tokenizer_GetArgIntegerRange(0, 0, STRIP_MAX_PIXELS);
 	// Second arg (optional, default "RGB"): pixel format of "RGB" or "GRB"
 	if (Tokenizer_GetArgsCount() > 1) {
 		const char *format = Tokenizer_GetArg(1);
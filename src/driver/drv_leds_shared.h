@@ -10,6 +10,8 @@ typedef struct ledStrip_s {
 	void (*setByte)(uint32_t idx, byte val);
 	void (*apply)();
 	void (*setLEDCount)(int pixel_count, int pixel_size);
+	// optional, bulk version of setByte
+	void (*setBytes)(uint32_t idx, const byte *data, int len);
 } ledStrip_t;
 
 typedef enum ColorChannel {
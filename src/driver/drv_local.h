@@ -30,7 +30,8 @@ void DRV_MAX72XX_Clock_RunFrame();
 void DRV_MAX72XX_Clock_Init();
 
 void DRV_ADCButton_Init();
-void DRV_ADCButton_RunFrame();
+void DRV_ADCButton_OnEverySecond();
+void DRV_ADCButton_Stop();
 
 void PT6523_Init();
 void PT6523_RunFrame();
@@ -75,6 +76,8 @@ void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w);
 void Strip_setAllPixels(int r, int g, int b, int c, int w);
 void Strip_scaleAllPixels(int scale);
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t* data, bool push);
+// frame has 5 bytes (RGBCW) per pixel, scale is 0-256 (256 is full brightness)
+void Strip_setFrame(const byte *rgbcw, int count, int scale);
 void SM16703P_Show();
 void SM15155E_Init();
 void SM15155E_Write(float *rgbcw);
@@ -95,13 +98,17 @@ void HD2015_Init();
 void DRV_IR2_Init();
 
 void DRV_ADCSmoother_Init();
-void DRV_ADCSmoother_RunFrame();
+void DRV_ADCSmoother_Stop();
 
 bool DRV_IsRunning(const char *name);
 
 // this is exposed here only for debug tool with automatic testing
-void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes);
-void DGR_SpoofNextDGRPacketSource(const char *ipStrs);
+struct sockaddr_in;
+void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes, const struct sockaddr_in *src);
+int DGR_RxRing_Push(const byte *data, int len, const struct sockaddr_in *src);
+void DGR_RxRing_ProcessAll();
+int DGR_GetMembersCount();
+void DGR_GetRxStats(int *received, int *oversize);
 
 void TuyaMCU_Sensor_RunEverySecond();
 void TuyaMCU_Sensor_Init();
@@ -223,6 +230,7 @@ void PixelAnim_Init();
 void PixelAnim_SetAnimQuickTick();
 void PixelAnim_SetAnim(int j);
 void PixelAnim_CreatePanel(http_request_t* request);
+int PixelAnim_GetFrameCount();
 
 void Drawers_Init();
 void Drawers_QuickTick();
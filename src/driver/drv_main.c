@@ -21,6 +21,7 @@
 #include "drv_ds1820_common.h"
 #include "drv_ds3231.h"
 #include "drv_hlw8112.h"
+#include "../tick_profiler.h"
 
 
 typedef struct driver_s {
@@ -336,7 +337,7 @@ static driver_t g_drivers[] = {
 	NTP_Init,                                // Init
 	NTP_OnEverySecond,                       // onEverySecond
 	NTP_AppendInformationToHTTPIndexPage,    // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
+	NTP_RunQuickTick,                        // runQuickTick
    	NTP_Stop,                                // stopFunction
    	NULL,                                    // onChannelChanged
    	NULL,                                    // onHassDiscovery
@@ -506,14 +507,14 @@ static driver_t g_drivers[] = {
 #if ENABLE_DRIVER_BL0942
 	//drvdetail:{"name":"BL0942",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"BL0942 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK. You need to calibrate power metering once, just like in Tasmota. See [LSPA9 teardown example](https://www.elektroda.com/rtvforum/topic3887748.html). By default, it uses 4800 baud, but you can also enable it with baud 9600 by using 'startDriver BL0942 9600', see [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20957896#20957896)",
+	//drvdetail:"descr":"BL0942 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK. You need to calibrate power metering once, just like in Tasmota. See [LSPA9 teardown example](https://www.elektroda.com/rtvforum/topic3887748.html). By default, it uses 4800 baud, but you can also enable it with baud 9600 by using 'startDriver BL0942 9600', see [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20957896#20957896). Packet is requested once per second, third argument sets request interval in ms, e.g. 'startDriver BL0942 4800 200', packets received between updates are averaged.",
 	//drvdetail:"requires":""}
 	{ "BL0942",                              // Driver Name
 	BL0942_UART_Init,                        // Init
 	BL0942_UART_RunEverySecond,              // onEverySecond
 	BL09XX_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	BL0942_UART_RunQuickTick,                // runQuickTick
+	BL0942_UART_Stop,                        // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
@@ -590,10 +591,10 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "BL0937",                              // Driver Name
 	BL0937_Init,                             // Init
-	BL0937_RunEverySecond,                   // onEverySecond
+	NULL,                                    // onEverySecond
 	BL09XX_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	BL0937_RunQuickTick,                     // runQuickTick
+	BL0937_Shutdown_Pins,                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
@@ -618,14 +619,14 @@ static driver_t g_drivers[] = {
 #if ENABLE_DRIVER_CSE7766
 	//drvdetail:{"name":"CSE7766",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"CSE7766 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK",
+	//drvdetail:"descr":"CSE7766 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK. Chip sends packets on its own every 50ms, all of them are read and averaged between updates.",
 	//drvdetail:"requires":""}
 	{ "CSE7766",                             // Driver Name
 	CSE7766_Init,                            // Init
 	CSE7766_RunEverySecond,                  // onEverySecond
 	BL09XX_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	CSE7766_RunQuickTick,                    // runQuickTick
+	CSE7766_Stop,                            // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
@@ -924,10 +925,10 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "ADCButton",                           // Driver Name
 	DRV_ADCButton_Init,                      // Init
-	NULL,                                    // onEverySecond
+	DRV_ADCButton_OnEverySecond,             // onEverySecond
 	NULL,                                    // appendInformationToHTTPIndexPage
-	DRV_ADCButton_RunFrame,                  // runQuickTick
-	NULL,                                    // stopFunction
+	NULL,                                    // runQuickTick
+	DRV_ADCButton_Stop,                      // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
@@ -1112,8 +1113,8 @@ static driver_t g_drivers[] = {
 	DRV_ADCSmoother_Init,                    // Init
 	NULL,                                    // onEverySecond
 	NULL,                                    // appendInformationToHTTPIndexPage
-	DRV_ADCSmoother_RunFrame,                // runQuickTick
-	NULL,                                    // stopFunction
+	NULL,                                    // runQuickTick
+	DRV_ADCSmoother_Stop,                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
@@ -1208,7 +1209,7 @@ static driver_t g_drivers[] = {
 	DS1820_full_driver_Init,                 // Init
 	DS1820_full_OnEverySecond,               // onEverySecond
 	DS1820_full_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
+	DS1820_full_OnQuickTick,                 // runQuickTick
 	NULL,                                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
@@ -1391,6 +1392,10 @@ static driver_t g_drivers[] = {
 
 
 static const int g_numDrivers = sizeof(g_drivers) / sizeof(g_drivers[0]);
+#if ENABLE_TICK_PROFILER
+// profiler slot + 1 for quick tick and every second, 0 until first call, -1 if table was full
+static short g_driverProfSlots[sizeof(g_drivers) / sizeof(g_drivers[0])][2];
+#endif
 
 bool DRV_IsRunning(const char* name) {
 	int i;
@@ -1423,8 +1428,22 @@ bool DRV_Mutex_Take(int del) {
 void DRV_Mutex_Free() {
 	xSemaphoreGive(g_mutex);
 }
+#if ENABLE_TICK_PROFILER
+static int DRV_GetProfilerSlot(int index, int kind) {
+	int slot;
+
+	if (g_driverProfSlots[index][kind] == 0) {
+		slot = TickProf_GetSlotFor(g_drivers[index].name, kind);
+		g_driverProfSlots[index][kind] = slot < 0 ? -1 : slot + 1;
+	}
+	return g_driverProfSlots[index][kind] - 1;
+}
+#endif
 void DRV_OnEverySecond() {
 	int i;
+#if ENABLE_TICK_PROFILER
+	unsigned int prof;
+#endif
 
 	if (DRV_Mutex_Take(100) == false) {
 		return;
@@ -1432,18 +1451,25 @@ void DRV_OnEverySecond() {
 	for (i = 0; i < g_numDrivers; i++) {
 		if (g_drivers[i].bLoaded) {
 			if (g_drivers[i].onEverySecond != 0) {
+				TICKPROF_START(prof);
 				g_drivers[i].onEverySecond();
+				TICKPROF_MARK(DRV_GetProfilerSlot(i, TICKPROF_KIND_SECOND), prof);
 			}
 		}
 	}
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	// unconditionally run TIME
+	TICKPROF_START(prof);
 	TIME_OnEverySecond();
+	TICKPROF_MARK(TICKPROF_CLOCK_SECOND, prof);
 #endif
 	DRV_Mutex_Free();
 }
 void DRV_RunQuickTick() {
 	int i;
+#if ENABLE_TICK_PROFILER
+	unsigned int prof;
+#endif
 
 	if (DRV_Mutex_Take(0) == false) {
 		return;
@@ -1451,7 +1477,9 @@ void DRV_RunQuickTick() {
 	for (i = 0; i < g_numDrivers; i++) {
 		if (g_drivers[i].bLoaded) {
 			if (g_drivers[i].runQuickTick != 0) {
+				TICKPROF_START(prof);
 				g_drivers[i].runQuickTick();
+				TICKPROF_MARK(DRV_GetProfilerSlot(i, TICKPROF_KIND_QUICK), prof);
 			}
 		}
 	}
@@ -1494,6 +1522,7 @@ void DRV_StopDriver(const char* name) {
 					g_drivers[i].stopFunc();
 				}
 				g_drivers[i].bLoaded = false;
+				JSON_BumpStateVersion();
 				addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Drv %s stopped.", g_drivers[i].name);
 			}
 			else {
@@ -1542,6 +1571,7 @@ void DRV_StartDriver(const char* name) {
 					g_drivers[i].initFunc();
 				}
 				g_drivers[i].bLoaded = true;
+				JSON_BumpStateVersion();
 				addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Started %s.\n", name);
 				bStarted = 1;
 				break;
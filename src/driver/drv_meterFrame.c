@@ -0,0 +1,199 @@
+#include "../obk_config.h"
+
+#if ENABLE_DRIVER_BL0942 || ENABLE_DRIVER_CSE7766
+
+#include "../new_common.h"
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "drv_meterFrame.h"
+#include "drv_uart.h"
+
+const meterFrameType_t g_meterFrameTypes[METERFRAME_TYPES] = {
+	// reply to read of full packet register, checksum covers read command too
+	{ "BL0942", { 0x55 }, 1, 23, METERFRAME_CHECKSUM_SUM8_INV, 0, 0x58 },
+	// sent by chip on its own every 50ms, same as HLW8032
+	{ "CSE7766", { 0x55, 0x5A }, 2, 24, METERFRAME_CHECKSUM_SUM8, 2, 0 },
+};
+
+typedef struct meterFrame_s {
+	const meterFrameType_t *type;
+	meterFrameCallback_t cb;
+	int user;
+	int uartIndex;
+	// bytes of current frame collected so far
+	byte have;
+	byte buf[METERFRAME_LEN_MAX];
+	meterFrameStats_t st;
+} meterFrame_t;
+
+static meterFrame_t g_meterFrames[METERFRAME_MAX_INSTANCES];
+
+static meterFrame_t *MeterFrame_Get(int instance) {
+	if (instance < 0 || instance >= METERFRAME_MAX_INSTANCES)
+		return 0;
+	if (g_meterFrames[instance].type == 0)
+		return 0;
+	return &g_meterFrames[instance];
+}
+
+int MeterFrame_Open(int type, int uartIndex, meterFrameCallback_t cb, int user) {
+	meterFrame_t *f;
+	int i;
+
+	if (type < 0 || type >= METERFRAME_TYPES)
+		return -1;
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		f = &g_meterFrames[i];
+		if (f->type)
+			continue;
+		memset(f, 0, sizeof(*f));
+		f->type = &g_meterFrameTypes[type];
+		f->cb = cb;
+		f->user = user;
+		f->uartIndex = uartIndex;
+		return i;
+	}
+	addLogAdv(LOG_ERROR, LOG_FEATURE_ENERGYMETER, "MeterFrame: no free instance for %s", g_meterFrameTypes[type].name);
+	return -1;
+}
+
+void MeterFrame_Close(int instance) {
+	meterFrame_t *f = MeterFrame_Get(instance);
+
+	if (f)
+		f->type = 0;
+}
+
+const meterFrameStats_t *MeterFrame_GetStats(int instance) {
+	meterFrame_t *f = MeterFrame_Get(instance);
+
+	if (f == 0)
+		return 0;
+	return &f->st;
+}
+
+static int MeterFrame_IsValid(const meterFrameType_t *t, const byte *b) {
+	byte sum = t->checksumSeed;
+	int i;
+
+	for (i = t->checksumFrom; i < t->len - 1; i++) {
+		sum += b[i];
+	}
+	if (t->checksumType == METERFRAME_CHECKSUM_SUM8_INV)
+		sum ^= 0xFF;
+	return sum == b[t->len - 1];
+}
+
+// drops collected bytes up to the next place where header could start
+static void MeterFrame_Resync(meterFrame_t *f, int from) {
+	const meterFrameType_t *t = f->type;
+	int i, j, n;
+
+	for (i = from; i < f->have; i++) {
+		n = f->have - i;
+		if (n > t->headerLen)
+			n = t->headerLen;
+		for (j = 0; j < n; j++) {
+			if (f->buf[i + j] != t->header[j])
+				break;
+		}
+		if (j == n)
+			break;
+	}
+	f->st.garbage += i;
+	f->have -= i;
+	memmove(f->buf, f->buf + i, f->have);
+}
+
+int MeterFrame_Feed(int instance, const byte *data, int len) {
+	meterFrame_t *f = MeterFrame_Get(instance);
+	const meterFrameType_t *t;
+	const byte *start;
+	int n, frames = 0;
+
+	if (f == 0)
+		return 0;
+	t = f->type;
+	while (len > 0) {
+		if (f->have == 0) {
+			// skip to first possible header byte in one go
+			start = memchr(data, t->header[0], len);
+			if (start == 0) {
+				f->st.garbage += len;
+				break;
+			}
+			f->st.garbage += start - data;
+			len -= start - data;
+			data = start;
+		}
+		if (f->have < t->headerLen) {
+			f->buf[f->have++] = *data++;
+			len--;
+			if (f->buf[f->have - 1] != t->header[f->have - 1])
+				MeterFrame_Resync(f, 1);
+			continue;
+		}
+		n = t->len - f->have;
+		if (n > len)
+			n = len;
+		memcpy(f->buf + f->have, data, n);
+		f->have += n;
+		data += n;
+		len -= n;
+		if (f->have < t->len)
+			break;
+		if (MeterFrame_IsValid(t, f->buf) == 0) {
+			f->st.badChecksums++;
+			addLogAdv(LOG_DEBUG, LOG_FEATURE_ENERGYMETER, "MeterFrame: %s bad checksum %02X", t->name, f->buf[t->len - 1]);
+			// frame may have been cut short, next header can be inside
+			MeterFrame_Resync(f, 1);
+			continue;
+		}
+		f->have = 0;
+		f->st.frames++;
+		frames++;
+		if (f->cb)
+			f->cb(instance, f->buf, f->user);
+	}
+	return frames;
+}
+
+int MeterFrame_Poll(int instance) {
+	meterFrame_t *f = MeterFrame_Get(instance);
+	byte *span;
+	int n, frames = 0;
+
+	if (f == 0)
+		return 0;
+	// at most two spans, before and after ring wrap
+	while ((n = UART_GetDataSpanEx(f->uartIndex, &span)) > 0) {
+		frames += MeterFrame_Feed(instance, span, n);
+		UART_ConsumeBytesEx(f->uartIndex, n);
+	}
+	return frames;
+}
+
+static commandResult_t CMD_MeterFrames(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	meterFrame_t *f;
+	int i;
+
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		f = MeterFrame_Get(i);
+		if (f == 0)
+			continue;
+		ADDLOG_INFO(LOG_FEATURE_ENERGYMETER, "MeterFrame %i: %s on UART %i, frames %u, bad checksums %u, garbage %u",
+			i, f->type->name, f->uartIndex, f->st.frames, f->st.badChecksums, f->st.garbage);
+	}
+	return CMD_RES_OK;
+}
+
+void MeterFrame_AddCommands() {
+	//cmddetail:{"name":"meterFrames","args":"",
+	//cmddetail:"descr":"Prints energy meter UART framing stats: valid frames, frames with bad checksum and skipped bytes, for every meter driver instance.",
+	//cmddetail:"fn":"CMD_MeterFrames","file":"driver/drv_meterFrame.c","requires":"",
+	//cmddetail:"examples":"meterFrames"}
+	CMD_RegisterCommand("meterFrames", CMD_MeterFrames, NULL);
+}
+
+// close ENABLE_DRIVER_BL0942 || ENABLE_DRIVER_CSE7766
+#endif
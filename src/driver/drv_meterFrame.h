@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../new_common.h"
+
+// Framing of fixed length packets sent by energy meter chips over UART.
+// Frame types are described in a table (header bytes, length, checksum),
+// every open instance reassembles frames of one type from one UART ring.
+// Bytes are taken in bulk ring spans, parser resyncs on the next header
+// after garbage, truncated frames and bad checksums without losing frames
+// that follow. Drivers poll their instances from QuickTick, so all frames
+// are seen at the rate meter sends them.
+
+#ifndef METERFRAME_MAX_INSTANCES
+#define METERFRAME_MAX_INSTANCES	4
+#endif
+#define METERFRAME_HEADER_MAX		2
+#define METERFRAME_LEN_MAX			32
+
+// frame types, index of g_meterFrameTypes
+#define METERFRAME_BL0942			0
+#define METERFRAME_CSE7766			1
+#define METERFRAME_TYPES			2
+
+// 8 bit sum of bytes from checksumFrom up to the last one, starting with seed
+#define METERFRAME_CHECKSUM_SUM8		0
+// as above, inverted
+#define METERFRAME_CHECKSUM_SUM8_INV	1
+
+typedef struct meterFrameType_s {
+	const char *name;
+	byte header[METERFRAME_HEADER_MAX];
+	byte headerLen;
+	// whole frame, with header and checksum byte
+	byte len;
+	byte checksumType;
+	byte checksumFrom;
+	byte checksumSeed;
+} meterFrameType_t;
+
+typedef struct meterFrameStats_s {
+	unsigned int frames;
+	unsigned int badChecksums;
+	// bytes skipped while looking for header
+	unsigned int garbage;
+} meterFrameStats_t;
+
+// frame points to len bytes starting with header, valid only during callback
+typedef void (*meterFrameCallback_t)(int instance, const byte *frame, int user);
+
+extern const meterFrameType_t g_meterFrameTypes[METERFRAME_TYPES];
+
+/// @brief Start reassembling frames of given type from UART port, see UART_PORT_INDEX_*.
+/// @return instance index or -1 if table is full
+int MeterFrame_Open(int type, int uartIndex, meterFrameCallback_t cb, int user);
+/// @brief Negative instance is ignored.
+void MeterFrame_Close(int instance);
+/// @brief Feed raw bytes, callback is called for every valid frame.
+/// @return number of valid frames
+int MeterFrame_Feed(int instance, const byte *data, int len);
+/// @brief Drain UART ring of instance through MeterFrame_Feed.
+/// @return number of valid frames
+int MeterFrame_Poll(int instance);
+const meterFrameStats_t *MeterFrame_GetStats(int instance);
+void MeterFrame_AddCommands();
@@ -12,9 +12,11 @@
 #include "../httpserver/new_http.h"
 #include "../logging/logging.h"
 #include "../hal/hal_ota.h"
+#include "lwip/sockets.h"
 #include "drv_deviceclock.h"	// for TIME_Init()
 #include "../libraries/obktime/obktime.h"	// for time functions
 #include "drv_ntp.h"
+#include "../quicktick.h"
 
 #define LOG_FEATURE LOG_FEATURE_NTP
 
@@ -48,24 +50,62 @@ typedef struct
 
 } ntp_packet;              // Total: 384 bits or 48 bytes.
 
-#define MAKE_WORD(hi, lo) hi << 8 | lo
-
 // NTP time since 1900 to unix time (since 1970)
 // Number of seconds to ad
 #define NTP_OFFSET 2208988800L
 
-static int g_ntp_socket = 0;
-static struct sockaddr_in g_address;
-static int adrLen;
-// in seconds, before next retry
+// up to this many servers, first one is stored in config, others only in RAM
+#define NTP_MAX_SERVERS 3
+#define NTP_PORT 123
+// no reply in that time means server is not reachable
+#define NTP_REPLY_TIMEOUT_MS 3000
+// replies with longer round trip are not trusted
+#define NTP_MAX_DELAY_MS 1000
+// clock may drift that much before we ask again
+#define NTP_MAX_ERROR_MS 100
+// never wait longer than 4 hours between requests
+#define NTP_POLL_MAX 14400
+// reference of the local millisecond clock is moved forward that often, so g_timeMs may wrap
+#define NTP_REBASE_MS (3600 * 1000)
+
+static int g_ntp_socket = -1;
+// extra servers, [0] is from config
+static char g_ntpServers[NTP_MAX_SERVERS - 1][32];
+// last 8 attempts for each server, bit set if answered
+static byte g_ntpReach[NTP_MAX_SERVERS];
+static int g_ntpServerIndex = 0;
+// how many attempts failed since last good reply
+static int g_ntpFailures = 0;
+// in seconds, before next request
 static int g_ntp_delay = 0;
+// current poll interval, adapts between g_ntp_syncinterval and NTP_POLL_MAX
+static int g_ntpPollSeconds = 60;
 static bool g_synced = false;
+// outstanding request
+static bool g_ntpWaiting = false;
+static unsigned int g_ntpSendTick;
+static uint64_t g_ntpT1;
+static uint32_t g_ntpT1_s, g_ntpT1_f;
+static struct sockaddr_in g_ntpRequestAddr;
+// UTC milliseconds at g_timeMs == g_ntpRefTick
+static uint64_t g_ntpRefUnixMs = 0;
+static unsigned int g_ntpRefTick;
+static bool g_ntpHasRef = false;
+// UTC milliseconds of last good sync, and results of it
+static uint64_t g_ntpLastSyncMs = 0;
+static int g_ntpLastOffsetMs = 0;
+static int g_ntpLastDelayMs = 0;
+// estimated drift of local clock, in parts per million
+static int g_ntpDriftPPM = 0;
+static int g_ntpDriftSamples = 0;
+static int g_ntpRequests = 0;
 // time offset (time zone?) in seconds
 //#define CFG_DEFAULT_TIMEOFFSETSECONDS (-8 * 60 * 60)
 static int g_timeOffsetSeconds = 0;
 // current time - this may be 32 or 64 bit, depending on platform
 // don't use as global variable, use functions to access and manipulate "clock" in "drv_deviceclock.c"
 time_t g_ntpTime;
+// minimal poll interval, in seconds
 static unsigned int g_ntp_syncinterval=60;
 
 int NTP_GetTimesZoneOfsSeconds()
@@ -85,9 +125,33 @@ void NTP_SetTimesZoneOfsSeconds(int o) {
 }
 
 
-//Set custom NTP server
+static const char *NTP_GetServer(int i) {
+	const char *adrString;
+
+	if (i > 0)
+		return g_ntpServers[i - 1];
+	adrString = CFG_GetNTPServer();
+	if (adrString == 0 || adrString[0] == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP: somehow ntp server in config was empty, setting non-empty");
+		CFG_SetNTPServer(DEFAULT_NTP_SERVER);
+		adrString = CFG_GetNTPServer();
+	}
+	return adrString;
+}
+static int NTP_GetServersCount() {
+	int i;
+
+	for (i = 1; i < NTP_MAX_SERVERS; i++) {
+		if (g_ntpServers[i - 1][0] == 0)
+			break;
+	}
+	return i;
+}
+
+//Set custom NTP server, and optional backup servers
 commandResult_t NTP_SetServer(const void *context, const char *cmd, const char *args, int cmdFlags) {
     const char *newValue;
+    int i;
 
     Tokenizer_TokenizeString(args,0);
 	// following check must be done after 'Tokenizer_TokenizeString',
@@ -99,12 +163,31 @@ commandResult_t NTP_SetServer(const void *context, const char *cmd, const char *
     newValue = Tokenizer_GetArg(0);
     CFG_SetNTPServer(newValue);
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP server set to %s", newValue);
+    for (i = 1; i < NTP_MAX_SERVERS; i++) {
+        g_ntpServers[i - 1][0] = 0;
+        if (i < Tokenizer_GetArgsCount()) {
+            strcpy_safe(g_ntpServers[i - 1], Tokenizer_GetArg(i), sizeof(g_ntpServers[i - 1]));
+        }
+        if (g_ntpServers[i - 1][0]) {
+            addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP backup server %i set to %s", i, g_ntpServers[i - 1]);
+        }
+    }
+    memset(g_ntpReach, 0, sizeof(g_ntpReach));
+    g_ntpServerIndex = 0;
     return CMD_RES_OK;
 }
 
 //Display settings used by the NTP driver
 commandResult_t NTP_Info(const void *context, const char *cmd, const char *args, int cmdFlags) {
+    int i;
+
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Server=%s, Time offset=%d", CFG_GetNTPServer(), TIME_GetTimesZoneOfsSeconds());
+    for (i = 0; i < NTP_GetServersCount(); i++) {
+        addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Server %i: %s, reach 0x%02X%s", i, NTP_GetServer(i), g_ntpReach[i],
+            i == g_ntpServerIndex ? " (current)" : "");
+    }
+    addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Offset %i ms, delay %i ms, drift %i ppm, poll %i s, requests %i",
+        g_ntpLastOffsetMs, g_ntpLastDelayMs, g_ntpDriftPPM, g_ntpPollSeconds, g_ntpRequests);
     return CMD_RES_OK;
 }
 
@@ -134,8 +217,8 @@ void NTP_Init() {
 	//cmddetail:"fn":"SetTimeZoneOfs","file":"driver/drv_ntp.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("ntp_timeZoneOfs",SetTimeZoneOfs, NULL);
-	//cmddetail:{"name":"ntp_setServer","args":"[ServerIP]",
-	//cmddetail:"descr":"Sets the NTP server",
+	//cmddetail:{"name":"ntp_setServer","args":"[ServerIP] [OptionalBackupServerIP] [OptionalBackupServerIP2]",
+	//cmddetail:"descr":"Sets the NTP server. Backup servers are tried when previous one does not answer, they are not saved in config. IP may be followed by :port.",
 	//cmddetail:"fn":"NTP_SetServer","file":"driver/drv_ntp.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("ntp_setServer", NTP_SetServer, NULL);
@@ -146,14 +229,35 @@ void NTP_Init() {
     CMD_RegisterCommand("ntp_info", NTP_Info, NULL);
     
     g_ntp_syncinterval = Tokenizer_GetArgIntegerDefault(1, 60);
+    g_ntpPollSeconds = g_ntp_syncinterval;
+    g_ntp_delay = 0;
+    g_ntpFailures = 0;
+    g_ntpWaiting = false;
+    g_ntpHasRef = false;
+    g_ntpLastSyncMs = 0;
+    g_ntpDriftPPM = 0;
+    g_ntpDriftSamples = 0;
+    g_ntpRequests = 0;
 
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP driver initialized with server=%s, offset=%d, syncing every %i seconds", CFG_GetNTPServer(), g_timeOffsetSeconds, g_ntp_syncinterval);
     g_synced = false;
 }
 
 // if driver is stopped, we need to make sure, we don't keep NTP in state "synched"
+void NTP_Shutdown() {
+    if(g_ntp_socket >= 0) {
+#if WINDOWS
+        closesocket(g_ntp_socket);
+#else
+        lwip_close(g_ntp_socket);
+#endif
+    }
+    g_ntp_socket = -1;
+    g_ntpWaiting = false;
+}
 void NTP_Stop() {
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP driver stopped");
+    NTP_Shutdown();
     g_synced = false;
 }
 
@@ -166,164 +270,251 @@ unsigned int NTP_GetCurrentTimeWithoutOffset() {
 }
 
 
-
-void NTP_Shutdown() {
-    if(g_ntp_socket != 0) {
-#if WINDOWS
-        closesocket(g_ntp_socket);
-#else
-        lwip_close(g_ntp_socket);
-#endif
-    }
-    g_ntp_socket = 0;
-    // can attempt in next 10 seconds
-    g_ntp_delay = g_ntp_syncinterval-1;
+// UTC milliseconds, local clock (g_timeMs) corrected by last NTP reply
+static uint64_t NTP_GetLocalMs() {
+	if (g_ntpHasRef == false) {
+		// start from whatever device clock says
+		g_ntpRefUnixMs = (uint64_t)TIME_GetCurrentTimeWithoutOffset() * 1000;
+		g_ntpRefTick = g_timeMs;
+		g_ntpHasRef = true;
+	}
+	return g_ntpRefUnixMs + (unsigned int)(g_timeMs - g_ntpRefTick);
 }
-void NTP_SendRequest(bool bBlocking) {
-    byte *ptr;
-	const char *adrString;
-    //int i, recv_len;
-    //char buf[64];
-    ntp_packet packet = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-    adrLen = sizeof(g_address);
-    memset( &packet, 0, sizeof( ntp_packet ) );
-    ptr = (byte*)&packet;
-    // Initialize values needed to form NTP request
-    // (see URL above for details on the packets)
-    ptr[0] = 0xE3;   // LI, Version, Mode
-    ptr[1] = 0;     // Stratum, or type of clock
-    ptr[2] = 6;     // Polling Interval
-    ptr[3] = 0xEC;  // Peer Clock Precision
-    // 8 bytes of zero for Root Delay & Root Dispersion
-    ptr[12]  = 49;
-    ptr[13]  = 0x4E;
-    ptr[14]  = 49;
-    ptr[15]  = 52;
-
-
-    //create a UDP socket
-    if ((g_ntp_socket=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP )) == -1)
-    {
-        g_ntp_socket = 0;
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: failed to create socket");
-        return;
-    }
-
-    memset((char *) &g_address, 0, sizeof(g_address));
+uint64_t NTP_GetCurrentTimeMsWithoutOffset() {
+	if (g_synced == false)
+		return 0;
+	return NTP_GetLocalMs();
+}
+static void NTP_MsToStamp(uint64_t ms, uint32_t *s, uint32_t *f) {
+	*s = (uint32_t)(ms / 1000 + NTP_OFFSET);
+	*f = (uint32_t)(((ms % 1000) << 32) / 1000);
+}
+static uint64_t NTP_StampToMs(uint32_t s, uint32_t f) {
+	uint64_t secs = s;
 
-	adrString = CFG_GetNTPServer();
-	if (adrString == 0 || adrString[0] == 0) {
-		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: somehow ntp server in config was empty, setting non-empty");
-		CFG_SetNTPServer(DEFAULT_NTP_SERVER);
-		adrString = CFG_GetNTPServer();
+	// RFC 4330 - with MSB clear, time is after 2036
+	if ((s & 0x80000000) == 0)
+		secs += 0x100000000ULL;
+	return (secs - NTP_OFFSET) * 1000 + (((uint64_t)f * 1000) >> 32);
+}
+static bool NTP_ParseServer(const char *adrString, struct sockaddr_in *adr) {
+	char host[32];
+	char *port;
+
+	strcpy_safe(host, adrString, sizeof(host));
+	memset(adr, 0, sizeof(*adr));
+	adr->sin_family = AF_INET;
+	adr->sin_port = htons(NTP_PORT);
+	port = strchr(host, ':');
+	if (port) {
+		*port = 0;
+		adr->sin_port = htons(atoi(port + 1));
 	}
-
-    g_address.sin_family = AF_INET;
-    g_address.sin_addr.s_addr = inet_addr(adrString);
-    g_address.sin_port = htons(123);
-
-
-    // Send the message to server:
-    if(sendto(g_ntp_socket, &packet, sizeof(packet), 0,
-         (struct sockaddr*)&g_address, adrLen) < 0) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: Unable to send message");
-        NTP_Shutdown();
-		// quick next frame attempt
+	adr->sin_addr.s_addr = inet_addr(host);
+	return adr->sin_addr.s_addr != INADDR_NONE;
+}
+static bool NTP_OpenSocket() {
+	if (g_ntp_socket >= 0)
+		return true;
+	if ((g_ntp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		g_ntp_socket = -1;
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: failed to create socket");
+		return false;
+	}
+	if (lwip_fcntl(g_ntp_socket, F_SETFL, O_NONBLOCK)) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: failed to make socket non-blocking!");
+	}
+	return true;
+}
+// server did not answer, try next one soon, or wait full interval after all failed
+static void NTP_OnFailure() {
+	int count = NTP_GetServersCount();
+
+	g_ntpWaiting = false;
+	g_ntpReach[g_ntpServerIndex] <<= 1;
+	g_ntpFailures++;
+	g_ntpServerIndex = (g_ntpServerIndex + 1) % count;
+	if (g_ntpFailures % count) {
+		g_ntp_delay = 1;
+	}
+	else {
+		g_ntp_delay = g_ntp_syncinterval - 1;
+		// quick next attempt
 		if (g_secondsElapsed < 60) {
 			g_ntp_delay = 0;
 		}
-        return;
-    }
+	}
+}
+void NTP_SendRequest() {
+	ntp_packet packet;
+	const char *adrString;
 
-    // https://github.com/tuya/tuya-iotos-embeded-sdk-wifi-ble-bk7231t/blob/5e28e1f9a1a9d88425f3fd4b658e895a8ee7b83b/platforms/bk7231t/tuya_os_adapter/src/system/tuya_hal_network.c
-    //
-    if(bBlocking == false) {
-#if WINDOWS
-#else
-        if(fcntl(g_ntp_socket, F_SETFL, O_NONBLOCK)) {
-            addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: failed to make socket non-blocking!");
-        }
-#endif
-    }
+	if (NTP_OpenSocket() == false) {
+		g_ntp_delay = g_ntp_syncinterval - 1;
+		return;
+	}
+	adrString = NTP_GetServer(g_ntpServerIndex);
+	if (NTP_ParseServer(adrString, &g_ntpRequestAddr) == false) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: bad server address %s", adrString);
+		NTP_OnFailure();
+		return;
+	}
 
-    // can attempt in next 10 seconds
-    g_ntp_delay = 10;
+	memset(&packet, 0, sizeof(ntp_packet));
+	// Initialize values needed to form NTP request
+	// (see URL above for details on the packets)
+	packet.li_vn_mode = 0xE3;   // LI, Version, Mode
+	packet.stratum = 0;     // Stratum, or type of clock
+	packet.poll = 6;     // Polling Interval
+	packet.precision = 0xEC;  // Peer Clock Precision
+	// our time goes into transmit timestamp, server returns it as originate timestamp
+	g_ntpT1 = NTP_GetLocalMs();
+	NTP_MsToStamp(g_ntpT1, &g_ntpT1_s, &g_ntpT1_f);
+	packet.txTm_s = htonl(g_ntpT1_s);
+	packet.txTm_f = htonl(g_ntpT1_f);
+
+	if (sendto(g_ntp_socket, (const char*)&packet, sizeof(packet), 0,
+		(struct sockaddr*)&g_ntpRequestAddr, sizeof(g_ntpRequestAddr)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: Unable to send message to %s", adrString);
+		// socket may be broken after network change, make new one next time
+		NTP_Shutdown();
+		NTP_OnFailure();
+		return;
+	}
+	g_ntpRequests++;
+	g_ntpWaiting = true;
+	g_ntpSendTick = g_timeMs;
 }
-void NTP_CheckForReceive() {
-    byte *ptr;
-    int i, recv_len;
-    //struct tm * ptm;
-    unsigned short highWord;
-    unsigned short lowWord;
-    unsigned int secsSince1900;
-    struct tm *ltm;
-    ntp_packet packet = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-    ptr = (byte*)&packet;
-
-    // Receive the server's response:
-    i = sizeof(packet);
-#if 0
-    recv_len = recvfrom(g_ntp_socket, ptr, i, 0,
-         (struct sockaddr*)&g_address, &adrLen);
-#else
-    recv_len = recv(g_ntp_socket, ptr, i, 0);
-#endif
-
-    if(recv_len < 0){
-			addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_CheckForReceive: Error while receiving server's msg");
-        return;
-    }
-    highWord = MAKE_WORD(ptr[40], ptr[41]);
-    lowWord = MAKE_WORD(ptr[42], ptr[43]);
-    // combine the four bytes (two words) into a long integer
-    // this is NTP time (seconds since Jan 1 1900):
-    secsSince1900 = highWord << 16 | lowWord;
-    addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"Seconds since Jan 1 1900 = %u",secsSince1900);
+// adapt poll interval, so that clock does not drift more than NTP_MAX_ERROR_MS between requests
+static void NTP_AdaptPollInterval(int offsetMs, bool bFirst) {
+	int poll;
 
-/*
-    g_ntpTime = secsSince1900 - NTP_OFFSET;
-    g_ntpTime += g_timeOffsetSeconds;
-*/
-   TIME_setDeviceTime((uint32_t) (secsSince1900 - NTP_OFFSET) );
-//    g_ntpTime=(time_t)TIME_GetCurrentTime();
-    addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"Unix time  : %u - local Time %s",(uint32_t) (secsSince1900 - NTP_OFFSET),TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_LONG));
-//    ltm = gmtime(&g_ntpTime);
-//    addLogAdv(LOG_INFO, LOG_FEATURE_NTP, LTSTR, LTM2TIME(ltm));
+	if (bFirst || abs(offsetMs) > NTP_MAX_ERROR_MS) {
+		g_ntpPollSeconds = g_ntp_syncinterval;
+		return;
+	}
+	poll = g_ntpPollSeconds * 2;
+	// seconds until drift adds up to NTP_MAX_ERROR_MS
+	if (g_ntpDriftPPM && NTP_MAX_ERROR_MS * 1000 / abs(g_ntpDriftPPM) < poll) {
+		poll = NTP_MAX_ERROR_MS * 1000 / abs(g_ntpDriftPPM);
+	}
+	if (poll > NTP_POLL_MAX)
+		poll = NTP_POLL_MAX;
+	if (poll < (int)g_ntp_syncinterval)
+		poll = g_ntp_syncinterval;
+	g_ntpPollSeconds = poll;
+}
+static void NTP_ProcessReply(const ntp_packet *packet) {
+	uint64_t t2, t3, t4, now;
+	int64_t offsetMs;
+	int delayMs, sinceLast, drift;
+	bool bFirst;
+
+	t4 = NTP_GetLocalMs();
+	t2 = NTP_StampToMs(ntohl(packet->rxTm_s), ntohl(packet->rxTm_f));
+	t3 = NTP_StampToMs(ntohl(packet->txTm_s), ntohl(packet->txTm_f));
+	// first sync may be off by decades
+	offsetMs = ((int64_t)(t2 - g_ntpT1) + (int64_t)(t3 - t4)) / 2;
+	delayMs = (int)((int64_t)(t4 - g_ntpT1) - (int64_t)(t3 - t2));
+	if (delayMs < 0)
+		delayMs = 0;
+	if (delayMs > NTP_MAX_DELAY_MS) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP: reply from %s took %i ms, ignored", NTP_GetServer(g_ntpServerIndex), delayMs);
+		NTP_OnFailure();
+		return;
+	}
+	g_ntpWaiting = false;
+	g_ntpReach[g_ntpServerIndex] = (g_ntpReach[g_ntpServerIndex] << 1) | 1;
+	g_ntpFailures = 0;
+
+	// drift is only known when clock was set by previous reply, and after a while
+	bFirst = g_synced == false || g_ntpLastSyncMs == 0;
+	if (bFirst || offsetMs > NTP_MAX_ERROR_MS || offsetMs < -NTP_MAX_ERROR_MS) {
+		// estimate was wrong (or there was none), learn again from next replies
+		g_ntpDriftSamples = 0;
+	}
+	else {
+		sinceLast = (int)((t4 - g_ntpLastSyncMs) / 1000);
+		if (sinceLast >= 30) {
+			drift = (int)(offsetMs * 1000 / sinceLast);
+			// first estimate as is, then smoothed
+			if (g_ntpDriftSamples++ == 0)
+				g_ntpDriftPPM = drift;
+			else
+				g_ntpDriftPPM = (g_ntpDriftPPM * 3 + drift) / 4;
+		}
+	}
+	g_ntpLastOffsetMs = (int)(offsetMs > INT_MAX ? INT_MAX : (offsetMs < INT_MIN ? INT_MIN : offsetMs));
+
+	// move local clock
+	now = t4 + offsetMs;
+	g_ntpRefUnixMs = now;
+	g_ntpRefTick = g_timeMs;
+	g_ntpLastSyncMs = now;
+	g_ntpLastDelayMs = delayMs;
+	TIME_setDeviceTime((uint32_t)(now / 1000));
+	NTP_AdaptPollInterval(g_ntpLastOffsetMs, bFirst);
+	g_ntp_delay = g_ntpPollSeconds - 1;
+
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP %s: offset %i ms, delay %i ms, drift %i ppm, next in %i s",
+		NTP_GetServer(g_ntpServerIndex), g_ntpLastOffsetMs, delayMs, g_ntpDriftPPM, g_ntpPollSeconds);
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"Unix time  : %u - local Time %s",(uint32_t)(now / 1000),TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_LONG));
 
 	if (g_synced == false) {
 		EventHandlers_FireEvent(CMD_EVENT_NTP_STATE, 1);
 		// so now clock is synced. If it wasn't set before, start "TIME_Init()" for timed events
 		// done in CMD_Init_Delayed()  in cmd_main.c
-//		if (! TIME_IsTimeSynced() ) TIME_Init();
 	}
-    g_synced = true;
-#if 0
-    //ptm = gmtime (&g_ntpTime);
-    ptm = gmtime(&g_ntpTime);
-    if(ptm == 0) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime somehow returned 0\n");
-    } else {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_year: %i\n",ptm->tm_year);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_mon: %i\n",ptm->tm_mon);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_mday: %i\n",ptm->tm_mday);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_hour: %i\n",ptm->tm_hour  );
-    }
-#endif
-    NTP_Shutdown();
-
+	g_synced = true;
+}
+void NTP_CheckForReceive() {
+	ntp_packet packet;
+	struct sockaddr_in from;
+	socklen_t fromLen;
+	int recv_len;
+
+	while (g_ntpWaiting) {
+		fromLen = sizeof(from);
+		recv_len = recvfrom(g_ntp_socket, (char*)&packet, sizeof(packet), 0,
+			(struct sockaddr*)&from, &fromLen);
+		if (recv_len < 0) {
+			// nothing yet
+			return;
+		}
+		// drop anything that is not an answer to our last request
+		if (recv_len < (int)sizeof(packet)
+			|| from.sin_addr.s_addr != g_ntpRequestAddr.sin_addr.s_addr
+			|| from.sin_port != g_ntpRequestAddr.sin_port
+			|| (packet.li_vn_mode & 0x07) != 4
+			|| ntohl(packet.origTm_s) != g_ntpT1_s
+			|| ntohl(packet.origTm_f) != g_ntpT1_f) {
+			addLogAdv(LOG_DEBUG, LOG_FEATURE_NTP, "NTP_CheckForReceive: ignored packet of %i bytes", recv_len);
+			continue;
+		}
+		// stratum 0 is kiss-o'-death, server wants us to go away
+		if (packet.stratum == 0) {
+			addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_CheckForReceive: %s refused us", NTP_GetServer(g_ntpServerIndex));
+			NTP_OnFailure();
+			return;
+		}
+		NTP_ProcessReply(&packet);
+	}
 }
 
-void NTP_SendRequest_BlockingMode() {
-    NTP_Shutdown();
-    NTP_SendRequest(true);
-    NTP_CheckForReceive();
-
+void NTP_RunQuickTick() {
+	// reply is picked up as soon as it arrives, so its time is measured well
+	if (g_ntpWaiting) {
+		NTP_CheckForReceive();
+	}
 }
 
 void NTP_OnEverySecond()
 {
-
+    // keep g_timeMs distance small
+    if (g_ntpHasRef && (unsigned int)(g_timeMs - g_ntpRefTick) > NTP_REBASE_MS) {
+        g_ntpRefUnixMs += (unsigned int)(g_timeMs - g_ntpRefTick);
+        g_ntpRefTick = g_timeMs;
+    }
     if(Main_IsConnectedToWiFi()==0)
     {
         return;
@@ -337,24 +528,29 @@ void NTP_OnEverySecond()
     {
         return;
     }
-    if(g_ntp_socket == 0) {
-        // if no socket, this is a reconnect delay
-        if(g_ntp_delay > 0) {
-            g_ntp_delay--;
-            return;
-        }
-        NTP_SendRequest(false);
-    } else {
+    if (g_ntpWaiting) {
         NTP_CheckForReceive();
-        // if socket exists, this is a disconnect timeout
-        if(g_ntp_delay > 0) {
-            g_ntp_delay--;
-            if(g_ntp_delay<=0) {
-                // disconnect and force reconnect
-                NTP_Shutdown();
-            }
+        if (g_ntpWaiting && (unsigned int)(g_timeMs - g_ntpSendTick) > NTP_REPLY_TIMEOUT_MS) {
+            addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP: no reply from %s", NTP_GetServer(g_ntpServerIndex));
+            NTP_OnFailure();
         }
+        return;
+    }
+    if(g_ntp_delay > 0) {
+        g_ntp_delay--;
+        return;
     }
+    NTP_SendRequest();
+}
+
+int NTP_GetPollInterval() {
+	return g_ntpPollSeconds;
+}
+int NTP_GetDriftPPM() {
+	return g_ntpDriftPPM;
+}
+int NTP_GetCurrentServerIndex() {
+	return g_ntpServerIndex;
 }
 
 void NTP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
@@ -9,11 +9,18 @@
 void NTP_Init();
 void NTP_Stop();
 void NTP_OnEverySecond();
+void NTP_RunQuickTick();
 // returns number of seconds passed after 1900
 unsigned int NTP_GetCurrentTime();
 unsigned int NTP_GetCurrentTimeWithoutOffset();
 void NTP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState);
 bool NTP_IsTimeSynced();
+// UTC time in milliseconds since 1970, or 0 if not synced
+uint64_t NTP_GetCurrentTimeMsWithoutOffset();
+// current poll interval in seconds, adapted to measured drift
+int NTP_GetPollInterval();
+int NTP_GetDriftPPM();
+int NTP_GetCurrentServerIndex();
 int NTP_GetTimesZoneOfsSeconds();
 void NTP_SetTimesZoneOfsSeconds(int o);
 // for Simulator only, on Windows, for unit testing
@@ -12,7 +12,7 @@
 #include "../logging/logging.h"
 #include "drv_local.h"
 #include "../hal/hal_pins.h"
-#include <math.h>
+#include "../quicktick.h"
 
 /*
 // Usage:
@@ -49,23 +49,107 @@ byte *RainbowWheel_Wheel(byte WheelPosition) {
 uint16_t j = 0;
 uint16_t count = 0;
 int direction = 1;
+
+// Effects render into local RGBCW frame (5 bytes per pixel) with palette
+// lookups and 8 bit scaling, brightness and channel order are applied
+// when whole frame goes to strip, see Strip_setFrame.
+#define PA_BPP 5
+#define scale8(x, scale) ((byte)(((uint32_t)(x) * (uint32_t)(scale)) >> 8))
+
+static byte *pa_frame = 0;
+static int pa_frameSize = 0;
+// built once from RainbowWheel_Wheel and heat color ramp
+static byte pa_rainbow[256][3];
+static byte pa_heat[256][3];
+static bool pa_palettesReady = false;
+
+static void PA_BuildPalettes() {
+	byte *c;
+	int i, t192, heatramp;
+
+	for (i = 0; i < 256; i++) {
+		c = RainbowWheel_Wheel(i);
+		pa_rainbow[i][0] = c[0];
+		pa_rainbow[i][1] = c[1];
+		pa_rainbow[i][2] = c[2];
+
+		// Rescale heat from 0-255 to 0-191
+		t192 = (i * 191 + 127) / 255;
+		// Calculate ramp up from
+		heatramp = t192 & 0x3F; // 0...63
+		heatramp <<= 2; // scale up to 0...252
+		// Figure out which third of the spectrum we're in:
+		if (t192 > 0x80) {                    // hottest
+			pa_heat[i][0] = 255;
+			pa_heat[i][1] = 255;
+			pa_heat[i][2] = heatramp;
+		}
+		else if (t192 > 0x40) {               // middle
+			pa_heat[i][0] = 255;
+			pa_heat[i][1] = heatramp;
+			pa_heat[i][2] = 0;
+		}
+		else {                               // coolest
+			pa_heat[i][0] = heatramp;
+			pa_heat[i][1] = 0;
+			pa_heat[i][2] = 0;
+		}
+	}
+	pa_palettesReady = true;
+}
+static bool PA_EnsureFrame() {
+	int bytes = pixel_count * PA_BPP;
+
+	if (bytes <= pa_frameSize)
+		return pa_frame != 0;
+	os_free(pa_frame);
+	pa_frame = (byte*)os_malloc(bytes);
+	if (pa_frame == 0) {
+		pa_frameSize = 0;
+		return false;
+	}
+	pa_frameSize = bytes;
+	memset(pa_frame, 0, bytes);
+	return true;
+}
+static inline void PA_SetPixel(int pixel, byte r, byte g, byte b, byte c, byte w) {
+	byte *p;
+
+	if (pixel < 0 || pixel >= pixel_count)
+		return;
+	p = pa_frame + pixel * PA_BPP;
+	p[0] = r;
+	p[1] = g;
+	p[2] = b;
+	p[3] = c;
+	p[4] = w;
+}
+static inline void PA_SetPixelRGB(int pixel, const byte *rgb) {
+	PA_SetPixel(pixel, rgb[0], rgb[1], rgb[2], 0, 0);
+}
+static void PA_SetPixelBase(int pixel) {
+	PA_SetPixel(pixel, led_baseColors[0], led_baseColors[1], led_baseColors[2], led_baseColors[3], led_baseColors[4]);
+}
 void fadeToBlackBy(uint8_t fadeBy)
 {
-	Strip_scaleAllPixels(255-fadeBy);
+	int scale = 255 - fadeBy;
+	int i, n = pixel_count * PA_BPP;
+
+	for (i = 0; i < n; i++) {
+		pa_frame[i] = scale8(pa_frame[i], scale);
+	}
 }
 void ShootingStar_Run() {
 	int tail_length = 32;
 	if (direction == -1) {        // Reverse direction option for LEDs
 		if (count < pixel_count) {
-			Strip_setPixelWithBrig(pixel_count - (count % (pixel_count + 1)),
-				led_baseColors[0], led_baseColors[1], led_baseColors[2], led_baseColors[3], led_baseColors[4]);    // Set LEDs with the color value
+			PA_SetPixelBase(pixel_count - (count % (pixel_count + 1)));    // Set LEDs with the color value
 		}
 		count++;
 	}
 	else {
 		if (count < pixel_count) {     // Forward direction option for LEDs
-			Strip_setPixelWithBrig(count % pixel_count,
-				led_baseColors[0], led_baseColors[1], led_baseColors[2], led_baseColors[3], led_baseColors[4]);    // Set LEDs with the color value
+			PA_SetPixelBase(count % pixel_count);    // Set LEDs with the color value
 		}
 		count++;
 	}
@@ -73,40 +157,22 @@ void ShootingStar_Run() {
 		count = 0;
 	}
 	fadeToBlackBy(tail_length);                 // Fade the tail LEDs to black
-	Strip_Apply();
 }
 void RainbowCycle_Run() {
-	byte *c;
+	uint32_t pos, step;
 	uint16_t i;
 
+	// wheel position in 16.16 fixed point, no division per pixel
+	step = (256 << 16) / pixel_count;
+	pos = j << 16;
 	for (i = 0; i < pixel_count; i++) {
-		c = RainbowWheel_Wheel(((i * 256 / pixel_count) + j) & 255);
-		Strip_setPixelWithBrig(pixel_count - 1 - i, *c, *(c + 1), *(c + 2), 0, 0);
+		PA_SetPixelRGB(pixel_count - 1 - i, pa_rainbow[(pos >> 16) & 255]);
+		pos += step;
 	}
-	Strip_Apply();
 	j++;
 	j %= 256;
 }
 
-void Fire_setPixelHeatColor(int Pixel, byte temperature) {
-	// Rescale heat from 0-255 to 0-191
-	byte t192 = round((temperature / 255.0) * 191);
-
-	// Calculate ramp up from
-	byte heatramp = t192 & 0x3F; // 0...63
-	heatramp <<= 2; // scale up to 0...252
-
-	// Figure out which third of the spectrum we're in:
-	if (t192 > 0x80) {                    // hottest
-		Strip_setPixelWithBrig(Pixel, 255, 255, heatramp, 0, 0); // red to yellow
-	}
-	else if (t192 > 0x40) {               // middle
-		Strip_setPixelWithBrig(Pixel, 255, heatramp, 0, 0, 0); // red to yellow
-	}
-	else {                               // coolest
-		Strip_setPixelWithBrig(Pixel, heatramp, 0, 0, 0, 0);
-	}
-}
 // FlameHeight - Use larger value for shorter flames, default=50.
 // Sparks - Use larger value for more ignitions and a more active fire (between 0 to 255), default=100.
 // DelayDuration - Use larger value for slower flame speed, default=10.
@@ -162,10 +228,8 @@ void Fire_Run() {
 
 	// Convert heat to LED colors
 	for (int j = 0; j < pixel_count; j++) {
-		Fire_setPixelHeatColor(j, heat[j]);
+		PA_SetPixelRGB(j, pa_heat[heat[j]]);
 	}
-	Strip_Apply();
-
 }
 static int comet_pos = 0;
 static int comet_dir_local = 1;
@@ -191,35 +255,24 @@ void Comet_Run() {
 
 	fadeToBlackBy(48);
 
-	Strip_setPixelWithBrig(head,
-		led_baseColors[0], led_baseColors[1], led_baseColors[2], led_baseColors[3], led_baseColors[4]);
+	PA_SetPixelBase(head);
 
 	for (int t = 1; t <= tail; t++) {
 		int idx = head - t * comet_dir_local;
 		if (idx < 0 || idx >= pixel_count) continue;
-		float scale = (float)(tail - t) / (float)tail;
-		if (scale < 0) scale = 0;
-		byte r = (byte)round(led_baseColors[0] * scale);
-		byte g = (byte)round(led_baseColors[1] * scale);
-		byte b = (byte)round(led_baseColors[2] * scale);
-		Strip_setPixelWithBrig(idx, r, g, b, 0, 0);
+		int scale = ((tail - t) * 256 + tail / 2) / tail;
+		PA_SetPixel(idx, scale8(led_baseColors[0], scale), scale8(led_baseColors[1], scale),
+			scale8(led_baseColors[2], scale), 0, 0);
 	}
-
-	Strip_Apply();
 }
 static int chase_pos = 0;
 
 void TheaterChase_Run() {
 	fadeToBlackBy(200);
 
-	for (int i = 0; i < pixel_count; i++) {
-		if ((i + chase_pos) % 3 == 0) {
-			Strip_setPixelWithBrig(i,
-				led_baseColors[0], led_baseColors[1], led_baseColors[2],
-				led_baseColors[3], led_baseColors[4]);
-		}
+	for (int i = (3 - chase_pos) % 3; i < pixel_count; i += 3) {
+		PA_SetPixelBase(i);
 	}
-	Strip_Apply();
 
 	chase_pos++;
 	if (chase_pos >= 3) chase_pos = 0;
@@ -230,14 +283,12 @@ static int chase_rainbow_pos = 0;
 void TheaterChaseRainbow_Run() {
 	for (int i = 0; i < pixel_count; i++) {
 		if ((i + chase_rainbow_pos) % 3 == 0) {
-			byte *c = RainbowWheel_Wheel((i + chase_rainbow_pos * 8) & 255);
-			Strip_setPixelWithBrig(i, *c, *(c + 1), *(c + 2), 0, 0);
+			PA_SetPixelRGB(i, pa_rainbow[(i + chase_rainbow_pos * 8) & 255]);
 		}
 		else {
-			Strip_setPixelWithBrig(i, 0, 0, 0, 0, 0);
+			PA_SetPixel(i, 0, 0, 0, 0, 0);
 		}
 	}
-	Strip_Apply();
 
 	chase_rainbow_pos++;
 	if (chase_rainbow_pos >= 3) chase_rainbow_pos = 0;
@@ -261,6 +312,12 @@ ledAnim_t g_anims[] = {
 int g_numAnims = sizeof(g_anims) / sizeof(g_anims[0]);
 int g_speed = 0;
 
+#define PIXELANIM_DEFAULT_FPS 30
+// frames run at fixed rate, AnimSpeed N makes it N times slower
+static int pa_frameMS = 1000 / PIXELANIM_DEFAULT_FPS;
+static int pa_timeAccum = 0;
+static int pa_frames = 0;
+
 void PixelAnim_SetAnim(int j) {
 	activeAnim = j;
 	g_lightMode = Light_Anim;
@@ -293,7 +350,23 @@ commandResult_t PA_Cmd_AnimSpeed(const void *context, const char *cmd, const cha
 
 	return CMD_RES_OK;
 }
+commandResult_t PA_Cmd_AnimFPS(const void *context, const char *cmd, const char *args, int flags) {
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() == 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Anim FPS %i, frames %i", 1000 / pa_frameMS, pa_frames);
+		return CMD_RES_OK;
+	}
+
+	pa_frameMS = 1000 / Tokenizer_GetArgIntegerRange(0, 1, 100);
+
+	return CMD_RES_OK;
+}
 void PixelAnim_Init() {
+	if (!pa_palettesReady) {
+		PA_BuildPalettes();
+	}
 
 	//cmddetail:{"name":"Anim","args":"[AnimationIndex]",
 	//cmddetail:"descr":"Starts given WS2812 animation by index.",
@@ -305,6 +378,11 @@ void PixelAnim_Init() {
 	//cmddetail:"fn":"PA_Cmd_AnimSpeed","file":"driver/drv_pixelAnim.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("AnimSpeed", PA_Cmd_AnimSpeed, NULL);
+	//cmddetail:{"name":"AnimFPS","args":"[FPS]",
+	//cmddetail:"descr":"Sets WS2812 animation frame rate, default is 30. AnimSpeed divides it further. Without argument, prints rate and number of frames shown.",
+	//cmddetail:"fn":"PA_Cmd_AnimFPS","file":"driver/drv_pixelAnim.c","requires":"",
+	//cmddetail:"examples":"AnimFPS 50"}
+	CMD_RegisterCommand("AnimFPS", PA_Cmd_AnimFPS, NULL);
 }
 
 void PixelAnim_CreatePanel(http_request_t *request) {
@@ -352,23 +430,55 @@ void PixelAnim_CreatePanel(http_request_t *request) {
 	}
 	poststr(request, "</td></tr>");
 }
-int g_ticks = 0;
+static void PixelAnim_RunFrame() {
+	int scale = 256;
+
+	if (activeAnim < 0 || activeAnim >= g_numAnims)
+		return;
+	if (pixel_count == 0 || !PA_EnsureFrame())
+		return;
+	g_anims[activeAnim].runFunc();
+#if ENABLE_LED_BASIC
+	scale = (int)(g_brightness0to100 * 2.56f + 0.5f);
+	if (scale < 0)
+		scale = 0;
+	if (scale > 256)
+		scale = 256;
+#endif
+	Strip_setFrame(pa_frame, pixel_count, scale);
+	Strip_Apply();
+	pa_frames++;
+}
+int PixelAnim_GetFrameCount() {
+	return pa_frames;
+}
 void PixelAnim_SetAnimQuickTick() {
+	int period;
+
 	if (g_lightEnableAll == 0) {
 		// disabled
+		pa_timeAccum = 0;
 		return;
 	}
 	if (g_lightMode != Light_Anim) {
 		// disabled
+		pa_timeAccum = 0;
 		return;
 	}
-	if (activeAnim != -1) {
-		g_ticks++;
-		if (g_ticks >= g_speed) {
-			g_anims[activeAnim].runFunc();
-			g_ticks = 0;
-		}
+	if (activeAnim == -1) {
+		return;
+	}
+	period = pa_frameMS * (g_speed > 1 ? g_speed : 1);
+	pa_timeAccum += g_deltaTimeMS;
+	if (pa_timeAccum < period) {
+		return;
+	}
+	pa_timeAccum -= period;
+	// late frames are dropped, not caught up
+	if (pa_timeAccum >= period) {
+		pa_timeAccum = 0;
 	}
+	PixelAnim_RunFrame();
 }
 
 
@@ -12,9 +12,9 @@ static float voltage_cal = 1;
 static float current_cal = 1;
 static float power_cal = 1;
 
-static int latest_raw_voltage;
+static float latest_raw_voltage;
 static float latest_raw_current;
-static int latest_raw_power;
+static float latest_raw_power;
 
 //#define PWRCAL_DEBUG
 
@@ -102,7 +102,7 @@ void PwrCal_Init(pwr_cal_type_t type, float default_voltage_cal,
     CMD_RegisterCommand("PowerSet", CalibratePower, NULL);
 }
 
-void PwrCal_Scale(int raw_voltage, float raw_current, int raw_power,
+void PwrCal_Scale(float raw_voltage, float raw_current, float raw_power,
                   float *real_voltage, float *real_current, float *real_power) {
     latest_raw_voltage = raw_voltage;
     latest_raw_current = raw_current;
@@ -113,6 +113,6 @@ void PwrCal_Scale(int raw_voltage, float raw_current, int raw_power,
     *real_power = Scale(raw_power, power_cal);
 }
 
-float PwrCal_ScalePowerOnly(int raw_power) {
+float PwrCal_ScalePowerOnly(float raw_power) {
     return Scale(raw_power, power_cal);
 }
@@ -8,6 +8,7 @@ typedef enum {
 
 void PwrCal_Init(pwr_cal_type_t type, float default_voltage_cal,
                  float default_current_cal, float default_power_cal);
-void PwrCal_Scale(int raw_voltage, float raw_current, int raw_power,
+// raw values are chip units, or pulses per second for pulse output chips
+void PwrCal_Scale(float raw_voltage, float raw_current, float raw_power,
                   float *real_voltage, float *real_current, float *real_power);
-float PwrCal_ScalePowerOnly(int raw_power);
+float PwrCal_ScalePowerOnly(float raw_power);
@@ -36,6 +36,19 @@ void SM16703P_setByte(int index, byte color) {
 		return;
 	translate_byte(color, spiLED.buf + (spiLED.ofs + index * 4));
 }
+void SM16703P_setBytes(uint32_t index, const byte *data, int len) {
+	byte *dst;
+
+	if (spiLED.buf == 0)
+		return;
+	if (spiLED.ready == 0)
+		return;
+	dst = spiLED.buf + spiLED.ofs + index * 4;
+	while (len-- > 0) {
+		translate_byte(*data++, dst);
+		dst += 4;
+	}
+}
 
 void SM16703P_SetLEDCount(int pixel_count, int pixel_size) {
 	// Third arg (optional, default "0"): spiLED.ofs to prepend to each transmission
@@ -63,6 +76,7 @@ void SM16703P_Init() {
 	ws_export.getByte = SM16703P_GetByte;
 	ws_export.setByte = SM16703P_setByte;
 	ws_export.setLEDCount = SM16703P_SetLEDCount;
+	ws_export.setBytes = SM16703P_setBytes;
 
 	LEDS_InitShared(&ws_export);
 }
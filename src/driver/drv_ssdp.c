@@ -2,7 +2,8 @@
 // 
 // OpenBeken SSDP support
 // listens on multicast 239.255.255.250:1900
-// responds to ANY M-SEARCH with a valid response.
+// responds to any M-SEARCH (MAN: "ssdp:discover") with a valid response,
+// delayed by random time up to MX seconds.
 // add an HTTP service routine for /ssdp.xml
 // which returns the SSDP Description
 //
@@ -26,6 +27,8 @@
 #include "../obk_config.h"
 #include "../httpserver/new_http.h"
 #include "drv_public.h"
+#include "drv_ssdp.h"
+#include "../quicktick.h"
 //#include "common_math.h"
 
 extern int DRV_SSDP_Active;
@@ -57,38 +60,99 @@ int http_message_len = 0;
 
 #define MAX_OBK_DEVICES 40
 #define OBK_DEVICE_TIMEOUT 60
+// power of two, comfortably above MAX_OBK_DEVICES
+#define OBK_DEVICE_HASH_SIZE 64
 
 typedef struct OBK_DEVICE_tag{
     uint32_t ip;
     int timeout; // seconds
 } OBK_DEVICE;
 
-static OBK_DEVICE obkDevices[MAX_OBK_DEVICES];
+// open addressing with linear probing, ip 0 is an empty slot
+static OBK_DEVICE obkDevices[OBK_DEVICE_HASH_SIZE];
+static int obkDevicesCount = 0;
 
-static void obkDeviceTick(uint32_t ip){
-    int i;
-    for (i = 0; i < MAX_OBK_DEVICES; i++){
+static int obkDeviceHash(uint32_t ip){
+    return (ip * 2654435761u) >> 26;
+}
+
+static int obkDeviceFind(uint32_t ip){
+    int i = obkDeviceHash(ip);
+    while (obkDevices[i].ip != 0){
         if (obkDevices[i].ip == ip){
-            obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
-            addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP obk device still present 0x%08x",ip);
+            return i;
+        }
+        i = (i + 1) & (OBK_DEVICE_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+// backward shift, so no tombstones are needed
+static void obkDeviceRemoveAt(int i){
+    int j = i;
+    int home;
+    while (1){
+        j = (j + 1) & (OBK_DEVICE_HASH_SIZE - 1);
+        if (obkDevices[j].ip == 0){
             break;
         }
+        home = obkDeviceHash(obkDevices[j].ip);
+        // entry at j may fill the hole at i only if its home is not in (i, j]
+        if (((j - home) & (OBK_DEVICE_HASH_SIZE - 1)) >= ((j - i) & (OBK_DEVICE_HASH_SIZE - 1))){
+            obkDevices[i] = obkDevices[j];
+            i = j;
+        }
     }
+    obkDevices[i].ip = 0;
+    obkDevices[i].timeout = 0;
+    obkDevicesCount--;
+}
 
-    if (i == MAX_OBK_DEVICES){
-        for (i = 0; i < MAX_OBK_DEVICES; i++){
-            if (obkDevices[i].ip == 0){
-                obkDevices[i].ip = ip;
-                obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
-                addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP new obk device 0x%08x",ip);
-                break;
-            }
+static void obkDeviceTick(uint32_t ip){
+    int i;
+
+    if (ip == 0){
+        return;
+    }
+    i = obkDeviceFind(ip);
+    if (i >= 0){
+        obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP obk device still present 0x%08x",ip);
+        return;
+    }
+    if (obkDevicesCount >= MAX_OBK_DEVICES){
+        return;
+    }
+    i = obkDeviceHash(ip);
+    while (obkDevices[i].ip != 0){
+        i = (i + 1) & (OBK_DEVICE_HASH_SIZE - 1);
+    }
+    obkDevices[i].ip = ip;
+    obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
+    obkDevicesCount++;
+    addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP new obk device 0x%08x",ip);
+}
+
+static void obkDeviceExpire(){
+    int i;
+    for (i = 0; i < OBK_DEVICE_HASH_SIZE; i++){
+        if (obkDevices[i].timeout){
+            obkDevices[i].timeout--;
+        }
+    }
+    // removal may shift a later entry into slot i, so check it again
+    i = 0;
+    while (i < OBK_DEVICE_HASH_SIZE){
+        if (obkDevices[i].ip != 0 && obkDevices[i].timeout == 0){
+            obkDeviceRemoveAt(i);
+        } else {
+            i++;
         }
     }
 }
 
 static void obkDeviceList(){
-    for (int i = 0; i < MAX_OBK_DEVICES; i++){
+    for (int i = 0; i < OBK_DEVICE_HASH_SIZE; i++){
         if (obkDevices[i].ip != 0){
             addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"obk device 0x%08x", obkDevices[i].ip);
         }
@@ -100,7 +164,7 @@ static int http_rest_get_devicelist(http_request_t* request) {
 	http_setup(request, httpMimeTypeJson);
 	hprintf255(request, "[");
     int count = 0;
-    for (int i = 0; i < MAX_OBK_DEVICES; i++){
+    for (int i = 0; i < OBK_DEVICE_HASH_SIZE; i++){
         if (obkDevices[i].ip != 0){
             if (count) hprintf255(request,",");
             hprintf255(request,"{\"ip\":\"%d.%d.%d.%d\"}", 
@@ -117,6 +181,30 @@ static int http_rest_get_devicelist(http_request_t* request) {
 	return 0;
 }
 
+// M-SEARCH replies wait here for their random MX delay
+#define SSDP_MAX_PENDING_REPLIES 8
+// bound on work done in one quick tick
+#define SSDP_MAX_PACKETS_PER_TICK 16
+// UPnP 1.1 says MX above 5 is treated as 5
+#define SSDP_MAX_MX 5
+
+typedef enum {
+    SSDP_REPLY_GENERIC,
+    SSDP_REPLY_WEMO_BELKIN,
+    SSDP_REPLY_WEMO_ROOT,
+    SSDP_REPLY_HUE,
+} ssdpReplyType_t;
+
+typedef struct ssdpPendingReply_s {
+    struct sockaddr_in addr;
+    unsigned int dueTime;
+    byte type;
+    byte bUsed;
+} ssdpPendingReply_t;
+
+static ssdpPendingReply_t g_ssdp_pending[SSDP_MAX_PENDING_REPLIES];
+static ssdpStats_t g_ssdp_stats;
+
 ///////////////////////////////
 // private functions, only used by the public functions...
 
@@ -422,6 +510,7 @@ void DRV_SSDP_Init()
     }
 
     memset(obkDevices, 0, sizeof(obkDevices));
+    obkDevicesCount = 0;
 
     addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"DRV_SSDP_Init");
     // like "e427ce1a-3e80-43d0-ad6f-89ec42e46363";
@@ -449,6 +538,8 @@ void DRV_SSDP_Init()
 
 
 void DRV_SSDP_RunEverySecond() {
+    obkDeviceExpire();
+
 	if (g_ssdp_socket_receive <= 0) {
 		return ;
 	}
@@ -459,115 +550,251 @@ void DRV_SSDP_RunEverySecond() {
         DRV_SSDP_Send_Notify();
         ssdp_timercount = 0;
     }
+}
 
-    for (int i = 0; i < MAX_OBK_DEVICES; i++){
-        if (obkDevices[i].timeout){
-            obkDevices[i].timeout --;
-            if (!obkDevices[i].timeout){
-                obkDevices[i].ip = 0;
+// compare header name, case insensitive
+static int ssdp_isHeader(const char *name, int nameLen, const char *expected){
+    int len = strlen(expected);
+    return nameLen == len && !wal_strnicmp(name, expected, len);
+}
+
+static byte ssdp_classifyTarget(const char *v, int len){
+    if (len == 8 && !wal_strnicmp(v, "ssdp:all", 8))
+        return SSDP_ST_ALL;
+    if (len == 14 && !wal_strnicmp(v, "ssdpsearch:all", 14))
+        return SSDP_ST_ALL;
+    if (len == 15 && !wal_strnicmp(v, "upnp:rootdevice", 15))
+        return SSDP_ST_ROOTDEVICE;
+    if (len >= 20 && !wal_strnicmp(v, "urn:belkin:device:**", 20))
+        return SSDP_ST_BELKIN;
+    // urn:schemas-upnp-org:device:basic:1 and alike
+    if (len >= 15 && !wal_strnicmp(v + len - 15, ":device:basic:1", 15))
+        return SSDP_ST_BASIC;
+    return SSDP_ST_OTHER;
+}
+
+/* we may get:
+M-SEARCH * HTTP/1.1
+HOST:239.255.255.250:1900
+ST:upnp:rootdevice
+MX:2
+MAN:"ssdp:discover"
+*/
+void DRV_SSDP_ParseMessage(const char *buf, int len, ssdpMessage_t *msg){
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *eol, *name, *v, *ve;
+    int nameLen, mx;
+
+    memset(msg, 0, sizeof(*msg));
+    if (len >= 8 && !strncmp(buf, "M-SEARCH", 8)){
+        msg->method = SSDP_METHOD_SEARCH;
+    } else if (len >= 6 && !strncmp(buf, "NOTIFY", 6)){
+        msg->method = SSDP_METHOD_NOTIFY;
+    } else {
+        return;
+    }
+    // skip request line
+    while (p < end && *p != '\n')
+        p++;
+    while (p < end){
+        p++;
+        eol = p;
+        while (eol < end && *eol != '\n')
+            eol++;
+        name = p;
+        while (p < eol && *p != ':')
+            p++;
+        if (p == eol)
+            continue;
+        nameLen = p - name;
+        // trim value
+        v = p + 1;
+        ve = eol;
+        while (v < ve && (*v == ' ' || *v == '\t'))
+            v++;
+        while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ' || ve[-1] == '\t'))
+            ve--;
+        if (ssdp_isHeader(name, nameLen, "ST")){
+            msg->searchTarget = ssdp_classifyTarget(v, ve - v);
+        } else if (ssdp_isHeader(name, nameLen, "MAN")){
+            msg->bDiscover = (ve - v) >= 15 && !wal_strnicmp(v, "\"ssdp:discover\"", 15);
+        } else if (ssdp_isHeader(name, nameLen, "MX")){
+            mx = 0;
+            while (v < ve && *v >= '0' && *v <= '9' && mx < 100){
+                mx = mx * 10 + (*v - '0');
+                v++;
             }
+            if (mx > SSDP_MAX_MX)
+                mx = SSDP_MAX_MX;
+            msg->mx = mx;
+        } else if (ssdp_isHeader(name, nameLen, "SERVER")){
+            msg->bFromOpenBk = (ve - v) >= 6 && !strncmp(v, "OpenBk", 6);
         }
+        p = eol;
     }
 }
 
-void DRV_SSDP_RunQuickTick() {
+static int ssdp_pickReply(const ssdpMessage_t *msg){
+    byte st = msg->searchTarget;
+#if ENABLE_DRIVER_WEMO
+    if (DRV_IsRunning("WEMO")) {
+        if (st == SSDP_ST_BELKIN)
+            return SSDP_REPLY_WEMO_BELKIN;
+        if (st == SSDP_ST_ROOTDEVICE || st == SSDP_ST_ALL)
+            return SSDP_REPLY_WEMO_ROOT;
+    }
+#endif
+#if ENABLE_DRIVER_HUE
+    if (DRV_IsRunning("HUE")) {
+        if (st == SSDP_ST_BASIC || st == SSDP_ST_ROOTDEVICE || st == SSDP_ST_ALL)
+            return SSDP_REPLY_HUE;
+    }
+#endif
+    return SSDP_REPLY_GENERIC;
+}
 
-	if (g_ssdp_socket_receive <= 0) {
-		return ;
-	}
-    // now just enter a read-print loop
-    //
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
+static void ssdp_queueReply(struct sockaddr_in *from, int type, int mx){
+    ssdpPendingReply_t *free_slot = 0;
+    ssdpPendingReply_t *r;
+    int i;
 
-    if (!udp_msgbuf){
-        udp_msgbuf = (char *)malloc(UDP_MSGBUF_LEN+1);
+    for (i = 0; i < SSDP_MAX_PENDING_REPLIES; i++){
+        r = &g_ssdp_pending[i];
+        if (!r->bUsed){
+            if (!free_slot)
+                free_slot = r;
+            continue;
+        }
+        // clients often repeat the search; one answer is enough
+        if (r->type == type && r->addr.sin_addr.s_addr == from->sin_addr.s_addr
+            && r->addr.sin_port == from->sin_port){
+            g_ssdp_stats.repliesMerged++;
+            return;
+        }
     }
-
-    socklen_t addrlen = sizeof(addr);
-    int nbytes = recvfrom(
-        g_ssdp_socket_receive,
-        udp_msgbuf,
-        UDP_MSGBUF_LEN,
-        0,
-        (struct sockaddr *) &addr,
-        &addrlen
-    );
-    udp_msgbuf[UDP_MSGBUF_LEN] = 0;
-    if (nbytes <= 0) {
-        //addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"nothing\n");
-        return ;
+    if (!free_slot){
+        g_ssdp_stats.repliesDropped++;
+        return;
+    }
+    free_slot->addr = *from;
+    free_slot->type = type;
+    free_slot->bUsed = 1;
+    // spread replies over MX seconds, unicast search (no MX) is answered at once
+    free_slot->dueTime = g_timeMs;
+    if (mx > 0){
+        free_slot->dueTime += rand() % (mx * 1000);
     }
-    // just so we can terminate for print
-    if (nbytes >= UDP_MSGBUF_LEN){
-        nbytes = UDP_MSGBUF_LEN-1;
-    }
-    addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"Received %i bytes from %s",nbytes,inet_ntoa(((struct sockaddr_in *)&addr)->sin_addr));
-    udp_msgbuf[nbytes] = 0;
-    addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"data: %s",udp_msgbuf);
-    udp_msgbuf[nbytes] = '\0';
-
-    /* we may get:
-    M-SEARCH * HTTP/1.1
-    HOST:239.255.255.250:1900
-    ST:upnp:rootdevice
-    MX:2
-    MAN:"ssdp:discover"
-    */
-
-    // if search, then respond
-    // we SHOULD be a little more specific!!!
-    if (!strncmp(udp_msgbuf, "M-SEARCH", 8)){
-        // reply with our advert to the sender
-        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"Is MSEARCH - responding");
+}
+
+static void ssdp_sendReply(ssdpPendingReply_t *r){
+    switch (r->type){
 #if ENABLE_DRIVER_WEMO
-		if (DRV_IsRunning("WEMO")) {
-			if (strcasestr(udp_msgbuf, "urn:belkin:device:**")) {
-				DRV_WEMO_Send_Advert_To(1, &addr);
-				return;
-			}
-			else if (strcasestr(udp_msgbuf, "upnp:rootdevice")
-				|| strcasestr(udp_msgbuf, "ssdpsearch:all")
-				|| strcasestr(udp_msgbuf, "ssdp:all")) {
-				DRV_WEMO_Send_Advert_To(2, &addr);
-				return;
-			}
-		}
+    case SSDP_REPLY_WEMO_BELKIN:
+        DRV_WEMO_Send_Advert_To(1, &r->addr);
+        break;
+    case SSDP_REPLY_WEMO_ROOT:
+        DRV_WEMO_Send_Advert_To(2, &r->addr);
+        break;
 #endif
 #if ENABLE_DRIVER_HUE
-		if (DRV_IsRunning("HUE")) {
-			if (strcasestr(udp_msgbuf, ":device:basic:1")
-				|| strcasestr(udp_msgbuf, "upnp:rootdevice")
-				|| strcasestr(udp_msgbuf, "ssdpsearch:all")
-				|| strcasestr(udp_msgbuf, "ssdp:all")) {
-				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, "SSDP has received HUE PACKET");
-				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, udp_msgbuf);
-				DRV_HUE_Send_Advert_To(&addr);
-				return;
-			}
-		}
+    case SSDP_REPLY_HUE:
+        DRV_HUE_Send_Advert_To(&r->addr);
+        break;
 #endif
-		DRV_SSDP_Send_Advert_To(&addr);
+    default:
+        DRV_SSDP_Send_Advert_To(&r->addr);
+        break;
     }
+    g_ssdp_stats.repliesSent++;
+}
 
-    // our NOTIFTY like:
-    //"NOTIFY * HTTP/1.1\r\n" 
-    //"SERVER: OpenBk\r\n" 
-    if (!strncmp(udp_msgbuf, "NOTIFY", 6)){
-        const char *p = udp_msgbuf;
-        while (*p && *p != '\n'){
-            p++;
+void DRV_SSDP_SendDueReplies(){
+    ssdpPendingReply_t *r;
+    int i;
+
+    for (i = 0; i < SSDP_MAX_PENDING_REPLIES; i++){
+        r = &g_ssdp_pending[i];
+        if (r->bUsed && (int)(g_timeMs - r->dueTime) >= 0){
+            r->bUsed = 0;
+            ssdp_sendReply(r);
         }
-        if (*p == '\n'){
-            p++;
-            if (!strncmp(p, "SERVER: OpenBk", 14)){
-                addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"NOTIFY from a peer device");
-                // add the device to the device list, or set timeout to 0
-                obkDeviceTick(*(uint32_t *)(&((struct sockaddr_in *)&addr)->sin_addr));
-            }
+    }
+}
+
+void DRV_SSDP_ProcessPacket(const char *buf, int len, struct sockaddr_in *from){
+    ssdpMessage_t msg;
+
+    g_ssdp_stats.packetsReceived++;
+    // inet_ntoa and payload print are costly, skip them if they would be filtered anyway
+    if (g_loglevel >= LOG_EXTRADEBUG && (logfeatures & (1 << LOG_FEATURE_HTTP))){
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"Received %i bytes from %s",len,inet_ntoa(from->sin_addr));
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"data: %s",buf);
+    }
+    DRV_SSDP_ParseMessage(buf, len, &msg);
+
+    if (msg.method == SSDP_METHOD_SEARCH){
+        g_ssdp_stats.searchesReceived++;
+        if (!msg.bDiscover){
+            return;
+        }
+        ssdp_queueReply(from, ssdp_pickReply(&msg), msg.mx);
+    } else if (msg.method == SSDP_METHOD_NOTIFY && msg.bFromOpenBk){
+        // add the device to the device list, or refresh its timeout
+        obkDeviceTick(from->sin_addr.s_addr);
+    }
+}
+
+int DRV_SSDP_GetPendingReplies(){
+    int i, c = 0;
+    for (i = 0; i < SSDP_MAX_PENDING_REPLIES; i++){
+        if (g_ssdp_pending[i].bUsed)
+            c++;
+    }
+    return c;
+}
+
+int DRV_SSDP_GetPeersCount(){
+    return obkDevicesCount;
+}
+
+const ssdpStats_t *DRV_SSDP_GetStats(){
+    return &g_ssdp_stats;
+}
+
+void DRV_SSDP_RunQuickTick() {
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    int nbytes;
+    int packets;
+
+	if (g_ssdp_socket_receive <= 0) {
+		return ;
+	}
+    if (!udp_msgbuf){
+        udp_msgbuf = (char *)malloc(UDP_MSGBUF_LEN+1);
+    }
+
+    // drain everything that arrived since last tick
+    for (packets = 0; packets < SSDP_MAX_PACKETS_PER_TICK; packets++){
+        memset(&addr, 0, sizeof(addr));
+        addrlen = sizeof(addr);
+        nbytes = recvfrom(
+            g_ssdp_socket_receive,
+            udp_msgbuf,
+            UDP_MSGBUF_LEN,
+            0,
+            (struct sockaddr *) &addr,
+            &addrlen
+        );
+        if (nbytes <= 0) {
+            break;
         }
+        udp_msgbuf[nbytes] = 0;
+        DRV_SSDP_ProcessPacket(udp_msgbuf, nbytes, &addr);
     }
 
+    DRV_SSDP_SendDueReplies();
 }
 
 
@@ -575,6 +802,11 @@ void DRV_SSDP_Shutdown(){
     addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"DRV_SSDP_Shutdown");
     DRV_SSDP_Active = 0;
 
+    memset(g_ssdp_pending, 0, sizeof(g_ssdp_pending));
+    memset(&g_ssdp_stats, 0, sizeof(g_ssdp_stats));
+    memset(obkDevices, 0, sizeof(obkDevices));
+    obkDevicesCount = 0;
+
 	if(g_ssdp_socket_receive>=0) {
 		close(g_ssdp_socket_receive);
 		g_ssdp_socket_receive = -1;
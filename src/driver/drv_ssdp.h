@@ -1,12 +1,53 @@
 
 extern int DRV_SSDP_Active;
 
+typedef enum {
+	SSDP_METHOD_OTHER,
+	SSDP_METHOD_SEARCH,
+	SSDP_METHOD_NOTIFY,
+} ssdpMethod_t;
+
+typedef enum {
+	SSDP_ST_NONE,
+	SSDP_ST_ALL,
+	SSDP_ST_ROOTDEVICE,
+	SSDP_ST_BELKIN,
+	SSDP_ST_BASIC,
+	SSDP_ST_OTHER,
+} ssdpSearchTarget_t;
+
+// headers of one datagram, filled in a single pass
+typedef struct ssdpMessage_s {
+	byte method;
+	byte searchTarget;
+	// MAN: "ssdp:discover"
+	byte bDiscover;
+	// SERVER: OpenBk
+	byte bFromOpenBk;
+	// seconds, 0 if missing
+	byte mx;
+} ssdpMessage_t;
+
+typedef struct ssdpStats_s {
+	int packetsReceived;
+	int searchesReceived;
+	int repliesSent;
+	// same reply for same client was already waiting
+	int repliesMerged;
+	// reply queue full
+	int repliesDropped;
+} ssdpStats_t;
+
 void DRV_SSDP_Init();
 void DRV_SSDP_RunEverySecond();
 void DRV_SSDP_RunQuickTick();
 void DRV_SSDP_Shutdown();
 void DRV_SSDP_SendReply(struct sockaddr_in *addr, const char *message);
-
-
+void DRV_SSDP_ParseMessage(const char *buf, int len, ssdpMessage_t *msg);
+void DRV_SSDP_ProcessPacket(const char *buf, int len, struct sockaddr_in *from);
+void DRV_SSDP_SendDueReplies();
+int DRV_SSDP_GetPendingReplies();
+int DRV_SSDP_GetPeersCount();
+const ssdpStats_t *DRV_SSDP_GetStats();
 
 
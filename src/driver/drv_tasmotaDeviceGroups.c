@@ -21,6 +21,8 @@ static int g_dgr_socket_send = -1;
 // statistics
 static int g_dgr_stat_sent = 0;
 static int g_dgr_stat_received = 0;
+// datagrams bigger than DGR_MAX_RX_PACKET, dropped
+static int g_dgr_stat_oversize = 0;
 struct sockaddr_in g_mySockAddr;
 
 static uint16_t g_dgr_send_seq = 0;
@@ -389,34 +391,51 @@ typedef struct dgrMmember_s {
 	uint16_t lastSeq;
 } dgrMember_t;
 
-#define MAX_DGR_MEMBERS 32
-static dgrMember_t g_dgrMembers[MAX_DGR_MEMBERS];
+// Members are kept in a small open-addressed (linear probing) hash table keyed by IP.
+// Slot with ip == 0 is free, 0.0.0.0 is never a valid source address.
+// Table size must be a power of two; keep load factor below ~0.9 so probes stay short.
+#define DGR_MEMBERS_HASH_SIZE 128
+#define MAX_DGR_MEMBERS 112
+static dgrMember_t g_dgrMembers[DGR_MEMBERS_HASH_SIZE];
 static int g_curDGRMembers = 0;
-static struct sockaddr_in addr;
 
-dgrMember_t *findMember() {
-	int i, ip;
+static int DGR_HashMemberIP(unsigned int ip) {
+	// Knuth multiplicative hash, top bits are the best mixed
+	ip *= 2654435761u;
+	return (ip >> 16) & (DGR_MEMBERS_HASH_SIZE - 1);
+}
+dgrMember_t *findMember(const struct sockaddr_in *src) {
+	int i, ip, probes;
 
-	ip = addr.sin_addr.s_addr;;
+	ip = src->sin_addr.s_addr;
+	if (ip == 0)
+		return 0;
 
-	for(i = 0; i < g_curDGRMembers; i++) {
-		if(g_dgrMembers[i].ip == ip) {
+	i = DGR_HashMemberIP(ip);
+	for (probes = 0; probes < DGR_MEMBERS_HASH_SIZE; probes++) {
+		if (g_dgrMembers[i].ip == ip) {
 			return &g_dgrMembers[i];
 		}
+		if (g_dgrMembers[i].ip == 0) {
+			break;
+		}
+		i = (i + 1) & (DGR_MEMBERS_HASH_SIZE - 1);
 	}
-	i = g_curDGRMembers;
-	if(i>=MAX_DGR_MEMBERS)
+	if (g_curDGRMembers >= MAX_DGR_MEMBERS || probes >= DGR_MEMBERS_HASH_SIZE)
 		return 0;
-	g_curDGRMembers ++;
+	g_curDGRMembers++;
 	g_dgrMembers[i].ip = ip;
 	g_dgrMembers[i].lastSeq = 0;
 	return &g_dgrMembers[i];
 }
+int DGR_GetMembersCount() {
+	return g_curDGRMembers;
+}
 
-int DGR_CheckSequence(uint16_t seq) {
+int DGR_CheckSequence(const struct sockaddr *addr, uint16_t seq) {
 	dgrMember_t *m;
 	
-	m = findMember();
+	m = findMember((const struct sockaddr_in *)addr);
 	
 	if (m == 0) {
 		addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR, "DGR_CheckSequence: no member found");
@@ -465,15 +484,10 @@ void DRV_DGR_RunEverySecond() {
 		}
 	}
 }
-void DGR_SpoofNextDGRPacketSource(const char *ipStrs) {
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr(ipStrs);
-	addr.sin_port = htons(dgr_port);
-}
-void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes) {
+void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes, const struct sockaddr_in *src) {
 	dgrDevice_t def;
 
+	// NOTE: caller must provide room for the terminator
 	msgbuf[nbytes] = '\0';
 
 	strcpy(def.gr.groupName, CFG_DeviceGroups_GetName());
@@ -493,51 +507,153 @@ void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes) {
 #ifdef DGRLOADMOREDEBUG	
 	DRV_DGR_Dump((byte*)msgbuf, nbytes);
 #endif
-	DGR_Parse((byte*)msgbuf, nbytes, &def, (struct sockaddr *)&addr);
+	DGR_Parse((byte*)msgbuf, nbytes, &def, (struct sockaddr *)src);
 	g_inCmdProcessing = 0;
 
 }
 
+//
+// Receive side packet ring.
+// QuickTick drains pending datagrams from the socket straight into ring slots
+// (recvfrom writes directly into the slot, no intermediate copy), then processes
+// the whole batch. If the ring fills up, it's processed and draining continues,
+// up to DGR_MAX_PACKETS_PER_TICK, the rest waits in socket for next tick.
+//
+// Max size of received DGR packet; Tasmota never sends more than that
+#define DGR_MAX_RX_PACKET 512
+// number of packets buffered before processing
+#define DGR_RX_RING_SIZE 4
+// bound on work done in one quick tick, so a multicast flood can't hold it
+#define DGR_MAX_PACKETS_PER_TICK 16
+
+typedef struct dgrRxPacket_s {
+	struct sockaddr_in src;
+	int length;
+	// +1 for NULL terminator added by DGR_ProcessIncomingPacket
+	char buffer[DGR_MAX_RX_PACKET + 1];
+} dgrRxPacket_t;
+
+// the ring is not allocated before driver start
+static dgrRxPacket_t *g_dgrRxRing = 0;
+static int g_dgrRxHead = 0;
+static int g_dgrRxCount = 0;
+
+// Returns next free slot or 0 if ring is full
+dgrRxPacket_t *DGR_RxRing_GetFreeSlot() {
+	if (g_dgrRxRing == 0) {
+		g_dgrRxRing = malloc(sizeof(dgrRxPacket_t) * DGR_RX_RING_SIZE);
+		if (g_dgrRxRing == 0) {
+			return 0;
+		}
+		g_dgrRxHead = 0;
+		g_dgrRxCount = 0;
+	}
+	if (g_dgrRxCount >= DGR_RX_RING_SIZE) {
+		return 0;
+	}
+	return &g_dgrRxRing[(g_dgrRxHead + g_dgrRxCount) % DGR_RX_RING_SIZE];
+}
+void DGR_RxRing_Commit() {
+	g_dgrRxCount++;
+}
+void DGR_RxRing_ProcessAll() {
+	dgrRxPacket_t *p;
+
+	while (g_dgrRxCount > 0) {
+		p = &g_dgrRxRing[g_dgrRxHead];
+		g_dgrRxHead = (g_dgrRxHead + 1) % DGR_RX_RING_SIZE;
+		g_dgrRxCount--;
+
+		g_dgr_stat_received++;
+		// IMPORTANT: do not call inet_ntoa if log level is not extradebug...
+		if (g_loglevel >= LOG_EXTRADEBUG) {
+			addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR, "Received %i bytes from %s\n", p->length, inet_ntoa(p->src.sin_addr));
+		}
+		DGR_ProcessIncomingPacket(p->buffer, p->length, &p->src);
+	}
+}
+// Queues a packet as if it was received from given source.
+// Used by simulator to replay captures through the same path as the socket.
+int DGR_RxRing_Push(const byte *data, int len, const struct sockaddr_in *src) {
+	dgrRxPacket_t *p;
+
+	if (len > DGR_MAX_RX_PACKET) {
+		return 0;
+	}
+	p = DGR_RxRing_GetFreeSlot();
+	if (p == 0) {
+		DGR_RxRing_ProcessAll();
+		p = DGR_RxRing_GetFreeSlot();
+		if (p == 0) {
+			return 0;
+		}
+	}
+	memcpy(p->buffer, data, len);
+	p->length = len;
+	p->src = *src;
+	DGR_RxRing_Commit();
+	return 1;
+}
+
 void DRV_DGR_RunQuickTick() {
-    char msgbuf[64];
+	dgrRxPacket_t *p;
 	socklen_t addrlen;
 	int nbytes;
-	int i;
+	int packets;
 
 	if(g_dgr_socket_receive<=0 || g_dgr_socket_send <= 0) {
 		return ;
 	}
     // send pending
 	DGR_FlushSendQueue();
-	
-	// NOTE: 'addr' is global, and used in callbacks to determine the member.
-	for (i = 0; i < 10; i++) {
-		addrlen = sizeof(addr);
+
+	// drain socket
+	for (packets = 0; packets < DGR_MAX_PACKETS_PER_TICK; packets++) {
+		p = DGR_RxRing_GetFreeSlot();
+		if (p == 0) {
+			if (g_dgrRxRing == 0) {
+				// out of memory
+				break;
+			}
+			DGR_RxRing_ProcessAll();
+			p = DGR_RxRing_GetFreeSlot();
+		}
+		addrlen = sizeof(p->src);
+		// one byte more than we accept, so a truncated datagram can be told apart
 		nbytes = recvfrom(
 			g_dgr_socket_receive,
-			msgbuf,
-			sizeof(msgbuf),
+			p->buffer,
+			DGR_MAX_RX_PACKET + 1,
 			0,
-			(struct sockaddr *) &addr,
+			(struct sockaddr *) &p->src,
 			&addrlen
 		);
+#if WINDOWS && !LINUX
+		// winsock fails oversized datagram instead of truncating it
+		if (nbytes < 0 && WSAGetLastError() == WSAEMSGSIZE) {
+			nbytes = DGR_MAX_RX_PACKET + 1;
+		}
+#endif
 		if (nbytes <= 0) {
-			return;
+			break;
 		}
-
-		if (g_mySockAddr.sin_addr.s_addr == addr.sin_addr.s_addr) {
+		if (nbytes > DGR_MAX_RX_PACKET) {
+			g_dgr_stat_oversize++;
+			addLogAdv(LOG_WARN, LOG_FEATURE_DGR, "Dropped datagram over %i bytes from %s\n", DGR_MAX_RX_PACKET, inet_ntoa(p->src.sin_addr));
 			continue;
 		}
-
-		g_dgr_stat_received++;
-
-		// IMPORTANT: do not call inet_ntoa if log level is not extradebug...
-		if (g_loglevel >= LOG_EXTRADEBUG) {
-			addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR, "Received %i bytes from %s\n", nbytes, inet_ntoa(((struct sockaddr_in *)&addr)->sin_addr));
+		// ignore our own multicast
+		if (g_mySockAddr.sin_addr.s_addr == p->src.sin_addr.s_addr) {
+			continue;
 		}
-
-		DGR_ProcessIncomingPacket(msgbuf, nbytes);
+		p->length = nbytes;
+		DGR_RxRing_Commit();
 	}
+	DGR_RxRing_ProcessAll();
+}
+void DGR_GetRxStats(int *received, int *oversize) {
+	*received = g_dgr_stat_received;
+	*oversize = g_dgr_stat_oversize;
 }
 void DRV_DGR_Shutdown()
 {
@@ -557,6 +673,12 @@ void DRV_DGR_Shutdown()
 #endif
 		g_dgr_socket_send = -1;
 	}
+	if (g_dgrRxRing) {
+		free(g_dgrRxRing);
+		g_dgrRxRing = 0;
+	}
+	g_dgrRxHead = 0;
+	g_dgrRxCount = 0;
 	dgr_retry_time_left = 5;
 	g_inCmdProcessing = 0;
 	g_dgr_send_seq = 0;
@@ -566,7 +688,7 @@ void DRV_DGR_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreS
 	if (bPreState){
 		return;
 	}
-	hprintf255(request, "<h4>DGR received: %i, send: %i</h4>", g_dgr_stat_received, g_dgr_stat_sent);
+	hprintf255(request, "<h4>DGR received: %i, send: %i, members: %i, oversize dropped: %i</h4>", g_dgr_stat_received, g_dgr_stat_sent, g_curDGRMembers, g_dgr_stat_oversize);
 }
 // DGR_SendPower testSocket 1 1
 // DGR_SendPower stringGroupName integerChannelValues integerChannelsCount
@@ -11,10 +11,13 @@
 #include "../httpserver/new_http.h"
 #include "../logging/logging.h"
 #include "../hal/hal_ota.h"
+#include "../memory/mem_pool.h"
 
 #include "drv_deviceclock.h"
 
+#ifndef M_PI
 #define M_PI   3.14159265358979323846264338327950288
+#endif
 #define LOG_FEATURE LOG_FEATURE_NTP
 
 time_t  clock_eventsTime = 0;
@@ -25,18 +28,30 @@ typedef struct clockEvent_s {
 	byte second;
 	byte weekDayFlags;
 #if ENABLE_TIME_SUNRISE_SUNSET
-	byte lastDay;  /* used so we don't repeat sunrise sunset events the same day */
 	byte sunflags;  /* flags for sunrise/sunset as follows: */
 #define SUNRISE_FLAG (1 << 0)
 #define SUNSET_FLAG (1 << 1)
 #endif
 	int id;
 	char *command;
+	// absolute local time of next run, 0 if not scheduled
+	time_t nextTime;
+	// position in g_eventHeap, -1 if not there
+	int heapIndex;
 	struct clockEvent_s *next;
 } clockEvent_t;
 
 clockEvent_t *clock_events = 0;
 
+// binary min-heap of scheduled events, ordered by nextTime
+static clockEvent_t **g_eventHeap = 0;
+static int g_eventHeapCount = 0;
+static int g_eventHeapAlloc = 0;
+
+#define SECONDS_PER_DAY 86400
+// days between 1970-01-01 and 2000-01-01
+#define DAYS_1970_TO_2000 10957
+
 #if ENABLE_TIME_SUNRISE_SUNSET
 /* Sunrise/sunset algorithm, somewhat based on https://edwilliams.org/sunrise_sunset_algorithm.htm and tasmota code */
 const float pi2 = (M_PI * 2);
@@ -115,34 +130,69 @@ static inline uint32_t JulianDay(void)
 #define DAWN_NAUTIC            -12.0
 #define DAWN_ASTRONOMIC        -18.0
 
-static void dusk2Dawn(struct SUN_DATA *Settings, byte sunflags, uint8_t *hour, uint8_t *minute, int day_offset)
+/* Solar times do not depend on time zone, so they are kept in UTC hours, per day and location.
+   Local time (with DST) is added on every use, so a DST switch needs no recalculation. */
+#define SUN_CACHE_DAYS 8
+typedef struct sunCacheEntry_s {
+	uint32_t Tdays;
+	int latitude;
+	int longitude;
+	float worldRise;
+	float worldSet;
+	byte bValid;
+} sunCacheEntry_t;
+
+static sunCacheEntry_t g_sunCache[SUN_CACHE_DAYS];
+static int g_sunCalculations = 0;
+
+/* Tdays is the number of days since Jan 1 2000 */
+static sunCacheEntry_t *sunGetDay(struct SUN_DATA *Settings, uint32_t Tdays)
 	{
-	float eventTime, declination, localTime;
-	const uint32_t JD2000 = 2451545;
-	uint32_t Tdays = JulianDay() - JD2000 + day_offset;  /* number of days since Jan 1 2000, plus offset */
+	sunCacheEntry_t *c = &g_sunCache[Tdays % SUN_CACHE_DAYS];
+	float declination, localTime;
+
+	if (c->bValid && c->Tdays == Tdays && c->latitude == Settings->latitude && c->longitude == Settings->longitude) {
+		return c;
+		}
+	g_sunCalculations++;
 
 	/* ex 2458977 (2020 May 7) - 2451545 -> 7432 -> 0,2034 */
 	const float sin_h = sinf(DAWN_NORMAL * RAD);    /* let GCC pre-compute the sin() at compile time */
 
 	float geoLatitude = Settings->latitude / (1000000.0f / RAD);
 	float geoLongitude = ((float) Settings->longitude) / 1000000;
-	float timeZone = ((float) TIME_GetTimesZoneOfsSeconds()) / 3600;  /* convert to hours */
 	float timeEquation = TimeFormula(&declination, Tdays);
 	float timeDiff = acosf((sin_h - sinf(geoLatitude) * sinf(declination)) / (cosf(geoLatitude) * cosf(declination))) * (12.0f / pi);
 
-	if (sunflags & SUNRISE_FLAG) {
-		localTime = 12.0f - timeDiff - timeEquation;
-		}
-	else {
-		localTime = 12.0f + timeDiff - timeEquation;
-		}
-	float worldTime = localTime - geoLongitude / 15.0f;
-	eventTime = worldTime + timeZone + (1 / 120.0f);  /* In Hours, with rounding to nearest minute (1/60 * .5) */
+	localTime = 12.0f - timeDiff - timeEquation;
+	c->worldRise = localTime - geoLongitude / 15.0f;
+	localTime = 12.0f + timeDiff - timeEquation;
+	c->worldSet = localTime - geoLongitude / 15.0f;
+	c->Tdays = Tdays;
+	c->latitude = Settings->latitude;
+	c->longitude = Settings->longitude;
+	c->bValid = 1;
+	return c;
+	}
+
+static void dusk2DawnForDay(struct SUN_DATA *Settings, byte sunflags, uint8_t *hour, uint8_t *minute, uint32_t Tdays)
+	{
+	sunCacheEntry_t *c = sunGetDay(Settings, Tdays);
+	float timeZone = ((float) TIME_GetTimesZoneOfsSeconds()) / 3600;  /* convert to hours */
+	float worldTime = (sunflags & SUNRISE_FLAG) ? c->worldRise : c->worldSet;
+	float eventTime = worldTime + timeZone + (1 / 120.0f);  /* In Hours, with rounding to nearest minute (1/60 * .5) */
+
 	eventTime = ModulusRangef(eventTime, 0.0f, 24.0f);   /* force 0 <= x < 24.0 */
 	*hour = (uint8_t) eventTime;
 	*minute = (uint8_t)(60.0f * fmodf(eventTime, 1.0f));
 	}
 
+static void dusk2Dawn(struct SUN_DATA *Settings, byte sunflags, uint8_t *hour, uint8_t *minute, int day_offset)
+	{
+	const uint32_t JD2000 = 2451545;
+	dusk2DawnForDay(Settings, sunflags, hour, minute, JulianDay() - JD2000 + day_offset);
+	}
+
 /* calc number of days until next sun event */
 static int calc_day_offset(int tm_wday, int weekDayFlags)
 	{
@@ -166,84 +216,163 @@ void TIME_CalculateSunrise(byte *outHour, byte *outMinute) {
 void TIME_CalculateSunset(byte *outHour, byte *outMinute) {
 	dusk2Dawn(&sun_data, SUNSET_FLAG, outHour, outMinute, 0);
 }
+int TIME_GetSunCalculationsCount() {
+	return g_sunCalculations;
+}
 #endif
 
-void TIME_RunEventsForSecond(time_t runTime) {
-	clockEvent_t *e;
-	
-/*
-	struct tm *ltm;
-
-	// NOTE: on windows, you need _USE_32BIT_TIME_T 
-	ltm = gmtime(&runTime);
-	
-	if (ltm == 0) {
-		return;
+static void TIME_HeapSwap(int i, int j) {
+	clockEvent_t *tmp = g_eventHeap[i];
+	g_eventHeap[i] = g_eventHeap[j];
+	g_eventHeap[j] = tmp;
+	g_eventHeap[i]->heapIndex = i;
+	g_eventHeap[j]->heapIndex = j;
+}
+static void TIME_HeapUp(int i) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (g_eventHeap[parent]->nextTime <= g_eventHeap[i]->nextTime)
+			break;
+		TIME_HeapSwap(i, parent);
+		i = parent;
 	}
-*/
-	TimeComponents tc=calculateComponents(runTime);
-	e = clock_events;
+}
+static void TIME_HeapDown(int i) {
+	while (1) {
+		int smallest = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+		if (l < g_eventHeapCount && g_eventHeap[l]->nextTime < g_eventHeap[smallest]->nextTime)
+			smallest = l;
+		if (r < g_eventHeapCount && g_eventHeap[r]->nextTime < g_eventHeap[smallest]->nextTime)
+			smallest = r;
+		if (smallest == i)
+			break;
+		TIME_HeapSwap(i, smallest);
+		i = smallest;
+	}
+}
+static void TIME_HeapPush(clockEvent_t *e) {
+	if (g_eventHeapCount >= g_eventHeapAlloc) {
+		int newAlloc = g_eventHeapAlloc ? g_eventHeapAlloc * 2 : 16;
+		clockEvent_t **n = (clockEvent_t **)realloc(g_eventHeap, newAlloc * sizeof(clockEvent_t *));
+		if (n == NULL) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_CMD, "No memory to schedule event %i", e->id);
+			return;
+		}
+		g_eventHeap = n;
+		g_eventHeapAlloc = newAlloc;
+	}
+	e->heapIndex = g_eventHeapCount;
+	g_eventHeap[g_eventHeapCount++] = e;
+	TIME_HeapUp(e->heapIndex);
+}
+static void TIME_HeapRemove(clockEvent_t *e) {
+	int i = e->heapIndex;
 
-	while (e) {
-		if (e->command) {
-			// base check
-//			if (e->hour == ltm->tm_hour && e->second == ltm->tm_sec && e->minute == ltm->tm_min) {
-			if (e->hour == tc.hour && e->second == tc.second && e->minute == tc.minute) {
-				// weekday check
-//				if (BIT_CHECK(e->weekDayFlags, ltm->tm_wday)) {
-				if (BIT_CHECK(e->weekDayFlags, tc.wday)) {
+	if (i < 0)
+		return;
+	e->heapIndex = -1;
+	g_eventHeapCount--;
+	if (i == g_eventHeapCount)
+		return;
+	g_eventHeap[i] = g_eventHeap[g_eventHeapCount];
+	g_eventHeap[i]->heapIndex = i;
+	TIME_HeapUp(i);
+	TIME_HeapDown(g_eventHeap[i]->heapIndex);
+}
+
+// first time >= from (local time) on which event should run, 0 if never
+static time_t TIME_CalcNextEventTime(clockEvent_t *e, time_t from) {
+	time_t day = from - from % SECONDS_PER_DAY;
+	time_t t;
+	int d, days, wday;
+	byte hour = e->hour;
+	byte minute = e->minute;
+
+	// 8 days, because today's time may already be gone and next run is the same weekday
+	for (d = 0; d < 8; d++, day += SECONDS_PER_DAY) {
+		days = (int)(day / SECONDS_PER_DAY);
+		// 1970-01-01 was a Thursday
+		wday = (days + 4) % 7;
+		if (!BIT_CHECK(e->weekDayFlags, wday))
+			continue;
 #if ENABLE_TIME_SUNRISE_SUNSET
-					if (e->sunflags) {	// no need to check for sunrise/sunset here. If sunflags != 0, it's either of them!!
-/*
-						if (e->lastDay != ltm->tm_wday) {
-							e->lastDay = ltm->tm_wday;  // stop any further sun events today 
-							dusk2Dawn(&sun_data, e->sunflags, &e->hour, &e->minute,
-								calc_day_offset(ltm->tm_wday + 1, e->weekDayFlags));  // setup for tomorrow
-							CMD_ExecuteCommand(e->command, 0);
-							}
-*/
-						if (e->lastDay != tc.wday) {
-							e->lastDay = tc.wday;  /* stop any further sun events today */
-							dusk2Dawn(&sun_data, e->sunflags, &e->hour, &e->minute,
-								calc_day_offset(tc.wday + 1, e->weekDayFlags));  /* setup for tomorrow */
-							CMD_ExecuteCommand(e->command, 0);
-							}
-
-						else {
-							e->lastDay = -1;  /* mark with anything but a valid day of week */
-							}
-						}
-					else
+		if (e->sunflags) {
+			dusk2DawnForDay(&sun_data, e->sunflags, &hour, &minute, days - DAYS_1970_TO_2000);
+		}
 #endif
-					CMD_ExecuteCommand(e->command, 0);
-				}
-			}
+		t = day + hour * 3600 + minute * 60 + e->second;
+		if (t >= from) {
+			return t;
 		}
-		e = e->next;
+	}
+	return 0;
+}
+static void TIME_ScheduleEvent(clockEvent_t *e, time_t from) {
+	e->nextTime = e->command ? TIME_CalcNextEventTime(e, from) : 0;
+	if (e->nextTime == 0) {
+		TIME_HeapRemove(e);
+	}
+	else if (e->heapIndex < 0) {
+		TIME_HeapPush(e);
+	}
+	else {
+		TIME_HeapUp(e->heapIndex);
+		TIME_HeapDown(e->heapIndex);
+	}
+}
+// after a jump in time, forget what was skipped and start again from given time
+static void TIME_RescheduleEvents(time_t from) {
+	clockEvent_t *e;
+
+	for (e = clock_events; e; e = e->next) {
+		TIME_ScheduleEvent(e, from);
+	}
+}
+// run all events due before given time, each second costs only a look at heap top
+static void TIME_RunEventsUntil(time_t end) {
+	clockEvent_t *e;
+
+	while (g_eventHeapCount && g_eventHeap[0]->nextTime < end) {
+		e = g_eventHeap[0];
+		// schedule next run first, command may add or remove events
+		TIME_ScheduleEvent(e, e->nextTime + 1);
+#if ENABLE_TIME_SUNRISE_SUNSET
+		// setup for next day, so listing and TIME_GetEventTime show it
+		if (e->sunflags && e->nextTime) {
+			TimeComponents tc = calculateComponents(e->nextTime);
+			e->hour = tc.hour;
+			e->minute = tc.minute;
+		}
+#endif
+		CMD_ExecuteCommand(e->command, 0);
 	}
 }
 #if ENABLE_TIME_SUNRISE_SUNSET && ENABLE_TIME_DST
 // in case a DST switch happens, we should change future events of sunset/sunrise, since this will be different after a switch
-// since we calculated the events in advance, we need to "fix" all events, postulating the DST switch is allways before a days sunrise and sunset
+// local clock moves by given minutes, solar times are cached in UTC, so just
+// schedule sun events again from the moved clock and with the new offset
 void fix_DSTforEvents(int minutes){
 	clockEvent_t *e;
-	e = clock_events;
-	while (e) {
-//		addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"fix_DSTforEvents(%i) - testing  %s",minutes,e->command);
+	TimeComponents tc;
+
+	if (clock_eventsTime == 0)
+		return;
+	for (e = clock_events; e; e = e->next) {
 		if (e->command && e->sunflags) {	// only for (future) sunflag events
-//		addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"fix_DSTforEvents(%i) - fixing  %s",minutes,e->command);
-			int h = minutes/60;
-			int m = minutes % 60;
-			e->hour += h;
-			e->minute += m;
+			TIME_ScheduleEvent(e, clock_eventsTime + minutes * 60);
+			if (e->nextTime) {
+				tc = calculateComponents(e->nextTime);
+				e->hour = tc.hour;
+				e->minute = tc.minute;
+			}
 		}
-		e = e->next;
 	}
 }
 #endif
 void TIME_RunEvents(unsigned int newTime, bool bTimeValid) {
 	unsigned int delta;
-	unsigned int i;
 
 	// new time invalid?
 	if (bTimeValid == false) {
@@ -251,25 +380,22 @@ void TIME_RunEvents(unsigned int newTime, bool bTimeValid) {
 		return;
 	}
 	// old time invalid, but new one ok?
-	if (clock_eventsTime == 0) {
+	// or time went backwards
+	if (clock_eventsTime == 0 || newTime < clock_eventsTime) {
 		clock_eventsTime = (time_t)newTime;
+		TIME_RescheduleEvents(clock_eventsTime);
 		return;
 	}
-	// time went backwards
-	if (newTime < clock_eventsTime) {
+	// NTP resynchronization could cause us to skip some seconds in some rare cases?
+	delta = (unsigned int)((time_t)newTime - clock_eventsTime);
+	// a large shift in time is not expected, so limit to a constant number of seconds
+	if (delta > 100) {
+		TIME_RunEventsUntil(clock_eventsTime + 100);
 		clock_eventsTime = (time_t)newTime;
+		TIME_RescheduleEvents(clock_eventsTime);
 		return;
 	}
-	if (clock_events) {
-		// NTP resynchronization could cause us to skip some seconds in some rare cases?
-		delta = (unsigned int)((time_t)newTime - clock_eventsTime);
-		// a large shift in time is not expected, so limit to a constant number of seconds
-		if (delta > 100)
-			delta = 100;
-		for (i = 0; i < delta; i++) {
-			TIME_RunEventsForSecond(clock_eventsTime + i);
-		}
-	}
+	TIME_RunEventsUntil((time_t)newTime);
 	clock_eventsTime = (time_t)newTime;
 }
 
@@ -278,7 +404,7 @@ void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, i
 #else
 void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, const char* command) {
 #endif
-	clockEvent_t* newEvent = (clockEvent_t*)malloc(sizeof(clockEvent_t));
+	clockEvent_t* newEvent = (clockEvent_t*)MemPool_Malloc(sizeof(clockEvent_t));
 	if (newEvent == NULL) {
 		// handle error
 		return;
@@ -289,14 +415,19 @@ void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, c
 	newEvent->second = second;
 	newEvent->weekDayFlags = weekDayFlags;
 #if ENABLE_TIME_SUNRISE_SUNSET
-	newEvent->lastDay = -1;  /* mark with anything but a valid day of week */
 	newEvent->sunflags = sunflags;
 #endif
 	newEvent->id = id;
-	newEvent->command = strdup(command);
+	newEvent->command = MemPool_StrDup(command);
+	newEvent->nextTime = 0;
+	newEvent->heapIndex = -1;
 	newEvent->next = clock_events;
 
 	clock_events = newEvent;
+	// without valid time it will be scheduled once clock is set
+	if (clock_eventsTime) {
+		TIME_ScheduleEvent(newEvent, clock_eventsTime);
+	}
 }
 int TIME_RemoveEvent(int id) {
 	int ret = 0;
@@ -311,8 +442,9 @@ int TIME_RemoveEvent(int id) {
 			else {
 				prev->next = curr->next;
 			}
-			free(curr->command);
-			free(curr);
+			TIME_HeapRemove(curr);
+			MemPool_Free(curr->command);
+			MemPool_Free(curr);
 			ret++;
 			if (prev == NULL) {
 				curr = clock_events;
@@ -516,10 +648,14 @@ int TIME_ClearEvents() {
 		t++;
 		e = e->next;
 
-		free(p->command);
-		free(p);
+		MemPool_Free(p->command);
+		MemPool_Free(p);
 	}
 	clock_events = 0;
+	free(g_eventHeap);
+	g_eventHeap = 0;
+	g_eventHeapCount = 0;
+	g_eventHeapAlloc = 0;
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Removed %i events", t);
 	return t;
 }
@@ -7,7 +7,6 @@
 #include "../logging/logging.h"
 #include "../hal/hal_uart.h"
 
-//#define UART_ALWAYSFIRSTBYTES 
 #define UART_DEFAULT_BUFIZE 512
 #ifdef UART_2_UARTS_CONCURRENT
 #define UART_BUF_CNT 2
@@ -34,20 +33,39 @@ int UART_GetBufIndexFromPort(int aport) {
 #endif
 }
 
+// Receive ring, single producer (UART ISR or HAL task) and single consumer (driver).
+// Size is power of two, In and Out are free running and masked on access,
+// so In - Out is data size and whole buffer is usable. Producer only writes In,
+// consumer only writes Out, so no lock is needed. When ring is full,
+// new bytes are dropped and counted, producer never touches Out.
 typedef struct {
   byte* g_recvBuf;
   int g_recvBufSize;
-  int g_recvBufIn;
-  int g_recvBufOut;
+  volatile unsigned int g_recvBufIn;
+  volatile unsigned int g_recvBufOut;
 // used to detect uart reinit
   int g_uart_init_counter;
 // used to detect uart manual mode
   int g_uart_manualInitCounter;
+// called when data arrives to empty buffer, may be called from ISR
+  uartRxNotify_t g_rxNotify;
+// bytes dropped because ring was full or not allocated
+  unsigned int g_overflows;
+// bytes lost in hardware FIFO, reported by HAL
+  unsigned int g_overruns;
+  unsigned int g_highWater;
 } uartbuf_t;
 
-static uartbuf_t uartbuf[UART_BUF_CNT] = { {0,0,0,0,0,-1}
+// data must be in ring before other side sees new index
+#if defined(__GNUC__)
+#define UART_RING_BARRIER() __sync_synchronize()
+#else
+#define UART_RING_BARRIER()
+#endif
+
+static uartbuf_t uartbuf[UART_BUF_CNT] = { { .g_uart_manualInitCounter = -1 }
   #if UART_BUF_CNT == 2
-    , { 0,0,0,0,0,-1 } 
+    , { .g_uart_manualInitCounter = -1 }
   #endif
   };
 
@@ -60,17 +78,34 @@ int get_g_uart_init_counter() {
   return fuartbuf->g_uart_init_counter;
 }
 
+int UART_GetInitCounterEx(int auartindex) {
+  return UART_GetBufFromPort(auartindex)->g_uart_init_counter;
+}
+
 void UART_InitReceiveRingBufferEx(int auartindex, int size){
   uartbuf_t* fuartbuf=UART_GetBufFromPort(auartindex);
-  //XJIKKA 20241122 - Note that the actual usable buffer size must be g_recvBufSize-1, 
-    //otherwise there would be no difference between an empty and a full buffer.
-	  if(fuartbuf->g_recvBuf!=0)
-        free(fuartbuf->g_recvBuf);
-	  fuartbuf->g_recvBuf = (byte*)malloc(size);
-	  memset(fuartbuf->g_recvBuf,0,size);
-    fuartbuf->g_recvBufSize = size;
-    fuartbuf->g_recvBufIn = 0;
-    fuartbuf->g_recvBufOut = 0;
+  byte *old = fuartbuf->g_recvBuf;
+  int pow2 = 16;
+
+  while (pow2 < size)
+    pow2 <<= 1;
+  // producer drops bytes while size is 0
+  fuartbuf->g_recvBufSize = 0;
+  UART_RING_BARRIER();
+  fuartbuf->g_recvBuf = 0;
+  if (old != 0)
+    free(old);
+  fuartbuf->g_recvBuf = (byte*)malloc(pow2);
+  if (fuartbuf->g_recvBuf == 0)
+    return;
+  memset(fuartbuf->g_recvBuf, 0, pow2);
+  fuartbuf->g_recvBufIn = 0;
+  fuartbuf->g_recvBufOut = 0;
+  fuartbuf->g_overflows = 0;
+  fuartbuf->g_overruns = 0;
+  fuartbuf->g_highWater = 0;
+  UART_RING_BARRIER();
+  fuartbuf->g_recvBufSize = pow2;
 }
 
 void UART_InitReceiveRingBuffer(int size) {
@@ -90,9 +125,7 @@ int UART_GetReceiveRingBufferSize() {
 
 int UART_GetDataSizeEx(int auartindex) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  return (fuartbuf->g_recvBufIn >= fuartbuf->g_recvBufOut
-                ? fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut
-                : fuartbuf->g_recvBufIn + (fuartbuf->g_recvBufSize - fuartbuf->g_recvBufOut)); //XJIKKA 20241122 fixed buffer size calculation on ring bufferroverflow
+  return (int)(fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut);
 }
 
 int UART_GetDataSize() {
@@ -102,7 +135,7 @@ int UART_GetDataSize() {
 
 byte UART_GetByteEx(int auartindex, int idx) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  return fuartbuf->g_recvBuf[(fuartbuf->g_recvBufOut + idx) % fuartbuf->g_recvBufSize];
+  return fuartbuf->g_recvBuf[(fuartbuf->g_recvBufOut + idx) & (fuartbuf->g_recvBufSize - 1)];
 }
 
 byte UART_GetByte(int idx) {
@@ -112,8 +145,11 @@ byte UART_GetByte(int idx) {
 
 void UART_ConsumeBytesEx(int auartindex, int idx) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  int used = UART_GetDataSizeEx(auartindex);
+  if (idx > used)
+    idx = used;
+  UART_RING_BARRIER();
   fuartbuf->g_recvBufOut += idx;
-  fuartbuf->g_recvBufOut %= fuartbuf->g_recvBufSize;
 }
 
 void UART_ConsumeBytes(int idx) {
@@ -121,33 +157,45 @@ void UART_ConsumeBytes(int idx) {
   UART_ConsumeBytesEx(fuartindex, idx);
 }
 
-void UART_AppendByteToReceiveRingBufferEx(int auartindex, int rc) {
+// May be called from ISR, so no logging and no allocation here.
+void UART_AppendBytesToReceiveRingBufferEx(int auartindex, const byte *data, int len) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  if (fuartbuf->g_recvBufSize <= 0) {
-      //if someone (uartFakeHex) send data without init, and if flag 26 changes(UART)
-      addLogAdv(LOG_ERROR, LOG_FEATURE_DRV, "UART %i not initialized\n",auartindex);
-      //return;
-      UART_InitReceiveRingBufferEx(auartindex,UART_DEFAULT_BUFIZE);
-    }
-#ifdef UART_ALWAYSFIRSTBYTES
-    //20250119 old style, if g_recvBufSize-1 is reached, received byte was ignored
-    if (UART_GetDataSizeEx(auartindex) < (fuartbuf->g_recvBufSize - 1)) {
-#else
-    //20250119 new style, we have always last g_recvBufSize-1 bytes
-    //if g_recvBufSize-1 is reached, first byte is overwritten
-#endif
-        fuartbuf->g_recvBuf[fuartbuf->g_recvBufIn++] = rc;
-        fuartbuf->g_recvBufIn %= fuartbuf->g_recvBufSize;
-#ifdef UART_ALWAYSFIRSTBYTES
-    }
-#endif
-    //XJIKKA 20241122 if the same pointer is reached (in and out), we must also advance 
-    //the outbuffer pointer, otherwise UART_GetDataSize will return g_recvBufSize.
-    //This way now we always have the last (g_recvBufSize - 1) bytes
-    if (fuartbuf->g_recvBufIn == fuartbuf->g_recvBufOut) {
-      fuartbuf->g_recvBufOut++;
-      fuartbuf->g_recvBufOut %= fuartbuf->g_recvBufSize;
-    }
+  unsigned int in, used;
+  int size, space, first, pos;
+  if (len <= 0)
+    return;
+  size = fuartbuf->g_recvBufSize;
+  if (size <= 0) {
+    fuartbuf->g_overflows += len;
+    return;
+  }
+  in = fuartbuf->g_recvBufIn;
+  used = in - fuartbuf->g_recvBufOut;
+  space = size - (int)used;
+  if (len > space) {
+    fuartbuf->g_overflows += len - space;
+    len = space;
+    if (len <= 0)
+      return;
+  }
+  pos = in & (size - 1);
+  first = size - pos;
+  if (first > len)
+    first = len;
+  memcpy(fuartbuf->g_recvBuf + pos, data, first);
+  memcpy(fuartbuf->g_recvBuf, data + first, len - first);
+  UART_RING_BARRIER();
+  fuartbuf->g_recvBufIn = in + len;
+  if (used + len > fuartbuf->g_highWater)
+    fuartbuf->g_highWater = used + len;
+  if (used == 0 && fuartbuf->g_rxNotify) {
+    fuartbuf->g_rxNotify(auartindex);
+  }
+}
+
+void UART_AppendByteToReceiveRingBufferEx(int auartindex, int rc) {
+  byte b = rc;
+  UART_AppendBytesToReceiveRingBufferEx(auartindex, &b, 1);
 }
 
 void UART_AppendByteToReceiveRingBuffer(int rc) {
@@ -155,6 +203,79 @@ void UART_AppendByteToReceiveRingBuffer(int rc) {
   UART_AppendByteToReceiveRingBufferEx(fuartindex, rc);
 }
 
+void UART_ReportOverrunEx(int auartindex, int count) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  fuartbuf->g_overruns += count;
+}
+
+void UART_GetRingStatsEx(int auartindex, uartRingStats_t *out) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  out->size = fuartbuf->g_recvBufSize;
+  out->used = UART_GetDataSizeEx(auartindex);
+  out->highWater = fuartbuf->g_highWater;
+  out->overflows = fuartbuf->g_overflows;
+  out->overruns = fuartbuf->g_overruns;
+}
+
+// Bulk ring access.
+// Returns number of bytes that can be read in one piece from *data,
+// call UART_ConsumeBytesEx after they are used. Data wrapped around
+// end of the ring is returned by next call.
+int UART_GetDataSpanEx(int auartindex, byte **data) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  int used = UART_GetDataSizeEx(auartindex);
+  int out = fuartbuf->g_recvBufOut & (fuartbuf->g_recvBufSize - 1);
+  UART_RING_BARRIER();
+  *data = fuartbuf->g_recvBuf + out;
+  if (used > fuartbuf->g_recvBufSize - out)
+    return fuartbuf->g_recvBufSize - out;
+  return used;
+}
+
+int UART_GetDataSpan(byte **data) {
+  int fuartindex = UART_GetSelectedPortIndex();
+  return UART_GetDataSpanEx(fuartindex, data);
+}
+
+// copies up to maxLen bytes and consumes them
+int UART_ReadBytesEx(int auartindex, byte *dst, int maxLen) {
+  byte *span;
+  int total = 0;
+  int len;
+  // at most two spans, before and after wrap
+  while (total < maxLen) {
+    len = UART_GetDataSpanEx(auartindex, &span);
+    if (len <= 0)
+      break;
+    if (len > maxLen - total)
+      len = maxLen - total;
+    memcpy(dst + total, span, len);
+    UART_ConsumeBytesEx(auartindex, len);
+    total += len;
+  }
+  return total;
+}
+
+int UART_ReadBytes(byte *dst, int maxLen) {
+  int fuartindex = UART_GetSelectedPortIndex();
+  return UART_ReadBytesEx(fuartindex, dst, maxLen);
+}
+
+void UART_AppendBytesToReceiveRingBuffer(const byte *data, int len) {
+  int fuartindex = UART_GetSelectedPortIndex();
+  UART_AppendBytesToReceiveRingBufferEx(fuartindex, data, len);
+}
+
+void UART_SetReceiveNotifyEx(int auartindex, uartRxNotify_t cb) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  fuartbuf->g_rxNotify = cb;
+}
+
+void UART_SetReceiveNotify(uartRxNotify_t cb) {
+  int fuartindex = UART_GetSelectedPortIndex();
+  UART_SetReceiveNotifyEx(fuartindex, cb);
+}
+
 void UART_SendByteEx(int auartindex, byte b) {
 #ifdef UART_2_UARTS_CONCURRENT
   HAL_UART_SendByteEx(auartindex, b);
@@ -168,6 +289,17 @@ void UART_SendByte(byte b) {
   UART_SendByteEx(fuartindex, b);
 }
 
+void UART_SendBytesEx(int auartindex, const byte *data, int len) {
+  for (int i = 0; i < len; i++) {
+    UART_SendByteEx(auartindex, data[i]);
+  }
+}
+
+void UART_SendBytes(const byte *data, int len) {
+  int fuartindex = UART_GetSelectedPortIndex();
+  UART_SendBytesEx(fuartindex, data, len);
+}
+
 commandResult_t CMD_UART_Send_Hex(const void *context, const char *cmd, const char *args, int cmdFlags) {
     if (!(*args)) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "CMD_UART_Send_Hex: requires 1 argument (hex string, like FFAABB00CCDD\n");
@@ -203,6 +335,11 @@ commandResult_t CMD_UART_FakeHex(const void *context, const char *cmd, const cha
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "CMD_UART_FakeHex: requires 1 argument (hex string, like FFAABB00CCDD\n");
         return CMD_RES_NOT_ENOUGH_ARGUMENTS;
     }
+    if (UART_GetReceiveRingBufferSize() <= 0) {
+        // someone sends data without driver started, or flag 26 (UART) changed
+        addLogAdv(LOG_ERROR, LOG_FEATURE_DRV, "UART %i not initialized\n", UART_GetSelectedPortIndex());
+        UART_InitReceiveRingBuffer(UART_DEFAULT_BUFIZE);
+    }
     while (*args) {
         byte b;
         if (*args == ' ') {
@@ -266,9 +403,11 @@ int UART_InitUART(int baud, int parity, bool hwflowc) {
 
 void UART_LogBufState(int auartindex) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  ADDLOG_WARN(LOG_INFO,
-    "Uart ix %d inbuf %i inptr %i outptr %i \n",
-    auartindex, UART_GetDataSizeEx(auartindex), fuartbuf->g_recvBufIn, fuartbuf->g_recvBufOut
+  ADDLOG_WARN(LOG_FEATURE_DRV,
+    "Uart ix %d inbuf %i/%i inptr %u outptr %u high %u overflow %u overrun %u\n",
+    auartindex, UART_GetDataSizeEx(auartindex), fuartbuf->g_recvBufSize,
+    fuartbuf->g_recvBufIn, fuartbuf->g_recvBufOut,
+    fuartbuf->g_highWater, fuartbuf->g_overflows, fuartbuf->g_overruns
   );
 }
 void UART_DebugTool_Run(int auartindex) {
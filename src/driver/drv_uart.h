@@ -1,5 +1,19 @@
 #pragma once
 
+// called when data arrives to empty receive buffer, may be called from ISR
+typedef void (*uartRxNotify_t)(int auartindex);
+
+typedef struct uartRingStats_s {
+  // ring size is rounded up to power of two
+  int size;
+  int used;
+  unsigned int highWater;
+  // received bytes dropped because ring was full
+  unsigned int overflows;
+  // bytes lost before ISR read them, see UART_ReportOverrunEx
+  unsigned int overruns;
+} uartRingStats_t;
+
 //---------------------------------------------------
 // Routines using UART port depending on config 
 // flag OBK_FLAG_USE_SECONDARY_UART
@@ -12,6 +26,12 @@ byte UART_GetByte(int idx);
 void UART_ConsumeBytes(int idx);
 void UART_AppendByteToReceiveRingBuffer(int rc);
 void UART_SendByte(byte b);
+// bulk versions of above, UART_GetDataSpan gives contiguous part of ring without copying
+int UART_GetDataSpan(byte **data);
+int UART_ReadBytes(byte *dst, int maxLen);
+void UART_AppendBytesToReceiveRingBuffer(const byte *data, int len);
+void UART_SendBytes(const byte *data, int len);
+void UART_SetReceiveNotify(uartRxNotify_t cb);
 int UART_InitUART(int baud, int parity, bool hwflowc);
 void UART_AddCommands();
 void UART_RunEverySecond();
@@ -40,6 +60,20 @@ int UART_GetDataSizeEx(int auartindex);
 byte UART_GetByteEx(int auartindex, int idx);
 void UART_ConsumeBytesEx(int auartindex, int idx);
 void UART_SendByteEx(int auartindex, byte b);
+int UART_GetDataSpanEx(int auartindex, byte **data);
+int UART_ReadBytesEx(int auartindex, byte *dst, int maxLen);
+void UART_AppendBytesToReceiveRingBufferEx(int auartindex, const byte *data, int len);
+void UART_SendBytesEx(int auartindex, const byte *data, int len);
+void UART_SetReceiveNotifyEx(int auartindex, uartRxNotify_t cb);
 int UART_InitUARTEx(int auartindex, int baud, int parity, bool hwflowc);
+// changes on every UART_InitUARTEx of that port, compare with value returned by it
+int UART_GetInitCounterEx(int auartindex);
 void UART_LogBufState(int auartindex);
+void UART_GetRingStatsEx(int auartindex, uartRingStats_t *out);
+// for HAL, when UART hardware reports receive FIFO overrun; ISR safe
+void UART_ReportOverrunEx(int auartindex, int count);
 
+#if WINDOWS
+// clears init counters between simulator tests
+void UART_ResetForSimulator();
+#endif
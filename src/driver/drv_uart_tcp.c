@@ -13,6 +13,7 @@
 #define DEFAULT_BUF_SIZE		512
 #define DEFAULT_UART_TCP_PORT	8888
 #define INVALID_SOCK			-1
+#define UTCP_RX_WAIT_MS			50
 #ifndef UTCP_DEBUG
 #define UTCP_DEBUG				0
 #endif
@@ -32,11 +33,44 @@ static xTaskHandle g_trx_thread = NULL;
 static xTaskHandle g_rx_thread = NULL;
 static xTaskHandle g_tx_thread = NULL;
 static bool rx_closed, tx_closed;
-static byte* g_utcpBuf = 0;
+#if PLATFORM_BEKEN
+static beken_semaphore_t g_rxSem = NULL;
+#else
+static SemaphoreHandle_t g_rxSem = NULL;
+#endif
 
 void Start_UART_TCP(void* arg);
 void UART_TCP_Deinit();
 
+// wakes TX thread when UART data arrives to empty ring
+static void UTCP_OnUartRx(int auartindex)
+{
+#if PLATFORM_BEKEN
+	// safe from ISR
+	rtos_set_semaphore(&g_rxSem);
+#else
+	if(xPortIsInsideInterrupt())
+	{
+		BaseType_t woken = pdFALSE;
+		xSemaphoreGiveFromISR(g_rxSem, &woken);
+		portYIELD_FROM_ISR(woken);
+	}
+	else
+	{
+		xSemaphoreGive(g_rxSem);
+	}
+#endif
+}
+
+static bool UTCP_WaitForUart(int ms)
+{
+#if PLATFORM_BEKEN
+	return rtos_get_semaphore(&g_rxSem, ms) == kNoErr;
+#else
+	return xSemaphoreTake(g_rxSem, ms / portTICK_PERIOD_MS) == pdTRUE;
+#endif
+}
+
 static void UTCP_TX_Thd(void* param)
 {
 	int client_fd = *(int*)param;
@@ -44,50 +78,38 @@ static void UTCP_TX_Thd(void* param)
 	while(1)
 	{
 		int ret = 0;
-		int delay = 0;
-		memset(g_utcpBuf, 0, buf_size);
-		int len = UART_GetDataSize();
+		byte* data;
+		int len;
 
 		if(client_fd == INVALID_SOCK) goto exit;
-		while(len < buf_size && delay < 10)
-		{
-			rtos_delay_milliseconds(1);
-			len = UART_GetDataSize();
-			delay++;
-		}
-
-		if(len > 0)
-		{
-			for(int i = 0; i < len; i++)
-			{
-				g_utcpBuf[i] = UART_GetByte(i);
-			}
-			UART_ConsumeBytes(len);
-#if UTCP_DEBUG
-			char data[len * 2];
-			char* p = data;
-			for(int i = 0; i < len; i++)
-			{
-				sprintf(p, "%02X", g_utcpBuf[i]);
-				p += 2;
-			}
-			ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes UART RX->TCP TX: %s", len, data);
-#endif
-			ret = send(client_fd, g_utcpBuf, len, 0);
-		}
-		else
+		len = UART_GetDataSpan(&data);
+		if(len <= 0)
 		{
 			if(rx_closed)
 			{
 				goto exit;
 			}
+			// timeout only to notice closed connection
+			UTCP_WaitForUart(UTCP_RX_WAIT_MS);
 			continue;
 		}
-
+		if(len > buf_size)
+			len = buf_size;
+#if UTCP_DEBUG
+		char hex[len * 2 + 1];
+		char* p = hex;
+		for(int i = 0; i < len; i++)
+		{
+			sprintf(p, "%02X", data[i]);
+			p += 2;
+		}
+		ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes UART RX->TCP TX: %s", len, hex);
+#endif
+		// straight from ring memory, span is consumed after it is sent
+		ret = send(client_fd, data, len, 0);
 		if(ret <= 0)
 			goto exit;
-
-		rtos_delay_milliseconds(5);
+		UART_ConsumeBytes(ret);
 	}
 
 exit:
@@ -119,10 +141,7 @@ static void UTCP_RX_Thd(void* param)
 			}
 			ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes TCP RX->UART TX: %s", ret, data);
 #endif
-			for(int i = 0; i < ret; i++)
-			{
-				UART_SendByte(buffer[i]);
-			}
+			UART_SendBytes(buffer, ret);
 		}
 		else if(tx_closed)
 		{
@@ -276,7 +295,15 @@ void Start_UART_TCP(void* arg)
 {
 	UART_TCP_Deinit();
 
-	g_utcpBuf = (byte*)os_malloc(buf_size);
+	if(g_rxSem == NULL)
+	{
+#if PLATFORM_BEKEN
+		rtos_init_semaphore(&g_rxSem, 1);
+#else
+		g_rxSem = xSemaphoreCreateBinary();
+#endif
+	}
+	UART_SetReceiveNotify(UTCP_OnUartRx);
 
 	OSStatus err = rtos_create_thread(&g_trx_thread, BEKEN_APPLICATION_PRIORITY,
 		"UART_TCP_TRX",
@@ -342,7 +369,7 @@ void UART_TCP_Deinit()
 		rtos_delete_thread(&g_tx_thread);
 		g_tx_thread = NULL;
 	}
-	if(g_utcpBuf) free(g_utcpBuf);
+	UART_SetReceiveNotify(NULL);
 
 	if(listen_sock != INVALID_SOCK) close(listen_sock);
 	if(client_sock != INVALID_SOCK) close(client_sock);
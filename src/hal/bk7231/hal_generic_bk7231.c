@@ -48,6 +48,27 @@ static uint32_t getTicksCount() {
 // 26 ticks per us * 15 000 000 us per overflow
 #define TICKS_PER_OVERFLOW (TICKS_PER_US * US_PER_OVERFLOW)
 
+// calibration timer restarts every 15 s, count restarts to make it free running.
+// Quick tick reads it far more often than that, so no restart is missed.
+// Also called from pin ISRs, so timer read and restart count are done with interrupts off.
+unsigned int HAL_GetTimeUs() {
+	static uint32_t lastTicks = 0;
+	static uint32_t baseUs = 0;
+	uint32_t ticks, r;
+	GLOBAL_INT_DECLARATION();
+
+	GLOBAL_INT_DISABLE();
+	ticks = getTicksCount();
+	if (ticks == BK_TIMER_FAILURE)
+		ticks = lastTicks;
+	if (ticks < lastTicks)
+		baseUs += US_PER_OVERFLOW;
+	lastTicks = ticks;
+	r = baseUs + ticks / TICKS_PER_US;
+	GLOBAL_INT_RESTORE();
+	return r;
+}
+
 #endif // #if ! (PLATFORM_BK7252 || PLATFORM_BK7238)
 
 // https://github.com/libretiny-eu/libretiny
@@ -12,11 +12,6 @@
 #include "../../driver/drv_bl_shared.h"
 #include "../../driver/drv_hlw8112.h"
 
-static unsigned char *sector = (void *)0;
-int sectorlen = 0;
-unsigned int addr = 0xff000;
-#define SECTOR_SIZE 0x1000
-static void store_sector(unsigned int addr, unsigned char *data);
 extern void flash_protection_op(UINT8 mode,PROTECT_TYPE type);
 
 // from wlan_ui.c
@@ -33,88 +28,46 @@ int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
 	return res;
 }
 
+int HAL_OTA_WriteSector(unsigned int addr, const unsigned char *data, int len) {
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
+	flash_ctrl(CMD_FLASH_ERASE_SECTOR, &addr);
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
+	return flash_write((char *)data, len, addr);
+}
+
 int init_ota(unsigned int startaddr){
-    flash_init();
-	  flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_PROTECT_NONE);
     if (startaddr > 0xff000){
-        if (sector){
-            addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"aborting OTS, sector already non-null\n");
-            return 0;
-        }
-        sector = os_malloc(SECTOR_SIZE);
-        sectorlen = 0;
-        addr = startaddr;
-        addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"init OTA, startaddr 0x%x\n", startaddr);
-        return 1;
+        flash_init();
+        flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_PROTECT_NONE);
+        // sectors are erased and programmed by pipeline writer task
+        // while next one is being received
+        return OTA_Pipeline_Begin(startaddr);
     }
     addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"aborting OTA, startaddr 0x%x < 0xff000\n", startaddr);
     return 0;
 }
 
-void close_ota(){
-    addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\n");
-    if (sectorlen){
-        addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"close OTA, additional 0x%x FF added \n", SECTOR_SIZE - sectorlen);
-        memset(sector+sectorlen, 0xff, SECTOR_SIZE - sectorlen);
-        sectorlen = SECTOR_SIZE;
-        store_sector(addr, sector);
-        addr += 1024;
-        sectorlen = 0;
-    }
-    addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"close OTA, addr 0x%x\n", addr);
+// returns 1 if CRC of flash matches received data
+int close_ota(){
+    int bOk;
 
-    os_free(sector);
-    sector = (void *)0;
-	  flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_UNPROTECT_LAST_BLOCK);
+    addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\n");
+    if (!OTA_Pipeline_IsActive())
+        return 0;
+    bOk = OTA_Pipeline_End();
+    flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_UNPROTECT_LAST_BLOCK);
+    return bOk;
 }
 
 void add_otadata(unsigned char *data, int len)
 {
-    if (!sector) return;
-    //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"OTA DataRxed start: %02.2x %02.2x len %d\r\n", data[0], data[1], len);
-    while (len > 0)
-    {
-        // force it to sleep...  we MUST have some idle task processing
-	    // else task memory doesn't get freed
-
-        if (sectorlen < SECTOR_SIZE)
-        {
-            int lenstore = SECTOR_SIZE - sectorlen;
-            if (lenstore > len) 
-                lenstore = len;
-            memcpy(sector + sectorlen, data, lenstore);
-            data += lenstore;
-            len -= lenstore;
-            sectorlen += lenstore;
-            //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"OTA sector start: %02.2x %02.2x len %d\r\n", sector[0], sector[1], sectorlen);
-        }
-
-        if (sectorlen == SECTOR_SIZE){
-            store_sector(addr, sector);
-            addr += SECTOR_SIZE;
-            sectorlen = 0;
-        } else {
-            //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"OTA sectorlen 0x%x not yet 0x%x\n", sectorlen, SECTOR_SIZE);
-            rtos_delay_milliseconds(10);
-        }
-    }
-}
-
-static void store_sector(unsigned int addr, unsigned char *data){
-    //if (!(addr % 0x4000))
-    {
-      addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"%x", addr);
-    }
-    //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"writing OTA, addr 0x%x\n", addr);
-    flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
-    flash_ctrl(CMD_FLASH_ERASE_SECTOR, &addr);
-    flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
-    flash_write((char *)data , SECTOR_SIZE, addr);
-    OTA_IncrementProgress(SECTOR_SIZE);
+    OTA_Pipeline_Write(data, len);
 }
 
 
 httprequest_t httprequest;
+// connection or receive error reported by http client during current OTA
+static int g_otaRequestFailed;
 
 int myhttpclientcallback(httprequest_t* request){
 
@@ -129,6 +82,7 @@ int myhttpclientcallback(httprequest_t* request){
     case 0: // start
       //init_ota(0xff000);
 
+      g_otaRequestFailed = 0;
       init_ota(START_ADR_OF_BK_PARTITION_OTA);
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\nmyhttpclientcallback state %d total %d/%d\r\n", request->state, OTA_GetTotalBytes(), request->client_data.response_content_len);
       break;
@@ -139,8 +93,19 @@ int myhttpclientcallback(httprequest_t* request){
         add_otadata(d, l);
       }
       break;
+    case -1:
+    case -2:
+      g_otaRequestFailed = 1;
+      break;
     case 2: // ended, write any remaining bytes to the sector
-      close_ota();
+      // size is known only after headers came, chunked replies have none
+      if (OTA_Pipeline_IsActive() && request->client_data.response_content_len > 0)
+        OTA_Pipeline_SetExpectedSize(request->client_data.response_content_len);
+      if (!close_ota() || g_otaRequestFailed){
+        OTA_ResetProgress();
+        addLogAdv(LOG_ERROR, LOG_FEATURE_OTA,"OTA verify failed, not rebooting\r\n");
+        break;
+      }
       OTA_ResetProgress();
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\nmyhttpclientcallback state %d total %d/%d\r\n", request->state, OTA_GetTotalBytes(), request->client_data.response_content_len);
 
@@ -218,7 +183,8 @@ void otarequest(const char *urlin){
   request->port = 80;//HTTP_PORT;
   request->url = url;
   request->method = HTTPCLIENT_GET;
-  request->timeout = 10000;
+  // deadline for whole image, not for each chunk
+  request->timeout = 300000;
   HTTPClient_Async_SendGeneric(request);
   //+2 Updating ota_status to 0 as before.
   OTA_ResetProgress();
@@ -234,16 +200,29 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "OTA post len %d", request->contentLength);
 
-	init_ota(startaddr);
+	if (!init_ota(startaddr))
+	{
+		return http_rest_error(request, -22, "OTA already in progress or bad address");
+	}
 
 	if (request->contentLength >= 0)
 	{
 		towrite = request->contentLength;
+		OTA_Pipeline_SetExpectedSize(request->contentLength);
+	}
+	// optional CRC32 of image, i.e. curl -H "X-OTA-CRC32: 1A2B3C4D"
+	for (int i = 0; i < request->numheaders; i++)
+	{
+		if (!my_strnicmp(request->headers[i], "X-OTA-CRC32:", 12))
+		{
+			OTA_Pipeline_SetExpectedCRC(strtoul(request->headers[i] + 12, NULL, 16));
+		}
 	}
 
 	if (writelen < 0 || (startaddr + writelen > maxaddr))
 	{
 		ADDLOG_DEBUG(LOG_FEATURE_OTA, "ABORTED: %d bytes to write", writelen);
+		close_ota();
 		return http_rest_error(request, -20, "writelen < 0 or end > 0x200000");
 	}
 
@@ -264,10 +243,14 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 			}
 		}
 	} while ((towrite > 0) && (writelen >= 0));
-	close_ota();
+	if (!close_ota())
+	{
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA verify failed, %d total bytes written", total);
+		return http_rest_error(request, -21, "OTA verify failed");
+	}
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d total bytes written", total);
 	http_setup(request, httpMimeTypeJson);
-	hprintf255(request, "{\"size\":%d}", total);
+	hprintf255(request, "{\"size\":%d,\"crc\":\"%08X\"}", total, OTA_Pipeline_GetStats()->rxCrc);
 	poststr(request, NULL);
 	CFG_IncrementOTACount();
 	return 0;
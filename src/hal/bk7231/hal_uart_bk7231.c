@@ -12,10 +12,19 @@ extern void bk_send_byte(UINT8 uport, UINT8 data);
 void test_ty_read_uart_data_to_buffer(int port, void* param)
 {
 	int rc = 0;
-  int fbufindex = UART_GetBufIndexFromPort(port);
-
-	while((rc = uart_read_byte(port)) != -1)
-		UART_AppendByteToReceiveRingBufferEx(fbufindex,rc);
+	byte buf[32];
+	int len = 0;
+
+	// whole FIFO goes to ring in as few appends as possible
+	while((rc = uart_read_byte(port)) != -1) {
+		buf[len++] = rc;
+		if (len == sizeof(buf)) {
+			UART_AppendBytesToReceiveRingBufferEx(port, buf, len);
+			len = 0;
+		}
+	}
+	if (len)
+		UART_AppendBytesToReceiveRingBufferEx(port, buf, len);
 }
 
 int bk_port_from_portindex(int auartindex) {
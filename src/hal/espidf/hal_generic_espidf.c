@@ -8,6 +8,7 @@
 #include "freertos/FreeRTOS.h"
 #if PLATFORM_ESPIDF
 #include "hal/wdt_hal.h"
+#include "esp_timer.h"
 #endif
 
 static int bFlashReady = 0;
@@ -37,6 +38,13 @@ void HAL_Delay_us(int delay)
 	usleep(delay);
 }
 
+#if PLATFORM_ESPIDF
+unsigned int HAL_GetTimeUs()
+{
+	return (unsigned int)esp_timer_get_time();
+}
+#endif
+
 void HAL_Run_WDT()
 {
 #if PLATFORM_ESPIDF
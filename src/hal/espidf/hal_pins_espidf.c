@@ -631,6 +631,15 @@ void HAL_AttachInterrupt(int pinIndex, OBKInterruptType mode, OBKInterruptHandle
 	}
 	espPinMapping_t* esp_cf = g_pins + pinIndex;
 	int esp_mode;
+	if (mode == INTERRUPT_CHANGE) {
+		// input pin is already set up by its role, keep its pull resistors
+		gpio_set_intr_type(esp_cf->pin, GPIO_INTR_ANYEDGE);
+		gpio_isr_handler_add(esp_cf->pin, ESP_Interrupt, (void*)pinIndex);
+#if PLATFORM_ESPIDF
+		gpio_intr_enable(esp_cf->pin);
+#endif
+		return;
+	}
 	if (mode == INTERRUPT_RISING) {
 		esp_mode = GPIO_INTR_POSEDGE;
 	}
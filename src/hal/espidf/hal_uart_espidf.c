@@ -39,10 +39,7 @@ static void uart_event_task(void* pvParameters)
 			{
 			case UART_DATA:
 				uart_read_bytes(uartnum, data, event.size, portMAX_DELAY);
-				for (int i = 0; i < event.size; i++)
-				{
-					UART_AppendByteToReceiveRingBuffer(data[i]);
-				}
+				UART_AppendBytesToReceiveRingBuffer(data, event.size);
 				break;
 			case UART_BUFFER_FULL:
 			case UART_FIFO_OVF:
@@ -88,12 +85,9 @@ static void uart_event_task(void* pvParameters)
 	while (1)
 	{
 		int len = uart_read_bytes(uartnum, data, 512, 20 / portTICK_RATE_MS);
-		if (len)
+		if (len > 0)
 		{
-			for (int i = 0; i < len; i++)
-			{
-				UART_AppendByteToReceiveRingBuffer(data[i]);
-			}
+			UART_AppendBytesToReceiveRingBuffer(data, len);
 		}
 	}
 }
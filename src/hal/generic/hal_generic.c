@@ -1,3 +1,4 @@
+#include "../../new_common.h"
 #include "../hal_generic.h"
 
 void __attribute__((weak)) HAL_RebootModule()
@@ -15,6 +16,14 @@ void __attribute__((weak)) HAL_Delay_us(int delay)
 	}
 }
 
+#ifndef WINDOWS
+// RTOS tick resolution, platforms with a hardware timer override this
+unsigned int __attribute__((weak)) HAL_GetTimeUs()
+{
+	return (unsigned int)(xTaskGetTickCount() * portTICK_PERIOD_MS * 1000);
+}
+#endif
+
 void __attribute__((weak)) HAL_Configure_WDT()
 {
 
@@ -0,0 +1,251 @@
+// Double buffered OTA writer, platform only provides HAL_OTA_WriteSector
+// and HAL_FlashRead (Beken HAL, simulator).
+// One sector is filled from the network while the other one is
+// erased, programmed and read back by the writer task.
+// CRC32 of received data is computed as it arrives and compared
+// with CRC32 of flash contents read back after programming.
+// The image itself is verified only if caller gave its size and CRC.
+#include "../../obk_config.h"
+
+#if PLATFORM_BEKEN || WINDOWS
+
+#include "../../new_common.h"
+#include "../../logging/logging.h"
+#include "../hal_ota.h"
+
+#define OTA_PIPELINE_SECTOR_SIZE 0x1000
+#define OTA_PIPELINE_VERIFY_CHUNK 256
+
+static byte *g_otaBuffers[2];
+// buffer being filled from the network
+static int g_otaFillIndex;
+static int g_otaFillLen;
+static unsigned int g_otaFillAddr;
+// buffer handed to the writer
+static int g_otaPendingIndex;
+static unsigned int g_otaPendingAddr;
+static int g_otaActive = 0;
+static otaPipelineStats_t g_otaStats;
+
+#if PLATFORM_BEKEN
+static beken_semaphore_t g_otaReadySem = NULL;
+static beken_semaphore_t g_otaFreeSem = NULL;
+static volatile bool g_otaQuit;
+#endif
+
+static const unsigned int g_crcNibbleTable[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// running CRC32 (poly 0xEDB88320), start with 0 and pass previous result
+unsigned int OTA_CRC32_Update(unsigned int crc, const byte *data, int len) {
+	crc = ~crc;
+	while (len--) {
+		crc ^= *data++;
+		crc = (crc >> 4) ^ g_crcNibbleTable[crc & 0x0F];
+		crc = (crc >> 4) ^ g_crcNibbleTable[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+static void OTA_Pipeline_StoreSector() {
+	byte verify[OTA_PIPELINE_VERIFY_CHUNK];
+	unsigned int addr = g_otaPendingAddr;
+	byte *data = g_otaBuffers[g_otaPendingIndex];
+	int i;
+
+	if (HAL_OTA_WriteSector(addr, data, OTA_PIPELINE_SECTOR_SIZE) != 0) {
+		g_otaStats.writeErrors++;
+	}
+	for (i = 0; i < OTA_PIPELINE_SECTOR_SIZE; i += OTA_PIPELINE_VERIFY_CHUNK) {
+		HAL_FlashRead((char *)verify, OTA_PIPELINE_VERIFY_CHUNK, addr + i);
+		g_otaStats.flashCrc = OTA_CRC32_Update(g_otaStats.flashCrc, verify, OTA_PIPELINE_VERIFY_CHUNK);
+	}
+	g_otaStats.sectorsWritten++;
+	OTA_IncrementProgress(OTA_PIPELINE_SECTOR_SIZE);
+}
+
+#if PLATFORM_BEKEN
+static void OTA_Pipeline_WriterThread(beken_thread_arg_t arg) {
+	while (1) {
+		rtos_get_semaphore(&g_otaReadySem, BEKEN_WAIT_FOREVER);
+		if (g_otaQuit)
+			break;
+		OTA_Pipeline_StoreSector();
+		rtos_set_semaphore(&g_otaFreeSem);
+	}
+	rtos_set_semaphore(&g_otaFreeSem);
+	rtos_delete_thread(NULL);
+}
+// blocks until writer has finished previous sector
+static void OTA_Pipeline_WaitForWriter() {
+	if (rtos_get_semaphore(&g_otaFreeSem, 0) != kNoErr) {
+		g_otaStats.waitsForWriter++;
+		rtos_get_semaphore(&g_otaFreeSem, BEKEN_WAIT_FOREVER);
+	}
+}
+#endif
+
+static void OTA_Pipeline_HandOff() {
+#if PLATFORM_BEKEN
+	OTA_Pipeline_WaitForWriter();
+#endif
+	g_otaPendingIndex = g_otaFillIndex;
+	g_otaPendingAddr = g_otaFillAddr;
+	g_otaFillIndex ^= 1;
+	g_otaFillAddr += OTA_PIPELINE_SECTOR_SIZE;
+	g_otaFillLen = 0;
+#if PLATFORM_BEKEN
+	rtos_set_semaphore(&g_otaReadySem);
+#else
+	// no semaphores in simulator, sector is written right away
+	OTA_Pipeline_StoreSector();
+#endif
+}
+
+static void OTA_Pipeline_Free() {
+	os_free(g_otaBuffers[0]);
+	os_free(g_otaBuffers[1]);
+	g_otaBuffers[0] = 0;
+	g_otaBuffers[1] = 0;
+#if PLATFORM_BEKEN
+	if (g_otaReadySem) {
+		rtos_deinit_semaphore(&g_otaReadySem);
+		g_otaReadySem = NULL;
+	}
+	if (g_otaFreeSem) {
+		rtos_deinit_semaphore(&g_otaFreeSem);
+		g_otaFreeSem = NULL;
+	}
+#endif
+	g_otaActive = 0;
+}
+
+int OTA_Pipeline_Begin(unsigned int startaddr) {
+	if (g_otaActive) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline already active\n");
+		return 0;
+	}
+	if (startaddr % OTA_PIPELINE_SECTOR_SIZE) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline start 0x%x not sector aligned\n", startaddr);
+		return 0;
+	}
+	g_otaBuffers[0] = os_malloc(OTA_PIPELINE_SECTOR_SIZE);
+	g_otaBuffers[1] = os_malloc(OTA_PIPELINE_SECTOR_SIZE);
+	if (g_otaBuffers[0] == 0 || g_otaBuffers[1] == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline malloc failed\n");
+		OTA_Pipeline_Free();
+		return 0;
+	}
+	memset(&g_otaStats, 0, sizeof(g_otaStats));
+	g_otaFillIndex = 0;
+	g_otaFillLen = 0;
+	g_otaFillAddr = startaddr;
+	g_otaActive = 1;
+#if PLATFORM_BEKEN
+	g_otaQuit = false;
+	if (rtos_init_semaphore(&g_otaReadySem, 1) != kNoErr
+		|| rtos_init_semaphore(&g_otaFreeSem, 1) != kNoErr) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline semaphore init failed\n");
+		OTA_Pipeline_Free();
+		return 0;
+	}
+	// writer is idle
+	rtos_set_semaphore(&g_otaFreeSem);
+	if (rtos_create_thread(NULL, BEKEN_APPLICATION_PRIORITY, "OTA writer",
+		(beken_thread_function_t)OTA_Pipeline_WriterThread, 0x800, (beken_thread_arg_t)0) != kNoErr) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline writer thread failed\n");
+		OTA_Pipeline_Free();
+		return 0;
+	}
+#endif
+	addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA pipeline started, startaddr 0x%x\n", startaddr);
+	return 1;
+}
+
+void OTA_Pipeline_Write(const byte *data, int len) {
+	int lenstore;
+
+	if (!g_otaActive || len <= 0)
+		return;
+	g_otaStats.rxCrc = OTA_CRC32_Update(g_otaStats.rxCrc, data, len);
+	g_otaStats.imageCrc = OTA_CRC32_Update(g_otaStats.imageCrc, data, len);
+	g_otaStats.bytesReceived += len;
+	while (len > 0) {
+		lenstore = OTA_PIPELINE_SECTOR_SIZE - g_otaFillLen;
+		if (lenstore > len)
+			lenstore = len;
+		memcpy(g_otaBuffers[g_otaFillIndex] + g_otaFillLen, data, lenstore);
+		data += lenstore;
+		len -= lenstore;
+		g_otaFillLen += lenstore;
+		if (g_otaFillLen == OTA_PIPELINE_SECTOR_SIZE) {
+			OTA_Pipeline_HandOff();
+		}
+	}
+}
+
+void OTA_Pipeline_SetExpectedSize(int size) {
+	g_otaStats.expectedSize = size;
+}
+
+void OTA_Pipeline_SetExpectedCRC(unsigned int crc) {
+	g_otaStats.expectedCrc = crc;
+	g_otaStats.bHasExpectedCrc = 1;
+}
+
+int OTA_Pipeline_End() {
+	int pad;
+	bool bFlashOk, bSizeOk, bImageOk;
+
+	if (!g_otaActive)
+		return 0;
+	if (g_otaFillLen) {
+		pad = OTA_PIPELINE_SECTOR_SIZE - g_otaFillLen;
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "close OTA, additional 0x%x FF added\n", pad);
+		memset(g_otaBuffers[g_otaFillIndex] + g_otaFillLen, 0xff, pad);
+		// padding is written to flash too, so it must be in received CRC
+		g_otaStats.rxCrc = OTA_CRC32_Update(g_otaStats.rxCrc, g_otaBuffers[g_otaFillIndex] + g_otaFillLen, pad);
+		g_otaFillLen = OTA_PIPELINE_SECTOR_SIZE;
+		OTA_Pipeline_HandOff();
+	}
+#if PLATFORM_BEKEN
+	// wait for last sector, then stop writer
+	OTA_Pipeline_WaitForWriter();
+	g_otaQuit = true;
+	rtos_set_semaphore(&g_otaReadySem);
+	rtos_get_semaphore(&g_otaFreeSem, BEKEN_WAIT_FOREVER);
+#endif
+	OTA_Pipeline_Free();
+
+	// flash holds what was received
+	bFlashOk = g_otaStats.writeErrors == 0 && g_otaStats.rxCrc == g_otaStats.flashCrc;
+	// and what was received is the whole image
+	bSizeOk = g_otaStats.expectedSize <= 0 || g_otaStats.bytesReceived == g_otaStats.expectedSize;
+	bImageOk = !g_otaStats.bHasExpectedCrc || g_otaStats.imageCrc == g_otaStats.expectedCrc;
+	addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "close OTA, addr 0x%x, %i sectors, rx crc %08X, flash crc %08X, writer waits %i - flash %s\n",
+		g_otaFillAddr, g_otaStats.sectorsWritten, g_otaStats.rxCrc, g_otaStats.flashCrc,
+		g_otaStats.waitsForWriter, bFlashOk ? "ok" : "MISMATCH");
+	if (!bSizeOk) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA image incomplete, got %i of %i bytes\n",
+			g_otaStats.bytesReceived, g_otaStats.expectedSize);
+	}
+	if (g_otaStats.bHasExpectedCrc) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA image crc %08X, expected %08X - %s\n",
+			g_otaStats.imageCrc, g_otaStats.expectedCrc, bImageOk ? "verified" : "VERIFY FAILED");
+	}
+	return bFlashOk && bSizeOk && bImageOk;
+}
+
+const otaPipelineStats_t *OTA_Pipeline_GetStats() {
+	return &g_otaStats;
+}
+
+int OTA_Pipeline_IsActive() {
+	return g_otaActive;
+}
+
+#endif
@@ -1,5 +1,7 @@
 
 void HAL_RebootModule();
 void HAL_Delay_us(int delay);
+// free running microsecond counter, wraps at 2^32, only differences are meaningful
+unsigned int HAL_GetTimeUs();
 void HAL_Configure_WDT();
 void HAL_Run_WDT();
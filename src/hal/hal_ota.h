@@ -42,5 +42,71 @@ void OTA_SetTotalBytes(int value);
 
 int HAL_FlashRead(char*buffer, int readlen, int startaddr);
 
+/***** Double buffered OTA writer, Beken and simulator, see generic/hal_ota_pipeline.c ******/
+
+/// @brief Erase sector and program it, provided by platform HAL for OTA pipeline.
+/// @param addr sector aligned flash address
+/// @param data
+/// @param len one sector
+/// @return 0 on success
+int HAL_OTA_WriteSector(unsigned int addr, const unsigned char *data, int len);
+
+typedef struct otaPipelineStats_s {
+	int sectorsWritten;
+	int bytesReceived;
+	// CRC32 of received data (with final 0xFF padding) and of flash read back
+	unsigned int rxCrc;
+	unsigned int flashCrc;
+	// CRC32 of received data without padding, and what caller expects
+	unsigned int imageCrc;
+	unsigned int expectedCrc;
+	int bHasExpectedCrc;
+	// 0 if not known
+	int expectedSize;
+	int writeErrors;
+	// how many times receiver had to wait for previous sector to be programmed
+	int waitsForWriter;
+} otaPipelineStats_t;
+
+/// @brief Update running CRC32. Start with 0.
+/// @param crc
+/// @param data
+/// @param len
+/// @return
+unsigned int OTA_CRC32_Update(unsigned int crc, const unsigned char *data, int len);
+
+/// @brief Start writing image at given sector aligned flash address.
+/// @param startaddr
+/// @return 1 on success
+int OTA_Pipeline_Begin(unsigned int startaddr);
+
+/// @brief Queue received data. Full sectors are erased and programmed by writer task.
+/// @param data
+/// @param len
+void OTA_Pipeline_Write(const unsigned char *data, int len);
+
+/// @brief Size of whole image, if known. End fails when a different amount arrived.
+/// Call after OTA_Pipeline_Begin.
+/// @param size
+void OTA_Pipeline_SetExpectedSize(int size);
+
+/// @brief CRC32 of whole image, if known. End fails when received data does not match.
+/// Call after OTA_Pipeline_Begin.
+/// @param crc
+void OTA_Pipeline_SetExpectedCRC(unsigned int crc);
+
+/// @brief Flush last sector, stop writer and compare CRC of received data with flash.
+/// Also checks size and CRC of image if they were given.
+/// @return 1 if flash matches received data and received data matches expectations
+int OTA_Pipeline_End();
+
+/// @brief Stats of current or last OTA.
+/// @return
+const otaPipelineStats_t *OTA_Pipeline_GetStats();
+
+/// @brief Is there OTA in progress.
+/// @return
+int OTA_Pipeline_IsActive();
+
 #endif /* __OTA_H__ */
 
@@ -1,6 +1,11 @@
 #ifdef WINDOWS
 
 #include "../hal_generic.h"
+#if LINUX
+#include <time.h>
+#else
+#include <windows.h>
+#endif
 
 void HAL_RebootModule() 
 {
@@ -12,6 +17,22 @@ void HAL_Delay_us(int delay)
 
 }
 
+unsigned int HAL_GetTimeUs()
+{
+#if LINUX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned int)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#else
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned int)(now.QuadPart * 1000000ULL / freq.QuadPart);
+#endif
+}
+
 void HAL_Configure_WDT()
 {
 
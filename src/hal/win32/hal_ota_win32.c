@@ -5,6 +5,8 @@
 #include "../../new_cfg.h"
 #include "../../httpserver/new_http.h"
 #include "../../logging/logging.h"
+#include "../hal_ota.h"
+#include "flash_pub.h"
 
 int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
 	int res;
@@ -12,6 +14,14 @@ int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
 	return res;
 }
 
+// same sequence as Beken HAL, on simulated flash
+int HAL_OTA_WriteSector(unsigned int addr, const unsigned char *data, int len) {
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
+	flash_ctrl(CMD_FLASH_ERASE_SECTOR, &addr);
+	flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
+	return flash_write((char *)data, len, addr);
+}
+
 int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 
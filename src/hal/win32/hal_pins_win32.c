@@ -18,12 +18,22 @@ int g_simulatedPinStates[PLATFORM_GPIO_MAX];
 int g_simulatedPWMs[PLATFORM_GPIO_MAX];
 simulatedPinMode_t g_pinModes[PLATFORM_GPIO_MAX];
 int g_simulatedADCValues[PLATFORM_GPIO_MAX];
+static OBKInterruptHandler g_simulatedHandlers[PLATFORM_GPIO_MAX];
+static OBKInterruptType g_simulatedIntModes[PLATFORM_GPIO_MAX];
+static float g_simulatedPulseHz[PLATFORM_GPIO_MAX];
+static double g_simulatedNextPulseUs[PLATFORM_GPIO_MAX];
+// time of edge being generated, 0 outside of SIM_RunPinPulses
+static double g_simulatedPulseNowUs;
+
+int rtos_get_time();
 
 void SIM_Hack_ClearSimulatedPinRoles() {
 	memset(g_simulatedPinStates, 0, sizeof(g_simulatedPinStates));
 	memset(g_simulatedPWMs, 0, sizeof(g_simulatedPWMs));
 	memset(g_pinModes, 0, sizeof(g_pinModes));
 	memset(g_simulatedADCValues, 0, sizeof(g_simulatedADCValues));
+	memset(g_simulatedHandlers, 0, sizeof(g_simulatedHandlers));
+	memset(g_simulatedPulseHz, 0, sizeof(g_simulatedPulseHz));
 }
 
 static int adcToGpio[] = {
@@ -57,7 +67,48 @@ int HAL_ADC_Read(int pinNumber) {
 	return g_simulatedADCValues[pinNumber];
 }
 void SIM_SetSimulatedPinValue(int pinIndex, bool bHigh) {
+	int prev = g_simulatedPinStates[pinIndex];
+	OBKInterruptType mode;
+
 	g_simulatedPinStates[pinIndex] = bHigh;
+	// like pin interrupt on hardware, called right away
+	if (g_simulatedHandlers[pinIndex] == 0 || prev == bHigh)
+		return;
+	mode = g_simulatedIntModes[pinIndex];
+	if (mode == INTERRUPT_CHANGE || (mode == INTERRUPT_RISING && bHigh)
+		|| (mode == INTERRUPT_FALLING && !bHigh)) {
+		g_simulatedHandlers[pinIndex](pinIndex);
+	}
+}
+void SIM_SetPinPulseFrequency(int index, float hz) {
+	if (hz > 0 && g_simulatedPulseHz[index] <= 0) {
+		g_simulatedNextPulseUs[index] = rtos_get_time() * 1000.0 + 1000000.0 / hz;
+	}
+	g_simulatedPulseHz[index] = hz;
+}
+unsigned int SIM_GetTimeUs() {
+	if (g_simulatedPulseNowUs > 0)
+		return (unsigned int)(unsigned long long)g_simulatedPulseNowUs;
+	return (unsigned int)(rtos_get_time() * 1000ULL);
+}
+// called once per frame, after simulated time was advanced
+void SIM_RunPinPulses() {
+	double frameEnd = rtos_get_time() * 1000.0;
+	double period;
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_simulatedPulseHz[i] <= 0)
+			continue;
+		period = 1000000.0 / g_simulatedPulseHz[i];
+		while (g_simulatedNextPulseUs[i] <= frameEnd) {
+			g_simulatedPulseNowUs = g_simulatedNextPulseUs[i];
+			SIM_SetSimulatedPinValue(i, true);
+			SIM_SetSimulatedPinValue(i, false);
+			g_simulatedNextPulseUs[i] += period;
+		}
+	}
+	g_simulatedPulseNowUs = 0;
 }
 bool SIM_GetSimulatedPinValue(int pinIndex) {
 	return g_simulatedPinStates[pinIndex];
@@ -233,10 +284,11 @@ unsigned int HAL_GetGPIOPin(int index) {
 }
 
 void HAL_AttachInterrupt(int pinIndex, OBKInterruptType mode, OBKInterruptHandler function) {
-
+	g_simulatedIntModes[pinIndex] = mode;
+	g_simulatedHandlers[pinIndex] = function;
 }
 void HAL_DetachInterrupt(int pinIndex) {
-
+	g_simulatedHandlers[pinIndex] = 0;
 }
 
 
@@ -35,6 +35,13 @@
 
 // even github release link is 84 chars..
 #define HTTPCLIENT_MAX_HOST_LEN   128
+
+/** @brief   Async requests waiting for the worker thread. */
+#define HTTPCLIENT_QUEUE_LEN      8
+/** @brief   Idle keep-alive connections kept open. */
+#define HTTPCLIENT_POOL_SIZE      2
+/** @brief   Idle connection is closed after this time, servers usually drop them soon. */
+#define HTTPCLIENT_KEEPALIVE_MS   4000
 //#define HTTPCLIENT_MAX_URL_LEN    2048
 
 #define HTTP_RETRIEVE_MORE_DATA   (1)            /**< More data needs to be retrieved. */
@@ -718,6 +725,8 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
     data[crlf_pos] = '\0';
 
     /* Parse HTTP response */
+    // HTTP/1.1 keeps connection open by default, HTTP/1.0 closes it
+    client->keep_alive = strncmp(data, "HTTP/1.0", 8) != 0;
     if (sscanf(data, "HTTP/%*d.%*d %d %*[^\r\n]", &(client->response_code)) != 1) {
         /* Cannot match string, error */
         ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "Not a correct HTTP answer : %s\r\n", data);
@@ -735,6 +744,7 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
     len -= (crlf_pos + 2);
 
     client_data->is_chunked = false;
+    client_data->retrieve_len = -1;
 
     /* Now get headers */
     while (true) {
@@ -769,6 +779,10 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
             /* End of headers */
             memmove(data, &data[2], len - 2 + 1); /* Be sure to move NULL-terminating char as well */
             len -= 2;
+            // end of body is only known with Content-Length, so only then connection can be reused
+            if (client_data->is_chunked || client_data->retrieve_len < 0) {
+                client->keep_alive = 0;
+            }
             break;
         }
 
@@ -786,6 +800,8 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
                     client_data->response_content_len = 0;
                     client_data->retrieve_len = 0;
                 }
+            } else if (!stricmp(key, "Connection")) {
+                client->keep_alive = stricmp(value, "close") != 0;
             }
             memmove(data, &data[crlf_pos + 2], len - (crlf_pos + 2) + 1); /* Be sure to move NULL-terminating char as well */
             len -= (crlf_pos + 2);
@@ -894,10 +910,18 @@ iotx_err_t httpclient_recv_response(httpclient_t *client, uint32_t timeout_ms, h
         client_data->response_buf[0] = '\0';
         client_data->response_buf_filled = 0;
         reclen = 0; // no existing data
+        // rest of this response only, next bytes on keep-alive connection belong to next one
+        if (!client_data->is_chunked && client_data->retrieve_len > 0 && lentoget > client_data->retrieve_len) {
+            lentoget = client_data->retrieve_len;
+        }
         ret = httpclient_recv(client, buf, 1, lentoget, &reclen, iotx_time_left(&timer));
         if (ret != 0) {
             return ret;
         }
+        if (reclen == 0) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "timeout while receiving body\r\n");
+            return ERROR_HTTP_CONN;
+        }
         ret = httpclient_retrieve_content(client,
             buf,
             reclen,
@@ -1007,13 +1031,128 @@ iotx_err_t iotx_post(
     return httpclient_common(client, url, port, ca_crt, HTTPCLIENT_POST, timeout_ms, client_data);
 }
 
-//void mylog12(const char *s) {
-//
-//    	ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, s);
-//}
-static void httprequest_thread( beken_thread_arg_t arg )
+// One long lived worker thread serves all async requests from a bounded queue.
+// Plain HTTP connections are kept open after responses with known length
+// and reused for next request to the same host:port.
+static httprequest_t *g_httpQueue[HTTPCLIENT_QUEUE_LEN];
+static int g_httpQueueFirst = 0;
+static int g_httpQueueCount = 0;
+static SemaphoreHandle_t g_httpQueueMutex = 0;
+#if !WINDOWS
+static bool g_httpWorkerStarted = false;
+static SemaphoreHandle_t g_httpWakeSem = 0;
+#endif
+
+typedef struct httpPoolConn_s {
+    char host[HTTPCLIENT_MAX_HOST_LEN];
+    int port;
+    utils_network_t net;
+    uint32_t lastUsed;
+} httpPoolConn_t;
+
+static httpPoolConn_t g_httpPool[HTTPCLIENT_POOL_SIZE];
+// response buffer for requests that do not want the body, so headers can still be parsed
+static char g_httpScratch[HTTPCLIENT_CHUNK_SIZE];
+static int g_httpStatConnects = 0;
+static int g_httpStatReuses = 0;
+#if WINDOWS
+static void (*g_httpNetHook)(utils_network_pt net) = 0;
+#endif
+
+static void httpclient_pool_close(httpPoolConn_t *c)
+{
+    if (c->net.handle) {
+        c->net.doDisconnect(&c->net);
+    }
+    c->net.handle = 0;
+}
+
+// takes matching idle connection out of the pool
+static bool httpclient_pool_take(httpclient_t *client, const char *host, int port)
+{
+    int i;
+    httpPoolConn_t *c;
+
+    for (i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        c = &g_httpPool[i];
+        if (c->net.handle == 0 || c->port != port || strcmp(c->host, host))
+            continue;
+        if (c->net.doIsAlive(&c->net) == 0) {
+            ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "pooled connection to %s:%i closed by server", host, port);
+            httpclient_pool_close(c);
+            continue;
+        }
+        client->net = c->net;
+        c->net.handle = 0;
+        g_httpStatReuses++;
+        return true;
+    }
+    return false;
+}
+
+// keeps connection for next request, or closes it
+static void httpclient_pool_put(httpclient_t *client, const char *host, int port)
+{
+    int i;
+    httpPoolConn_t *c = 0;
+
+    if (client->net.handle == 0)
+        return;
+    if (client->keep_alive == 0 || client->net.ca_crt) {
+        httpclient_close(client);
+        return;
+    }
+    for (i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        if (g_httpPool[i].net.handle == 0) {
+            c = &g_httpPool[i];
+            break;
+        }
+        // least recently used one gets replaced
+        if (c == 0 || (int32_t)(g_httpPool[i].lastUsed - c->lastUsed) < 0) {
+            c = &g_httpPool[i];
+        }
+    }
+    httpclient_pool_close(c);
+    strcpy_safe(c->host, host, sizeof(c->host));
+    c->port = port;
+    c->net = client->net;
+    c->net.pHostAddress = c->host;
+    c->lastUsed = utils_time_get_ms();
+    client->net.handle = 0;
+}
+
+static void httpclient_pool_expire()
+{
+    int i;
+    uint32_t now = utils_time_get_ms();
+
+    for (i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        if (g_httpPool[i].net.handle && now - g_httpPool[i].lastUsed > HTTPCLIENT_KEEPALIVE_MS) {
+            httpclient_pool_close(&g_httpPool[i]);
+        }
+    }
+}
+
+static int httpclient_open(httprequest_t *request, const char *host, int port)
+{
+    httpclient_t *client = &request->client;
+
+    if (httpclient_pool_take(client, host, port)) {
+        ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "reusing connection to %s:%d", host, port);
+        return SUCCESS_RETURN;
+    }
+    iotx_net_init(&client->net, host, port, request->ca_crt);
+#if WINDOWS
+    if (g_httpNetHook) {
+        g_httpNetHook(&client->net);
+    }
+#endif
+    g_httpStatConnects++;
+    return httpclient_connect(client);
+}
+
+static void httprequest_run(httprequest_t *request)
 {
-    httprequest_t *request = (httprequest_t *)arg;
     iotx_time_t timer;
     int ret = 0;
     char host[HTTPCLIENT_MAX_HOST_LEN] = { 0 };
@@ -1021,129 +1160,104 @@ static void httprequest_thread( beken_thread_arg_t arg )
     const char *url = request->url;
     const char *header = request->header;
     int port = request->port;
-    const char *ca_crt = request->ca_crt;
-    //uint32_t timeout = request->timeout;
     httpclient_data_t *client_data = &request->client_data;
     int method = request->method;
     int timeout_ms = request->timeout;
-
-    //addLog("start request thread\r\n");
-    //rtos_delay_milliseconds(500);
-
+    bool bScratch = false;
 
     if (header && header[0]){
         HTTPClient_SetCustomHeader(client, header);  //Sets the custom header if needed.
     }
 
-    //addLog("after HTTPClient_SetCustomHeader\r\n");
-    //rtos_delay_milliseconds(500);
-
-
     request->state = 0;
+    client->keep_alive = 0;
 
-    if (0 == client->net.handle) {
-        //Establish connection if no.
-        //addLog("before httpclient_parse_host\r\n");
-        //rtos_delay_milliseconds(500);
-    	ret = httpclient_parse_host(url, host, &port, sizeof(host));
-
-        if (ret != SUCCESS_RETURN){
-            request->state = -1;
-            if (request->data_callback){
-                request->data_callback(request);
-            }
-            goto exit;
+    ret = httpclient_parse_host(url, host, &port, sizeof(host));
+    if (ret != SUCCESS_RETURN){
+        request->state = -1;
+        if (request->data_callback){
+            request->data_callback(request);
         }
+        goto exit;
+    }
 
-    	ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "host: '%s', port: %d", host, port);
-        //rtos_delay_milliseconds(500);
-
-    	iotx_net_init(&client->net, host, port, ca_crt);
-        //addLog("after iotx_net_init\r\n");
-        //rtos_delay_milliseconds(500);
+    ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "host: '%s', port: %d", host, port);
 
-    	ret = httpclient_connect(client);
-        //addLog("after httpclient_connect %d\r\n", ret);
-        //rtos_delay_milliseconds(500);
-    	if (0 != ret) {
-            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_connect is error,ret = %d", ret);
-            httpclient_close(client);
-            request->state = -1;
-            if (request->data_callback){
-                request->data_callback(request);
-            }
-            goto exit;
-    	}
+    ret = httpclient_open(request, host, port);
+    if (0 != ret) {
+        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_connect is error,ret = %d", ret);
+        httpclient_close(client);
+        request->state = -1;
+        if (request->data_callback){
+            request->data_callback(request);
+        }
+        goto exit;
+    }
 
-        ret = httpclient_send_request(client, url, method, client_data);
-        if (0 != ret) {
-            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_send_request is error,ret = %d", ret);
-            httpclient_close(client);
-            request->state = -1;
-            if (request->data_callback){
-                request->data_callback(request);
-            }
-            goto exit;
+    ret = httpclient_send_request(client, url, method, client_data);
+    if (0 != ret) {
+        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_send_request is error,ret = %d", ret);
+        httpclient_close(client);
+        request->state = -1;
+        if (request->data_callback){
+            request->data_callback(request);
         }
+        goto exit;
     }
-    //addLog("httpclient_connect ret = %d", ret);
-    //rtos_delay_milliseconds(500);
     request->state = 0;  // start
     request->client_data.response_buf_filled = 0;
     if (request->data_callback){
         request->data_callback(request);
     }
 
+    // response must be read out to reuse the connection (and for lwip to free socket on close),
+    // so without buffer from caller it is parsed and dropped in scratch buffer
+    if (client_data->response_buf == NULL || client_data->response_buf_len == 0) {
+        client_data->response_buf = g_httpScratch;
+        client_data->response_buf_len = sizeof(g_httpScratch);
+        bScratch = true;
+    }
+    // request timeout is a deadline for whole response, not for each chunk
     iotx_time_init(&timer);
     utils_time_countdown_ms(&timer, timeout_ms);
-
-    //addLog("rx buflen %d", client_data->response_buf_len);
-    //rtos_delay_milliseconds(500);
-
-    if ((NULL != client_data->response_buf)
-         || (0 != client_data->response_buf_len)) {
-        do {
-            // parse headers, fill client_data->response_buf up to max client_data->response_buf_len-1
-            ret = httpclient_recv_response(client, iotx_time_left(&timer), client_data);
-            //addLog("httpclient_recv_response is ret = %d is_more %d", ret, client_data->is_more);
-            //rtos_delay_milliseconds(500);
-            if (ret < 0) {
-                ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_recv_response is error,ret = %d", ret);
-                httpclient_close(client);
-                request->state = -2;
-                if (request->data_callback){
-                    request->data_callback(request);
-                }
-                // close & leave
-                break;
+    do {
+        if (utils_time_is_expired(&timer)) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "response not complete in %d ms", timeout_ms);
+            httpclient_close(client);
+            request->state = -2;
+            if (request->data_callback){
+                request->data_callback(request);
             }
-            request->state = 1;
+            break;
+        }
+        // parse headers, fill client_data->response_buf up to max client_data->response_buf_len-1
+        // body is passed to callback chunk by chunk as it arrives, never buffered whole
+        ret = httpclient_recv_response(client, iotx_time_left(&timer), client_data);
+        if (ret < 0) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_recv_response is error,ret = %d", ret);
+            httpclient_close(client);
+            request->state = -2;
             if (request->data_callback){
-                //addLog("calling callback");
-                //rtos_delay_milliseconds(500);
-                if (request->data_callback(request)){
-                    // abort on user request
-                    // close & leave
-                    break;
-                }
+                request->data_callback(request);
             }
-        } while (client_data->is_more);
-    } else {
-		// must read out somewhere data, otherwise lwip will fail at lwip_close and it wont free socket
-		// and then it will soon run out of the sockets and break networking
-		int c_read;
-		int ret;
-		c_read = 0;
-		do {
-			ret = client->net.doRead(&client->net, host, sizeof(host), iotx_time_left(&timer));
-			if(ret>0)
-				c_read += ret;
-		} while(ret > 0);
-        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient - no response buff, skipped %i",c_read);
+            // close & leave
+            break;
+        }
+        request->state = 1;
+        if (request->data_callback && bScratch == false){
+            if (request->data_callback(request)){
+                // abort on user request, rest of body is unread
+                httpclient_close(client);
+                break;
+            }
+        }
+    } while (client_data->is_more);
+    if (bScratch) {
+        client_data->response_buf = NULL;
+        client_data->response_buf_len = 0;
     }
 exit:
-    //addLog("close http channel");
-    httpclient_close(client);
+    httpclient_pool_put(client, host, port);
     request->state = 2;  // complete
     request->client_data.response_buf_filled = 0;
     if (request->data_callback){
@@ -1151,26 +1265,131 @@ exit:
     }
 	// free if required
 	httpclient_freeMemory(request);
-    // remove this thread
-    rtos_delete_thread( NULL );
-    return;
 }
 
+static httprequest_t *httpclient_queue_pop()
+{
+    httprequest_t *r = 0;
+
+    xSemaphoreTake(g_httpQueueMutex, portMAX_DELAY);
+    if (g_httpQueueCount > 0) {
+        r = g_httpQueue[g_httpQueueFirst];
+        g_httpQueueFirst = (g_httpQueueFirst + 1) % HTTPCLIENT_QUEUE_LEN;
+        g_httpQueueCount--;
+    }
+    xSemaphoreGive(g_httpQueueMutex);
+    return r;
+}
+
+void HTTPClient_Worker_RunOnce()
+{
+    httprequest_t *r;
+
+    while ((r = httpclient_queue_pop()) != 0) {
+        httprequest_run(r);
+    }
+    httpclient_pool_expire();
+}
+
+#if !WINDOWS
+static void httpclient_worker_thread( beken_thread_arg_t arg )
+{
+    while (1) {
+        HTTPClient_Worker_RunOnce();
+        // woken by new request, or periodically to drop idle connections
+        xSemaphoreTake(g_httpWakeSem, HTTPCLIENT_KEEPALIVE_MS / portTICK_PERIOD_MS);
+    }
+}
+#endif
+
+void HTTPClient_Init()
+{
+    if (g_httpQueueMutex != 0)
+        return;
+    g_httpQueueMutex = xSemaphoreCreateMutex();
+#if !WINDOWS
+    g_httpWakeSem = xSemaphoreCreateBinary();
+#endif
+}
+
+int HTTPClient_GetQueuedCount()
+{
+    int count;
+
+    xSemaphoreTake(g_httpQueueMutex, portMAX_DELAY);
+    count = g_httpQueueCount;
+    xSemaphoreGive(g_httpQueueMutex);
+    return count;
+}
+
+void HTTPClient_GetPoolStats(int *connects, int *reuses)
+{
+    *connects = g_httpStatConnects;
+    *reuses = g_httpStatReuses;
+}
+
+#if WINDOWS
+void HTTPClient_SetNetworkHook(void (*hook)(utils_network_pt net))
+{
+    g_httpNetHook = hook;
+}
+void HTTPClient_ResetForSimulator()
+{
+    int i;
+
+    for (i = 0; i < HTTPCLIENT_POOL_SIZE; i++) {
+        httpclient_pool_close(&g_httpPool[i]);
+    }
+    g_httpStatConnects = 0;
+    g_httpStatReuses = 0;
+}
+#endif
 
 //////////////////////////////////////
 // our async stuff
 int HTTPClient_Async_SendGeneric(httprequest_t *request){
+    bool bQueued = false;
+#if !WINDOWS
     OSStatus err = kNoErr;
-    err = rtos_create_thread( NULL, BEKEN_APPLICATION_PRIORITY,
-									"httprequest",
-									(beken_thread_function_t)httprequest_thread,
+    bool bStartWorker = false;
+#endif
+
+    xSemaphoreTake(g_httpQueueMutex, portMAX_DELAY);
+    if (g_httpQueueCount < HTTPCLIENT_QUEUE_LEN) {
+        g_httpQueue[(g_httpQueueFirst + g_httpQueueCount) % HTTPCLIENT_QUEUE_LEN] = request;
+        g_httpQueueCount++;
+        bQueued = true;
+    }
+#if !WINDOWS
+    if (bQueued && g_httpWorkerStarted == false) {
+        g_httpWorkerStarted = true;
+        bStartWorker = true;
+    }
+#endif
+    xSemaphoreGive(g_httpQueueMutex);
+    if (bQueued == false) {
+        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "request queue full, dropping %s\r\n", request->url);
+        httpclient_freeMemory(request);
+        return -1;
+    }
+#if WINDOWS
+    // simulator has no real semaphores, queue is served from its main loop
+#else
+    xSemaphoreGive(g_httpWakeSem);
+    if (bStartWorker) {
+        err = rtos_create_thread( NULL, BEKEN_APPLICATION_PRIORITY,
+									"httpclient",
+									(beken_thread_function_t)httpclient_worker_thread,
 									0x800,
-									(beken_thread_arg_t)request );
-    if(err != kNoErr)
-    {
-       ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "create \"httprequest\" thread failed!\r\n");
-       return -1;
+									(beken_thread_arg_t)0 );
+        if(err != kNoErr)
+        {
+           ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "create \"httpclient\" thread failed!\r\n");
+           g_httpWorkerStarted = false;
+           return -1;
+        }
     }
+#endif
 
     return 0;
 }
@@ -68,6 +68,7 @@ typedef struct {
     int remote_port; /**< HTTP or HTTPS port. */
     utils_network_t net;
     int response_code; /**< Response code. */
+    int keep_alive; /**< Connection can be reused after this response. */
     char *header; /**< Custom header. */
     char *auth_user; /**< Username for basic authentication. */
     char *auth_password; /**< Password for basic authentication. */
@@ -167,6 +168,22 @@ int HTTPClient_Async_SendGet(const char *url_in, const char *tgFile, const char
 int HTTPClient_Async_SendPost(const char *url_in, int http_port, const char *content_type, const char *post_content, const char *post_header);
 void HTTPClient_SetCustomHeader(httpclient_t *client, const char *header);
 
+/** @brief           Creates request queue lock. Called once at startup, before any request is sent. */
+void HTTPClient_Init();
+/**
+ * @brief            Runs queued requests on calling thread, then closes expired idle connections.
+ *                   Called by the worker thread, and every frame by the simulator which has no worker.
+ */
+void HTTPClient_Worker_RunOnce();
+int HTTPClient_GetQueuedCount();
+/** @brief           New TCP connections opened and pooled ones reused since start. */
+void HTTPClient_GetPoolStats(int *connects, int *reuses);
+#if WINDOWS
+/** @brief           Lets selftests replace network functions of every new connection. */
+void HTTPClient_SetNetworkHook(void (*hook)(utils_network_pt net));
+void HTTPClient_ResetForSimulator();
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -194,7 +194,7 @@ int32_t HAL_TCP_Read(uintptr_t fd, char *buf, uint32_t len, uint32_t timeout_ms)
 #else
     int ret, err_code,data_over;
     uint32_t len_recv;
-    uint64_t t_end, t_left;
+    uint32_t t_end, t_now, t_left;
     fd_set sets;
     struct timeval timeout;
 
@@ -205,7 +205,10 @@ int32_t HAL_TCP_Read(uintptr_t fd, char *buf, uint32_t len, uint32_t timeout_ms)
     data_over = 0;
 
     do {
-        t_left = utils_time_left(t_end, utils_time_get_ms());
+        // timeout_ms bounds the whole call, however many selects it takes.
+        // Pooled keep-alive connections must not block forever on silent server.
+        t_now = utils_time_get_ms();
+        t_left = (int32_t)(t_end - t_now) > 0 ? t_end - t_now : 0;
 /*        if (0 == t_left && bk_http_ptr->do_data == 0) {
             break;
         }*/
@@ -215,7 +218,11 @@ int32_t HAL_TCP_Read(uintptr_t fd, char *buf, uint32_t len, uint32_t timeout_ms)
         timeout.tv_sec = t_left / 1000;
         timeout.tv_usec = (t_left % 1000) * 1000;
 
-        ret = select(fd + 1, &sets, NULL, NULL, NULL);
+        ret = select(fd + 1, &sets, NULL, NULL, &timeout);
+        if (0 == ret) {
+            // timeout
+            break;
+        }
         if ( FD_ISSET( fd, &sets ) )
         {
             if (ret > 0) {
@@ -266,6 +273,33 @@ int32_t HAL_TCP_Read(uintptr_t fd, char *buf, uint32_t len, uint32_t timeout_ms)
     return (0 != len_recv) ? len_recv : err_code;
 }
 
+// Checks if idle connection is still usable, without blocking.
+// Server closing it (or sending anything while we are idle) makes it unusable.
+int HAL_TCP_IsAlive(uintptr_t fd)
+{
+    fd_set sets;
+    struct timeval timeout;
+    char c;
+    int ret;
+
+    FD_ZERO(&sets);
+    FD_SET(fd, &sets);
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    ret = select(fd + 1, &sets, NULL, NULL, &timeout);
+    if (ret == 0) {
+        // nothing pending, still open
+        return 1;
+    }
+    if (ret > 0 && FD_ISSET(fd, &sets)) {
+        ret = recv(fd, &c, 1, MSG_PEEK);
+        if (ret > 0) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "unexpected data on idle connection");
+        }
+    }
+    return 0;
+}
+
 /*** TCP connection ***/
 int read_tcp(utils_network_pt pNetwork, char *buffer, uint32_t len, uint32_t timeout_ms)
 {
@@ -290,6 +324,14 @@ static int disconnect_tcp(utils_network_pt pNetwork)
 }
 
 
+static int is_alive_tcp(utils_network_pt pNetwork)
+{
+    if (0 == pNetwork->handle) {
+        return 0;
+    }
+    return HAL_TCP_IsAlive(pNetwork->handle);
+}
+
 static int connect_tcp(utils_network_pt pNetwork)
 {
     if (NULL == pNetwork) {
@@ -335,6 +377,15 @@ int iotx_net_disconnect(utils_network_pt pNetwork)
 }
 
 
+int iotx_net_is_alive(utils_network_pt pNetwork)
+{
+    if (NULL == pNetwork->ca_crt) { //TCP connection
+        return is_alive_tcp(pNetwork);
+    }
+    return 0;
+}
+
+
 int iotx_net_connect(utils_network_pt pNetwork)
 {
     if (NULL == pNetwork->ca_crt) { //TCP connection
@@ -365,6 +416,7 @@ int iotx_net_init(utils_network_pt pNetwork, const char *host, uint16_t port, co
     pNetwork->doWrite = utils_net_write;
     pNetwork->doDisconnect = iotx_net_disconnect;
     pNetwork->doConnect = iotx_net_connect;
+    pNetwork->doIsAlive = iotx_net_is_alive;
 
     return 0;
 }
@@ -37,6 +37,9 @@ struct utils_network {
 
     /**< Establish the network */
     int (*doConnect)(utils_network_pt);
+
+    /**< Check if idle connection can be reused, non blocking */
+    int (*doIsAlive)(utils_network_pt);
 };
 
 
@@ -44,6 +47,7 @@ int utils_net_read(utils_network_pt pNetwork, char *buffer, uint32_t len, uint32
 int utils_net_write(utils_network_pt pNetwork, const char *buffer, uint32_t len, uint32_t timeout_ms);
 int iotx_net_disconnect(utils_network_pt pNetwork);
 int iotx_net_connect(utils_network_pt pNetwork);
+int iotx_net_is_alive(utils_network_pt pNetwork);
 int iotx_net_init(utils_network_pt pNetwork, const char *host, uint16_t port, const char *ca_crt);
 extern void http_data_process(char *buf, uint32_t len);
 
@@ -51,6 +55,7 @@ uintptr_t HAL_TCP_Establish(const char *host, uint16_t port);
 int32_t HAL_TCP_Write(uintptr_t fd, const char *buf, uint32_t len, uint32_t timeout_ms);
 int32_t HAL_TCP_Read(uintptr_t fd, char *buf, uint32_t len, uint32_t timeout_ms);
 int32_t HAL_TCP_Destroy(uintptr_t fd);
+int HAL_TCP_IsAlive(uintptr_t fd);
 
 #endif
 
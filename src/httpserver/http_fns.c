@@ -18,6 +18,7 @@
 #include "../mqtt/new_mqtt.h"
 #include "hass.h"
 #include "../cJSON/cJSON.h"
+#include "../cJSON/cJSON_arena.h"
 #include <time.h>
 #include "../driver/drv_ntp.h"
 #include "../driver/drv_deviceclock.h"		// to set clock via Javascript in pmntp
@@ -1926,7 +1927,6 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 	HassDeviceInfo* dev_info = NULL;
 	bool measuringPower = false;
 	bool measuringBattery = false;
-	struct cJSON_Hooks hooks;
 	bool discoveryQueued = false;
 	int type;
 	// warning - this is 32 bit
@@ -1962,14 +1962,8 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 	ledDriverChipRunning = 0;
 #endif
 
-#if PLATFORM_TXW81X
-	hooks.malloc_fn = _os_malloc;
-	hooks.free_fn = _os_free;
-#else
-	hooks.malloc_fn = os_malloc;
-	hooks.free_fn = os_free;
-#endif
-	cJSON_InitHooks(&hooks);
+	// every entity is built, printed and freed before the next one
+	JSONArena_Begin(JSONARENA_HASS);
 
 	DRV_OnHassDiscovery(topic);
 	EventHandlers_FireEvent(CMD_EVENT_ON_DISCOVERY, 0);
@@ -2483,6 +2477,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 		discoveryQueued = true;
 
 	}
+	JSONArena_End();
 	if (discoveryQueued) {
 		MQTT_InvokeCommandAtEnd(PublishChannels);
 	}
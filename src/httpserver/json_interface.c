@@ -27,8 +27,202 @@
 
 #include "../libraries/obktime/obktime.h"	// for time functions
 
+unsigned int g_jsonStateVersion = 0;
+unsigned int g_jsonSensorVersion = 0;
+
 #if ENABLE_TASMOTA_JSON
 
+// Snapshots of JSON sections that pollers ask for every few seconds.
+// Section is printed once into a buffer and the same bytes are sent to
+// following requests, until g_jsonStateVersion (and g_jsonSensorVersion
+// for SNS), pending config changes or section key (things that change
+// without a bump, like chip temperature or IP) are different from when
+// it was taken. Time, uptime, heap and RSSI are never cached.
+#define JSON_SNAPSHOT_CHUNK		250
+
+typedef int(*jsonSection_t)(void* request, jsonCb_t printer);
+
+static const char *g_jsonSnapshotNames[JSON_SNAPSHOT_SECTIONS] = {
+	"SNS",
+	"POWER",
+	"NET",
+};
+
+// printed section, never changed once built; freed by whoever drops last reference
+typedef struct jsonSnapshotData_s {
+	int refs;
+	int len;
+	int size;
+	char data[1];
+} jsonSnapshotData_t;
+
+typedef struct jsonSnapshot_s {
+	jsonSnapshotData_t *snap;
+	unsigned int version;
+	unsigned int sensorVersion;
+	int cfgChanges;
+	int key;
+	int hits;
+	int misses;
+} jsonSnapshot_t;
+
+// filled by JSON_Snapshot_Printer while section is built
+typedef struct jsonSnapshotCapture_s {
+	jsonSnapshotData_t *snap;
+	bool failed;
+} jsonSnapshotCapture_t;
+
+static jsonSnapshot_t g_jsonSnapshots[JSON_SNAPSHOT_SECTIONS];
+static bool g_jsonSnapshotsEnabled = true;
+// HTTP and MQTT threads can ask at the same time. It only guards the table
+// and reference counts, sections are built and sent without holding it.
+static SemaphoreHandle_t g_jsonSnapshotMutex = 0;
+
+static bool JSON_Snapshot_Mutex_Take(int del) {
+	int taken;
+
+	taken = xSemaphoreTake(g_jsonSnapshotMutex, del);
+	if (taken == pdTRUE) {
+		return true;
+	}
+	return false;
+}
+
+static void JSON_Snapshot_Mutex_Free()
+{
+	xSemaphoreGive(g_jsonSnapshotMutex);
+}
+
+// call with mutex taken
+static void JSON_Snapshot_Release(jsonSnapshotData_t *snap) {
+	if (snap && --snap->refs == 0)
+		os_free(snap);
+}
+
+static int JSON_Snapshot_Printer(void* userData, const char* fmt, ...) {
+	jsonSnapshotCapture_t *c = (jsonSnapshotCapture_t*)userData;
+	jsonSnapshotData_t *s = c->snap;
+	va_list argList;
+	char tmp[256];
+	jsonSnapshotData_t *n;
+	int len, size;
+
+	if (c->failed)
+		return 0;
+	// same limit as hprintf255 and mqtt_printf255, so replay gives same bytes
+	memset(tmp, 0, sizeof(tmp));
+	va_start(argList, fmt);
+	vsnprintf(tmp, 255, fmt, argList);
+	va_end(argList);
+	len = strlen(tmp);
+	if (s == 0 || s->len + len > s->size) {
+		size = s ? s->size : 256;
+		while (size < (s ? s->len : 0) + len) {
+			size *= 2;
+		}
+		n = (jsonSnapshotData_t*)os_malloc(sizeof(jsonSnapshotData_t) + size);
+		if (n == 0) {
+			c->failed = true;
+			return 0;
+		}
+		n->refs = 1;
+		n->len = 0;
+		n->size = size;
+		if (s) {
+			memcpy(n->data, s->data, s->len);
+			n->len = s->len;
+			os_free(s);
+		}
+		c->snap = s = n;
+	}
+	memcpy(s->data + s->len, tmp, len);
+	s->len += len;
+	return len;
+}
+
+static void JSON_PrintSnapshot(void* request, jsonCb_t printer, int section, int key, jsonSection_t build) {
+	jsonSnapshot_t *s = &g_jsonSnapshots[section];
+	jsonSnapshotCapture_t cap;
+	jsonSnapshotData_t *snap;
+	char chunk[JSON_SNAPSHOT_CHUNK + 1];
+	unsigned int version, sensorVersion;
+	int cfgChanges;
+	int i, n;
+
+	if (!g_jsonSnapshotsEnabled || JSON_Snapshot_Mutex_Take(10) == false) {
+		build(request, printer);
+		return;
+	}
+	// energy and sensor readings change often, but only SNS shows them
+	version = g_jsonStateVersion;
+	sensorVersion = section == JSON_SNAPSHOT_SNS ? g_jsonSensorVersion : 0;
+	cfgChanges = g_cfg_pendingChanges;
+	snap = s->snap;
+	if (snap && s->version == version && s->sensorVersion == sensorVersion
+		&& s->cfgChanges == cfgChanges && s->key == key) {
+		s->hits++;
+		snap->refs++;
+	}
+	else {
+		s->misses++;
+		snap = 0;
+	}
+	JSON_Snapshot_Mutex_Free();
+
+	if (snap == 0) {
+		// versions are taken before build, so a change made meanwhile is not lost
+		cap.snap = 0;
+		cap.failed = false;
+		build(&cap, JSON_Snapshot_Printer);
+		if (cap.failed || cap.snap == 0) {
+			os_free(cap.snap);
+			build(request, printer);
+			return;
+		}
+		snap = cap.snap;
+		if (JSON_Snapshot_Mutex_Take(10)) {
+			JSON_Snapshot_Release(s->snap);
+			snap->refs++;
+			s->snap = snap;
+			s->version = version;
+			s->sensorVersion = sensorVersion;
+			s->cfgChanges = cfgChanges;
+			s->key = key;
+			JSON_Snapshot_Mutex_Free();
+		}
+	}
+	for (i = 0; i < snap->len; i += n) {
+		n = snap->len - i;
+		if (n > JSON_SNAPSHOT_CHUNK)
+			n = JSON_SNAPSHOT_CHUNK;
+		memcpy(chunk, snap->data + i, n);
+		chunk[n] = 0;
+		printer(request, "%s", chunk);
+	}
+	// cache may have dropped it meanwhile, then last one frees it
+	JSON_Snapshot_Mutex_Take(portMAX_DELAY);
+	JSON_Snapshot_Release(snap);
+	JSON_Snapshot_Mutex_Free();
+}
+
+static int JSON_Snapshot_StrKey(const char *s) {
+	unsigned int h = 5381;
+
+	while (*s) {
+		h = h * 33 + (byte)*s++;
+	}
+	return (int)h;
+}
+
+void JSON_GetSnapshotStats(int section, int *hits, int *misses) {
+	if (section < 0 || section >= JSON_SNAPSHOT_SECTIONS) {
+		*hits = *misses = 0;
+		return;
+	}
+	*hits = g_jsonSnapshots[section].hits;
+	*misses = g_jsonSnapshots[section].misses;
+}
+
 void JSON_PrintKeyValue_String(void* request, jsonCb_t printer, const char* key, const char* value, bool bComma) {
 	printer(request, "\"%s\":\"%s\"", key, value);
 	if (bComma) {
@@ -388,21 +582,9 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 */
 // use obktimes ISO_8601 for this, e.g. TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_ISO_8601)
 
-static int http_tasmota_json_status_SNS(void* request, jsonCb_t printer, bool bAppendHeader) {
-	char buff[20];
-
-	if (bAppendHeader) {
-		printer(request, "\"StatusSNS\":");
-	}
-	printer(request, "{");
-
-/*	time_t localTime = (time_t)TIME_GetCurrentTime();
-	format_date(buff, sizeof(buff), gmtime(&localTime));
-	JSON_PrintKeyValue_String(request, printer, "Time", buff, false);
-*/
-	JSON_PrintKeyValue_String(request, printer, "Time", TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_ISO_8601), false);
-
 #ifndef OBK_DISABLE_ALL_DRIVERS
+// everything after Time, cached as JSON_SNAPSHOT_SNS
+static int http_tasmota_json_status_SNS_sensors(void* request, jsonCb_t printer) {
 #ifdef ENABLE_DRIVER_BL0937
 	if (DRV_IsMeasuringPower() || DRV_IsMeasuringBattery()) {
 
@@ -428,6 +610,31 @@ static int http_tasmota_json_status_SNS(void* request, jsonCb_t printer, bool bA
 		http_tasmota_json_SENSOR(request, printer);
 		JSON_PrintKeyValue_String(request, printer, "TempUnit", "C", false);
 	}
+	return 0;
+}
+#endif
+
+static int http_tasmota_json_status_SNS(void* request, jsonCb_t printer, bool bAppendHeader) {
+	char buff[20];
+	int key = 0;
+
+	if (bAppendHeader) {
+		printer(request, "\"StatusSNS\":");
+	}
+	printer(request, "{");
+
+/*	time_t localTime = (time_t)TIME_GetCurrentTime();
+	format_date(buff, sizeof(buff), gmtime(&localTime));
+	JSON_PrintKeyValue_String(request, printer, "Time", buff, false);
+*/
+	JSON_PrintKeyValue_String(request, printer, "Time", TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_ISO_8601), false);
+
+#ifndef OBK_DISABLE_ALL_DRIVERS
+#ifndef NO_CHIP_TEMPERATURE
+	// chip temperature is set by HAL without bump
+	memcpy(&key, &g_wifi_temperature, sizeof(key));
+#endif
+	JSON_PrintSnapshot(request, printer, JSON_SNAPSHOT_SNS, key, http_tasmota_json_status_SNS_sensors);
 #endif
 
 	printer(request, "}");
@@ -504,7 +711,7 @@ static int http_tasmota_json_status_STS(void* request, jsonCb_t printer, bool bA
 		printer(request, "\"Vcc\":%.4f,", Battery_lastreading(OBK_BATT_VOLTAGE) / 1000.00);
 	}
 #endif
-	http_tasmota_json_power(request, printer);
+	JSON_PrintSnapshot(request, printer, JSON_SNAPSHOT_POWER, 0, http_tasmota_json_power);
 	printer(request, ",");
 	printer(request, "\"Wifi\":{"); // open WiFi
 	JSON_PrintKeyValue_Int(request, printer, "AP", 1, true);
@@ -815,7 +1022,7 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 
 	printer(request, ",");
 
-	http_tasmota_json_status_NET(request, printer);
+	JSON_PrintSnapshot(request, printer, JSON_SNAPSHOT_NET, JSON_Snapshot_StrKey(HAL_GetMyIPString()), http_tasmota_json_status_NET);
 
 	printer(request, ",");
 
@@ -854,7 +1061,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 	if (!wal_strnicmp(cmd, "POWER", 5)) {
 
 		printer(request, "{");
-		http_tasmota_json_power(request, printer);
+		JSON_PrintSnapshot(request, printer, JSON_SNAPSHOT_POWER, 0, http_tasmota_json_power);
 		printer(request, "}");
 #if ENABLE_MQTT
 		if (flags == COMMAND_FLAG_SOURCE_MQTT) {
@@ -1053,7 +1260,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 		}
 		else if (!stricmp(arg, "5")) {
 			printer(request, "{");
-			http_tasmota_json_status_NET(request, printer);
+			JSON_PrintSnapshot(request, printer, JSON_SNAPSHOT_NET, JSON_Snapshot_StrKey(HAL_GetMyIPString()), http_tasmota_json_status_NET);
 			printer(request, "}");
 #if ENABLE_MQTT
 			if (flags == COMMAND_FLAG_SOURCE_MQTT) {
@@ -1190,6 +1397,38 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 
 	return 0;
 }
+
+static commandResult_t CMD_JSONSnapshot(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	jsonSnapshot_t *s;
+	int i;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_jsonSnapshotsEnabled = Tokenizer_GetArgInteger(0) != 0;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "JSONSnapshot: %s, state version %u, sensor version %u",
+		g_jsonSnapshotsEnabled ? "enabled" : "disabled", g_jsonStateVersion, g_jsonSensorVersion);
+	for (i = 0; i < JSON_SNAPSHOT_SECTIONS; i++) {
+		s = &g_jsonSnapshots[i];
+		ADDLOG_INFO(LOG_FEATURE_CMD, "JSONSnapshot %s: hits %i, misses %i, %i bytes",
+			g_jsonSnapshotNames[i], s->hits, s->misses, s->snap ? s->snap->len : 0);
+	}
+	return CMD_RES_OK;
+}
+
+void JSON_Init() {
+	if (g_jsonSnapshotMutex == 0) {
+		g_jsonSnapshotMutex = xSemaphoreCreateMutex();
+	}
+}
+
+void JSON_AddCommands() {
+	//cmddetail:{"name":"JSONSnapshot","args":"[Enable]",
+	//cmddetail:"descr":"Prints hits and misses of cached STATUS JSON sections (sensors, power, network). Optional 0 or 1 turns the cache off or on.",
+	//cmddetail:"fn":"CMD_JSONSnapshot","file":"httpserver/json_interface.c","requires":"",
+	//cmddetail:"examples":"JSONSnapshot 0"}
+	CMD_RegisterCommand("JSONSnapshot", CMD_JSONSnapshot, NULL);
+}
 // close for ENABLE_TASMOTA_JSON
 #endif
 
@@ -28,6 +28,9 @@ extern uint8_t flash_size_8720;
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
 #include "../driver/drv_local.h"
+#include "../tick_profiler.h"
+#include "../memory/mem_pool.h"
+#include "../quicktick.h"
 #endif
 
 #define MAX_JSON_VALUE_LENGTH   128
@@ -64,6 +67,10 @@ static int http_rest_get_flash_advanced(http_request_t* request);
 static int http_rest_post_flash_advanced(http_request_t* request);
 
 static int http_rest_get_info(http_request_t* request);
+#if ENABLE_TICK_PROFILER
+static int http_rest_get_tickprofile(http_request_t* request);
+static int http_rest_get_memstats(http_request_t* request);
+#endif
 
 static int http_rest_post_channels(http_request_t* request);
 static int http_rest_get_channels(http_request_t* request);
@@ -153,6 +160,16 @@ static int http_rest_get(http_request_t* request) {
 	if (!strcmp(request->url, "api/info")) {
 		return http_rest_get_info(request);
 	}
+#if ENABLE_TICK_PROFILER
+	if (!strcmp(request->url, "api/tickprofile")) {
+		return http_rest_get_tickprofile(request);
+	}
+#endif
+#if ENABLE_MEM_POOL
+	if (!strcmp(request->url, "api/memstats")) {
+		return http_rest_get_memstats(request);
+	}
+#endif
 
 	if (!strncmp(request->url, "api/flash/", 10)) {
 		return http_rest_get_flash_advanced(request);
@@ -1025,6 +1042,51 @@ static int http_rest_post_logconfig(http_request_t* request) {
 /////////////////////////////////////////////////
 
 
+#if ENABLE_TICK_PROFILER
+static int http_rest_get_tickprofile(http_request_t* request) {
+	const tickProfSlot_t *s;
+	int i, n = 0;
+
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"uptime_s\":%d,\"budget_us\":%d,\"slots\":[", g_secondsElapsed, QUICK_TMR_DURATION * 1000);
+	for (i = 0; i < TickProf_GetSlotsCount(); i++) {
+		s = TickProf_GetSlot(i);
+		if (s->count == 0)
+			continue;
+		if (n++)
+			poststr(request, ",");
+		hprintf255(request, "{\"name\":\"%s\",\"kind\":\"%s\",\"count\":%u,", s->name,
+			s->kind == TICKPROF_KIND_QUICK ? "quick" : "second", s->count);
+		hprintf255(request, "\"min\":%u,\"avg\":%u,\"p99\":%u,\"max\":%u,\"overruns\":%u}",
+			s->minUs, (unsigned int)(s->totalUs / s->count), TickProf_GetPercentile(i, 99), s->maxUs, s->overruns);
+	}
+	poststr(request, "]}");
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_MEM_POOL
+static int http_rest_get_memstats(http_request_t* request) {
+	memHeapStats_t h;
+	const memPoolStats_t *s;
+	int i;
+
+	MemPool_GetHeapStats(&h);
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"uptime_s\":%d,\"free\":%d,\"lowWater\":%d,\"largestBlock\":%d,\"oversize\":%u,\"pools\":[",
+		g_secondsElapsed, h.freeHeap, h.lowWater, h.largestFreeBlock, h.oversize);
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		s = MemPool_GetStats(i);
+		hprintf255(request, "%s{\"size\":%i,\"count\":%i,\"used\":%i,\"highWater\":%i,\"allocs\":%u,\"fallbacks\":%u}",
+			i ? "," : "", s->blockSize, s->blockCount, s->used, s->highWater, s->allocs, s->fallbacks);
+	}
+	poststr(request, "]}");
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
 static int http_rest_get_info(http_request_t* request) {
 	char macstr[3 * 6 + 1];
 	long int* pAllGenericFlags = (long int*)&g_cfg.genericFlags;
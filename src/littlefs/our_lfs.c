@@ -145,6 +145,194 @@ struct lfs_config cfg = {
     .block_cycles = 500,
 };
 
+typedef struct lfsProfile_s {
+	lfs_size_t readSize;
+	lfs_size_t progSize;
+	lfs_size_t cacheSize;
+	lfs_size_t lookaheadSize;
+} lfsProfile_t;
+
+static const lfsProfile_t g_lfsProfiles[] = {
+	// LFS_PROFILE_COMPAT
+#if ENABLE_LFS_SPI
+	{ 1, 1, 128, 128 },
+#else
+	{ 1, 1, 16, 16 },
+#endif
+	// LFS_PROFILE_FAST
+	{ LFS_FAST_READ_SIZE, LFS_FAST_PROG_SIZE, LFS_FAST_CACHE_SIZE, LFS_FAST_LOOKAHEAD_SIZE },
+};
+
+#if ENABLE_LFS_PERF_PROFILE
+static int g_lfsProfile = LFS_PROFILE_FAST;
+#else
+static int g_lfsProfile = LFS_PROFILE_COMPAT;
+#endif
+
+// littlefs allocates its buffers at mount, so only call it while unmounted
+static void LFS_ApplyProfile() {
+	const lfsProfile_t *p = &g_lfsProfiles[g_lfsProfile];
+
+	cfg.read_size = p->readSize;
+	cfg.prog_size = p->progSize;
+	cfg.cache_size = p->cacheSize;
+	cfg.lookahead_size = p->lookaheadSize;
+}
+
+int LFS_GetProfile() {
+	return g_lfsProfile;
+}
+
+void LFS_SetProfile(int profile) {
+	int wasMounted = lfs_initialised;
+
+	if (profile < LFS_PROFILE_COMPAT || profile > LFS_PROFILE_FAST)
+		return;
+	release_lfs();
+	g_lfsProfile = profile;
+	if (wasMounted)
+		init_lfs(0);
+}
+
+#if ENABLE_LFS_FILE_CACHE
+
+typedef struct lfsCachedFile_s {
+	char name[LFS_FILE_CACHE_MAX_NAME];
+	byte *data;
+	int len;
+	unsigned int lastUse;
+} lfsCachedFile_t;
+
+static lfsCachedFile_t g_lfsCache[LFS_FILE_CACHE_ENTRIES];
+static unsigned int g_lfsCacheClock = 0;
+// bumped on every flash sync, a read that started before it is stale
+static unsigned int g_lfsCacheGeneration = 0;
+static int g_lfsCacheHits = 0;
+static int g_lfsCacheMisses = 0;
+static SemaphoreHandle_t g_lfsCacheMutex = 0;
+static bool g_lfsCacheReady = false;
+
+// called from init_lfs, until then nothing is cached and cache calls do nothing
+static void LFS_FileCache_Init() {
+	if (g_lfsCacheReady)
+		return;
+	g_lfsCacheMutex = xSemaphoreCreateMutex();
+	g_lfsCacheReady = true;
+}
+static void LFS_FileCache_Lock() {
+	xSemaphoreTake(g_lfsCacheMutex, portMAX_DELAY);
+}
+static void LFS_FileCache_Unlock() {
+	xSemaphoreGive(g_lfsCacheMutex);
+}
+
+byte *LFS_FileCache_Get(const char *fname) {
+	lfsCachedFile_t *e;
+	byte *r = 0;
+	int i;
+
+	if (!g_lfsCacheReady)
+		return 0;
+	LFS_FileCache_Lock();
+	for (i = 0; i < LFS_FILE_CACHE_ENTRIES; i++) {
+		e = &g_lfsCache[i];
+		if (e->data == 0 || strcmp(e->name, fname))
+			continue;
+		r = malloc(e->len + 1);
+		if (r) {
+			memcpy(r, e->data, e->len);
+			r[e->len] = 0;
+			e->lastUse = ++g_lfsCacheClock;
+		}
+		break;
+	}
+	if (r)
+		g_lfsCacheHits++;
+	else
+		g_lfsCacheMisses++;
+	LFS_FileCache_Unlock();
+	return r;
+}
+
+unsigned int LFS_FileCache_GetGeneration() {
+	return g_lfsCacheGeneration;
+}
+
+void LFS_FileCache_Put(const char *fname, const byte *data, int len, unsigned int generation) {
+	lfsCachedFile_t *e, *victim = 0;
+	byte *copy;
+	int i;
+
+	if (!g_lfsCacheReady)
+		return;
+	if (len > LFS_FILE_CACHE_MAX_FILE || strlen(fname) >= LFS_FILE_CACHE_MAX_NAME)
+		return;
+	copy = malloc(len);
+	if (copy == 0)
+		return;
+	memcpy(copy, data, len);
+	LFS_FileCache_Lock();
+	if (generation != g_lfsCacheGeneration) {
+		LFS_FileCache_Unlock();
+		free(copy);
+		return;
+	}
+	// same name or least recently used
+	for (i = 0; i < LFS_FILE_CACHE_ENTRIES; i++) {
+		e = &g_lfsCache[i];
+		if (e->data && !strcmp(e->name, fname)) {
+			victim = e;
+			break;
+		}
+		if (victim == 0 || (victim->data && (e->data == 0 || e->lastUse < victim->lastUse)))
+			victim = e;
+	}
+	free(victim->data);
+	strcpy(victim->name, fname);
+	victim->data = copy;
+	victim->len = len;
+	victim->lastUse = ++g_lfsCacheClock;
+	LFS_FileCache_Unlock();
+}
+
+void LFS_FileCache_Invalidate() {
+	int i;
+
+	if (!g_lfsCacheReady)
+		return;
+	LFS_FileCache_Lock();
+	g_lfsCacheGeneration++;
+	for (i = 0; i < LFS_FILE_CACHE_ENTRIES; i++) {
+		free(g_lfsCache[i].data);
+		g_lfsCache[i].data = 0;
+	}
+	LFS_FileCache_Unlock();
+}
+
+void LFS_FileCache_GetStats(int *hits, int *misses) {
+	*hits = g_lfsCacheHits;
+	*misses = g_lfsCacheMisses;
+}
+
+#else
+
+byte *LFS_FileCache_Get(const char *fname) {
+	return 0;
+}
+unsigned int LFS_FileCache_GetGeneration() {
+	return 0;
+}
+void LFS_FileCache_Put(const char *fname, const byte *data, int len, unsigned int generation) {
+}
+void LFS_FileCache_Invalidate() {
+}
+void LFS_FileCache_GetStats(int *hits, int *misses) {
+	*hits = 0;
+	*misses = 0;
+}
+
+#endif
+
 int lfs_present(){
     return lfs_initialised;
 }
@@ -317,6 +505,7 @@ static commandResult_t CMD_LFS_Format(const void *context, const char *cmd, cons
 #endif
 
     cfg.block_count = (newsize/LFS_BLOCK_SIZE);
+    LFS_ApplyProfile();
 
     int err  = lfs_format(&lfs, &cfg);
     ADDLOG_INFO(LOG_FEATURE_CMD, "LFS formatted size 0x%X (err %d)", LFS_Size, err);
@@ -490,6 +679,9 @@ void LFSAddCmds(){
 
 
 void init_lfs(int create){
+#if ENABLE_LFS_FILE_CACHE
+    LFS_FileCache_Init();
+#endif
     if (!lfs_initialised){
         uint32_t newsize = CFG_GetLFS_Size();
 
@@ -601,6 +793,7 @@ void init_lfs(int create){
         LFS_Start = newstart;
         LFS_Size = newsize;
         cfg.block_count = (newsize/LFS_BLOCK_SIZE);
+        LFS_ApplyProfile();
 
         int err = lfs_mount(&lfs, &cfg);
 
@@ -651,6 +844,7 @@ void release_lfs(){
 		lfs_unmount(&lfs);
 		lfs_initialised = 0;
 	}
+	LFS_FileCache_Invalidate();
 }
 
 #if ENABLE_LFS_SPI
@@ -1191,7 +1385,8 @@ static int lfs_erase(const struct lfs_config* c, lfs_block_t block)
 // Sync the state of the underlying block device. Negative error codes
 // are propogated to the user.
 static int lfs_sync(const struct lfs_config *c){
-    // nothing to do
+    // every commit ends here, so cached files may be stale now
+    LFS_FileCache_Invalidate();
     return 0;
 }
 
@@ -190,6 +190,31 @@
 
 #define LFS_BLOCK_SIZE 0x1000
 
+// I/O granularity of the filesystem. Block size is the same in both,
+// so filesystem made with one profile mounts with the other.
+// COMPAT is byte granular with tiny caches, FAST works in flash pages.
+#define LFS_PROFILE_COMPAT 0
+#define LFS_PROFILE_FAST 1
+
+// cache must be a multiple of read and prog size, lookahead a multiple of 8
+#ifndef LFS_FAST_READ_SIZE
+#define LFS_FAST_READ_SIZE 16
+#endif
+#ifndef LFS_FAST_PROG_SIZE
+#define LFS_FAST_PROG_SIZE 16
+#endif
+#ifndef LFS_FAST_CACHE_SIZE
+#define LFS_FAST_CACHE_SIZE 256
+#endif
+// 8 blocks per byte, so 64 covers 2MB without rescans
+#ifndef LFS_FAST_LOOKAHEAD_SIZE
+#define LFS_FAST_LOOKAHEAD_SIZE 64
+#endif
+
+// small files read with LFS_ReadFile are kept in RAM until next flash write
+#define LFS_FILE_CACHE_ENTRIES 4
+#define LFS_FILE_CACHE_MAX_FILE 2048
+#define LFS_FILE_CACHE_MAX_NAME 32
 
 extern int boot_count;
 extern lfs_t lfs;
@@ -200,5 +225,17 @@ void LFSAddCmds();
 void init_lfs(int create);
 void release_lfs();
 int lfs_present();
+/// @brief Select I/O profile, remounts if mounted.
+void LFS_SetProfile(int profile);
+int LFS_GetProfile();
+
+/// @brief Copy of cached file, made with malloc and zero terminated, or 0 on miss.
+unsigned char *LFS_FileCache_Get(const char *fname);
+/// @brief Read generation, take it before reading file to be put in cache.
+unsigned int LFS_FileCache_GetGeneration();
+/// @brief Cache file content if nothing was written since generation was taken.
+void LFS_FileCache_Put(const char *fname, const unsigned char *data, int len, unsigned int generation);
+void LFS_FileCache_Invalidate();
+void LFS_FileCache_GetStats(int *hits, int *misses);
 #endif
 #endif
@@ -0,0 +1,227 @@
+#include "../obk_config.h"
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "mem_pool.h"
+
+#if PLATFORM_ESPIDF
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#endif
+
+static int g_heapLowWater = 0;
+static unsigned int g_poolOversize = 0;
+
+#if ENABLE_MEM_POOL
+
+typedef struct memPool_s {
+	memPoolStats_t st;
+	byte *base;
+	// first free block, free blocks hold pointer to next one
+	void *freeList;
+} memPool_t;
+
+// small strings, event commands, topics, list nodes
+static memPool_t g_pools[MEMPOOL_CLASSES] = {
+	{ .st = { .blockSize = 16, .blockCount = 48 } },
+	{ .st = { .blockSize = 32, .blockCount = 32 } },
+	{ .st = { .blockSize = 64, .blockCount = 16 } },
+	{ .st = { .blockSize = 128, .blockCount = 8 } },
+};
+static SemaphoreHandle_t g_poolMutex = 0;
+
+static void MemPool_Lock() {
+	xSemaphoreTake(g_poolMutex, portMAX_DELAY);
+}
+static void MemPool_Unlock() {
+	xSemaphoreGive(g_poolMutex);
+}
+
+void MemPool_Init() {
+	memPool_t *p;
+	int i, j;
+
+	if (g_poolMutex == 0) {
+		g_poolMutex = xSemaphoreCreateMutex();
+	}
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		p = &g_pools[i];
+		if (p->base)
+			continue;
+		p->base = os_malloc(p->st.blockSize * p->st.blockCount);
+		if (p->base == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_MAIN, "MemPool: no memory for %i byte blocks", p->st.blockSize);
+			continue;
+		}
+		p->freeList = 0;
+		for (j = p->st.blockCount - 1; j >= 0; j--) {
+			*(void**)(p->base + j * p->st.blockSize) = p->freeList;
+			p->freeList = p->base + j * p->st.blockSize;
+		}
+		p->st.used = 0;
+	}
+}
+
+static memPool_t *MemPool_FindOwner(const void *ptr) {
+	const byte *b = (const byte*)ptr;
+	int i;
+
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		if (g_pools[i].base && b >= g_pools[i].base
+			&& b < g_pools[i].base + g_pools[i].st.blockSize * g_pools[i].st.blockCount)
+			return &g_pools[i];
+	}
+	return 0;
+}
+
+void *MemPool_Malloc(int size) {
+	memPool_t *p;
+	void *r;
+	int i;
+
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		if (size <= g_pools[i].st.blockSize)
+			break;
+	}
+	if (i == MEMPOOL_CLASSES) {
+		g_poolOversize++;
+		return os_malloc(size);
+	}
+	p = &g_pools[i];
+	MemPool_Lock();
+	r = p->freeList;
+	if (r) {
+		p->freeList = *(void**)r;
+		p->st.used++;
+		if (p->st.used > p->st.highWater)
+			p->st.highWater = p->st.used;
+		p->st.allocs++;
+	}
+	else {
+		p->st.fallbacks++;
+	}
+	MemPool_Unlock();
+	if (r == 0)
+		return os_malloc(size);
+	return r;
+}
+
+void MemPool_Free(void *ptr) {
+	memPool_t *p;
+
+	if (ptr == 0)
+		return;
+	p = MemPool_FindOwner(ptr);
+	if (p == 0) {
+		os_free(ptr);
+		return;
+	}
+	MemPool_Lock();
+	*(void**)ptr = p->freeList;
+	p->freeList = ptr;
+	p->st.used--;
+	MemPool_Unlock();
+}
+
+int MemPool_Owns(const void *ptr) {
+	return MemPool_FindOwner(ptr) != 0;
+}
+
+const memPoolStats_t *MemPool_GetStats(int classIndex) {
+	if (classIndex < 0 || classIndex >= MEMPOOL_CLASSES)
+		return 0;
+	return &g_pools[classIndex].st;
+}
+
+#else
+
+void MemPool_Init() {
+}
+void *MemPool_Malloc(int size) {
+	return os_malloc(size);
+}
+void MemPool_Free(void *ptr) {
+	if (ptr)
+		os_free(ptr);
+}
+int MemPool_Owns(const void *ptr) {
+	return 0;
+}
+const memPoolStats_t *MemPool_GetStats(int classIndex) {
+	return 0;
+}
+
+#endif
+
+char *MemPool_StrDup(const char *s) {
+	int len = strlen(s) + 1;
+	char *r = MemPool_Malloc(len);
+
+	if (r)
+		memcpy(r, s, len);
+	return r;
+}
+
+static int MemPool_GetLargestFreeBlock() {
+#if PLATFORM_ESPIDF
+	return heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+#else
+	// other allocators (Beken heap_4 port included) do not tell us, walking
+	// their free list needs SDK internals and probing with malloc would
+	// itself fragment heap, so report it as unknown
+	return -1;
+#endif
+}
+
+void MemPool_OnEverySecond() {
+	int freeHeap = xPortGetFreeHeapSize();
+
+	if (g_heapLowWater == 0 || freeHeap < g_heapLowWater)
+		g_heapLowWater = freeHeap;
+}
+
+void MemPool_GetHeapStats(memHeapStats_t *out) {
+	out->freeHeap = xPortGetFreeHeapSize();
+	if (g_heapLowWater == 0 || out->freeHeap < g_heapLowWater)
+		g_heapLowWater = out->freeHeap;
+#if PLATFORM_ESPIDF
+	// allocator tracks it on every malloc, so it catches dips between our samples
+	out->lowWater = esp_get_minimum_free_heap_size();
+#else
+	out->lowWater = g_heapLowWater;
+#endif
+	out->largestFreeBlock = MemPool_GetLargestFreeBlock();
+	out->oversize = g_poolOversize;
+}
+
+static commandResult_t CMD_MemStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	memHeapStats_t h;
+	const memPoolStats_t *s;
+	int i;
+
+	MemPool_GetHeapStats(&h);
+	if (h.largestFreeBlock < 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Heap free %i, low water %i, largest block unknown (not reported by this platform's heap), oversize %u",
+			h.freeHeap, h.lowWater, h.oversize);
+	}
+	else {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Heap free %i, low water %i, largest block %i, oversize %u",
+			h.freeHeap, h.lowWater, h.largestFreeBlock, h.oversize);
+	}
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		s = MemPool_GetStats(i);
+		if (s == 0)
+			break;
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Pool %3i: used %i/%i, high water %i, allocs %u, fallbacks %u",
+			s->blockSize, s->used, s->blockCount, s->highWater, s->allocs, s->fallbacks);
+	}
+	return CMD_RES_OK;
+}
+
+void MemPool_AddCommands() {
+	//cmddetail:{"name":"memStats","args":"",
+	//cmddetail:"descr":"Prints free heap, its low water mark, largest free block (ESP-IDF only, other platforms print unknown and give -1 in JSON) and small block pools occupancy. Same data is at /api/memstats.",
+	//cmddetail:"fn":"CMD_MemStats","file":"memory/mem_pool.c","requires":"",
+	//cmddetail:"examples":"memStats"}
+	CMD_RegisterCommand("memStats", CMD_MemStats, NULL);
+}
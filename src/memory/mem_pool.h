@@ -0,0 +1,50 @@
+#ifndef __MEM_POOL_H__
+#define __MEM_POOL_H__
+
+/////////////////////////////////////////////////////////
+// mem_pool.h
+// fixed size class pools for small, short lived blocks,
+// so they do not punch holes in the main heap,
+// and heap telemetry (free, low water, largest free block).
+//
+// Pools and their mutex are taken from heap once, at MemPool_Init, and never returned.
+// A block that does not fit any class, or finds its pool full,
+// goes to os_malloc. MemPool_Free tells them apart by address.
+// Without ENABLE_MEM_POOL all calls go straight to os_malloc/os_free.
+
+#define MEMPOOL_CLASSES		4
+
+typedef struct memPoolStats_s {
+	unsigned short blockSize;
+	unsigned short blockCount;
+	unsigned short used;
+	unsigned short highWater;
+	unsigned int allocs;
+	// requests of this size that went to heap because pool was full
+	unsigned int fallbacks;
+} memPoolStats_t;
+
+typedef struct memHeapStats_s {
+	int freeHeap;
+	// lowest free heap seen by MemPool_OnEverySecond
+	int lowWater;
+	// -1 if platform allocator can not tell
+	int largestFreeBlock;
+	// requests bigger than largest class
+	unsigned int oversize;
+} memHeapStats_t;
+
+void MemPool_Init();
+void *MemPool_Malloc(int size);
+void MemPool_Free(void *ptr);
+char *MemPool_StrDup(const char *s);
+/// @brief Is this block from one of the pools (and not from heap).
+int MemPool_Owns(const void *ptr);
+/// @brief Stats of given size class, 0 if no such class or pools are disabled.
+const memPoolStats_t *MemPool_GetStats(int classIndex);
+/// @brief Heap stats. Largest free block is -1 where allocator does not report it.
+void MemPool_GetHeapStats(memHeapStats_t *out);
+void MemPool_OnEverySecond();
+void MemPool_AddCommands();
+
+#endif
@@ -16,6 +16,7 @@
 #include "../driver/drv_deviceclock.h"
 #include "../driver/drv_tuyaMCU.h"
 #include "../hal/hal_ota.h"
+#include "../memory/mem_pool.h"
 #include <math.h>
 #ifndef WINDOWS
 #include <lwip/dns.h>
@@ -915,7 +916,7 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 
 	g_timeSinceLastMQTTPublish = 0;
 
-	pub_topic = (char*)os_malloc(strlen(sTopic) + 1 + strlen(sChannel) + 5 + 1); //5 for /get
+	pub_topic = (char*)MemPool_Malloc(strlen(sTopic) + 1 + strlen(sChannel) + 5 + 1); //5 for /get
 	if ((pub_topic != NULL) && (sVal != NULL))
 	{
 		sVal_len = strlen(sVal);
@@ -939,7 +940,7 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 		LOCK_TCPIP_CORE();
 		err = mqtt_publish(client, pub_topic, sVal, strlen(sVal), qos, retain, mqtt_pub_request_cb, 0);
 		UNLOCK_TCPIP_CORE();
-		os_free(pub_topic);
+		MemPool_Free(pub_topic);
 
 		if (err != ERR_OK)
 		{
@@ -963,6 +964,7 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 		return OBK_PUBLISH_OK;
 	}
 	else {
+		MemPool_Free(pub_topic);
 		MQTT_Mutex_Free();
 		return OBK_PUBLISH_MEM_FAIL;
 	}
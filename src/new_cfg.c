@@ -97,6 +97,7 @@ void CFG_MarkAsDirty() {
 void CFG_ClearIO() {
 	memset(&g_cfg.pins, 0, sizeof(g_cfg.pins));
 	g_cfg_pendingChanges++;
+	PIN_InvalidateChannelIndex();
 }
 void CFG_SetDefaultConfig() {
 	// must be unsigned, else print below prints negatives as e.g. FFFFFFFe
@@ -112,6 +113,7 @@ void CFG_SetDefaultConfig() {
 	g_configInitialized = 1;
 
 	memset(&g_cfg,0,sizeof(mainConfig_t));
+	PIN_InvalidateChannelIndex();
 	g_cfg.version = MAIN_CFG_VERSION;
 	g_cfg.mqtt_port = 1883;
 	g_cfg.ident0 = CFG_IDENT_0;
@@ -181,6 +183,7 @@ void CFG_SetDefaultConfig() {
 	g_cfg.buttonShortPress = CFG_DEFAULT_BTN_SHORT;
 	// default value is 10, which means 1000ms
 	g_cfg.buttonLongPress = CFG_DEFAULT_BTN_LONG;
+	PIN_UpdateButtonTimes();
 
 	// This is helpful for users
 	CFG_SetFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEONCONNECT,true);
@@ -536,6 +539,7 @@ void CFG_SetMQTTPass(const char *s) {
 void CFG_ClearPins() {
 	memset(&g_cfg.pins,0,sizeof(g_cfg.pins));
 	g_cfg_pendingChanges++;
+	PIN_InvalidateChannelIndex();
 }
 void CFG_IncrementOTACount() {
 	g_cfg.otaCounter++;
@@ -554,6 +558,8 @@ void CFG_Save_IfThereArePendingChanges() {
 		g_cfg.crc = CFG_CalcChecksum(&g_cfg);
 		HAL_Configuration_SaveConfigMemory(&g_cfg,sizeof(g_cfg));
 		g_cfg_pendingChanges = 0;
+		// pending count starts over, it can no longer tell cached JSON apart
+		JSON_BumpStateVersion();
 	}
 }
 void CFG_DeviceGroups_SetName(const char *s) {
@@ -687,6 +693,7 @@ void PIN_SetPinChannelForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels[index] = ch;
+		PIN_InvalidateChannelIndex();
 	}
 }
 void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
@@ -697,6 +704,7 @@ void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels2[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels2[index] = ch;
+		PIN_InvalidateChannelIndex();
 	}
 }
 //void CFG_ApplyStartChannelValues() {
@@ -746,18 +754,21 @@ void CFG_SetButtonLongPressTime(int value) {
 	if(g_cfg.buttonLongPress != value) {
 		g_cfg.buttonLongPress = value;
 		g_cfg_pendingChanges++;
+		PIN_UpdateButtonTimes();
 	}
 }
 void CFG_SetButtonShortPressTime(int value) {
 	if(g_cfg.buttonShortPress != value) {
 		g_cfg.buttonShortPress = value;
 		g_cfg_pendingChanges++;
+		PIN_UpdateButtonTimes();
 	}
 }
 void CFG_SetButtonRepeatPressTime(int value) {
 	if(g_cfg.buttonHoldRepeat != value) {
 		g_cfg.buttonHoldRepeat = value;
 		g_cfg_pendingChanges++;
+		PIN_UpdateButtonTimes();
 	}
 }
 const char *CFG_GetWebPassword() {
@@ -845,6 +856,7 @@ void CFG_InitAndLoad() {
 	byte chkSum;
 
 	HAL_Configuration_ReadConfigMemory(&g_cfg,sizeof(g_cfg));
+	PIN_InvalidateChannelIndex();
 	chkSum = CFG_CalcChecksum(&g_cfg);
 	if(g_cfg.ident0 != CFG_IDENT_0 || g_cfg.ident1 != CFG_IDENT_1 || g_cfg.ident2 != CFG_IDENT_2
 		|| chkSum != g_cfg.crc) {
@@ -888,6 +900,7 @@ void CFG_InitAndLoad() {
 		// default value is 3, which means 100ms
 		g_cfg.buttonLongPress = CFG_DEFAULT_BTN_LONG;
 	}
+	PIN_UpdateButtonTimes();
 	// convert to new version - add missing table
 	if (CFG_HasValidLEDCorrectionTable() == false) {
 		CFG_SetDefaultLEDCorrectionTable();
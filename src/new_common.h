@@ -356,6 +356,7 @@ void doNothing();
 // RTOS
 typedef long portTickType;
 #define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xffffffff
 #define configTICK_RATE_HZ 1
 typedef int SemaphoreHandle_t;
 #define pdTRUE 1
@@ -1045,6 +1046,7 @@ int Main_IsOpenAccessPointMode();
 void Main_Init();
 bool Main_HasFastConnect();
 void Main_OnEverySecond();
+void Main_OnWiFiStatusChange(int code);
 int Main_HasMQTTConnected();
 int Main_HasWiFiConnected();
 void Main_OnPingCheckerReply(int ms);
@@ -1109,8 +1111,23 @@ extern char g_wifi_bssid[33];
 extern uint8_t g_wifi_channel;
 
 typedef int(*jsonCb_t)(void *userData, const char *fmt, ...);
+// Moved by everything that changes what STATUS JSON shows: channels,
+// LED state, drivers, pins and saved config.
+// Cached JSON sections are built again once it has moved.
+extern unsigned int g_jsonStateVersion;
+#define JSON_BumpStateVersion()		(g_jsonStateVersion++)
+// Moved by energy and sensor readings, only StatusSNS is built again.
+extern unsigned int g_jsonSensorVersion;
+#define JSON_BumpSensorVersion()	(g_jsonSensorVersion++)
 #if ENABLE_TASMOTA_JSON
 int JSON_ProcessCommandReply(const char *cmd, const char *args, void *request, jsonCb_t printer, int flags);
+#define JSON_SNAPSHOT_SNS		0
+#define JSON_SNAPSHOT_POWER		1
+#define JSON_SNAPSHOT_NET		2
+#define JSON_SNAPSHOT_SECTIONS	3
+void JSON_GetSnapshotStats(int section, int *hits, int *misses);
+void JSON_Init();
+void JSON_AddCommands();
 #endif
 void ScheduleDriverStart(const char *name, int delay);
 bool isWhiteSpace(char ch);
@@ -17,6 +17,7 @@
 #include "hal/hal_flashVars.h"
 #include "hal/hal_pins.h"
 #include "hal/hal_adc.h"
+#include "driver/drv_adcSampler.h"
 
 #ifdef PLATFORM_BEKEN
 #include <gpio_pub.h>
@@ -25,6 +26,9 @@
 #include "hal/espidf/hal_pinmap_espidf.h"
 #include "esp_sleep.h"
 #include "esp_wifi.h"
+#if PLATFORM_ESPIDF
+#include "esp_timer.h"
+#endif
 #elif PLATFORM_XRADIO
 #undef HAL_ADC_Init
 #include "hal/xradio/hal_pinmap_xradio.h"
@@ -730,8 +734,191 @@ bool BTN_ShouldInvert(int index) {
 	}
 	return false;
 }
+static uint32_t g_time = 0;
+
+static uint32_t PIN_GetTimeMs() {
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
+	return rtos_get_time();
+#elif PLATFORM_ESPIDF
+	// safe to call from ISR
+	return (uint32_t)(esp_timer_get_time() / 1000);
+#else
+	return g_time + PIN_TMR_DURATION;
+#endif
+}
+
+#if ENABLE_PIN_EDGE_QUEUE
+// Input pins get an interrupt on both edges, ISR puts pin level and time
+// into a single producer, single consumer queue, and PIN_ticks only visits
+// pins that had an edge or are still debouncing or timing a click.
+// Pins without interrupt (g_enable_pins off, roles not listed in
+// PIN_IsEdgeInputRole) are polled every tick like before.
+#define PIN_EDGE_QUEUE_SIZE		32	// power of two
+
+#define PIN_EDGE_ATTACHED		1
+#define PIN_EDGE_LEVEL			2	// raw level, before inversion
+#define PIN_EDGE_BUSY			4
+
+typedef struct pinEdge_s {
+	uint32_t timeMs;
+	byte index;
+	byte level;
+} pinEdge_t;
+
+static pinEdge_t g_pinEdges[PIN_EDGE_QUEUE_SIZE];
+// head is written only by ISR, tail only by PIN_ticks
+static volatile unsigned int g_pinEdgeHead;
+static volatile unsigned int g_pinEdgeTail;
+static volatile unsigned int g_pinEdgeOverflows;
+static unsigned int g_pinEdgeOverflowsSeen;
+static byte g_pinEdgeState[PLATFORM_GPIO_MAX];
+static uint32_t g_pinEdgeTime[PLATFORM_GPIO_MAX];
+static pinEdgeStats_t g_pinEdgeStats;
+
+void PIN_PushEdge(int index, int level, unsigned int timeMs) {
+	unsigned int head = g_pinEdgeHead;
+	pinEdge_t *e;
+
+	if (head - g_pinEdgeTail >= PIN_EDGE_QUEUE_SIZE) {
+		// PIN_ticks will read all levels again
+		g_pinEdgeOverflows++;
+		return;
+	}
+	e = &g_pinEdges[head & (PIN_EDGE_QUEUE_SIZE - 1)];
+	e->index = index;
+	e->level = level;
+	e->timeMs = timeMs;
+	// publish only after entry is complete
+	g_pinEdgeHead = head + 1;
+}
+
+// NOTE: ISR!
+static void PIN_EdgeInterruptHandler(int gpio) {
+	PIN_PushEdge(gpio, HAL_PIN_ReadDigitalInput(gpio), PIN_GetTimeMs());
+}
+
+static bool PIN_IsEdgeInputRole(int role) {
+	switch (role) {
+	case IOR_Button:
+	case IOR_Button_n:
+	case IOR_Button_ToggleAll:
+	case IOR_Button_ToggleAll_n:
+	case IOR_Button_NextColor:
+	case IOR_Button_NextColor_n:
+	case IOR_Button_NextDimmer:
+	case IOR_Button_NextDimmer_n:
+	case IOR_Button_NextTemperature:
+	case IOR_Button_NextTemperature_n:
+	case IOR_Button_ScriptOnly:
+	case IOR_Button_ScriptOnly_n:
+	case IOR_SmartButtonForLEDs:
+	case IOR_SmartButtonForLEDs_n:
+	case IOR_DigitalInput:
+	case IOR_DigitalInput_n:
+	case IOR_DigitalInput_NoPup:
+	case IOR_DigitalInput_NoPup_n:
+	case IOR_DoorSensorWithDeepSleep:
+	case IOR_DoorSensorWithDeepSleep_NoPup:
+	case IOR_DoorSensorWithDeepSleep_pd:
+	case IOR_ToggleChannelOnToggle:
+		return true;
+	}
+	return false;
+}
+
+static void PIN_SetEdgeLevel(int index, int level) {
+	if (level)
+		g_pinEdgeState[index] |= PIN_EDGE_LEVEL;
+	else
+		g_pinEdgeState[index] &= ~PIN_EDGE_LEVEL;
+}
+
+static void PIN_StartEdgeCapture(int index, int role) {
+	if (!PIN_IsEdgeInputRole(role))
+		return;
+	HAL_AttachInterrupt(index, INTERRUPT_CHANGE, PIN_EdgeInterruptHandler);
+	PIN_SetEdgeLevel(index, HAL_PIN_ReadDigitalInput(index));
+	g_pinEdgeTime[index] = PIN_GetTimeMs();
+	g_pinEdgeState[index] |= PIN_EDGE_ATTACHED | PIN_EDGE_BUSY;
+}
+
+static void PIN_StopEdgeCapture(int index) {
+	if (!(g_pinEdgeState[index] & PIN_EDGE_ATTACHED))
+		return;
+	HAL_DetachInterrupt(index);
+	g_pinEdgeState[index] = 0;
+}
+
+// returns true if there is any input pin to process in this tick
+static bool PIN_DrainEdges() {
+	pinEdge_t *e;
+	bool bAny = false;
+	int i;
+
+	if (g_pinEdgeOverflows != g_pinEdgeOverflowsSeen) {
+		g_pinEdgeOverflowsSeen = g_pinEdgeOverflows;
+		for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+			if (g_pinEdgeState[i] & PIN_EDGE_ATTACHED) {
+				PIN_SetEdgeLevel(i, HAL_PIN_ReadDigitalInput(i));
+				g_pinEdgeTime[i] = g_time;
+				g_pinEdgeState[i] |= PIN_EDGE_BUSY;
+			}
+		}
+	}
+	while (g_pinEdgeTail != g_pinEdgeHead) {
+		e = &g_pinEdges[g_pinEdgeTail & (PIN_EDGE_QUEUE_SIZE - 1)];
+		if (e->index < PLATFORM_GPIO_MAX && (g_pinEdgeState[e->index] & PIN_EDGE_ATTACHED)) {
+			PIN_SetEdgeLevel(e->index, e->level);
+			g_pinEdgeTime[e->index] = e->timeMs;
+			g_pinEdgeState[e->index] |= PIN_EDGE_BUSY;
+		}
+		g_pinEdgeTail = g_pinEdgeTail + 1;
+		g_pinEdgeStats.edges++;
+	}
+	g_pinEdgeStats.overflows = g_pinEdgeOverflows;
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_pinEdgeState[i] & PIN_EDGE_BUSY)
+			bAny = true;
+		else if (!(g_pinEdgeState[i] & PIN_EDGE_ATTACHED) && PIN_IsEdgeInputRole(g_cfg.pins.roles[i]))
+			bAny = true;
+	}
+	if (!bAny)
+		g_pinEdgeStats.idleTicks++;
+	return bAny;
+}
+
+// time since last edge, so debouncing counts from the edge and not from the tick
+static uint32_t PIN_GetEdgeAge(int index, uint32_t ms_since_last) {
+	uint32_t age;
+
+	if (!(g_pinEdgeState[index] & PIN_EDGE_ATTACHED))
+		return ms_since_last;
+	age = g_time - g_pinEdgeTime[index];
+	if (age > ms_since_last)
+		return ms_since_last;
+	return age;
+}
+
+void PIN_GetEdgeStats(pinEdgeStats_t *out) {
+	*out = g_pinEdgeStats;
+}
+#else
+void PIN_PushEdge(int index, int level, unsigned int timeMs) {
+}
+void PIN_GetEdgeStats(pinEdgeStats_t *out) {
+	memset(out, 0, sizeof(*out));
+}
+#endif
+
 static uint8_t PIN_ReadDigitalInputValue_WithInversionIncluded(int index) {
-	uint8_t iVal = HAL_PIN_ReadDigitalInput(index);
+	uint8_t iVal;
+
+#if ENABLE_PIN_EDGE_QUEUE
+	if (g_pinEdgeState[index] & PIN_EDGE_ATTACHED)
+		iVal = (g_pinEdgeState[index] & PIN_EDGE_LEVEL) ? 1 : 0;
+	else
+#endif
+		iVal = HAL_PIN_ReadDigitalInput(index);
 
 	// support inverted button
 	if (BTN_ShouldInvert(index)) {
@@ -951,6 +1138,9 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 
 		// remove from active inputs
 		setGPIActive(index, 0, 0);
+#if ENABLE_PIN_EDGE_QUEUE
+		PIN_StopEdgeCapture(index);
+#endif
 
 		switch (g_cfg.pins.roles[index])
 		{
@@ -1021,6 +1211,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		}
 		g_cfg.pins.roles[index] = role;
 		g_cfg_pendingChanges++;
+		PIN_InvalidateChannelIndex();
 	}
 
 	if (g_enable_pins) {
@@ -1247,6 +1438,9 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		default:
 			break;
 		}
+#if ENABLE_PIN_EDGE_QUEUE
+		PIN_StartEdgeCapture(index, role);
+#endif
 	}
 	if (bSampleInitialState) {
 		if (PIN_ReadDigitalInputValue_WithInversionIncluded(index)) {
@@ -1278,6 +1472,156 @@ void Channel_SaveInFlashIfNeeded(int ch) {
 		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel_SaveInFlashIfNeeded: Channel %i is not saved to flash, state %i", ch, g_channelValues[ch]);
 	}
 }
+// Per channel view of pin roles, so channel queries do not scan all pins.
+// Pin config almost never changes at runtime, so it is rebuilt lazily
+// after PIN_InvalidateChannelIndex. Channel types are read directly.
+static byte g_channelCaps[CHANNEL_MAX];
+// pins driven by channel value, as list linked through pin index, -1 ends it
+static short g_channelFirstOutPin[CHANNEL_MAX];
+static short g_pinNextOutPin[PLATFORM_GPIO_MAX];
+static bool g_channelIndexDirty = true;
+static int g_pinConfigGeneration = 0;
+
+int PIN_GetConfigGeneration() {
+	return g_pinConfigGeneration;
+}
+void PIN_InvalidateChannelIndex() {
+	g_channelIndexDirty = true;
+	g_pinConfigGeneration++;
+	JSON_BumpStateVersion();
+	// IOR_ADC slots follow the same role and channel changes
+	ADCSampler_InvalidatePins();
+}
+
+static void PIN_AddChannelCaps(int ch, int caps) {
+	if (ch >= 0 && ch < CHANNEL_MAX)
+		g_channelCaps[ch] |= caps;
+}
+
+static void PIN_RebuildChannelIndex() {
+	int i, role, ch, ch2, caps, nofC;
+
+	// cleared first, so a change made during rebuild triggers another one
+	g_channelIndexDirty = false;
+	memset(g_channelCaps, 0, sizeof(g_channelCaps));
+	for (i = 0; i < CHANNEL_MAX; i++) {
+		g_channelFirstOutPin[i] = -1;
+	}
+	// backwards, so lists keep pin order
+	for (i = PLATFORM_GPIO_MAX - 1; i >= 0; i--) {
+		role = g_cfg.pins.roles[i];
+		ch = g_cfg.pins.channels[i];
+		ch2 = g_cfg.pins.channels2[i];
+		g_pinNextOutPin[i] = -1;
+		if (role == IOR_None)
+			continue;
+
+		nofC = PIN_IOR_NofChan(role);
+		if (nofC >= 1)
+			PIN_AddChannelCaps(ch, CHANNEL_CAP_INUSE);
+		if (nofC >= 2)
+			PIN_AddChannelCaps(ch2, CHANNEL_CAP_INUSE);
+
+		caps = 0;
+		switch (role) {
+		case IOR_Relay:
+		case IOR_Relay_n:
+		case IOR_BridgeForward:
+		case IOR_BridgeReverse:
+			caps = CHANNEL_CAP_RELAY;
+			break;
+		case IOR_LED:
+		case IOR_LED_n:
+			caps = CHANNEL_CAP_LED;
+			break;
+		case IOR_PWM:
+		case IOR_PWM_n:
+			caps = CHANNEL_CAP_PWM;
+			break;
+		case IOR_PWM_ScriptOnly:
+		case IOR_PWM_ScriptOnly_n:
+			caps = CHANNEL_CAP_PWM_SCRIPT;
+			break;
+		case IOR_DigitalInput:
+		case IOR_DigitalInput_n:
+		case IOR_DigitalInput_NoPup:
+		case IOR_DigitalInput_NoPup_n:
+		case IOR_DoorSensorWithDeepSleep:
+		case IOR_DoorSensorWithDeepSleep_NoPup:
+		case IOR_DoorSensorWithDeepSleep_pd:
+			caps = CHANNEL_CAP_INPUT;
+			break;
+		}
+		switch (role) {
+		case IOR_Relay:
+		case IOR_Relay_n:
+		case IOR_LED:
+		case IOR_LED_n:
+		case IOR_ADC:
+		case IOR_BAT_ADC:
+		case IOR_DigitalInput:
+		case IOR_DigitalInput_n:
+		case IOR_DigitalInput_NoPup:
+		case IOR_DigitalInput_NoPup_n:
+		case IOR_DoorSensorWithDeepSleep:
+		case IOR_DoorSensorWithDeepSleep_NoPup:
+		case IOR_DoorSensorWithDeepSleep_pd:
+			caps |= CHANNEL_CAP_PUBLISH;
+			break;
+		case IOR_CHT83XX_DAT:
+		case IOR_SHT3X_DAT:
+		case IOR_SGP_DAT:
+			// secondary channel is humidity
+			caps |= CHANNEL_CAP_PUBLISH;
+			if (ch2 != ch)
+				PIN_AddChannelCaps(ch2, CHANNEL_CAP_PUBLISH);
+			break;
+		default:
+			if (IS_PIN_DHT_ROLE(role)) {
+				caps |= CHANNEL_CAP_PUBLISH;
+				if (ch2 != ch)
+					PIN_AddChannelCaps(ch2, CHANNEL_CAP_PUBLISH);
+			}
+			break;
+		}
+		PIN_AddChannelCaps(ch, caps);
+
+		switch (role) {
+		case IOR_Relay:
+		case IOR_Relay_n:
+		case IOR_BAT_Relay:
+		case IOR_BAT_Relay_n:
+		case IOR_LED:
+		case IOR_LED_n:
+		case IOR_PWM:
+		case IOR_PWM_n:
+		case IOR_PWM_ScriptOnly:
+		case IOR_PWM_ScriptOnly_n:
+			if (ch < CHANNEL_MAX) {
+				g_pinNextOutPin[i] = g_channelFirstOutPin[ch];
+				g_channelFirstOutPin[ch] = i;
+			}
+			break;
+		}
+	}
+}
+
+int CHANNEL_GetCapabilities(int ch) {
+	if (ch < 0 || ch >= CHANNEL_MAX)
+		return 0;
+	if (g_channelIndexDirty)
+		PIN_RebuildChannelIndex();
+	return g_channelCaps[ch];
+}
+
+static int CHANNEL_GetFirstOutputPin(int ch) {
+	if (ch < 0 || ch >= CHANNEL_MAX)
+		return -1;
+	if (g_channelIndexDirty)
+		PIN_RebuildChannelIndex();
+	return g_channelFirstOutPin[ch];
+}
+
 static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 	int i;
 	int iVal;
@@ -1287,6 +1631,7 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 	iVal = g_channelValues[ch];
 	g_channelValuesFloats[ch] = (float)iVal;
 	bOn = iVal > 0;
+	JSON_BumpStateVersion();
 
 #if ENABLE_I2C
 	I2C_OnChannelChanged(ch, iVal);
@@ -1302,20 +1647,18 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 #if ENABLE_DRIVER_GIRIERMCU
 	GirierMCU_OnChannelChanged(ch, iVal);
 #endif
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == IOR_Relay || g_cfg.pins.roles[i] == IOR_BAT_Relay || g_cfg.pins.roles[i] == IOR_LED) {
-				RAW_SetPinValue(i, bOn);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_Relay_n || g_cfg.pins.roles[i] == IOR_LED_n || g_cfg.pins.roles[i] == IOR_BAT_Relay_n) {
-				RAW_SetPinValue(i, !bOn);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				HAL_PIN_PWM_Update(i, iVal);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				HAL_PIN_PWM_Update(i, 100 - iVal);
-			}
+	for (i = CHANNEL_GetFirstOutputPin(ch); i >= 0; i = g_pinNextOutPin[i]) {
+		if (g_cfg.pins.roles[i] == IOR_Relay || g_cfg.pins.roles[i] == IOR_BAT_Relay || g_cfg.pins.roles[i] == IOR_LED) {
+			RAW_SetPinValue(i, bOn);
+		}
+		else if (g_cfg.pins.roles[i] == IOR_Relay_n || g_cfg.pins.roles[i] == IOR_LED_n || g_cfg.pins.roles[i] == IOR_BAT_Relay_n) {
+			RAW_SetPinValue(i, !bOn);
+		}
+		else if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
+			HAL_PIN_PWM_Update(i, iVal);
+		}
+		else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
+			HAL_PIN_PWM_Update(i, 100 - iVal);
 		}
 	}
 #if ENABLE_MQTT
@@ -1348,6 +1691,7 @@ void CFG_ApplyChannelStartValues() {
 			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CFG_ApplyChannelStartValues: Channel %i is being set to constant state %i", i, g_channelValues[i]);
 		}
 	}
+	JSON_BumpStateVersion();
 }
 int ChannelType_GetDecimalPlaces(int type) {
 	int pl;
@@ -1566,15 +1910,14 @@ void CHANNEL_Set_FloatPWM(int ch, float fVal, int iFlags) {
 
 	g_channelValues[ch] = (int)fVal;
 	g_channelValuesFloats[ch] = fVal;
+	JSON_BumpStateVersion();
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				HAL_PIN_PWM_Update(i, fVal);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				HAL_PIN_PWM_Update(i, 100.0f - fVal);
-			}
+	for (i = CHANNEL_GetFirstOutputPin(ch); i >= 0; i = g_pinNextOutPin[i]) {
+		if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
+			HAL_PIN_PWM_Update(i, fVal);
+		}
+		else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
+			HAL_PIN_PWM_Update(i, 100.0f - fVal);
 		}
 	}
 	// TODO: support float
@@ -1726,18 +2069,8 @@ void CHANNEL_Add(int ch, int iVal) {
 }
 
 int CHANNEL_FindMaxValueForChannel(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		// is pin tied to this channel?
-		if (g_cfg.pins.channels[i] == ch) {
-			// is it PWM?
-			if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				return 100;
-			}
-			if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				return 100;
-			}
-		}
+	if (CHANNEL_GetCapabilities(ch) & (CHANNEL_CAP_PWM | CHANNEL_CAP_PWM_SCRIPT)) {
+		return 100;
 	}
 	if (g_cfg.pins.channelTypes[ch] == ChType_Dimmer)
 		return 100;
@@ -1819,22 +2152,11 @@ bool CHANNEL_Check(int ch) {
 }
 
 bool CHANNEL_IsInUse(int ch) {
-	int i;
-
 	if (g_cfg.pins.channelTypes[ch] != ChType_Default) {
 		return true;
 	}
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.roles[i] != IOR_None) {
-			int NofC=PIN_IOR_NofChan(g_cfg.pins.roles[i]);
-			if (NofC>=1 && g_cfg.pins.channels[i] == ch) {
-				return true;
-			}
-			if (NofC>=2 && g_cfg.pins.channels2[i] == ch) {
-				return true;
-			}
-		}
+	if (CHANNEL_GetCapabilities(ch) & CHANNEL_CAP_INUSE) {
+		return true;
 	}
 #if (ENABLE_DRIVER_DS1820_FULL)
 #include "driver/drv_ds1820_full.h"
@@ -1845,50 +2167,16 @@ bool CHANNEL_IsInUse(int ch) {
 
 
 bool CHANNEL_IsPowerRelayChannel(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			int role = g_cfg.pins.roles[i];
-			// NOTE: do not include Battery relay
-			if (role == IOR_Relay || role == IOR_Relay_n) {
-				return true;
-			}
-			// Also allow toggling Bridge channel
-			// https://www.elektroda.com/rtvforum/viewtopic.php?p=20906463#20906463
-			if (role == IOR_BridgeForward || role == IOR_BridgeReverse) {
-				return true;
-			}
-		}
-	}
-	return false;
+	// NOTE: do not include Battery relay
+	// Also allow toggling Bridge channel
+	// https://www.elektroda.com/rtvforum/viewtopic.php?p=20906463#20906463
+	return (CHANNEL_GetCapabilities(ch) & CHANNEL_CAP_RELAY) != 0;
 }
 bool CHANNEL_ShouldBePublished(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		int role = g_cfg.pins.roles[i];
-
-		if (g_cfg.pins.channels[i] == ch) {
-			if (role == IOR_Relay || role == IOR_Relay_n
-				|| role == IOR_LED || role == IOR_LED_n
-				|| role == IOR_ADC || role == IOR_BAT_ADC
-				|| role == IOR_CHT83XX_DAT || role == IOR_SHT3X_DAT || role == IOR_SGP_DAT
-				|| role == IOR_DigitalInput || role == IOR_DigitalInput_n
-				|| role == IOR_DoorSensorWithDeepSleep || role == IOR_DoorSensorWithDeepSleep_NoPup
-				|| role == IOR_DoorSensorWithDeepSleep_pd
-				|| IS_PIN_DHT_ROLE(role)
-				|| role == IOR_DigitalInput_NoPup || role == IOR_DigitalInput_NoPup_n) {
-				return true;
-			}
-		}
-		else if (g_cfg.pins.channels2[i] == ch) {
-			if (IS_PIN_DHT_ROLE(role)) {
-				return true;
-			}
-			// SGP, CHT8305 and SHT3X uses secondary channel for humidity
-			if (role == IOR_CHT83XX_DAT || role == IOR_SHT3X_DAT || role == IOR_SGP_DAT) {
-				return true;
-			}
-		}
+	// relays, LEDs, ADCs, digital inputs, door sensors, and sensors
+	// like DHT, SGP, CHT8305 and SHT3X which also publish secondary channel
+	if (CHANNEL_GetCapabilities(ch) & CHANNEL_CAP_PUBLISH) {
+		return true;
 	}
 	if (g_cfg.pins.channelTypes[ch] != ChType_Default) {
 		return true;
@@ -1948,7 +2236,7 @@ int CHANNEL_GetRoleForOutputChannel(int ch) {
 #define ADC_SAMPLING_TICK_COUNT PIN_TMR_LOOPS_PER_SECOND
 
 
-void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
+static void PIN_Input_HandlerEx(int pinIndex, uint32_t ms_since_last, uint32_t ms_since_edge)
 {
 	pinButton_s* handle;
 	uint8_t read_gpio_level;
@@ -1968,7 +2256,10 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 	/*------------button debounce handle---------------*/
 	if (read_gpio_level != handle->button_level) { //not equal to prev one
 		//continue read 3 times same new level change
-		handle->debounce_cnt += ms_since_last;
+		if (handle->debounce_cnt == 0)
+			handle->debounce_cnt += ms_since_edge;
+		else
+			handle->debounce_cnt += ms_since_last;
 
 		if (handle->debounce_cnt >= BTN_DEBOUNCE_MS) {
 			handle->button_level = read_gpio_level;
@@ -2086,6 +2377,42 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 		break;
 	}
 }
+void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
+{
+	PIN_Input_HandlerEx(pinIndex, ms_since_last, ms_since_last);
+}
+
+#if ENABLE_PIN_EDGE_QUEUE
+// nothing will happen on this pin until next edge
+static bool PIN_IsEdgeInputIdle(int index) {
+	pinButton_s* handle;
+	int role = g_cfg.pins.roles[index];
+	int value = PIN_ReadDigitalInputValue_WithInversionIncluded(index);
+
+	switch (role) {
+	case IOR_DigitalInput:
+	case IOR_DigitalInput_n:
+	case IOR_DigitalInput_NoPup:
+	case IOR_DigitalInput_NoPup_n:
+	case IOR_DoorSensorWithDeepSleep:
+	case IOR_DoorSensorWithDeepSleep_NoPup:
+	case IOR_DoorSensorWithDeepSleep_pd:
+	case IOR_ToggleChannelOnToggle:
+		return g_lastValidState[index] == value;
+	}
+	if (!PIN_IsEdgeInputRole(role))
+		return true;
+	handle = &g_buttons[index];
+	return handle->state == 0 && handle->debounce_cnt == 0
+		&& handle->button_level == value && handle->button_level != handle->active_level;
+}
+#endif
+
+void PIN_UpdateButtonTimes() {
+	BTN_SHORT_MS = (g_cfg.buttonShortPress * 100);
+	BTN_LONG_MS = (g_cfg.buttonLongPress * 100);
+	BTN_HOLD_REPEAT_MS = (g_cfg.buttonHoldRepeat * 100);
+}
 
 void PIN_set_wifi_led(int value) {
 	int i;
@@ -2100,7 +2427,6 @@ void PIN_set_wifi_led(int value) {
 	}
 }
 
-static uint32_t g_time = 0;
 static uint32_t g_last_time = 0;
 static int activepoll_time = 0; // time to keep polling active until
 
@@ -2113,11 +2439,7 @@ void PIN_ticks(void* param)
 
 	PIN_ApplyCounterDeltas();
 
-#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-	g_time = rtos_get_time();
-#else
-	g_time += PIN_TMR_DURATION;
-#endif
+	g_time = PIN_GetTimeMs();
 	uint32_t t_diff = g_time - g_last_time;
 	// cope with wrap
 	if (t_diff > 0x4000) {
@@ -2125,10 +2447,6 @@ void PIN_ticks(void* param)
 	}
 	g_last_time = g_time;
 
-	BTN_SHORT_MS = (g_cfg.buttonShortPress * 100);
-	BTN_LONG_MS = (g_cfg.buttonLongPress * 100);
-	BTN_HOLD_REPEAT_MS = (g_cfg.buttonHoldRepeat * 100);
-
 	int debounceMS;
 	if (CFG_HasFlag(OBK_FLAG_BTN_INSTANTTOUCH)) {
 		debounceMS = 100;
@@ -2139,9 +2457,24 @@ void PIN_ticks(void* param)
 
 	int activepins = 0;
 	uint32_t pinvalues[2] = { 0, 0 };
+	uint32_t t_edge;
+
+#if ENABLE_PIN_EDGE_QUEUE
+	if (!PIN_DrainEdges()) {
+		// no edges, nothing debouncing or waiting for click timeout
+		return;
+	}
+#endif
 
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++)
 	{
+#if ENABLE_PIN_EDGE_QUEUE
+		if ((g_pinEdgeState[i] & PIN_EDGE_ATTACHED) && !(g_pinEdgeState[i] & PIN_EDGE_BUSY))
+			continue;
+		t_edge = PIN_GetEdgeAge(i, t_diff);
+#else
+		t_edge = t_diff;
+#endif
 		// note pins which are active - i.e. would not trigger an edge interrupt on change.
 		// if we have any, then we must poll until none
 		// TODO: this will only be used when GPI interrupt triggeringis used.
@@ -2208,7 +2541,7 @@ void PIN_ticks(void* param)
 				|| g_cfg.pins.roles[i] == IOR_Button_ScriptOnly || g_cfg.pins.roles[i] == IOR_Button_ScriptOnly_n
 				|| g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs || g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs_n) {
 				//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL,"Test hold %i\r\n",i);
-				PIN_Input_Handler(i, t_diff);
+				PIN_Input_HandlerEx(i, t_diff, t_edge);
 			}
 			else if (g_cfg.pins.roles[i] == IOR_DigitalInput || g_cfg.pins.roles[i] == IOR_DigitalInput_n
 				||
@@ -2231,7 +2564,7 @@ void PIN_ticks(void* param)
 						}
 					}
 					else {
-						g_times[i] += t_diff;
+						g_times[i] += g_times[i] ? t_diff : t_edge;
 					}
 					g_times2[i] = 0;
 				}
@@ -2244,7 +2577,7 @@ void PIN_ticks(void* param)
 						}
 					}
 					else {
-						g_times2[i] += t_diff;
+						g_times2[i] += g_times2[i] ? t_diff : t_edge;
 					}
 					g_times[i] = 0;
 				}
@@ -2267,7 +2600,7 @@ void PIN_ticks(void* param)
 							}
 						}
 					} else {
-						g_times[i] += t_diff;
+						g_times[i] += g_times[i] ? t_diff : t_edge;
 					}
 					g_times2[i] = 0;
 				} else {
@@ -2283,11 +2616,15 @@ void PIN_ticks(void* param)
 							}
 						}
 					} else {
-						g_times2[i] += t_diff;
+						g_times2[i] += g_times2[i] ? t_diff : t_edge;
 					}
 					g_times[i] = 0;
 				}
 			}
+#if ENABLE_PIN_EDGE_QUEUE
+		if ((g_pinEdgeState[i] & PIN_EDGE_BUSY) && PIN_IsEdgeInputIdle(i))
+			g_pinEdgeState[i] &= ~PIN_EDGE_BUSY;
+#endif
 	}
 
 #ifdef PLATFORM_BEKEN
@@ -2630,63 +2967,16 @@ void PIN_get_Relay_PWM_Count(int* relayCount, int* pwmCount, int* dInputCount) {
 
 
 int h_isChannelPWM(int tg_ch) {
-	int i;
-	int role;
-	int ch;
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		ch = PIN_GetPinChannelForPinIndex(i);
-		if (tg_ch != ch)
-			continue;
-		role = PIN_GetPinRoleForPinIndex(i);
-		if (role == IOR_PWM || role == IOR_PWM_n) {
-			return true;
-		}
-		// DO NOT COUNT SCRIPTONLY PWM HERE!
-		// As in title - it's only for scripts. 
-		// It should not generate lights!
-		//if (role == IOR_PWM_ScriptOnly) {
-		//	return true;
-		//}
-	}
-	return false;
+	// DO NOT COUNT SCRIPTONLY PWM HERE!
+	// As in title - it's only for scripts. 
+	// It should not generate lights!
+	return (CHANNEL_GetCapabilities(tg_ch) & CHANNEL_CAP_PWM) != 0;
 }
 int h_isChannelRelay(int tg_ch) {
-	int i;
-	int role;
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		int ch = PIN_GetPinChannelForPinIndex(i);
-		if (tg_ch != ch)
-			continue;
-		role = PIN_GetPinRoleForPinIndex(i);
-		if (role == IOR_Relay || role == IOR_Relay_n || role == IOR_LED || role == IOR_LED_n) {
-			return true;
-		}
-		if ((role == IOR_BridgeForward) || (role == IOR_BridgeReverse))
-		{
-			return true;
-		}
-	}
-	return false;
+	return (CHANNEL_GetCapabilities(tg_ch) & (CHANNEL_CAP_RELAY | CHANNEL_CAP_LED)) != 0;
 }
 int h_isChannelDigitalInput(int tg_ch) {
-	int i;
-	int role;
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		int ch = PIN_GetPinChannelForPinIndex(i);
-		if (tg_ch != ch)
-			continue;
-		role = PIN_GetPinRoleForPinIndex(i);
-		if (role == IOR_DigitalInput || role == IOR_DigitalInput_n || role == IOR_DigitalInput_NoPup || role == IOR_DigitalInput_NoPup_n) {
-			return true;
-		}
-		if (role == IOR_DoorSensorWithDeepSleep || role == IOR_DoorSensorWithDeepSleep_NoPup || role == IOR_DoorSensorWithDeepSleep_pd) {
-			return true;
-		}
-	}
-	return false;
+	return (CHANNEL_GetCapabilities(tg_ch) & CHANNEL_CAP_INPUT) != 0;
 }
 static commandResult_t showgpi(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
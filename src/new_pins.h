@@ -1621,6 +1621,35 @@ void CHANNEL_SetStateOnly(int iVal);
 int CHANNEL_HasChannelPinWithRole(int ch, int iorType);
 int CHANNEL_HasChannelPinWithRoleOrRole(int ch, int iorType, int iorType2);
 bool CHANNEL_IsInUse(int ch);
+// bits of CHANNEL_GetCapabilities, derived from roles of pins tied to channel
+#define CHANNEL_CAP_PUBLISH			1	// pin role publishes channel over MQTT
+#define CHANNEL_CAP_RELAY			2	// relay or bridge, not battery relay
+#define CHANNEL_CAP_LED				4
+#define CHANNEL_CAP_PWM				8	// PWM that makes lights, not script only
+#define CHANNEL_CAP_PWM_SCRIPT		16
+#define CHANNEL_CAP_INPUT			32	// digital input or door sensor
+#define CHANNEL_CAP_INUSE			64	// any pin role using channel
+int CHANNEL_GetCapabilities(int ch);
+// call after changing pin roles or channels without PIN_Set* functions
+void PIN_InvalidateChannelIndex();
+// changes whenever pin roles or channels may have changed, so drivers
+// can cache pins they found and look again only then
+int PIN_GetConfigGeneration();
+
+typedef struct pinEdgeStats_s {
+	// edges taken from interrupt queue by PIN_ticks
+	unsigned int edges;
+	// edges lost because queue was full, levels were read again
+	unsigned int overflows;
+	// PIN_ticks calls with no input pin to process
+	unsigned int idleTicks;
+} pinEdgeStats_t;
+/// @brief Queue input pin edge, as seen by interrupt (raw level, PIN_ticks time base).
+/// Safe to call from ISR. Also used by selftests to inject edge streams.
+void PIN_PushEdge(int index, int level, unsigned int timeMs);
+void PIN_GetEdgeStats(pinEdgeStats_t *out);
+// call after changing button timing config
+void PIN_UpdateButtonTimes();
 void Channel_SaveInFlashIfNeeded(int ch);
 int CHANNEL_FindMaxValueForChannel(int ch);
 int CHANNEL_FindIndexForType(int requiredType); 
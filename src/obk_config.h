@@ -190,6 +190,11 @@
 #define ENABLE_OBK_BERRY						1
 #define ENABLE_DRIVER_DS1820_FULL				1
 #define ENABLE_DRIVER_DMX						1
+#define ENABLE_TICK_PROFILER					1
+#define ENABLE_MEM_POOL							1
+#define ENABLE_LFS_PERF_PROFILE					1
+#define ENABLE_LFS_FILE_CACHE					1
+#define ENABLE_PIN_EDGE_QUEUE					1
 
 #elif PLATFORM_BL602
 
@@ -275,6 +280,10 @@
 #define ENABLE_DRIVER_HUE						1
 // #define ENABLE_DRIVER_CHARGINGLIMIT			1
 #define ENABLE_DRIVER_BATTERY					1
+#define ENABLE_TICK_PROFILER					1
+#define ENABLE_MEM_POOL							1
+#define ENABLE_LFS_PERF_PROFILE					1
+#define ENABLE_LFS_FILE_CACHE					1
 #if PLATFORM_BK7231N || PLATFORM_BEKEN_NEW
 // #define ENABLE_DRIVER_PWM_GROUP				1
 #define ENABLE_DRIVER_SM16703P					1
@@ -437,6 +446,8 @@
 #define ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY	1
 #define ENABLE_DRIVER_SM16703P					1
 #define ENABLE_DRIVER_PIXELANIM					1
+#define ENABLE_TICK_PROFILER					1
+#define ENABLE_PIN_EDGE_QUEUE					1
 
 #if (OBK_VARIANT == OBK_VARIANT_ESP4M || OBK_VARIANT == OBK_VARIANT_ESP2M_BERRY)
 #define ENABLE_OBK_BERRY						1
@@ -0,0 +1,168 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_adcSampler.h"
+
+static void Test_ADCSampler_Filters() {
+	adcFilter_t f;
+	int window[ADCFILTER_WINDOW_MAX];
+	unsigned int seed = 777;
+	int i, j, v, sum;
+
+	ADCFilter_Init(&f, ADCFILTER_AVERAGE, 4, 0);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 10) == 10);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 20) == 15);
+	ADCFilter_Add(&f, 30);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 40) == 25);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 50) == 35);
+
+	// running sum must match full re-sum over many wraps
+	ADCFilter_Init(&f, ADCFILTER_AVERAGE, 100, 0);
+	SELFTEST_ASSERT(f.size == ADCFILTER_WINDOW_MAX);
+	for (i = 0; i < 1000; i++) {
+		seed = seed * 1103515245 + 12345;
+		v = (seed >> 16) & 0xFFF;
+		window[i % ADCFILTER_WINDOW_MAX] = v;
+		ADCFilter_Add(&f, v);
+		if (i < ADCFILTER_WINDOW_MAX)
+			continue;
+		sum = 0;
+		for (j = 0; j < ADCFILTER_WINDOW_MAX; j++) {
+			sum += window[j];
+		}
+		if (ADCFilter_Get(&f) != (sum + ADCFILTER_WINDOW_MAX / 2) / ADCFILTER_WINDOW_MAX)
+			break;
+	}
+	SELFTEST_ASSERT(i == 1000);
+
+	// first sample is taken as is, then value moves by 1/4 of the difference
+	ADCFilter_Init(&f, ADCFILTER_EMA, 2, 0);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 0) == 0);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 1000) == 250);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 1000) == 438);
+	for (i = 0; i < 50; i++) {
+		ADCFilter_Add(&f, 1000);
+	}
+	SELFTEST_ASSERT(ADCFilter_Get(&f) == 1000);
+
+	// single spike is never seen behind median of 3
+	ADCFilter_Init(&f, ADCFILTER_NONE, 0, 3);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 100) == 100);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 100) == 100);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 4000) == 100);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 100) == 100);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 200) == 200);
+	SELFTEST_ASSERT(ADCFilter_Add(&f, 4000) == 200);
+}
+
+void Test_ADCSampler() {
+	adcSamplerStats_t st;
+	unsigned int samples;
+	int i, maxSeen;
+
+	Test_ADCSampler_Filters();
+
+	SIM_ClearOBK(0);
+
+	// IOR_ADC pins are sampled once per second, as before
+	PIN_SetPinRoleForPinIndex(23, IOR_ADC);
+	PIN_SetPinChannelForPinIndex(23, 12);
+	SIM_SetIntegerValueADCPin(23, 1234);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(ADCSampler_GetStats(23, 0, &st));
+	samples = st.samples;
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1234);
+	ADCSampler_GetStats(23, 0, &st);
+	SELFTEST_ASSERT(st.samples - samples >= 1 && st.samples - samples <= 2);
+	// new channel gets value without waiting for ADC change
+	PIN_SetPinChannelForPinIndex(23, 13);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(13, 1234);
+	PIN_SetPinChannelForPinIndex(23, 12);
+
+	// 100ms, median of 3, 4 sample average, deadband 50
+	CMD_ExecuteCommand("ADCSampler 23 100 avg 4 3 50", 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(12, 1234);
+	SIM_SetIntegerValueADCPin(23, 1260);
+	Sim_RunSeconds(1, false);
+	// inside deadband
+	SELFTEST_ASSERT_CHANNEL(12, 1234);
+	SIM_SetIntegerValueADCPin(23, 1400);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(CHANNEL_Get(12) != 1234);
+	SELFTEST_ASSERT(CHANNEL_Get(12) >= 1350 && CHANNEL_Get(12) <= 1400);
+
+	// one sample long spike does not reach channel
+	ADCSampler_GetStats(23, 0, &st);
+	samples = st.samples;
+	SIM_SetIntegerValueADCPin(23, 4000);
+	while (st.samples == samples) {
+		Sim_RunFrames(1, false);
+		ADCSampler_GetStats(23, 0, &st);
+	}
+	SIM_SetIntegerValueADCPin(23, 1400);
+	maxSeen = 0;
+	for (i = 0; i < 100; i++) {
+		Sim_RunFrames(1, false);
+		if (CHANNEL_Get(12) > maxSeen)
+			maxSeen = CHANNEL_Get(12);
+	}
+	SELFTEST_ASSERT(maxSeen <= 1400);
+
+	// slot goes away with the role
+	PIN_SetPinRoleForPinIndex(23, IOR_None);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(ADCSampler_GetStats(23, 0, &st) == 0);
+
+	// ADC smoother runs on the same sampler
+	CMD_ExecuteCommand("startDriver ADCSmoother", 0);
+	SIM_SetIntegerValueADCPin(4, 3000);
+	CMD_ExecuteCommand("ADCSmoother 4 4 50 10 2048 11", 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(10, 3000);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+	SIM_SetIntegerValueADCPin(4, 1000);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1000);
+	SELFTEST_ASSERT_CHANNEL(11, 0);
+	CMD_ExecuteCommand("stopDriver ADCSmoother", 0);
+	SELFTEST_ASSERT(ADCSampler_CountSlots(4) == 0);
+
+	// smoother on IOR_ADC pin gets its own slot, pin channel keeps going
+	PIN_SetPinRoleForPinIndex(23, IOR_ADC);
+	SIM_SetIntegerValueADCPin(23, 1500);
+	CMD_ExecuteCommand("startDriver ADCSmoother", 0);
+	CMD_ExecuteCommand("ADCSmoother 23 4 50 10 2048 11", 0);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(ADCSampler_CountSlots(23) == 2);
+	SELFTEST_ASSERT_CHANNEL(10, 1500);
+	SELFTEST_ASSERT_CHANNEL(12, 1500);
+	SIM_SetIntegerValueADCPin(23, 2500);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT_CHANNEL(10, 2500);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+	SELFTEST_ASSERT_CHANNEL(12, 2500);
+	CMD_ExecuteCommand("stopDriver ADCSmoother", 0);
+	SELFTEST_ASSERT(ADCSampler_CountSlots(23) == 1);
+	SELFTEST_ASSERT(ADCSampler_GetStats(23, 0, &st));
+	PIN_SetPinRoleForPinIndex(23, IOR_None);
+
+	// and so do ADC buttons
+	PIN_SetPinRoleForPinIndex(5, IOR_ADC_Button);
+	SIM_SetIntegerValueADCPin(5, 3000);
+	CMD_ExecuteCommand("startDriver ADCButton", 0);
+	CMD_ExecuteCommand("AB_Map 500 1500 2500", 0);
+	CMD_ExecuteCommand("addEventHandler OnADCButton 1 setChannel 20 77", 0);
+	Sim_RunFrames(20, false);
+	SELFTEST_ASSERT(ADCSampler_CountSlots(5) == 1);
+	SELFTEST_ASSERT_CHANNEL(20, 0);
+	SIM_SetIntegerValueADCPin(5, 1000);
+	Sim_RunFrames(20, false);
+	SELFTEST_ASSERT_CHANNEL(20, 77);
+	CMD_ExecuteCommand("stopDriver ADCButton", 0);
+	SELFTEST_ASSERT(ADCSampler_CountSlots(5) == 0);
+}
+
+#endif
@@ -2,6 +2,9 @@
 
 #include "selftest_local.h"
 
+int Berry_GetBytecodeCacheHits();
+bool Berry_IsBytecodeCacheFresh(const char *src, bool *bSourceExists, unsigned int *srcHash);
+
 
 void Test_Berry_VarLifeSpan() {
 	// reset whole device
@@ -1426,6 +1429,130 @@ void Test_Berry_CmdHandler() {
 	SELFTEST_ASSERT_STRING("555.168.0.123", CFG_GetMQTTHost());
 
 
+}
+// Many handlers on the same event, only matching ones must fire
+void Test_Berry_ManyHandlers() {
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("setChannel 3 0", 0);
+	// 40 per-pin click handlers, each adds its pin number to channel 1
+	CMD_ExecuteCommand("berry def mkClick(n) return def(arg) addChannel(1, n) end end", 0);
+	CMD_ExecuteCommand("berry for i: 0..39 addEventHandler(\"OnClick\", i, mkClick(i)) end", 0);
+	// catch-all click handler counts all clicks
+	CMD_ExecuteCommand("berry addEventHandler(\"OnClick\", def(a, b) addChannel(2, 1) end)", 0);
+	// a few command handlers, matched by name, case insensitive
+	CMD_ExecuteCommand("berry addEventHandler(\"OnCmd\", \"CmdA\", def(arg) addChannel(3, 1) end)", 0);
+	CMD_ExecuteCommand("berry addEventHandler(\"OnCmd\", \"CmdB\", def(arg) addChannel(3, 10) end)", 0);
+	CMD_ExecuteCommand("berry addEventHandler(\"OnCmd\", \"CmdC\", def(arg) addChannel(3, 100) end)", 0);
+
+	CMD_Berry_RunEventHandlers_IntInt(CMD_EVENT_PIN_ONCLICK, 7, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 7);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	CMD_Berry_RunEventHandlers_IntInt(CMD_EVENT_PIN_ONCLICK, 33, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 40);
+	SELFTEST_ASSERT_CHANNEL(2, 2);
+	// no handler for that pin, only the catch-all
+	CMD_Berry_RunEventHandlers_IntInt(CMD_EVENT_PIN_ONCLICK, 55, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 40);
+	SELFTEST_ASSERT_CHANNEL(2, 3);
+	// other event must not reach click handlers
+	CMD_Berry_RunEventHandlers_IntInt(CMD_EVENT_PIN_ONDBLCLICK, 7, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 40);
+	SELFTEST_ASSERT_CHANNEL(2, 3);
+
+	SELFTEST_ASSERT(CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, "cmdb", "") == 1);
+	SELFTEST_ASSERT_CHANNEL(3, 10);
+	SELFTEST_ASSERT(CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, "CMDC", "") == 1);
+	SELFTEST_ASSERT_CHANNEL(3, 110);
+	SELFTEST_ASSERT(CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, "CmdD", "") == 0);
+	SELFTEST_ASSERT_CHANNEL(3, 110);
+
+	// timers still run while all these handlers wait
+	CMD_ExecuteCommand("berry setTimeout(def() addChannel(3, 1000) end, 50)", 0);
+	for (i = 0; i < 10; i++) {
+		Berry_RunThreads(10);
+	}
+	SELFTEST_ASSERT_CHANNEL(3, 1110);
+	// and handlers are still there after timers were swept
+	CMD_Berry_RunEventHandlers_IntInt(CMD_EVENT_PIN_ONCLICK, 1, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 41);
+	SELFTEST_ASSERT_CHANNEL(2, 4);
+}
+// Same script run from source and from cached bytecode must give same results
+void Test_Berry_Bytecode() {
+	byte *data;
+	int hits;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/bctest.be",
+		"def fib(n)\n"
+		"	if n <= 1 return n end\n"
+		"	return fib(n - 1) + fib(n - 2)\n"
+		"end\n"
+		"var s = 0\n"
+		"for i: 1..10 s += i * i end\n"
+		"setChannel(1, fib(15))\n"
+		"setChannel(2, s)\n");
+
+	// from source
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("berry import bctest", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 610);
+	SELFTEST_ASSERT_CHANNEL(2, 385);
+
+	// compile, cache must appear
+	CMD_ExecuteCommand("berryCompile bctest.be", 0);
+	data = LFS_ReadFile("bctest.be.bc");
+	SELFTEST_ASSERT(data != 0);
+	free(data);
+	SELFTEST_ASSERT(Berry_IsBytecodeCacheFresh("bctest.be", 0, 0));
+
+	// from bytecode, on a fresh VM so module is imported again
+	hits = Berry_GetBytecodeCacheHits();
+	CMD_ExecuteCommand("stopBerry", 0);
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("startScript bctest.be", 0);
+	SELFTEST_ASSERT(Berry_GetBytecodeCacheHits() > hits);
+	SELFTEST_ASSERT_CHANNEL(1, 610);
+	SELFTEST_ASSERT_CHANNEL(2, 385);
+
+	// reading the source as data still gives the source, not bytecode
+	hits = Berry_GetBytecodeCacheHits();
+	CMD_ExecuteCommand("berry var f = open('bctest.be') var t = f.read() f.close() setChannel(3, t[0] == 'd' ? 1 : 0)", 0);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	SELFTEST_ASSERT(Berry_GetBytecodeCacheHits() == hits);
+
+	// changed source invalidates the cache, source is used again
+	Test_FakeHTTPClientPacket_POST("api/lfs/bctest.be",
+		"setChannel(1, 123)\n"
+		"setChannel(2, 456)\n");
+	SELFTEST_ASSERT(Berry_IsBytecodeCacheFresh("bctest.be", 0, 0) == false);
+	hits = Berry_GetBytecodeCacheHits();
+	CMD_ExecuteCommand("stopBerry", 0);
+	CMD_ExecuteCommand("berry import bctest", 0);
+	SELFTEST_ASSERT(Berry_GetBytecodeCacheHits() == hits);
+	SELFTEST_ASSERT_CHANNEL(1, 123);
+	SELFTEST_ASSERT_CHANNEL(2, 456);
+
+	// startScript shorthand compiles the new source on its own
+	CMD_ExecuteCommand("stopBerry", 0);
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("startScript bctest.be", 0);
+	SELFTEST_ASSERT(Berry_IsBytecodeCacheFresh("bctest.be", 0, 0));
+	SELFTEST_ASSERT(Berry_GetBytecodeCacheHits() > hits);
+	SELFTEST_ASSERT_CHANNEL(1, 123);
+	SELFTEST_ASSERT_CHANNEL(2, 456);
 }
 void Test_Berry_NTP() {
 	// reset whole device
@@ -1551,6 +1678,8 @@ void Test_Berry() {
 	Test_Berry_MQTTHandler();
 	Test_Berry_MQTTHandler2();
 	Test_Berry_CmdHandler();
+	Test_Berry_ManyHandlers();
+	Test_Berry_Bytecode();
 	Test_Berry_Fibonacci();
 	Test_Berry_AddChangeHandler();
 	Test_Berry_FileSystem();
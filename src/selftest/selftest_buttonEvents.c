@@ -97,5 +97,85 @@ void Test_ButtonEvents() {
 	SELFTEST_ASSERT_CHANNEL(13, 1201);
 }
 
+int rtos_get_time();
+
+// button and input driven by edges from interrupt queue, idle when nothing happens
+void Test_ButtonEvents_EdgeQueue() {
+#if ENABLE_PIN_EDGE_QUEUE
+	pinEdgeStats_t st, st2;
+	int i, t;
+
+	SIM_ClearOBK(0);
+
+	SIM_SetSimulatedPinValue(9, true);
+	PIN_SetPinRoleForPinIndex(9, IOR_Button);
+	SIM_SetSimulatedPinValue(10, false);
+	PIN_SetPinRoleForPinIndex(10, IOR_DigitalInput);
+	PIN_SetPinChannelForPinIndex(10, 2);
+	CMD_ExecuteCommand("addEventHandler OnPress 9 addChannel 10 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnClick 9 addChannel 11 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnHold 9 addChannel 12 1", 0);
+	Sim_RunFrames(50, false);
+
+	// nothing changes, so pins are not even looked at
+	PIN_GetEdgeStats(&st);
+	Sim_RunFrames(100, false);
+	PIN_GetEdgeStats(&st2);
+	SELFTEST_ASSERT(st2.edges == st.edges);
+	SELFTEST_ASSERT(st2.idleTicks == st.idleTicks + 100);
+
+	// bouncy press, as seen by ISR within one tick
+	t = rtos_get_time();
+	PIN_PushEdge(9, 0, t);
+	PIN_PushEdge(9, 1, t + 1);
+	PIN_PushEdge(9, 0, t + 2);
+	Sim_RunFrames(15, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+	PIN_GetEdgeStats(&st);
+	SELFTEST_ASSERT(st.edges == st2.edges + 3);
+	// release, click comes after double click timeout
+	PIN_PushEdge(9, 1, rtos_get_time());
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	// and it is idle again
+	PIN_GetEdgeStats(&st);
+	Sim_RunFrames(10, false);
+	PIN_GetEdgeStats(&st2);
+	SELFTEST_ASSERT(st2.idleTicks == st.idleTicks + 10);
+
+	// glitch shorter than debounce is ignored
+	t = rtos_get_time();
+	PIN_PushEdge(9, 0, t);
+	PIN_PushEdge(9, 1, t + 3);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+
+	// edges from simulated pin interrupt
+	SIM_SetSimulatedPinValue(10, true);
+	Sim_RunFrames(40, false);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SIM_SetSimulatedPinValue(10, false);
+	Sim_RunFrames(40, false);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+
+	// more edges than queue holds, levels are read again from pins
+	PIN_GetEdgeStats(&st);
+	for (i = 0; i < 40; i++) {
+		PIN_PushEdge(9, i & 1, rtos_get_time());
+	}
+	Sim_RunFrames(200, false);
+	PIN_GetEdgeStats(&st2);
+	SELFTEST_ASSERT(st2.overflows > st.overflows);
+	// pin is high, so no stuck press
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+	PIN_GetEdgeStats(&st);
+	Sim_RunFrames(10, false);
+	PIN_GetEdgeStats(&st2);
+	SELFTEST_ASSERT(st2.idleTicks == st.idleTicks + 10);
+#endif
+}
 
 #endif
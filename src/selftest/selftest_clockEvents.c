@@ -15,6 +15,72 @@ static void ResetEventsAndChannels(int eventsCleared) {
 	SELFTEST_ASSERT_CHANNEL(3, 0);
 }
 
+// hundreds of events, each one must run exactly once per matching day
+static void Test_ClockEvents_Many() {
+	char cmd[128];
+	unsigned int simTime, i;
+
+	ResetEventsAndChannels(4);
+	// 300 events every 5 minutes of the day, spread over channels 1-3
+	for (i = 0; i < 300; i++) {
+		sprintf(cmd, "addClockEvent %i 0xff %i addChannel %i 1", i * 300, 2000 + i, 1 + i % 3);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	// only on Monday (bit 1) and Saturday (bit 6)
+	CMD_ExecuteCommand("addClockEvent 12:00:00 0x42 3000 addChannel 4 1", 0);
+	CMD_ExecuteCommand("setChannel 4 0", 0);
+	SELFTEST_ASSERT(TIME_Print_EventList() == 301);
+
+	// Thu, Apr 20 2023 00:00:00, run a whole week in 50 second steps
+	simTime = 1681948800;
+	for (i = 0; i <= 7 * 86400; i += 50) {
+		TIME_RunEvents(simTime + i, true);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 7 * 100);
+	SELFTEST_ASSERT_CHANNEL(2, 7 * 100);
+	SELFTEST_ASSERT_CHANNEL(3, 7 * 100);
+	SELFTEST_ASSERT_CHANNEL(4, 2);
+
+	// removing one of them keeps the rest in order
+	SELFTEST_ASSERT(TIME_RemoveEvent(2000) == 1);
+	SELFTEST_ASSERT(TIME_RemoveEvent(2152) == 1);
+	simTime += 7 * 86400;
+	for (i = 1; i <= 86400; i += 50) {
+		TIME_RunEvents(simTime + i, true);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 8 * 100 - 1);
+	SELFTEST_ASSERT_CHANNEL(2, 8 * 100);
+	SELFTEST_ASSERT_CHANNEL(3, 8 * 100 - 1);
+	SELFTEST_ASSERT_CHANNEL(4, 2);
+
+	// a big jump forward only catches up 100 seconds, the rest is skipped
+	simTime += 86400;
+	ResetEventsAndChannels(299);
+	CMD_ExecuteCommand("addClockEvent 00:00:50 0xff 1 addChannel 1 1", 0);
+	CMD_ExecuteCommand("addClockEvent 00:30:00 0xff 2 addChannel 2 1", 0);
+	CMD_ExecuteCommand("addClockEvent 01:00:10 0xff 3 addChannel 3 1", 0);
+	TIME_RunEvents(simTime + 3600, true);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	TIME_RunEvents(simTime + 3620, true);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	// going back runs them again
+	TIME_RunEvents(simTime + 1000, true);
+	TIME_RunEvents(simTime + 1900, true);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	TIME_RunEvents(simTime + 1750, true);
+	TIME_RunEvents(simTime + 1850, true);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	// time lost and found again
+	TIME_RunEvents(simTime + 1900, false);
+	TIME_RunEvents(simTime + 3609, true);
+	TIME_RunEvents(simTime + 3611, true);
+	SELFTEST_ASSERT_CHANNEL(3, 2);
+
+	ResetEventsAndChannels(3);
+}
+
 void Test_ClockEvents() {
 	// reset whole device
 	SIM_ClearOBK(0);
@@ -141,6 +207,8 @@ void Test_ClockEvents() {
 	SELFTEST_ASSERT_CHANNEL(2, 20);
 	SELFTEST_ASSERT_CHANNEL(3, 30);
 	SELFTEST_ASSERT_CHANNEL(4, 53);
+
+	Test_ClockEvents_Many();
 }
 
 #endif
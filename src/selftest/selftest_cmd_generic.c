@@ -1,6 +1,11 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_uart.h"
+#if LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 void Test_Events() {
 	// reset whole device
@@ -130,9 +135,189 @@ void Test_Events() {
 	SELFTEST_ASSERT_CHANNEL(10, 4);
 }
 
+static int g_uartNotifies = 0;
+static void Test_UART_OnReceive(int auartindex) {
+	g_uartNotifies++;
+}
+// span reads, bulk append with wrap and overflow, receive notification
+static void Test_UART_Bulk() {
+	byte data[300];
+	byte out[300];
+	byte *span;
+	int len;
+	uartRingStats_t st;
+
+	for (int i = 0; i < sizeof(data); i++) {
+		data[i] = i * 7;
+	}
+	// rounded up to power of two
+	UART_InitReceiveRingBuffer(100);
+	SELFTEST_ASSERT(UART_GetReceiveRingBufferSize() == 128);
+	UART_SetReceiveNotify(Test_UART_OnReceive);
+	g_uartNotifies = 0;
+
+	UART_AppendBytesToReceiveRingBuffer(data, 60);
+	SELFTEST_ASSERT(g_uartNotifies == 1);
+	SELFTEST_ASSERT(UART_GetDataSize() == 60);
+	// no notify while there is unread data
+	UART_AppendByteToReceiveRingBuffer(data[60]);
+	SELFTEST_ASSERT(g_uartNotifies == 1);
+	len = UART_GetDataSpan(&span);
+	SELFTEST_ASSERT(len == 61);
+	SELFTEST_ASSERT(memcmp(span, data, 61) == 0);
+	UART_ConsumeBytes(50);
+
+	// wraps around end of ring, so two spans
+	UART_AppendBytesToReceiveRingBuffer(data + 61, 70);
+	SELFTEST_ASSERT(UART_GetDataSize() == 81);
+	len = UART_GetDataSpan(&span);
+	SELFTEST_ASSERT(len == 78);
+	SELFTEST_ASSERT(memcmp(span, data + 50, 78) == 0);
+	SELFTEST_ASSERT(UART_ReadBytes(out, 10) == 10);
+	SELFTEST_ASSERT(memcmp(out, data + 50, 10) == 0);
+	SELFTEST_ASSERT(UART_ReadBytes(out, sizeof(out)) == 71);
+	SELFTEST_ASSERT(memcmp(out, data + 60, 71) == 0);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+
+	// overflow keeps unread data, drops and counts new bytes
+	UART_AppendBytesToReceiveRingBuffer(data, 40);
+	SELFTEST_ASSERT(g_uartNotifies == 2);
+	UART_AppendBytesToReceiveRingBuffer(data + 40, 100);
+	SELFTEST_ASSERT(UART_GetDataSize() == 128);
+	SELFTEST_ASSERT(UART_GetByte(0) == data[0]);
+	UART_GetRingStatsEx(UART_GetSelectedPortIndex(), &st);
+	SELFTEST_ASSERT(st.overflows == 12);
+	SELFTEST_ASSERT(st.highWater == 128);
+	SELFTEST_ASSERT(UART_ReadBytes(out, sizeof(out)) == 128);
+	SELFTEST_ASSERT(memcmp(out, data, 128) == 0);
+	UART_AppendBytesToReceiveRingBuffer(data, 250);
+	SELFTEST_ASSERT(UART_GetDataSize() == 128);
+	SELFTEST_ASSERT(UART_ReadBytes(out, sizeof(out)) == 128);
+	SELFTEST_ASSERT(memcmp(out, data, 128) == 0);
+	SELFTEST_ASSERT(g_uartNotifies == 3);
+	UART_GetRingStatsEx(UART_GetSelectedPortIndex(), &st);
+	SELFTEST_ASSERT(st.overflows == 12 + 122);
+	UART_ReportOverrunEx(UART_GetSelectedPortIndex(), 3);
+	UART_GetRingStatsEx(UART_GetSelectedPortIndex(), &st);
+	SELFTEST_ASSERT(st.overruns == 3);
+	UART_LogBufState(UART_GetSelectedPortIndex());
+
+	UART_SetReceiveNotify(NULL);
+}
+
+#define UART_STRESS_BYTES	2000000
+
+static volatile int g_uartStressThrottle;
+static volatile int g_uartStressDone;
+// kept between calls, so without threads producer resumes where it stopped
+static int g_uartStressSent;
+static unsigned int g_uartStressSeed;
+
+static int Test_UART_StressChunk() {
+	g_uartStressSeed = g_uartStressSeed * 1103515245 + 12345;
+	return 1 + ((g_uartStressSeed >> 16) % 40);
+}
+
+// plays UART ISR, byte values are running counter
+static void *Test_UART_StressProducer(void *arg) {
+	byte chunk[40];
+	int port = UART_GetSelectedPortIndex();
+	int i, len;
+
+	while (g_uartStressSent < UART_STRESS_BYTES) {
+		len = Test_UART_StressChunk();
+		if (len > UART_STRESS_BYTES - g_uartStressSent)
+			len = UART_STRESS_BYTES - g_uartStressSent;
+		// like hardware flow control
+		while (g_uartStressThrottle && UART_GetDataSizeEx(port) > UART_GetReceiveRingBufferSizeEx(port) - len) {
+#if LINUX
+			sched_yield();
+#else
+			// chunk size is drawn again on resume, stream stays the same
+			return 0;
+#endif
+		}
+		for (i = 0; i < len; i++) {
+			chunk[i] = (byte)(g_uartStressSent + i);
+		}
+		UART_AppendBytesToReceiveRingBufferEx(port, chunk, len);
+		g_uartStressSent += len;
+	}
+	g_uartStressDone = 1;
+	return 0;
+}
+
+// reads until producer is done and ring is empty, returns bytes read
+static int Test_UART_StressConsume(int bCheckOrder) {
+	byte out[64];
+	int got = 0;
+	int bad = 0;
+	int i, len;
+
+	while (1) {
+		len = UART_ReadBytes(out, sizeof(out));
+		if (len == 0) {
+			if (g_uartStressDone && UART_GetDataSize() == 0)
+				break;
+#if LINUX
+			sched_yield();
+#else
+			// no threads, run producer step here
+			Test_UART_StressProducer(0);
+#endif
+			continue;
+		}
+		for (i = 0; i < len; i++) {
+			if (bCheckOrder && out[i] != (byte)(got + i))
+				bad++;
+		}
+		got += len;
+	}
+	SELFTEST_ASSERT(bad == 0);
+	return got;
+}
+
+static void Test_UART_StressRun(int bThrottle) {
+	uartRingStats_t st;
+	int got;
+#if LINUX
+	pthread_t th;
+#endif
+
+	UART_InitReceiveRingBuffer(256);
+	g_uartStressSeed = 1234;
+	g_uartStressThrottle = bThrottle;
+	g_uartStressDone = 0;
+	g_uartStressSent = 0;
+#if LINUX
+	pthread_create(&th, NULL, Test_UART_StressProducer, NULL);
+	got = Test_UART_StressConsume(bThrottle);
+	pthread_join(th, NULL);
+#else
+	if (!bThrottle) {
+		Test_UART_StressProducer(0);
+	}
+	got = Test_UART_StressConsume(bThrottle);
+#endif
+	UART_GetRingStatsEx(UART_GetSelectedPortIndex(), &st);
+	SELFTEST_ASSERT(got + st.overflows == UART_STRESS_BYTES);
+	SELFTEST_ASSERT(st.highWater <= 256);
+	if (bThrottle) {
+		SELFTEST_ASSERT(st.overflows == 0);
+	}
+	else {
+		SELFTEST_ASSERT(st.overflows > 0);
+		SELFTEST_ASSERT(st.highWater == 256);
+	}
+	UART_LogBufState(UART_GetSelectedPortIndex());
+}
+
 void Test_UART() {
 	int USED_BUFFER_SIZE = 123;
 	UART_InitReceiveRingBuffer(USED_BUFFER_SIZE);
+	// size is rounded up to power of two, all of it usable
+	USED_BUFFER_SIZE = UART_GetReceiveRingBufferSize();
+	SELFTEST_ASSERT(USED_BUFFER_SIZE == 128);
 	byte next = 0;
 	for (int i = 0; i < 512; i++) {
 		SELFTEST_ASSERT(UART_GetDataSize() == 0);
@@ -168,14 +353,18 @@ void Test_UART() {
 
 		int reportedSize = (i+1);
 		// detect overflow
-		if (reportedSize > (USED_BUFFER_SIZE-1)) {
-			reportedSize = (USED_BUFFER_SIZE-1);
+		if (reportedSize > USED_BUFFER_SIZE) {
+			reportedSize = USED_BUFFER_SIZE;
 		}
 		int realSize = UART_GetDataSize();
 		// is data size correctly reported?
 		SELFTEST_ASSERT(realSize == reportedSize);
 		next++;
 	}
+	Test_UART_Bulk();
+	// producer thread against consumer, with and without flow control
+	Test_UART_StressRun(1);
+	Test_UART_StressRun(0);
 }
 
 void Test_PinMutex() {
@@ -0,0 +1,168 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_ddpSend.h"
+#include "../quicktick.h"
+#include "lwip/sockets.h"
+
+// UDP sink on loopback, stands for remote DDP strip
+static int g_ddpSink = -1;
+
+static int Test_DDPSend_OpenSink(int *port) {
+	struct sockaddr_in adr;
+	socklen_t len = sizeof(adr);
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	memset(&adr, 0, sizeof(adr));
+	adr.sin_family = AF_INET;
+	adr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	adr.sin_port = 0;
+	bind(s, (struct sockaddr*)&adr, sizeof(adr));
+	getsockname(s, (struct sockaddr*)&adr, &len);
+	lwip_fcntl(s, F_SETFL, O_NONBLOCK);
+	*port = ntohs(adr.sin_port);
+	return s;
+}
+static int Test_DDPSend_Recv(byte *buf, int maxLen) {
+	struct sockaddr_in from;
+	socklen_t fromLen = sizeof(from);
+	int n;
+
+	n = recvfrom(g_ddpSink, (char*)buf, maxLen, 0, (struct sockaddr*)&from, &fromLen);
+	return n > 0 ? n : 0;
+}
+static int Test_DDPSend_Offset(const byte *p) {
+	return (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+}
+static int Test_DDPSend_Length(const byte *p) {
+	return (p[8] << 8) | p[9];
+}
+
+void Test_DDPSend() {
+	byte frame[4000];
+	byte got[sizeof(frame)];
+	byte packet[DDPSEND_HEADER_SIZE + DDPSEND_FRAGMENT_DATA + 16];
+	char cmd[64];
+	const ddpSendStats_t *st;
+	int port, target, i, n, len, total, dropped;
+	byte seq;
+
+	SIM_ClearOBK(0);
+	g_ddpSink = Test_DDPSend_OpenSink(&port);
+	CMD_ExecuteCommand("startDriver DDPSend", 0);
+	st = DDPSend_GetStats();
+
+	// address is parsed once, same destination gives same entry
+	target = DDPSend_AddTarget("127.0.0.1", port);
+	SELFTEST_ASSERT(target >= 0);
+	SELFTEST_ASSERT(DDPSend_AddTarget("127.0.0.1", port) == target);
+	SELFTEST_ASSERT(DDPSend_AddTarget("127.0.0.1", port + 1) != target);
+	SELFTEST_ASSERT(DDPSend_AddTarget("not an ip", port) == -1);
+
+	// large frame goes out in fragments with offsets, PUSH only on the last
+	for (i = 0; i < (int)sizeof(frame); i++) {
+		frame[i] = (byte)(i * 7);
+	}
+	SELFTEST_ASSERT(DDPSend_SendFrame(target, 3, frame, sizeof(frame), 0) == 3);
+	memset(got, 0, sizeof(got));
+	total = 0;
+	for (i = 0; i < 3; i++) {
+		len = Test_DDPSend_Recv(packet, sizeof(packet));
+		SELFTEST_ASSERT(len > DDPSEND_HEADER_SIZE);
+		n = Test_DDPSend_Length(packet);
+		SELFTEST_ASSERT(len == DDPSEND_HEADER_SIZE + n);
+		SELFTEST_ASSERT(Test_DDPSend_Offset(packet) == i * DDPSEND_FRAGMENT_DATA);
+		SELFTEST_ASSERT(packet[2] == 0x0B);
+		if (i == 0)
+			seq = packet[1];
+		SELFTEST_ASSERT(packet[1] == seq);
+		if (i < 2) {
+			SELFTEST_ASSERT(n == DDPSEND_FRAGMENT_DATA);
+			SELFTEST_ASSERT(packet[0] == 0x40);
+		}
+		else {
+			SELFTEST_ASSERT(packet[0] == 0x41);
+		}
+		memcpy(got + Test_DDPSend_Offset(packet), packet + DDPSEND_HEADER_SIZE, n);
+		total += n;
+	}
+	SELFTEST_ASSERT(total == sizeof(frame));
+	SELFTEST_ASSERT(!memcmp(got, frame, sizeof(frame)));
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == 0);
+
+	// small RGBW frame is a single datagram with next sequence number
+	SELFTEST_ASSERT(DDPSend_SendFrame(target, 4, frame, 8, 0) == 1);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 8);
+	SELFTEST_ASSERT(packet[0] == 0x41);
+	SELFTEST_ASSERT(packet[1] == seq % 15 + 1);
+	SELFTEST_ASSERT(packet[2] == 0x1B);
+	SELFTEST_ASSERT(Test_DDPSend_Offset(packet) == 0);
+
+	// delayed frames leave from QuickTick after their deadline
+	DDPSend_SendFrame(target, 3, frame, 6, 100);
+	DDPSend_SendFrame(target, 3, frame + 6, 3000, 200);
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 2);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == 0);
+	for (i = 0; i < 100 && DDPSend_GetQueuedFrames() == 2; i++) {
+		Sim_RunFrames(1, false);
+	}
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 1);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 6);
+	SELFTEST_ASSERT(!memcmp(packet + DDPSEND_HEADER_SIZE, frame, 6));
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == 0);
+	for (i = 0; i < 100 && DDPSend_GetQueuedFrames() == 1; i++) {
+		Sim_RunFrames(1, false);
+	}
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 0);
+	for (i = 0; i < 3; i++) {
+		SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) > DDPSEND_HEADER_SIZE);
+	}
+	SELFTEST_ASSERT(packet[0] == 0x41);
+	SELFTEST_ASSERT(Test_DDPSend_Offset(packet) == 2 * DDPSEND_FRAGMENT_DATA);
+	SELFTEST_ASSERT(!memcmp(packet + DDPSEND_HEADER_SIZE, frame + 6 + 2 * DDPSEND_FRAGMENT_DATA, 3000 - 2 * DDPSEND_FRAGMENT_DATA));
+
+	// later frame with shorter delay must not wait behind earlier one
+	frame[0] = 0x11;
+	DDPSend_SendFrame(target, 3, frame, 3, 1000);
+	frame[0] = 0x22;
+	DDPSend_SendFrame(target, 3, frame, 3, 10);
+	Sim_RunMiliseconds(50, false);
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 1);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 3);
+	SELFTEST_ASSERT(packet[DDPSEND_HEADER_SIZE] == 0x22);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 0);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 3);
+	SELFTEST_ASSERT(packet[DDPSEND_HEADER_SIZE] == 0x11);
+
+	// ring is fixed, frame due first gives way
+	dropped = st->droppedFrames;
+	for (i = 0; i < DDPSEND_RING_SIZE + 2; i++) {
+		frame[0] = i;
+		DDPSend_SendFrame(target, 3, frame, 3, 1000);
+	}
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == DDPSEND_RING_SIZE);
+	SELFTEST_ASSERT(st->droppedFrames == dropped + 2);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(DDPSend_GetQueuedFrames() == 0);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 3);
+	SELFTEST_ASSERT(packet[DDPSEND_HEADER_SIZE] == 2);
+	while (Test_DDPSend_Recv(packet, sizeof(packet))) {
+	}
+
+	// command takes port after address
+	snprintf(cmd, sizeof(cmd), "DDP_Send 127.0.0.1:%i 3 0 FF00AB", port);
+	CMD_ExecuteCommand(cmd, 0);
+	SELFTEST_ASSERT(Test_DDPSend_Recv(packet, sizeof(packet)) == DDPSEND_HEADER_SIZE + 3);
+	SELFTEST_ASSERT(packet[DDPSEND_HEADER_SIZE] == 0xFF);
+	SELFTEST_ASSERT(packet[DDPSEND_HEADER_SIZE + 2] == 0xAB);
+	SELFTEST_ASSERT(st->failedPackets == 0);
+
+	CMD_ExecuteCommand("stopDriver DDPSend", 0);
+	closesocket(g_ddpSink);
+	g_ddpSink = -1;
+}
+
+#endif
@@ -6,24 +6,35 @@
 
 static int sim_fakeSeq = 1;
 
+static void SIM_MakeFakeDGRSource(struct sockaddr_in *src, const char *ipStr) {
+	memset(src, 0, sizeof(*src));
+	src->sin_family = AF_INET;
+	src->sin_addr.s_addr = inet_addr(ipStr);
+	src->sin_port = htons(4447);
+}
+
 void SIM_SendFakeDGRPowerPacketToSelf(const char *groupName, int seq, int powerBits, int powerCount) {
 	byte buffer[256];
 	int len;
 
+	struct sockaddr_in src;
+
 	len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), groupName, seq, 0, powerBits, powerCount);
 
-	DGR_SpoofNextDGRPacketSource("192.168.0.123");
-	DGR_ProcessIncomingPacket((char*)buffer, len);
+	SIM_MakeFakeDGRSource(&src, "192.168.0.123");
+	DGR_ProcessIncomingPacket((char*)buffer, len, &src);
 }
 
 void SIM_SendFakeDGRBrightnessPacketToSelf(const char *groupName, int seq, byte brightness) {
 	byte buffer[256];
 	int len;
 
+	struct sockaddr_in src;
+
 	len = DGR_Quick_FormatBrightness(buffer, sizeof(buffer), groupName, seq, 0, brightness);
 
-	DGR_SpoofNextDGRPacketSource("192.168.0.123");
-	DGR_ProcessIncomingPacket((char*)buffer, len);
+	SIM_MakeFakeDGRSource(&src, "192.168.0.123");
+	DGR_ProcessIncomingPacket((char*)buffer, len, &src);
 }
 
 void SIM_SendFakeDGRBrightnessPacketToSelf_Next(const char *groupName, byte brightness) {
@@ -168,10 +179,141 @@ void Test_DeviceGroups_RGB() {
 	SELFTEST_ASSERT_CHANNEL(3, 0);
 
 }
+// Replays a capture of 100 group members, each sending a burst of packets,
+// interleaved, through the receive ring, like a busy network would.
+void Test_DeviceGroups_ManyMembers() {
+	const char *testName = "win_m4nyMmbrs";
+	struct sockaddr_in srcs[100];
+	byte buffer[256];
+	char ipStr[32];
+	int len, i, round, seq;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	PIN_SetPinRoleForPinIndex(10, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(10, 2);
+
+	CFG_DeviceGroups_SetName(testName);
+	CFG_DeviceGroups_SetRecvFlags(DGR_SHARE_POWER);
+	CFG_DeviceGroups_SetSendFlags(0);
+	CMD_ExecuteCommand("startDriver DGR", 0);
+
+	for (i = 0; i < 100; i++) {
+		sprintf(ipStr, "10.0.%i.%i", i / 50, 1 + (i % 50) * 5);
+		SIM_MakeFakeDGRSource(&srcs[i], ipStr);
+	}
+	SELFTEST_ASSERT(DGR_GetMembersCount() == 0);
+
+	seq = 0;
+	for (round = 0; round < 50; round++) {
+		seq++;
+		for (i = 0; i < 100; i++) {
+			// alternate relay pattern, last member of the round decides final state
+			len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), testName, seq, 0, (round + i) & 3, 2);
+			SELFTEST_ASSERT(DGR_RxRing_Push(buffer, len, &srcs[i]));
+		}
+		DGR_RxRing_ProcessAll();
+		// last member sent (round + 99) & 3
+		SELFTEST_ASSERT_CHANNEL(1, (((round + 99) & 1) ? 1 : 0));
+		SELFTEST_ASSERT_CHANNEL(2, (((round + 99) & 2) ? 1 : 0));
+	}
+	SELFTEST_ASSERT(DGR_GetMembersCount() == 100);
+
+	// replayed (duplicate) sequence from every member must be ignored
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	for (i = 0; i < 100; i++) {
+		len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), testName, seq, 0, 0b11, 2);
+		SELFTEST_ASSERT(DGR_RxRing_Push(buffer, len, &srcs[i]));
+	}
+	DGR_RxRing_ProcessAll();
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+
+	// ... but next one from a single member is accepted
+	len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), testName, seq + 1, 0, 0b11, 2);
+	SELFTEST_ASSERT(DGR_RxRing_Push(buffer, len, &srcs[57]));
+	DGR_RxRing_ProcessAll();
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SELFTEST_ASSERT(DGR_GetMembersCount() == 100);
+}
+// same path as on device: real datagrams on the DGR port, drained by quick tick
+void Test_DeviceGroups_SocketDrain() {
+	const char *testName = "win_s0ckDrain";
+	extern struct sockaddr_in g_mySockAddr;
+	struct sockaddr_in dst;
+	byte buffer[600];
+	int s, len, i, seq, ticks;
+	int received, oversize, startReceived, startOversize, prevReceived;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	PIN_SetPinRoleForPinIndex(10, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(10, 2);
+
+	CFG_DeviceGroups_SetName(testName);
+	CFG_DeviceGroups_SetRecvFlags(DGR_SHARE_POWER);
+	CFG_DeviceGroups_SetSendFlags(0);
+	CMD_ExecuteCommand("startDriver DGR", 0);
+	// simulator reports 127.0.0.1 as its own address, don't filter the test sender
+	g_mySockAddr.sin_addr.s_addr = 0;
+
+	s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	SELFTEST_ASSERT(s >= 0);
+	memset(&dst, 0, sizeof(dst));
+	dst.sin_family = AF_INET;
+	dst.sin_addr.s_addr = inet_addr("127.0.0.1");
+	dst.sin_port = htons(4447);
+
+	DGR_GetRxStats(&startReceived, &startOversize);
+
+	// oversized one first, it must be dropped and counted, not truncated and parsed
+	memset(buffer, 0, sizeof(buffer));
+	len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), testName, 1, 0, 0b11, 2);
+	sendto(s, (const char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&dst, sizeof(dst));
+	// then a burst bigger than a single tick may take
+	for (seq = 1; seq <= 40; seq++) {
+		len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), testName, seq, 0, (seq == 40) ? 0b10 : (seq & 3), 2);
+		sendto(s, (const char*)buffer, len, 0, (struct sockaddr*)&dst, sizeof(dst));
+	}
+
+	prevReceived = startReceived;
+	for (ticks = 0; ticks < 10; ticks++) {
+		DRV_DGR_RunQuickTick();
+		DGR_GetRxStats(&received, &oversize);
+		SELFTEST_ASSERT(received - prevReceived <= 16);
+		prevReceived = received;
+		if (received - startReceived == 40)
+			break;
+	}
+	// 41 datagrams, 16 per tick
+	SELFTEST_ASSERT(ticks == 2);
+	SELFTEST_ASSERT(received - startReceived == 40);
+	SELFTEST_ASSERT(oversize - startOversize == 1);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+
+	// nothing left
+	DRV_DGR_RunQuickTick();
+	DGR_GetRxStats(&received, &oversize);
+	SELFTEST_ASSERT(received - startReceived == 40);
+
+#if WINDOWS
+	closesocket(s);
+#else
+	close(s);
+#endif
+}
+
 void Test_DeviceGroups() {
 
 	Test_DeviceGroups_TwoRelays();
 	Test_DeviceGroups_RGB();
+	Test_DeviceGroups_ManyMembers();
+	Test_DeviceGroups_SocketDrain();
 
 }
 
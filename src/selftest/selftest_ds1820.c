@@ -0,0 +1,139 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_ds1820_common.h"
+#include "../driver/drv_ds1820_full.h"
+
+static void Test_DS1820_MakeRom(uint8_t *rom, int bus, int i) {
+	rom[0] = 0x28;
+	rom[1] = i;
+	rom[2] = 0x10 + bus;
+	rom[3] = 0x20;
+	rom[4] = 0x30;
+	rom[5] = 0x40;
+	rom[6] = 0x50;
+	rom[7] = 0xAA;
+}
+// waits for next convert command and gives sensors time to convert and be read
+static void Test_DS1820_RunConversionCycle() {
+	int converts = DS1820_Mock_GetConvertsCount();
+	for (int i = 0; i < 1000 && DS1820_Mock_GetConvertsCount() == converts; i++) {
+		Sim_RunFrames(1, false);
+	}
+	Sim_RunMiliseconds(900, false);
+}
+
+// two GPIOs with 6 sensors each, read in parallel by the QuickTick scheduler
+void Test_DS1820_Full_MultiBus() {
+	uint8_t rom[8];
+	char cmd[128];
+	int idx[12];
+	int reads, converts;
+	const char *json;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	DS1820_Mock_Clear();
+
+	for (int i = 0; i < 12; i++) {
+		Test_DS1820_MakeRom(rom, i / 6, i);
+		idx[i] = DS1820_Mock_AddSensor(i < 6 ? 7 : 8, rom, 20.5f + i);
+		SELFTEST_ASSERT(idx[i] == i);
+	}
+	PIN_SetPinRoleForPinIndex(7, IOR_DS1820_IO);
+	PIN_SetPinRoleForPinIndex(8, IOR_DS1820_IO);
+	// conversion every 5 seconds
+	CMD_ExecuteCommand("startDriver DS1820_FULL 5", 0);
+	// map every sensor to a channel
+	for (int i = 0; i < 12; i++) {
+		Test_DS1820_MakeRom(rom, i / 6, i);
+		snprintf(cmd, sizeof(cmd), "DS1820_FULL_setsensor \"%02X%02X%02X%02X%02X%02X%02X%02X\" %i \"s%i\" %i",
+			rom[0], rom[1], rom[2], rom[3], rom[4], rom[5], rom[6], rom[7], i < 6 ? 7 : 8, i, 10 + i);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	// first conversion is started right away, one convert-all per GPIO
+	Test_DS1820_RunConversionCycle();
+	SELFTEST_ASSERT(DS1820_Mock_GetConvertsCount() == 2);
+	SELFTEST_ASSERT(DS1820_Mock_GetScratchpadReadsCount() == 12);
+	for (int i = 0; i < 12; i++) {
+		SELFTEST_ASSERT_CHANNEL(10 + i, 2050 + i * 100);
+	}
+
+	// new values are picked up on next conversion cycle
+	for (int i = 0; i < 12; i++) {
+		DS1820_Mock_SetTemperature(idx[i], -10.25f - i);
+	}
+	Test_DS1820_RunConversionCycle();
+	SELFTEST_ASSERT(DS1820_Mock_GetConvertsCount() == 4);
+	SELFTEST_ASSERT(DS1820_Mock_GetScratchpadReadsCount() == 24);
+	for (int i = 0; i < 12; i++) {
+		SELFTEST_ASSERT_CHANNEL(10 + i, -1025 - i * 100);
+	}
+
+	// CRC errors are retried on following ticks
+	DS1820_Mock_SetTemperature(idx[3], 55.5f);
+	DS1820_Mock_CorruptNextReads(idx[3], 2);
+	reads = DS1820_Mock_GetScratchpadReadsCount();
+	converts = DS1820_Mock_GetConvertsCount();
+	Test_DS1820_RunConversionCycle();
+	SELFTEST_ASSERT(DS1820_Mock_GetConvertsCount() == converts + 2);
+	SELFTEST_ASSERT(DS1820_Mock_GetScratchpadReadsCount() == reads + 12 + 2);
+	SELFTEST_ASSERT_CHANNEL(13, 5550);
+
+	// lost sensor keeps last channel value, but is reported as disconnected after a minute
+	DS1820_Mock_SetPresent(idx[8], false);
+	Sim_RunSeconds(70, false);
+	SELFTEST_ASSERT_CHANNEL(13, 5550);
+	SELFTEST_ASSERT_CHANNEL(18, -1825);
+	json = DS1820_full_jsonSensors();
+	SELFTEST_ASSERT(json != 0);
+	SELFTEST_ASSERT(strstr(json, "\"Id\":\"504030201108\",\"Temperature\": -127.0") != 0);
+	SELFTEST_ASSERT(strstr(json, "\"Id\":\"504030201003\",\"Temperature\": 55.5") != 0);
+
+	// and comes back
+	DS1820_Mock_SetPresent(idx[8], true);
+	DS1820_Mock_SetTemperature(idx[8], 1.0f);
+	Test_DS1820_RunConversionCycle();
+	SELFTEST_ASSERT_CHANNEL(18, 100);
+
+	PIN_SetPinRoleForPinIndex(7, IOR_None);
+	PIN_SetPinRoleForPinIndex(8, IOR_None);
+}
+
+// parasite powered sensor is read only after full 12 bit conversion time
+void Test_DS1820_Full_Parasite() {
+	uint8_t rom[8];
+	char cmd[128];
+	int idx, reads;
+
+	SIM_ClearOBK(0);
+	DS1820_Mock_Clear();
+
+	Test_DS1820_MakeRom(rom, 2, 0);
+	idx = DS1820_Mock_AddSensor(9, rom, 30.5f);
+	DS1820_Mock_SetParasite(idx, true);
+	PIN_SetPinRoleForPinIndex(9, IOR_DS1820_IO);
+	CMD_ExecuteCommand("startDriver DS1820_FULL 5", 0);
+	snprintf(cmd, sizeof(cmd), "DS1820_FULL_setsensor \"%02X%02X%02X%02X%02X%02X%02X%02X\" 9 \"p\" 5",
+		rom[0], rom[1], rom[2], rom[3], rom[4], rom[5], rom[6], rom[7]);
+	CMD_ExecuteCommand(cmd, 0);
+	for (int i = 0; i < 1000 && DS1820_Mock_GetConvertsCount() == 0; i++) {
+		Sim_RunFrames(1, false);
+	}
+	reads = DS1820_Mock_GetScratchpadReadsCount();
+	// sensor would look done at once if polled
+	Sim_RunMiliseconds(500, false);
+	SELFTEST_ASSERT(DS1820_Mock_GetScratchpadReadsCount() == reads);
+	Sim_RunMiliseconds(400, false);
+	SELFTEST_ASSERT(DS1820_Mock_GetScratchpadReadsCount() == reads + 1);
+	SELFTEST_ASSERT_CHANNEL(5, 3050);
+
+	PIN_SetPinRoleForPinIndex(9, IOR_None);
+}
+
+void Test_DS1820() {
+	Test_DS1820_Full_MultiBus();
+	Test_DS1820_Full_Parasite();
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_public.h"
 
 #if ENABLE_BL_SHARED
 
@@ -141,6 +142,62 @@ void Test_EnergyMeter_CSE7766() {
 
 	SIM_ClearMQTTHistory();
 }
+#if ENABLE_DRIVER_BL0937
+// BL0937 default calibration, units per pulse per second
+#define TEST_BL0937_VOLTAGE_CAL		0.13253012048f
+#define TEST_BL0937_CURRENT_CAL		0.0118577075f
+#define TEST_BL0937_POWER_CAL		1.5f
+
+// drives CF and CF1 pins with pulses, CF1 follows SEL like the real chip
+static void Test_BL0937_Run(int frames, float v, float c, float p) {
+	int i;
+
+	SIM_SetPinPulseFrequency(7, p / TEST_BL0937_POWER_CAL);
+	for (i = 0; i < frames; i++) {
+		if (SIM_GetSimulatedPinValue(24))
+			SIM_SetPinPulseFrequency(8, v / TEST_BL0937_VOLTAGE_CAL);
+		else
+			SIM_SetPinPulseFrequency(8, c / TEST_BL0937_CURRENT_CAL);
+		Sim_RunFrames(1, false);
+	}
+}
+void Test_EnergyMeter_BL0937() {
+	SIM_ClearOBK(0);
+
+	PIN_SetPinRoleForPinIndex(24, IOR_BL0937_SEL);
+	PIN_SetPinRoleForPinIndex(7, IOR_BL0937_CF);
+	PIN_SetPinRoleForPinIndex(8, IOR_BL0937_CF1);
+	CMD_ExecuteCommand("startDriver BL0937", 0);
+
+	Test_BL0937_Run(500, 230, 1.3f, 299);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 230, 0.5f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_CURRENT), 1.3f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 299, 0.5f);
+
+	// pulse every 2 seconds, counting per second would read 0 or 1.5W
+	Test_BL0937_Run(800, 230, 0.01f, 0.75f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 0.75f, 0.02f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_CURRENT), 0.01f, 0.0005f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 230, 0.5f);
+
+	// shorter window follows load change within half a second
+	CMD_ExecuteCommand("BL0937Window 250", 0);
+	Test_BL0937_Run(200, 230, 1.3f, 299);
+	Test_BL0937_Run(50, 230, 0.65f, 150);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 150, 0.5f);
+	CMD_ExecuteCommand("BL0937Window 1000", 0);
+
+	// no pulses at all times out to zero
+	Test_BL0937_Run(1500, 230, 0, 0);
+	SELFTEST_ASSERT_FLOATCOMPARE(DRV_GetReading(OBK_POWER), 0);
+	SELFTEST_ASSERT_FLOATCOMPARE(DRV_GetReading(OBK_CURRENT), 0);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 230, 0.5f);
+
+	CMD_ExecuteCommand("stopDriver BL0937", 0);
+	SIM_SetPinPulseFrequency(7, 0);
+	SIM_SetPinPulseFrequency(8, 0);
+}
+#endif
 void Test_EnergyMeter_Events() {
 	SIM_ClearOBK(0);
 	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
@@ -535,6 +592,9 @@ void Test_EnergyMeter_ResetBug() {
 void Test_EnergyMeter() {
 	Test_EnergyMeter_ResetBug();
 	Test_EnergyMeter_CSE7766();
+#if ENABLE_DRIVER_BL0937
+	Test_EnergyMeter_BL0937();
+#endif
 #ifndef LINUX
 	// TODO: fix on Linux
 	Test_EnergyMeter_BL0942();
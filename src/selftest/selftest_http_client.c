@@ -1,6 +1,156 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../httpclient/http_client.h"
+
+// In-memory HTTP/1.1 server standing in for the network.
+// Every new client connection gets these functions instead of TCP ones.
+static int g_fakeHttpConnects = 0;
+static int g_fakeHttpRequests = 0;
+static int g_fakeHttpNextHandle = 0;
+static bool g_fakeHttpCloseAfterResponse = false;
+static bool g_fakeHttpIdleDropped = false;
+static int g_fakeHttpBodyLen = 0;
+static char g_fakeHttpReq[512];
+static int g_fakeHttpReqLen = 0;
+static char g_fakeHttpResp[2048];
+static int g_fakeHttpRespLen = 0;
+static int g_fakeHttpRespPos = 0;
+
+static int Test_FakeHttp_Connect(utils_network_pt net) {
+	g_fakeHttpConnects++;
+	net->handle = ++g_fakeHttpNextHandle;
+	g_fakeHttpReqLen = 0;
+	return 0;
+}
+static int Test_FakeHttp_Write(utils_network_pt net, const char *buf, uint32_t len, uint32_t timeout) {
+	int i;
+	char *end;
+
+	if (g_fakeHttpReqLen + len >= sizeof(g_fakeHttpReq))
+		return -1;
+	memcpy(g_fakeHttpReq + g_fakeHttpReqLen, buf, len);
+	g_fakeHttpReqLen += len;
+	g_fakeHttpReq[g_fakeHttpReqLen] = 0;
+	end = strstr(g_fakeHttpReq, "\r\n\r\n");
+	if (end == 0)
+		return len;
+	// whole request header received, answer it
+	g_fakeHttpRequests++;
+	g_fakeHttpRespLen = sprintf(g_fakeHttpResp, "HTTP/1.1 200 OK\r\nContent-Length: %i\r\n%s\r\n",
+		g_fakeHttpBodyLen, g_fakeHttpCloseAfterResponse ? "Connection: close\r\n" : "");
+	for (i = 0; i < g_fakeHttpBodyLen; i++) {
+		g_fakeHttpResp[g_fakeHttpRespLen++] = 'a' + (i + g_fakeHttpRequests) % 26;
+	}
+	g_fakeHttpRespPos = 0;
+	g_fakeHttpReqLen = 0;
+	return len;
+}
+static int Test_FakeHttp_Read(utils_network_pt net, char *buf, uint32_t len, uint32_t timeout) {
+	int left = g_fakeHttpRespLen - g_fakeHttpRespPos;
+	if (left <= 0)
+		return 0;
+	if ((int)len > left)
+		len = left;
+	memcpy(buf, g_fakeHttpResp + g_fakeHttpRespPos, len);
+	g_fakeHttpRespPos += len;
+	return len;
+}
+static int Test_FakeHttp_Disconnect(utils_network_pt net) {
+	net->handle = 0;
+	return 0;
+}
+static int Test_FakeHttp_IsAlive(utils_network_pt net) {
+	return g_fakeHttpIdleDropped == false;
+}
+static void Test_FakeHttp_Hook(utils_network_pt net) {
+	net->doConnect = Test_FakeHttp_Connect;
+	net->doWrite = Test_FakeHttp_Write;
+	net->doRead = Test_FakeHttp_Read;
+	net->doDisconnect = Test_FakeHttp_Disconnect;
+	net->doIsAlive = Test_FakeHttp_IsAlive;
+}
+
+// requests are queued, served by one worker and share keep-alive connections.
+// Simulator serves the queue from its main loop, so one frame runs all queued requests.
+void Test_HTTP_Client_Pool() {
+	int connects, reuses;
+	const char *data;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+	HTTPClient_ResetForSimulator();
+	HTTPClient_SetNetworkHook(Test_FakeHttp_Hook);
+	g_fakeHttpConnects = 0;
+	g_fakeHttpRequests = 0;
+	g_fakeHttpCloseAfterResponse = false;
+	g_fakeHttpIdleDropped = false;
+
+	// body bigger than one chunk is streamed to file in parts
+	g_fakeHttpBodyLen = 1000;
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/a.txt http1.txt", 0);
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/b.txt http2.txt", 0);
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/c", 0);
+	SELFTEST_ASSERT(HTTPClient_GetQueuedCount() == 3);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(HTTPClient_GetQueuedCount() == 0);
+	SELFTEST_ASSERT(g_fakeHttpRequests == 3);
+	HTTPClient_GetPoolStats(&connects, &reuses);
+	SELFTEST_ASSERT(connects == 1);
+	SELFTEST_ASSERT(reuses == 2);
+	SELFTEST_ASSERT(g_fakeHttpConnects == 1);
+	data = (const char*)LFS_ReadFile("http1.txt");
+	SELFTEST_ASSERT(data != 0);
+	SELFTEST_ASSERT(strlen(data) == 1000);
+	SELFTEST_ASSERT(data[0] == 'b' && data[999] == 'a' + 1000 % 26);
+	free((void*)data);
+	data = (const char*)LFS_ReadFile("http2.txt");
+	SELFTEST_ASSERT(data != 0);
+	SELFTEST_ASSERT(strlen(data) == 1000);
+	SELFTEST_ASSERT(data[0] == 'c');
+	free((void*)data);
+
+	// server asks to close, so next request opens new connection
+	g_fakeHttpBodyLen = 10;
+	g_fakeHttpCloseAfterResponse = true;
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/d", 0);
+	Sim_RunFrames(1, false);
+	g_fakeHttpCloseAfterResponse = false;
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/e", 0);
+	Sim_RunFrames(1, false);
+	HTTPClient_GetPoolStats(&connects, &reuses);
+	SELFTEST_ASSERT(connects == 2);
+	SELFTEST_ASSERT(g_fakeHttpRequests == 5);
+
+	// other port is other pool entry
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8081/f", 0);
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/g", 0);
+	Sim_RunFrames(1, false);
+	HTTPClient_GetPoolStats(&connects, &reuses);
+	SELFTEST_ASSERT(connects == 3);
+	SELFTEST_ASSERT(reuses == 4);
+
+	// idle connection dropped by server is not reused
+	g_fakeHttpIdleDropped = true;
+	CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/h", 0);
+	Sim_RunFrames(1, false);
+	g_fakeHttpIdleDropped = false;
+	HTTPClient_GetPoolStats(&connects, &reuses);
+	SELFTEST_ASSERT(connects == 4);
+	SELFTEST_ASSERT(reuses == 4);
+	SELFTEST_ASSERT(g_fakeHttpRequests == 8);
+
+	// queue is bounded
+	for (int i = 0; i < 10; i++) {
+		CMD_ExecuteCommand("SendGet http://192.168.0.123:8080/i", 0);
+	}
+	SELFTEST_ASSERT(HTTPClient_GetQueuedCount() == 8);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(g_fakeHttpRequests == 16);
+
+	HTTPClient_SetNetworkHook(0);
+	HTTPClient_ResetForSimulator();
+}
 
 void Test_HTTP_Client() {
 	// reset whole device
@@ -36,6 +186,8 @@ void Test_HTTP_Client() {
 	//CMD_ExecuteCommand("SendGet http://127.0.0.1/cm?cmnd=POWER%20TOGGLE", 0);
 	//Sim_RunFrames(15, false);
 	//SELFTEST_ASSERT_CHANNEL(1, 1);
+
+	Test_HTTP_Client_Pool();
 }
 
 
@@ -2,8 +2,18 @@
 
 #include "selftest_local.h"
 #include "../cJSON/cJSON.h"
+#include "../cJSON/cJSON_arena.h"
+#include "../logging/logging.h"
 
-void Test_JSON_Lib() {
+static int g_jsonMallocs = 0;
+
+static void *Test_JSON_CountingMalloc(size_t sz) {
+	g_jsonMallocs++;
+	return malloc(sz);
+}
+
+// same document as energy stats publish
+static char *Test_JSON_BuildStats(int samples) {
 	int i;
 	cJSON* root;
 	cJSON* stats;
@@ -11,6 +21,16 @@ void Test_JSON_Lib() {
 	float dailyStats[4] = { 00000095.44071197,00000171.84954833,00000181.58737182,00000331.35061645 };
 
 	root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "uptime", 12345);
+	cJSON_AddNumberToObject(root, "consumption_total", 1234.5);
+	{
+		stats = cJSON_CreateArray();
+		for (i = 0; i < samples; i++)
+		{
+			cJSON_AddItemToArray(stats, cJSON_CreateNumber(i * 0.25));
+		}
+		cJSON_AddItemToObject(root, "consumption_samples", stats);
+	}
 	{
 		stats = cJSON_CreateArray();
 		for (i = 0; i < 4; i++)
@@ -23,7 +43,94 @@ void Test_JSON_Lib() {
 	msg = cJSON_PrintUnformatted(root);
 	cJSON_Delete(root);
 
-	free(msg);
+	return msg;
+}
+
+void Test_JSON_Lib() {
+	const jsonArenaStats_t *st = JSONArena_GetStats(JSONARENA_TEST);
+	cJSON_Hooks hooks;
+	cJSON *root;
+	char expected[1024];
+	char *msg;
+	int i, heapAllocs, overflows, nodeMallocs, chunks, peak, hassScopes;
+
+	// every node is a separate heap allocation without arena
+	hooks.malloc_fn = Test_JSON_CountingMalloc;
+	hooks.free_fn = free;
+	cJSON_InitHooks(&hooks);
+	msg = Test_JSON_BuildStats(60);
+	nodeMallocs = g_jsonMallocs;
+	SELFTEST_ASSERT(strlen(msg) < sizeof(expected));
+	strcpy_safe(expected, msg, sizeof(expected));
+	cJSON_free(msg);
+	JSONArena_Init();
+	SELFTEST_ASSERT(nodeMallocs > 60);
+
+	// document is spread over a few chunks, output is the same
+	heapAllocs = st->heapAllocs;
+	overflows = st->overflows;
+	JSONArena_Begin(JSONARENA_TEST);
+	msg = Test_JSON_BuildStats(60);
+	SELFTEST_ASSERT(!strcmp(msg, expected));
+	cJSON_free(msg);
+	SELFTEST_ASSERT(st->chunks > 1);
+	SELFTEST_ASSERT(st->heapAllocs - heapAllocs < nodeMallocs / 4);
+	chunks = st->chunks;
+	peak = st->peak;
+	// documents built one after another reuse the same chunks
+	for (i = 0; i < 20; i++) {
+		msg = Test_JSON_BuildStats(60);
+		SELFTEST_ASSERT(!strcmp(msg, expected));
+		cJSON_free(msg);
+	}
+	JSONArena_End();
+	SELFTEST_ASSERT(st->chunks == chunks);
+	SELFTEST_ASSERT(st->peak == peak);
+	// besides chunks, only print buffers bigger than a chunk went to heap
+	SELFTEST_ASSERT(st->heapAllocs - heapAllocs == chunks + st->overflows - overflows);
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "JSON arena: %i heap allocations per document without arena, %i chunks, peak %i bytes",
+		nodeMallocs, chunks, peak);
+
+	// nested scope shares the outer one
+	i = st->scopes;
+	hassScopes = JSONArena_GetStats(JSONARENA_HASS)->scopes;
+	JSONArena_Begin(JSONARENA_TEST);
+	JSONArena_Begin(JSONARENA_HASS);
+	msg = Test_JSON_BuildStats(4);
+	cJSON_free(msg);
+	JSONArena_End();
+	JSONArena_End();
+	SELFTEST_ASSERT(st->scopes == i + 1);
+	SELFTEST_ASSERT(JSONArena_GetStats(JSONARENA_HASS)->scopes == hassScopes);
+
+	// outside of scope hooks go to heap
+	heapAllocs = st->heapAllocs;
+	msg = Test_JSON_BuildStats(4);
+	cJSON_free(msg);
+	SELFTEST_ASSERT(st->heapAllocs == heapAllocs);
+
+	// document that outlives its scope is freed back into kept chunks,
+	// last free releases them, so next scope costs as much as a clean one
+	heapAllocs = st->heapAllocs;
+	JSONArena_Begin(JSONARENA_TEST);
+	msg = Test_JSON_BuildStats(4);
+	cJSON_free(msg);
+	JSONArena_End();
+	i = st->heapAllocs - heapAllocs;
+	JSONArena_Begin(JSONARENA_TEST);
+	root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "power", 123);
+	cJSON_AddStringToObject(root, "name", "kept");
+	JSONArena_End();
+	cJSON_Delete(root);
+	heapAllocs = st->heapAllocs;
+	JSONArena_Begin(JSONARENA_TEST);
+	msg = Test_JSON_BuildStats(4);
+	cJSON_free(msg);
+	JSONArena_End();
+	SELFTEST_ASSERT(st->heapAllocs - heapAllocs == i);
+
+	CMD_ExecuteCommand("JSONArena", 0);
 }
 
 
@@ -1,6 +1,156 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../littlefs/our_lfs.h"
+#include "../logging/logging.h"
+#include <time.h>
+
+#define TEST_LFS_BENCH_FILES	10
+#define TEST_LFS_BENCH_SIZE		3000
+#define TEST_LFS_BENCH_READS	10
+
+typedef struct testLfsBench_s {
+	int reads, writes, erases;
+	int readMs, writeMs;
+} testLfsBench_t;
+
+static void Test_LFS_BenchFill(byte *buf, int fileIndex) {
+	int i;
+
+	for (i = 0; i < TEST_LFS_BENCH_SIZE; i++) {
+		buf[i] = 'A' + (i * 7 + fileIndex) % 26;
+	}
+}
+
+// files written in 100 byte pieces and read in 64 byte pieces, as scripts
+// and HTTP do, straight through littlefs so the file cache is not involved
+static void Test_LFS_Bench(int profile, testLfsBench_t *r) {
+	static byte data[TEST_LFS_BENCH_SIZE];
+	byte chunk[64];
+	char fname[16];
+	lfs_file_t f;
+	int i, j, pos, len, bad = 0;
+	int reads, writes, erases;
+	clock_t start;
+
+	LFS_SetProfile(profile);
+	CMD_ExecuteCommand("lfs_format 0x20000", 0);
+	SELFTEST_ASSERT(lfs_present());
+
+	reads = SIM_GetFlashReadCount();
+	writes = SIM_GetFlashWriteCount();
+	erases = SIM_GetFlashEraseCount();
+	start = clock();
+	for (i = 0; i < TEST_LFS_BENCH_FILES; i++) {
+		sprintf(fname, "bench%i.txt", i);
+		Test_LFS_BenchFill(data, i);
+		memset(&f, 0, sizeof(f));
+		SELFTEST_ASSERT(lfs_file_open(&lfs, &f, fname, LFS_O_CREAT | LFS_O_WRONLY | LFS_O_TRUNC) >= 0);
+		for (pos = 0; pos < TEST_LFS_BENCH_SIZE; pos += len) {
+			len = TEST_LFS_BENCH_SIZE - pos;
+			if (len > 100)
+				len = 100;
+			lfs_file_write(&lfs, &f, data + pos, len);
+		}
+		lfs_file_close(&lfs, &f);
+	}
+	r->writeMs = (int)((clock() - start) * 1000 / CLOCKS_PER_SEC);
+	r->writes = SIM_GetFlashWriteCount() - writes;
+	r->erases = SIM_GetFlashEraseCount() - erases;
+
+	reads = SIM_GetFlashReadCount();
+	start = clock();
+	for (j = 0; j < TEST_LFS_BENCH_READS; j++) {
+		for (i = 0; i < TEST_LFS_BENCH_FILES; i++) {
+			sprintf(fname, "bench%i.txt", i);
+			Test_LFS_BenchFill(data, i);
+			memset(&f, 0, sizeof(f));
+			SELFTEST_ASSERT(lfs_file_open(&lfs, &f, fname, LFS_O_RDONLY) >= 0);
+			for (pos = 0; (len = lfs_file_read(&lfs, &f, chunk, sizeof(chunk))) > 0; pos += len) {
+				if (memcmp(chunk, data + pos, len))
+					bad++;
+			}
+			SELFTEST_ASSERT(pos == TEST_LFS_BENCH_SIZE);
+			lfs_file_close(&lfs, &f);
+		}
+	}
+	r->readMs = (int)((clock() - start) * 1000 / CLOCKS_PER_SEC);
+	r->reads = SIM_GetFlashReadCount() - reads;
+	SELFTEST_ASSERT(bad == 0);
+
+	ADDLOG_INFO(LOG_FEATURE_MAIN, "LFS bench %s: write %i B in %i ms, %i flash writes, %i erases; read %i B in %i ms, %i flash reads",
+		profile == LFS_PROFILE_FAST ? "fast" : "compat",
+		TEST_LFS_BENCH_FILES * TEST_LFS_BENCH_SIZE, r->writeMs, r->writes, r->erases,
+		TEST_LFS_BENCH_FILES * TEST_LFS_BENCH_SIZE * TEST_LFS_BENCH_READS, r->readMs, r->reads);
+}
+
+void Test_LFS_Profile() {
+	testLfsBench_t compat, fast;
+	int defaultProfile = LFS_GetProfile();
+	int hits, misses, reads;
+	char *data;
+	byte *big;
+
+	SIM_ClearOBK(0);
+
+	Test_LFS_Bench(LFS_PROFILE_COMPAT, &compat);
+	Test_LFS_Bench(LFS_PROFILE_FAST, &fast);
+	SELFTEST_ASSERT(fast.reads * 4 < compat.reads);
+	SELFTEST_ASSERT(fast.writes * 4 < compat.writes);
+	SELFTEST_ASSERT(fast.erases <= compat.erases);
+
+	// filesystem made by old settings is readable and writable with new ones
+	LFS_SetProfile(LFS_PROFILE_COMPAT);
+	CMD_ExecuteCommand("lfs_format 0x20000", 0);
+	CMD_ExecuteCommand("lfs_write old.txt made by compat", 0);
+	CMD_ExecuteCommand("lfs_append old.txt _profile", 0);
+	LFS_SetProfile(LFS_PROFILE_FAST);
+	SELFTEST_ASSERT(lfs_present());
+	data = (char*)LFS_ReadFile("old.txt");
+	SELFTEST_ASSERT(data && !strcmp(data, "made by compat_profile"));
+	free(data);
+	CMD_ExecuteCommand("lfs_append old.txt +fast", 0);
+	CMD_ExecuteCommand("lfs_write new.txt made by fast", 0);
+	LFS_SetProfile(LFS_PROFILE_COMPAT);
+	data = (char*)LFS_ReadFile("old.txt");
+	SELFTEST_ASSERT(data && !strcmp(data, "made by compat_profile+fast"));
+	free(data);
+	data = (char*)LFS_ReadFile("new.txt");
+	SELFTEST_ASSERT(data && !strcmp(data, "made by fast"));
+	free(data);
+	LFS_SetProfile(defaultProfile);
+
+	// second read of unchanged file does not touch flash
+	LFS_FileCache_GetStats(&hits, &misses);
+	data = (char*)LFS_ReadFile("new.txt");
+	free(data);
+	reads = SIM_GetFlashReadCount();
+	data = (char*)LFS_ReadFile("new.txt");
+	SELFTEST_ASSERT(data && !strcmp(data, "made by fast"));
+	free(data);
+	SELFTEST_ASSERT(SIM_GetFlashReadCount() == reads);
+	LFS_FileCache_GetStats(&hits, &misses);
+	SELFTEST_ASSERT(hits >= 1);
+	// any write drops cached copies
+	CMD_ExecuteCommand("lfs_append new.txt !", 0);
+	data = (char*)LFS_ReadFile("new.txt");
+	SELFTEST_ASSERT(data && !strcmp(data, "made by fast!"));
+	free(data);
+	// big file is not cached
+	big = malloc(LFS_FILE_CACHE_MAX_FILE + 1);
+	memset(big, 'x', LFS_FILE_CACHE_MAX_FILE + 1);
+	LFS_WriteFile("big.txt", big, LFS_FILE_CACHE_MAX_FILE + 1, false);
+	free(big);
+	data = (char*)LFS_ReadFile("big.txt");
+	free(data);
+	reads = SIM_GetFlashReadCount();
+	data = (char*)LFS_ReadFile("big.txt");
+	SELFTEST_ASSERT(data && strlen(data) == LFS_FILE_CACHE_MAX_FILE + 1);
+	free(data);
+	SELFTEST_ASSERT(SIM_GetFlashReadCount() > reads);
+
+	CMD_ExecuteCommand("lfs_format", 0);
+}
 
 void Test_LFS() {
 	char buffer[64];
@@ -130,6 +280,8 @@ void Test_LFS() {
 	CMD_ExecuteCommand("lfs_appendInt numbers.txt 15+16", 0);
 	Test_FakeHTTPClientPacket_GET("api/lfs/numbers.txt");
 	SELFTEST_ASSERT_HTML_REPLY("value is 2023, and 31");
+
+	Test_LFS_Profile();
 }
 
 #endif
@@ -105,6 +105,17 @@ void Test_Scripting();
 void Test_RepeatingEvents();
 void Test_HTTP_Client();
 void Test_DeviceGroups();
+void Test_DS1820();
+void Test_OTA();
+void Test_SSDP();
+void Test_TickProfiler();
+void Test_MemPool();
+// simulator only, see src/sim/Solver.cpp
+void Test_Sim_Solver();
+void Test_Sim_SolverJunctions();
+void Test_ADCSampler();
+void Test_MeterFrame();
+void Test_DDPSend();
 void Test_NTP();
 void Test_TIME_DST();
 void Test_TIME_SunsetSunrise();
@@ -149,6 +160,7 @@ void Test_Enums();
 void Test_Expressions_RunTests_Basic();
 void Test_Expressions_RunTests_Braces();
 void Test_ButtonEvents();
+void Test_ButtonEvents_EdgeQueue();
 void Test_Http();
 void Test_Demo_ConditionalRelay();
 void Test_PIR();
@@ -156,6 +168,7 @@ void Test_Driver_TCL_AC();
 void Test_MAX72XX();
 void Test_OpenWeatherMap();
 void Test_Pins();
+void Test_Pins_ChannelIndex();
 
 void Test_GetJSONValue_Setup(const char *text);
 void Test_FakeHTTPClientPacket_GET(const char *tg);
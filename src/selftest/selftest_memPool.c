@@ -0,0 +1,155 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../memory/mem_pool.h"
+#include "../logging/logging.h"
+
+// override for long fragmentation runs, e.g. -DMEMPOOL_SOAK_ITERATIONS=100000000
+#ifndef MEMPOOL_SOAK_ITERATIONS
+#define MEMPOOL_SOAK_ITERATIONS		200000
+#endif
+#define MEMPOOL_SOAK_SLOTS			512
+
+static unsigned int g_testPoolSeed;
+
+static int Test_MemPool_Random() {
+	g_testPoolSeed = g_testPoolSeed * 1103515245 + 12345;
+	return (g_testPoolSeed >> 16) & 0x7FFF;
+}
+
+static int Test_MemPool_TotalUsed() {
+	int i, r = 0;
+
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		r += MemPool_GetStats(i)->used;
+	}
+	return r;
+}
+
+// random sized, random lifetime blocks, content checked before every free
+static void Test_MemPool_Soak() {
+	static byte *ptrs[MEMPOOL_SOAK_SLOTS];
+	static short sizes[MEMPOOL_SOAK_SLOTS];
+	int usedBefore[MEMPOOL_CLASSES];
+	const memPoolStats_t *s;
+	memHeapStats_t h;
+	unsigned int fallbacks = 0;
+	int i, j, slot, bad = 0;
+
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		usedBefore[i] = MemPool_GetStats(i)->used;
+	}
+	g_testPoolSeed = 4321;
+	for (i = 0; i < MEMPOOL_SOAK_ITERATIONS; i++) {
+		slot = Test_MemPool_Random() % MEMPOOL_SOAK_SLOTS;
+		if (ptrs[slot]) {
+			for (j = 0; j < sizes[slot]; j++) {
+				if (ptrs[slot][j] != (byte)(slot + j))
+					bad++;
+			}
+			MemPool_Free(ptrs[slot]);
+			ptrs[slot] = 0;
+		}
+		else {
+			sizes[slot] = 1 + Test_MemPool_Random() % 200;
+			ptrs[slot] = MemPool_Malloc(sizes[slot]);
+			for (j = 0; j < sizes[slot]; j++) {
+				ptrs[slot][j] = slot + j;
+			}
+		}
+	}
+	for (i = 0; i < MEMPOOL_SOAK_SLOTS; i++) {
+		MemPool_Free(ptrs[i]);
+		ptrs[i] = 0;
+	}
+	SELFTEST_ASSERT(bad == 0);
+	for (i = 0; i < MEMPOOL_CLASSES; i++) {
+		s = MemPool_GetStats(i);
+		SELFTEST_ASSERT(s->used == usedBefore[i]);
+		SELFTEST_ASSERT(s->highWater <= s->blockCount);
+		fallbacks += s->fallbacks;
+	}
+	// far more live blocks than pool space, so some went to heap
+	SELFTEST_ASSERT(fallbacks > 0);
+	MemPool_GetHeapStats(&h);
+	SELFTEST_ASSERT(h.oversize > 0);
+	SELFTEST_ASSERT(h.lowWater <= h.freeHeap);
+	// simulator allocator does not report it
+	SELFTEST_ASSERT(h.largestFreeBlock == -1);
+	ADDLOG_INFO(LOG_FEATURE_MAIN, "MemPool soak: %i iterations", MEMPOOL_SOAK_ITERATIONS);
+	CMD_ExecuteCommand("memStats", 0);
+}
+
+void Test_MemPool() {
+	const memPoolStats_t *s;
+	void *blocks[128];
+	void *p, *q;
+	char *str;
+	int i, n, used;
+	unsigned int fallbacks;
+
+	SIM_ClearOBK(0);
+	// pools survive simulated reboots
+	MemPool_Init();
+
+	SELFTEST_ASSERT(MemPool_GetStats(-1) == 0);
+	SELFTEST_ASSERT(MemPool_GetStats(MEMPOOL_CLASSES) == 0);
+
+	// smallest fitting class is used
+	p = MemPool_Malloc(16);
+	SELFTEST_ASSERT(MemPool_Owns(p));
+	SELFTEST_ASSERT(MemPool_GetStats(0)->used >= 1);
+	q = MemPool_Malloc(17);
+	SELFTEST_ASSERT(MemPool_Owns(q));
+	SELFTEST_ASSERT(MemPool_GetStats(1)->used >= 1);
+	MemPool_Free(p);
+	MemPool_Free(q);
+	MemPool_Free(0);
+	// bigger than largest class goes to heap
+	p = MemPool_Malloc(129);
+	SELFTEST_ASSERT(p != 0);
+	SELFTEST_ASSERT(MemPool_Owns(p) == 0);
+	MemPool_Free(p);
+
+	str = MemPool_StrDup("addChannel 1 1");
+	SELFTEST_ASSERT(MemPool_Owns(str));
+	SELFTEST_ASSERT(!strcmp(str, "addChannel 1 1"));
+	MemPool_Free(str);
+
+	// exhaust 128 byte class, rest goes to heap and is counted
+	s = MemPool_GetStats(MEMPOOL_CLASSES - 1);
+	used = s->used;
+	n = s->blockCount - used + 4;
+	fallbacks = s->fallbacks;
+	for (i = 0; i < n; i++) {
+		blocks[i] = MemPool_Malloc(100);
+	}
+	SELFTEST_ASSERT(s->used == s->blockCount);
+	SELFTEST_ASSERT(s->highWater == s->blockCount);
+	SELFTEST_ASSERT(s->fallbacks == fallbacks + 4);
+	SELFTEST_ASSERT(MemPool_Owns(blocks[0]));
+	SELFTEST_ASSERT(MemPool_Owns(blocks[n - 1]) == 0);
+	// freed block is handed out again
+	p = blocks[0];
+	MemPool_Free(p);
+	blocks[0] = MemPool_Malloc(128);
+	SELFTEST_ASSERT(blocks[0] == p);
+	for (i = 0; i < n; i++) {
+		MemPool_Free(blocks[i]);
+	}
+	SELFTEST_ASSERT(s->used == used);
+
+	// clock and repeating events keep their structs and commands in pools
+	used = Test_MemPool_TotalUsed();
+	CMD_ExecuteCommand("addClockEvent 9:28:00 0xff 123 addChannel 1 54", 0);
+	SELFTEST_ASSERT(Test_MemPool_TotalUsed() == used + 2);
+	CMD_ExecuteCommand("addRepeatingEvent 5 -1 addChannel 2 1", 0);
+	SELFTEST_ASSERT(Test_MemPool_TotalUsed() == used + 4);
+	CMD_ExecuteCommand("clearClockEvents", 0);
+	CMD_ExecuteCommand("clearRepeatingEvents", 0);
+	SELFTEST_ASSERT(Test_MemPool_TotalUsed() == used);
+
+	Test_MemPool_Soak();
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_meterFrame.h"
+#include "../driver/drv_uart.h"
+#include "../driver/drv_public.h"
+
+// CSE7766 frames captured on a real device, see drv_cse7766.c,
+// first one has a corrupted byte
+static const char *g_cse7766Capture =
+	"555A02D5000005A9003C3800FD5C4DB2A002957C714823AD"
+	"555A02D5000005A9003C0500FD734DB2A002972771482876"
+	"555A02D5000005A7003C0500FD734DB2A002961F71482E71"
+	"555A02D5000005A7003C0500FD734DB2A002975C714834B5"
+	"555A02D5000005A7003C0500FD9C4DB2A002968071483A07"
+	"555A02D5000005A6003C0500FD9C4DB2A00293C27148404B"
+	"555A02D5000005A6003C0500FD9C4DB2A0029654714846E6"
+	"555A02D5000005A6003C0500FDAB4DB2A002965F71484B05";
+// 70W 240V
+static const char *g_cse7766Capture70W =
+	"555A02FCD800062800413200C9FE537B18023BD47171E3FA"
+	"555A02FCD800062F00413200D7F2537B18023E9F7171FEEC";
+// BL0942 replies for 230V 0.26A 60W, 230V 0.26A 60W, 231V 0.27A 62W,
+// CF counter 100, 110, 120, 50Hz
+static const char *g_bl0942Capture =
+	"5522FF00784D35000000288C00640000204E00000000B1"
+	"5522FF00784D35000000288C006E0000204E00000000A7"
+	"55F20801CC8835000000D49000780000204E0000000084";
+
+static int g_frameCount[METERFRAME_MAX_INSTANCES];
+static byte g_lastFrame[METERFRAME_LEN_MAX];
+
+static void Test_MeterFrame_OnFrame(int instance, const byte *frame, int user) {
+	g_frameCount[user]++;
+	memcpy(g_lastFrame, frame, g_meterFrameTypes[METERFRAME_CSE7766].len);
+}
+
+static int Test_MeterFrame_Hex(const char *hex, byte *out, int maxLen) {
+	int len = 0;
+
+	while (*hex && len < maxLen) {
+		if (*hex == ' ') {
+			hex++;
+			continue;
+		}
+		out[len++] = hexbyte(hex);
+		hex += 2;
+	}
+	return len;
+}
+
+static void Test_MeterFrame_Parser() {
+	byte data[256];
+	byte last[METERFRAME_LEN_MAX];
+	const meterFrameStats_t *st;
+	unsigned int seed = 1234;
+	int a, b, i, n, len, pos;
+
+	memset(g_frameCount, 0, sizeof(g_frameCount));
+
+	// leading garbage, with header bytes in it
+	data[0] = 0x00;
+	data[1] = 0x55;
+	data[2] = 0x12;
+	data[3] = 0x55;
+	data[4] = 0x55;
+	len = 5 + Test_MeterFrame_Hex(g_cse7766Capture, data + 5, sizeof(data) - 5);
+	SELFTEST_ASSERT(len == 5 + 8 * 24);
+	a = MeterFrame_Open(METERFRAME_CSE7766, UART_PORT_INDEX_0, Test_MeterFrame_OnFrame, 0);
+	SELFTEST_ASSERT(a >= 0);
+	SELFTEST_ASSERT(MeterFrame_Feed(a, data, len) == 7);
+	st = MeterFrame_GetStats(a);
+	SELFTEST_ASSERT(st->frames == 7);
+	SELFTEST_ASSERT(st->badChecksums == 1);
+	SELFTEST_ASSERT(st->garbage == 5 + 24);
+	SELFTEST_ASSERT(g_frameCount[0] == 7);
+	SELFTEST_ASSERT(!memcmp(g_lastFrame, data + len - 24, 24));
+	memcpy(last, g_lastFrame, 24);
+	MeterFrame_Close(a);
+	SELFTEST_ASSERT(MeterFrame_GetStats(a) == 0);
+
+	// same capture split at random points gives same frames
+	a = MeterFrame_Open(METERFRAME_CSE7766, UART_PORT_INDEX_0, Test_MeterFrame_OnFrame, 1);
+	for (i = 0; i < 20; i++) {
+		for (pos = 0; pos < len; pos += n) {
+			seed = seed * 1103515245 + 12345;
+			n = 1 + (seed >> 16) % 30;
+			if (n > len - pos)
+				n = len - pos;
+			MeterFrame_Feed(a, data + pos, n);
+		}
+	}
+	st = MeterFrame_GetStats(a);
+	SELFTEST_ASSERT(st->frames == 20 * 7);
+	SELFTEST_ASSERT(st->badChecksums == 20);
+	SELFTEST_ASSERT(g_frameCount[1] == 20 * 7);
+	SELFTEST_ASSERT(!memcmp(g_lastFrame, last, 24));
+	MeterFrame_Close(a);
+
+	// truncated frame, next frame starts inside of it and is not lost
+	len = Test_MeterFrame_Hex(g_bl0942Capture, data + 11, sizeof(data) - 11);
+	memcpy(data, data + 11, 11);
+	len += 11;
+	a = MeterFrame_Open(METERFRAME_BL0942, UART_PORT_INDEX_0, Test_MeterFrame_OnFrame, 2);
+	SELFTEST_ASSERT(MeterFrame_Feed(a, data, len) == 3);
+	st = MeterFrame_GetStats(a);
+	SELFTEST_ASSERT(st->badChecksums == 1);
+	SELFTEST_ASSERT(st->garbage == 11);
+	MeterFrame_Close(a);
+
+	// two meters at once, chunks interleaved
+	memset(g_frameCount, 0, sizeof(g_frameCount));
+	a = MeterFrame_Open(METERFRAME_BL0942, UART_PORT_INDEX_0, Test_MeterFrame_OnFrame, 0);
+	b = MeterFrame_Open(METERFRAME_CSE7766, UART_PORT_INDEX_1, Test_MeterFrame_OnFrame, 1);
+	SELFTEST_ASSERT(a >= 0 && b >= 0 && a != b);
+	len = Test_MeterFrame_Hex(g_bl0942Capture, data, sizeof(data));
+	n = Test_MeterFrame_Hex(g_cse7766Capture70W, data + len, sizeof(data) - len);
+	for (i = 0; i < len || i < n; i += 7) {
+		if (i < len)
+			MeterFrame_Feed(a, data + i, i + 7 < len ? 7 : len - i);
+		if (i < n)
+			MeterFrame_Feed(b, data + len + i, i + 7 < n ? 7 : n - i);
+	}
+	SELFTEST_ASSERT(g_frameCount[0] == 3);
+	SELFTEST_ASSERT(g_frameCount[1] == 2);
+	SELFTEST_ASSERT(MeterFrame_GetStats(a)->garbage == 0);
+	SELFTEST_ASSERT(MeterFrame_GetStats(b)->garbage == 0);
+	MeterFrame_Close(a);
+	MeterFrame_Close(b);
+
+	// table is shared by all drivers
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		SELFTEST_ASSERT(MeterFrame_Open(METERFRAME_BL0942, UART_PORT_INDEX_0, 0, 0) == i);
+	}
+	SELFTEST_ASSERT(MeterFrame_Open(METERFRAME_BL0942, UART_PORT_INDEX_0, 0, 0) == -1);
+	SELFTEST_ASSERT(MeterFrame_Open(METERFRAME_TYPES, UART_PORT_INDEX_0, 0, 0) == -1);
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		MeterFrame_Close(i);
+	}
+	MeterFrame_Close(-1);
+}
+
+void Test_MeterFrame() {
+	char cmd[160];
+	int i;
+
+	// no meter driver may hold instances during parser tests
+	SIM_ClearOBK(0);
+	Test_MeterFrame_Parser();
+
+	// every frame sent by CSE7766 is taken on quick tick and averaged
+	CMD_ExecuteCommand("startDriver CSE7766", 0);
+	snprintf(cmd, sizeof(cmd), "uartFakeHex %s", g_cse7766Capture70W);
+	CMD_ExecuteCommand(cmd, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 240.5f, 0.1f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 70.2f, 0.1f);
+	CMD_ExecuteCommand("meterFrames", 0);
+	CMD_ExecuteCommand("stopDriver CSE7766", 0);
+
+	// BL0942 replies from a capture, works without the simulator packet generator
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver BL0942", 0);
+	CMD_ExecuteCommand("uartFakeHex 5522FF00784D35000000288C00640000204E00000000B1", 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 230.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_CURRENT), 0.26f, 0.001f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 60.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_FREQUENCY), 50.0f, 0.01f);
+	// two replies within one update are averaged, garbage in between is skipped
+	CMD_ExecuteCommand("uartFakeHex 5522FF00784D35000000288C006E0000204E00000000A7 00 55 12", 0);
+	CMD_ExecuteCommand("uartFakeHex 55F20801CC8835000000D49000780000204E0000000084", 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_VOLTAGE), 230.5f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(DRV_GetReading(OBK_POWER), 61.0f, 0.01f);
+	// UART is set up again only after something else took it over
+	i = UART_GetInitCounterEx(UART_GetSelectedPortIndex());
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(UART_GetInitCounterEx(UART_GetSelectedPortIndex()) == i);
+	UART_InitUARTEx(UART_GetSelectedPortIndex(), 115200, 0, false);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(UART_GetInitCounterEx(UART_GetSelectedPortIndex()) == i + 2);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(UART_GetInitCounterEx(UART_GetSelectedPortIndex()) == i + 2);
+	CMD_ExecuteCommand("stopDriver BL0942", 0);
+
+	// stopped drivers give their instances back
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		SELFTEST_ASSERT(MeterFrame_Open(METERFRAME_CSE7766, UART_PORT_INDEX_0, 0, 0) == i);
+	}
+	for (i = 0; i < METERFRAME_MAX_INSTANCES; i++) {
+		MeterFrame_Close(i);
+	}
+}
+
+#endif
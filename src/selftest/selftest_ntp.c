@@ -1,6 +1,132 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_ntp.h"
+#include "../driver/drv_deviceclock.h"
+#include "../hal/hal_wifi.h"
+#include "../quicktick.h"
+#include "lwip/sockets.h"
+
+// Fake NTP server on loopback, its clock runs from g_timeMs with given drift
+static int g_fakeNtpSocket = -1;
+static uint64_t g_fakeNtpBaseMs;
+static unsigned int g_fakeNtpBaseTick;
+static int g_fakeNtpDriftPPM = 0;
+static int g_fakeNtpRequests = 0;
+
+static uint64_t Test_FakeNTP_Now() {
+	unsigned int elapsed = g_timeMs - g_fakeNtpBaseTick;
+	return g_fakeNtpBaseMs + elapsed + (int64_t)elapsed * g_fakeNtpDriftPPM / 1000000;
+}
+static int Test_FakeNTP_Open(int *port) {
+	struct sockaddr_in adr;
+	socklen_t len = sizeof(adr);
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	memset(&adr, 0, sizeof(adr));
+	adr.sin_family = AF_INET;
+	adr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	adr.sin_port = 0;
+	bind(s, (struct sockaddr*)&adr, sizeof(adr));
+	getsockname(s, (struct sockaddr*)&adr, &len);
+	lwip_fcntl(s, F_SETFL, O_NONBLOCK);
+	*port = ntohs(adr.sin_port);
+	return s;
+}
+static void Test_FakeNTP_Serve() {
+	byte buf[48];
+	struct sockaddr_in from;
+	socklen_t fromLen = sizeof(from);
+	uint64_t now;
+	uint32_t sec, frac;
+
+	while (recvfrom(g_fakeNtpSocket, (char*)buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromLen) == sizeof(buf)) {
+		g_fakeNtpRequests++;
+		now = Test_FakeNTP_Now();
+		sec = (uint32_t)(now / 1000 + 2208988800UL);
+		frac = (uint32_t)(((now % 1000) << 32) / 1000);
+		// originate = client transmit
+		memcpy(buf + 24, buf + 40, 8);
+		buf[0] = 0x24;
+		buf[1] = 2;
+		// receive and transmit, 1 ms apart
+		sec = htonl(sec);
+		memcpy(buf + 32, &sec, 4);
+		memcpy(buf + 40, &sec, 4);
+		frac = htonl(frac);
+		memcpy(buf + 36, &frac, 4);
+		frac = htonl(ntohl(frac) + 4294967);
+		memcpy(buf + 44, &frac, 4);
+		sendto(g_fakeNtpSocket, (char*)buf, sizeof(buf), 0, (struct sockaddr*)&from, fromLen);
+		fromLen = sizeof(from);
+	}
+}
+// one second of device time, reply arrives 20 ms after request
+static void Test_FakeNTP_RunSeconds(int seconds) {
+	while (seconds--) {
+		NTP_OnEverySecond();
+		Test_FakeNTP_Serve();
+		g_timeMs += 20;
+		NTP_RunQuickTick();
+		g_timeMs += 980;
+		g_secondsElapsed++;
+	}
+}
+static int Test_FakeNTP_ErrorMs() {
+	return (int)((int64_t)NTP_GetCurrentTimeMsWithoutOffset() - (int64_t)Test_FakeNTP_Now());
+}
+
+void Test_NTP_Client() {
+	char cmd[64];
+	int deadSocket, deadPort, livePort, requests;
+
+	SIM_ClearOBK(0);
+	Main_OnWiFiStatusChange(WIFI_STA_CONNECTED);
+	CMD_ExecuteCommand("startDriver NTP 60", 0);
+
+	// first server never answers
+	deadSocket = Test_FakeNTP_Open(&deadPort);
+	g_fakeNtpSocket = Test_FakeNTP_Open(&livePort);
+	sprintf(cmd, "ntp_setServer 127.0.0.1:%i 127.0.0.1:%i", deadPort, livePort);
+	CMD_ExecuteCommand(cmd, 0);
+	// Tue Nov 14 2023 22:13:20.123
+	g_fakeNtpBaseMs = 1700000000123ULL;
+	g_fakeNtpBaseTick = g_timeMs;
+	g_fakeNtpDriftPPM = 0;
+	g_fakeNtpRequests = 0;
+
+	SELFTEST_ASSERT(NTP_IsTimeSynced() == false);
+	Test_FakeNTP_RunSeconds(10);
+	SELFTEST_ASSERT(NTP_IsTimeSynced());
+	SELFTEST_ASSERT(NTP_GetCurrentServerIndex() == 1);
+	SELFTEST_ASSERT(g_fakeNtpRequests == 1);
+	// milliseconds are right, up to half of the 20 ms round trip
+	SELFTEST_ASSERT(abs(Test_FakeNTP_ErrorMs()) <= 11);
+	SELFTEST_ASSERT(abs((int)(TIME_GetCurrentTimeWithoutOffset() - (uint32_t)(Test_FakeNTP_Now() / 1000))) <= 1);
+
+	// stable clock, requests get rare
+	Test_FakeNTP_RunSeconds(6 * 3600);
+	SELFTEST_ASSERT(NTP_GetPollInterval() == 14400);
+	SELFTEST_ASSERT(g_fakeNtpRequests < 15);
+	SELFTEST_ASSERT(abs(Test_FakeNTP_ErrorMs()) <= 11);
+
+	// server clock runs 500 ppm faster, poll adapts so that error stays about 100 ms
+	g_fakeNtpBaseMs = Test_FakeNTP_Now();
+	g_fakeNtpBaseTick = g_timeMs;
+	g_fakeNtpDriftPPM = 500;
+	Test_FakeNTP_RunSeconds(4 * 3600 + 60);
+	requests = g_fakeNtpRequests;
+	Test_FakeNTP_RunSeconds(3600);
+	SELFTEST_ASSERT(NTP_GetDriftPPM() >= 450 && NTP_GetDriftPPM() <= 550);
+	SELFTEST_ASSERT(NTP_GetPollInterval() == 200);
+	SELFTEST_ASSERT(g_fakeNtpRequests - requests >= 17 && g_fakeNtpRequests - requests <= 19);
+	SELFTEST_ASSERT(abs(Test_FakeNTP_ErrorMs()) <= 110);
+
+	CMD_ExecuteCommand("stopDriver NTP", 0);
+	closesocket(deadSocket);
+	closesocket(g_fakeNtpSocket);
+	g_fakeNtpSocket = -1;
+}
 
 void Test_NTP() {
 	// reset whole device
@@ -38,8 +164,7 @@ void Test_NTP() {
 	CMD_ExecuteCommand("ntp_timeZoneOfs -12:05", 0);
 	SELFTEST_ASSERT_INTCOMPARE(NTP_GetTimesZoneOfsSeconds(), -(12 * 60 * 60 + 5 * 60));
 
-
-
+	Test_NTP_Client();
 }
 
 
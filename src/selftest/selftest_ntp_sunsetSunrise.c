@@ -4,6 +4,57 @@
 #include "../driver/drv_ntp.h"
 #include "../driver/drv_deviceclock.h"
 
+// solar position is calculated once per day and location, not per use
+static void Test_TIME_SunCache() {
+	byte hour, minute;
+	int calcs;
+	char cmd[64];
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver NTP", 0);
+	CMD_ExecuteCommand("ntp_timeZoneOfs 1", 0);
+	CMD_ExecuteCommand("ntp_setLatlong 52.237049 21.017532", 0);
+	// Wed, 20 Dec 2023 15:16:45 in Warsaw
+	NTP_SetSimulatedTime(1703081805);
+
+	TIME_CalculateSunset(&hour, &minute);
+	calcs = TIME_GetSunCalculationsCount();
+	// same day, both rise and set, any number of times
+	for (int i = 0; i < 20; i++) {
+		SELFTEST_ASSERT_EXPRESSION("$sunset", 55380);
+		SELFTEST_ASSERT_EXPRESSION("$sunrise", 27660);
+	}
+	SELFTEST_ASSERT(TIME_GetSunCalculationsCount() == calcs);
+
+	// many sun events share the cached days
+	TIME_OnEverySecond();
+	calcs = TIME_GetSunCalculationsCount();
+	for (int i = 0; i < 50; i++) {
+		sprintf(cmd, "addClockEvent %s 0x%x %i addChannel 1 1", (i & 1) ? "sunset" : "sunrise", 1 << (i % 7), 100 + i);
+		CMD_ExecuteCommand(cmd, 0);
+	}
+	TIME_OnEverySecond();
+	SELFTEST_ASSERT(TIME_GetSunCalculationsCount() <= calcs + 8);
+
+	// time zone change does not need new calculation
+	calcs = TIME_GetSunCalculationsCount();
+	CMD_ExecuteCommand("ntp_timeZoneOfs 2", 0);
+	SELFTEST_ASSERT_EXPRESSION("$sunset", 55380 + 3600);
+	SELFTEST_ASSERT(TIME_GetSunCalculationsCount() == calcs);
+
+	// new location does
+	CMD_ExecuteCommand("ntp_timeZoneOfs -5", 0);
+	CMD_ExecuteCommand("ntp_setLatlong 30.266666 -97.73333", 0);
+	// Wed Jul 12 2023 13:47:13 GMT+0000
+	NTP_SetSimulatedTime(1689169633);
+	SELFTEST_ASSERT_EXPRESSION("$sunrise", 23820);
+	SELFTEST_ASSERT(TIME_GetSunCalculationsCount() == calcs + 1);
+	SELFTEST_ASSERT_EXPRESSION("$sunset", 74040);
+	SELFTEST_ASSERT(TIME_GetSunCalculationsCount() == calcs + 1);
+
+	TIME_ClearEvents();
+}
+
 void Test_TIME_SunsetSunrise() {
 	byte hour, minute;
 	int sunrise, sunset;
@@ -145,6 +196,8 @@ void Test_TIME_SunsetSunrise() {
 	// channel value should change
 	SELFTEST_ASSERT_CHANNEL(15, 4567);
 
+	Test_TIME_SunCache();
+
 }
 
 
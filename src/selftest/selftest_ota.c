@@ -0,0 +1,143 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_ota.h"
+#include "../logging/logging.h"
+#include <time.h>
+
+// outside of simulated LFS and config
+#define TEST_OTA_START 0x10000
+// close to real firmware, last sector partially filled
+#define TEST_OTA_SIZE (0x100000 - 0x321)
+
+static unsigned int g_testOtaSeed;
+
+static int Test_OTA_Random() {
+	g_testOtaSeed = g_testOtaSeed * 1103515245 + 12345;
+	return (g_testOtaSeed >> 16) & 0x7FFF;
+}
+
+// whole image pushed in uneven, network sized chunks
+void Test_OTA_Pipeline() {
+	byte *image;
+	byte *check;
+	int pos, len, erases, i;
+	unsigned int crc;
+	clock_t start;
+	const otaPipelineStats_t *st;
+
+	SIM_ClearOBK(0);
+
+	// known CRC32 check value
+	SELFTEST_ASSERT(OTA_CRC32_Update(0, (const byte*)"123456789", 9) == 0xCBF43926);
+	// incremental CRC is same as one shot
+	crc = OTA_CRC32_Update(0, (const byte*)"1234", 4);
+	SELFTEST_ASSERT(OTA_CRC32_Update(crc, (const byte*)"56789", 5) == 0xCBF43926);
+
+	// must be sector aligned
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START + 0x100) == 0);
+	SELFTEST_ASSERT(OTA_Pipeline_IsActive() == 0);
+
+	image = malloc(TEST_OTA_SIZE);
+	check = malloc(TEST_OTA_SIZE);
+	g_testOtaSeed = 1234;
+	for (i = 0; i < TEST_OTA_SIZE; i++) {
+		image[i] = Test_OTA_Random();
+	}
+	erases = SIM_GetFlashEraseCount();
+
+	start = clock();
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 1);
+	SELFTEST_ASSERT(OTA_Pipeline_IsActive());
+	// only one OTA at once
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 0);
+	OTA_Pipeline_SetExpectedSize(TEST_OTA_SIZE);
+	OTA_Pipeline_SetExpectedCRC(OTA_CRC32_Update(0, image, TEST_OTA_SIZE));
+	pos = 0;
+	while (pos < TEST_OTA_SIZE) {
+		len = 1 + Test_OTA_Random() % 1460;
+		if (len > TEST_OTA_SIZE - pos)
+			len = TEST_OTA_SIZE - pos;
+		OTA_Pipeline_Write(image + pos, len);
+		pos += len;
+	}
+	SELFTEST_ASSERT(OTA_Pipeline_End() == 1);
+	SELFTEST_ASSERT(OTA_Pipeline_IsActive() == 0);
+	ADDLOG_INFO(LOG_FEATURE_OTA, "OTA pipeline: %i bytes in %i ms",
+		TEST_OTA_SIZE, (int)((clock() - start) * 1000 / CLOCKS_PER_SEC));
+
+	st = OTA_Pipeline_GetStats();
+	SELFTEST_ASSERT(st->bytesReceived == TEST_OTA_SIZE);
+	SELFTEST_ASSERT(st->sectorsWritten == 0x100);
+	SELFTEST_ASSERT(st->writeErrors == 0);
+	SELFTEST_ASSERT(st->rxCrc == st->flashCrc);
+	SELFTEST_ASSERT(st->imageCrc == st->expectedCrc);
+	SELFTEST_ASSERT(SIM_GetFlashEraseCount() == erases + 0x100);
+
+	// image is in flash and tail of last sector is padded
+	HAL_FlashRead((char*)check, TEST_OTA_SIZE, TEST_OTA_START);
+	SELFTEST_ASSERT(memcmp(image, check, TEST_OTA_SIZE) == 0);
+	HAL_FlashRead((char*)check, 0x321, TEST_OTA_START + TEST_OTA_SIZE);
+	for (i = 0; i < 0x321; i++) {
+		SELFTEST_ASSERT(check[i] == 0xFF);
+	}
+	// received CRC covers padding as well
+	crc = OTA_CRC32_Update(0, image, TEST_OTA_SIZE);
+	SELFTEST_ASSERT(OTA_CRC32_Update(crc, check, 0x321) == st->rxCrc);
+
+	// data after end is ignored
+	OTA_Pipeline_Write(image, 16);
+	SELFTEST_ASSERT(OTA_Pipeline_GetStats()->bytesReceived == TEST_OTA_SIZE);
+
+	free(image);
+	free(check);
+}
+
+// flash read back is fine, but image is not what caller expected
+void Test_OTA_Pipeline_Expected() {
+	byte image[0x2345];
+	unsigned int crc;
+	int i;
+
+	g_testOtaSeed = 4321;
+	for (i = 0; i < (int)sizeof(image); i++) {
+		image[i] = Test_OTA_Random();
+	}
+	crc = OTA_CRC32_Update(0, image, sizeof(image));
+
+	// nothing expected, nothing but flash is checked
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 1);
+	OTA_Pipeline_Write(image, sizeof(image));
+	SELFTEST_ASSERT(OTA_Pipeline_End() == 1);
+
+	// connection dropped before last bytes
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 1);
+	OTA_Pipeline_SetExpectedSize(sizeof(image));
+	OTA_Pipeline_Write(image, sizeof(image) - 100);
+	SELFTEST_ASSERT(OTA_Pipeline_End() == 0);
+	SELFTEST_ASSERT(OTA_Pipeline_GetStats()->rxCrc == OTA_Pipeline_GetStats()->flashCrc);
+
+	// same size, one byte changed on the way
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 1);
+	OTA_Pipeline_SetExpectedSize(sizeof(image));
+	OTA_Pipeline_SetExpectedCRC(crc);
+	image[0x1234] ^= 0x10;
+	OTA_Pipeline_Write(image, sizeof(image));
+	image[0x1234] ^= 0x10;
+	SELFTEST_ASSERT(OTA_Pipeline_End() == 0);
+
+	// whole and correct
+	SELFTEST_ASSERT(OTA_Pipeline_Begin(TEST_OTA_START) == 1);
+	OTA_Pipeline_SetExpectedSize(sizeof(image));
+	OTA_Pipeline_SetExpectedCRC(crc);
+	OTA_Pipeline_Write(image, sizeof(image));
+	SELFTEST_ASSERT(OTA_Pipeline_End() == 1);
+	SELFTEST_ASSERT(OTA_Pipeline_GetStats()->imageCrc == crc);
+}
+
+void Test_OTA() {
+	Test_OTA_Pipeline();
+	Test_OTA_Pipeline_Expected();
+}
+
+#endif
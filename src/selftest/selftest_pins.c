@@ -53,4 +53,70 @@ const char *HAL_PIN_GetPinNameAlias(int index) {
 //	printf("################################################################## End Selftest PIN_FindIndexFromString() ##################################################################\r\n");
 }
 
+// channel capabilities follow pin config changes
+void Test_Pins_ChannelIndex() {
+	SIM_ClearOBK(0);
+
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(1) == 0);
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(-1) == 0);
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(CHANNEL_MAX) == 0);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(1) == false);
+
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(1));
+	SELFTEST_ASSERT(CHANNEL_ShouldBePublished(1));
+	SELFTEST_ASSERT(CHANNEL_IsInUse(1));
+	SELFTEST_ASSERT(h_isChannelRelay(1));
+	SELFTEST_ASSERT(h_isChannelPWM(1) == 0);
+	// moved to other channel
+	PIN_SetPinChannelForPinIndex(9, 2);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(1) == false);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(1) == false);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(2));
+	// LED is relay for lights, but not power relay
+	PIN_SetPinRoleForPinIndex(9, IOR_LED_n);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(2) == false);
+	SELFTEST_ASSERT(h_isChannelRelay(2));
+
+	// script only PWM is not a light, but has 0-100 range
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM_ScriptOnly);
+	PIN_SetPinChannelForPinIndex(24, 3);
+	SELFTEST_ASSERT(h_isChannelPWM(3) == 0);
+	SELFTEST_ASSERT(CHANNEL_FindMaxValueForChannel(3) == 100);
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	SELFTEST_ASSERT(h_isChannelPWM(3));
+
+	// humidity goes to secondary channel
+	PIN_SetPinRoleForPinIndex(10, IOR_SHT3X_DAT);
+	PIN_SetPinChannelForPinIndex(10, 4);
+	PIN_SetPinChannel2ForPinIndex(10, 5);
+	SELFTEST_ASSERT(CHANNEL_ShouldBePublished(4));
+	SELFTEST_ASSERT(CHANNEL_ShouldBePublished(5));
+	SELFTEST_ASSERT(CHANNEL_IsInUse(5));
+	PIN_SetPinRoleForPinIndex(11, IOR_DigitalInput_n);
+	PIN_SetPinChannelForPinIndex(11, 6);
+	SELFTEST_ASSERT(h_isChannelDigitalInput(6));
+
+	// channel type alone also counts, without any pin
+	SELFTEST_ASSERT(CHANNEL_IsInUse(7) == false);
+	CMD_ExecuteCommand("setChannelType 7 Temperature", 0);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(7));
+
+	// pins follow channel value, also after index rebuild
+	CMD_ExecuteCommand("setChannel 2 1", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(9, false);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(9, true);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	CMD_ExecuteCommand("setChannel 2 1", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(9, true);
+
+	CFG_ClearPins();
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(2) == 0);
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(3) == 0);
+	SELFTEST_ASSERT(CHANNEL_GetCapabilities(5) == 0);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(2) == false);
+}
+
 #endif
@@ -0,0 +1,76 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../sim/sim_nets.h"
+
+// Net graph of circuit solver, without SDL, so it runs in headless builds too.
+// Junctions 0..5: 0-1 linked, 1-3-5 wired out of order, 2 and 4 alone.
+void Test_Sim_Solver() {
+	static const int pairs[] = { 1, 0, 5, 3, 3, 1 };
+	int parent[6], netOf[6], items[6], start[7], fill[6];
+	// gates: net 0 -> net 1 open, net 1 -> net 2 open, net 2 -> net 0 closed
+	int gateNet[3] = { 0, 1, 2 };
+	int gateOtherNet[3] = { 1, 2, -1 };
+	int netGates[3], netGateStart[4];
+	int gatePairs[6], compOf[3], depth[3], queue[3];
+	unsigned int claimed[1];
+	int nets, comps, count, i;
+
+	// lowest junction names the net, numbering follows it
+	nets = SIM_Nets_Group(6, pairs, 3, parent, netOf);
+	SELFTEST_ASSERT(nets == 3);
+	SELFTEST_ASSERT(netOf[0] == 0 && netOf[1] == 0 && netOf[3] == 0 && netOf[5] == 0);
+	SELFTEST_ASSERT(netOf[2] == 1);
+	SELFTEST_ASSERT(netOf[4] == 2);
+
+	SIM_Nets_List(6, netOf, nets, start, items, fill);
+	SELFTEST_ASSERT(start[0] == 0 && start[1] == 4 && start[2] == 5 && start[3] == 6);
+	SELFTEST_ASSERT(items[0] == 0 && items[1] == 1 && items[2] == 3 && items[3] == 5);
+	SELFTEST_ASSERT(items[4] == 2 && items[5] == 4);
+
+	// no pairs, every item is its own group
+	SELFTEST_ASSERT(SIM_Nets_Group(3, pairs, 0, parent, compOf) == 3);
+	SELFTEST_ASSERT(compOf[0] == 0 && compOf[1] == 1 && compOf[2] == 2);
+
+	// open gates join nets into components
+	SIM_Nets_List(3, gateNet, nets, netGateStart, netGates, fill);
+	count = 0;
+	for (i = 0; i < 3; i++) {
+		if (gateOtherNet[i] == -1)
+			continue;
+		gatePairs[count * 2] = gateNet[i];
+		gatePairs[count * 2 + 1] = gateOtherNet[i];
+		count++;
+	}
+	comps = SIM_Nets_Group(nets, gatePairs, count, parent, compOf);
+	SELFTEST_ASSERT(comps == 1);
+
+	// flood crosses open gates breadth first, depth counts gates
+	claimed[0] = 0;
+	count = SIM_Nets_Flood(0, netGateStart, netGates, gateOtherNet, claimed, depth, queue);
+	SELFTEST_ASSERT(count == 3);
+	SELFTEST_ASSERT(queue[0] == 0 && queue[1] == 1 && queue[2] == 2);
+	SELFTEST_ASSERT(depth[0] == 0 && depth[1] == 1 && depth[2] == 2);
+	SELFTEST_ASSERT(claimed[0] == 7);
+
+	// closed gate is not crossed
+	claimed[0] = 0;
+	count = SIM_Nets_Flood(2, netGateStart, netGates, gateOtherNet, claimed, depth, queue);
+	SELFTEST_ASSERT(count == 1);
+	SELFTEST_ASSERT(claimed[0] == 4);
+
+	// net claimed by earlier source stops the flood
+	claimed[0] = 2;
+	count = SIM_Nets_Flood(0, netGateStart, netGates, gateOtherNet, claimed, depth, queue);
+	SELFTEST_ASSERT(count == 1);
+	SELFTEST_ASSERT(claimed[0] == 3);
+
+	// closing gate 0 -> 1 splits net 0 off
+	gatePairs[0] = 1;
+	gatePairs[1] = 2;
+	comps = SIM_Nets_Group(nets, gatePairs, 1, parent, compOf);
+	SELFTEST_ASSERT(comps == 2);
+	SELFTEST_ASSERT(compOf[0] == 0 && compOf[1] == 1 && compOf[2] == 1);
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "lwip/sockets.h"
+#include "../driver/drv_ssdp.h"
+#include "../quicktick.h"
+
+static const char *g_testSearch =
+	"M-SEARCH * HTTP/1.1\r\n"
+	"HOST:239.255.255.250:1900\r\n"
+	"st: ssdp:all\r\n"
+	"MX: 2\r\n"
+	"MAN:\"ssdp:discover\"\r\n"
+	"\r\n";
+
+static void Test_SSDP_Packet(const char *data, uint32_t ip, int port) {
+	struct sockaddr_in from;
+
+	memset(&from, 0, sizeof(from));
+	from.sin_family = AF_INET;
+	from.sin_addr.s_addr = ip;
+	from.sin_port = htons(port);
+	DRV_SSDP_ProcessPacket(data, strlen(data), &from);
+}
+
+static void Test_SSDP_Parse() {
+	ssdpMessage_t msg;
+	const char *s;
+
+	DRV_SSDP_ParseMessage(g_testSearch, strlen(g_testSearch), &msg);
+	SELFTEST_ASSERT(msg.method == SSDP_METHOD_SEARCH);
+	SELFTEST_ASSERT(msg.searchTarget == SSDP_ST_ALL);
+	SELFTEST_ASSERT(msg.bDiscover);
+	SELFTEST_ASSERT(msg.mx == 2);
+
+	s = "M-SEARCH * HTTP/1.1\r\nST: urn:Belkin:device:**\r\nMAN: \"ssdp:discover\"\r\nMX: 120\r\n\r\n";
+	DRV_SSDP_ParseMessage(s, strlen(s), &msg);
+	SELFTEST_ASSERT(msg.searchTarget == SSDP_ST_BELKIN);
+	// clamped to 5 seconds
+	SELFTEST_ASSERT(msg.mx == 5);
+
+	s = "M-SEARCH * HTTP/1.1\r\nST: urn:schemas-upnp-org:device:Basic:1\r\n\r\n";
+	DRV_SSDP_ParseMessage(s, strlen(s), &msg);
+	SELFTEST_ASSERT(msg.searchTarget == SSDP_ST_BASIC);
+	SELFTEST_ASSERT(msg.bDiscover == 0);
+	SELFTEST_ASSERT(msg.mx == 0);
+
+	// value is matched as a whole, not searched for
+	s = "M-SEARCH * HTTP/1.1\nST: urn:dial-multiscreen-org:service:dial:1\nUSER-AGENT: upnp:rootdevice\n\n";
+	DRV_SSDP_ParseMessage(s, strlen(s), &msg);
+	SELFTEST_ASSERT(msg.searchTarget == SSDP_ST_OTHER);
+
+	s = "NOTIFY * HTTP/1.1\r\nSERVER: OpenBk\r\nNTS: ssdp:alive\r\n\r\n";
+	DRV_SSDP_ParseMessage(s, strlen(s), &msg);
+	SELFTEST_ASSERT(msg.method == SSDP_METHOD_NOTIFY);
+	SELFTEST_ASSERT(msg.bFromOpenBk);
+
+	s = "HTTP/1.1 200 OK\r\nST: ssdp:all\r\n\r\n";
+	DRV_SSDP_ParseMessage(s, strlen(s), &msg);
+	SELFTEST_ASSERT(msg.method == SSDP_METHOD_OTHER);
+	SELFTEST_ASSERT(msg.searchTarget == SSDP_ST_NONE);
+}
+
+static void Test_SSDP_Replies() {
+	const ssdpStats_t *st = DRV_SSDP_GetStats();
+	int i;
+
+	g_timeMs = 100000;
+	Test_SSDP_Packet(g_testSearch, 0x0A00A8C0, 5000);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 1);
+	// repeated search from same client is merged
+	Test_SSDP_Packet(g_testSearch, 0x0A00A8C0, 5000);
+	Test_SSDP_Packet(g_testSearch, 0x0A00A8C0, 5000);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 1);
+	SELFTEST_ASSERT(st->repliesMerged == 2);
+	Test_SSDP_Packet(g_testSearch, 0x0A00A8C0, 5001);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 2);
+	// no MAN header, ignored
+	Test_SSDP_Packet("M-SEARCH * HTTP/1.1\r\nST: ssdp:all\r\nMX: 1\r\n\r\n", 0x0B00A8C0, 5000);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 2);
+	SELFTEST_ASSERT(st->searchesReceived == 5);
+
+	// unicast search without MX is answered right away
+	Test_SSDP_Packet("M-SEARCH * HTTP/1.1\r\nST: upnp:rootdevice\r\nMAN: \"ssdp:discover\"\r\n\r\n", 0x0C00A8C0, 5000);
+	DRV_SSDP_SendDueReplies();
+	SELFTEST_ASSERT(st->repliesSent == 1);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 2);
+
+	// others wait below MX
+	g_timeMs += 1999;
+	DRV_SSDP_SendDueReplies();
+	g_timeMs += 1;
+	DRV_SSDP_SendDueReplies();
+	SELFTEST_ASSERT(st->repliesSent == 3);
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 0);
+
+	// flood of clients is bounded
+	for (i = 0; i < 12; i++) {
+		Test_SSDP_Packet(g_testSearch, 0x0A00A8C0 + (i << 24), 5000);
+	}
+	SELFTEST_ASSERT(DRV_SSDP_GetPendingReplies() == 8);
+	SELFTEST_ASSERT(st->repliesDropped == 4);
+	g_timeMs += 2000;
+	DRV_SSDP_SendDueReplies();
+	SELFTEST_ASSERT(st->repliesSent == 11);
+}
+
+static void Test_SSDP_Peers() {
+	const char *notify = "NOTIFY * HTTP/1.1\r\nSERVER: OpenBk\r\nHOST: 239.255.255.250:1900\r\n\r\n";
+	int i;
+
+	// some other UPnP device is not a peer
+	Test_SSDP_Packet("NOTIFY * HTTP/1.1\r\nSERVER: Linux UPnP/1.0\r\n\r\n", 0x0100A8C0, 1900);
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 0);
+
+	// addresses differing only in last byte, table is bounded to 40
+	for (i = 1; i <= 50; i++) {
+		Test_SSDP_Packet(notify, 0x0000A8C0 + (i << 24), 1900);
+	}
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 40);
+	// known peer is refreshed, not added again
+	Test_SSDP_Packet(notify, 0x0100A8C0, 1900);
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 40);
+
+	for (i = 0; i < 30; i++) {
+		DRV_SSDP_RunEverySecond();
+	}
+	// every second one keeps announcing
+	for (i = 2; i <= 40; i += 2) {
+		Test_SSDP_Packet(notify, 0x0000A8C0 + (i << 24), 1900);
+	}
+	for (i = 0; i < 31; i++) {
+		DRV_SSDP_RunEverySecond();
+	}
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 20);
+	// remaining entries are still found after removals shifted them
+	for (i = 2; i <= 40; i += 2) {
+		Test_SSDP_Packet(notify, 0x0000A8C0 + (i << 24), 1900);
+	}
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 20);
+	Test_SSDP_Packet(notify, 0x0300A8C0, 1900);
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 21);
+	for (i = 0; i < 61; i++) {
+		DRV_SSDP_RunEverySecond();
+	}
+	SELFTEST_ASSERT(DRV_SSDP_GetPeersCount() == 0);
+}
+
+void Test_SSDP() {
+	SIM_ClearOBK(0);
+	// driver is not started, no socket, just the packet handling
+	DRV_SSDP_Shutdown();
+
+	Test_SSDP_Parse();
+	Test_SSDP_Replies();
+	Test_SSDP_Peers();
+
+	DRV_SSDP_Shutdown();
+}
+
+#endif
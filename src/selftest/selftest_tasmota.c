@@ -648,6 +648,96 @@ void Test_Tasmota_Backlog() {
 	Sim_RunMiliseconds(500, false);
 	SELFTEST_ASSERT_CHANNEL(1, 567);
 }
+static char g_snapshotReply[4096];
+static int g_snapshotReplyLen;
+
+static int Test_Tasmota_SnapshotPrinter(void *userData, const char *fmt, ...) {
+	va_list argList;
+	char tmp[256];
+
+	memset(tmp, 0, sizeof(tmp));
+	va_start(argList, fmt);
+	vsnprintf(tmp, 255, fmt, argList);
+	va_end(argList);
+	strcpy_safe(g_snapshotReply + g_snapshotReplyLen, tmp, sizeof(g_snapshotReply) - g_snapshotReplyLen);
+	g_snapshotReplyLen = strlen(g_snapshotReply);
+	return 0;
+}
+static const char *Test_Tasmota_SnapshotReply(const char *cmd, const char *arg) {
+	g_snapshotReply[0] = 0;
+	g_snapshotReplyLen = 0;
+	JSON_ProcessCommandReply(cmd, arg, 0, Test_Tasmota_SnapshotPrinter, COMMAND_FLAG_SOURCE_HTTP);
+	return g_snapshotReply;
+}
+void Test_Tasmota_JSONSnapshot() {
+	char fresh[sizeof(g_snapshotReply)];
+	int hits, misses, prevHits, prevMisses;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	PIN_SetPinRoleForPinIndex(10, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(10, 2);
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 0.26 60 50.10 0", 0);
+	Sim_RunSeconds(2, false);
+
+	// reference output built without cache
+	CMD_ExecuteCommand("JSONSnapshot 0", 0);
+	strcpy_safe(fresh, Test_Tasmota_SnapshotReply("STATUS", "8"), sizeof(fresh));
+	SELFTEST_ASSERT(strstr(fresh, "\"ENERGY\":") != 0);
+	CMD_ExecuteCommand("JSONSnapshot 1", 0);
+
+	// first poll builds the section, next ones replay the same bytes
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_SNS, &prevHits, &prevMisses);
+	SELFTEST_ASSERT(!strcmp(Test_Tasmota_SnapshotReply("STATUS", "8"), fresh));
+	SELFTEST_ASSERT(!strcmp(Test_Tasmota_SnapshotReply("STATUS", "10"), fresh));
+	SELFTEST_ASSERT(!strcmp(Test_Tasmota_SnapshotReply("STATUS", "8"), fresh));
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_SNS, &hits, &misses);
+	SELFTEST_ASSERT(misses == prevMisses + 1);
+	SELFTEST_ASSERT(hits == prevHits + 2);
+
+	// new energy reading is visible on next poll
+	CMD_ExecuteCommand("SetupTestPower 240 0.31 70 49.99 0", 0);
+	Sim_RunSeconds(2, false);
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS%208");
+	SELFTEST_ASSERT_JSON_VALUE_FLOAT_NESTED2("StatusSNS", "ENERGY", "Voltage", 240);
+	SELFTEST_ASSERT_JSON_VALUE_FLOAT_NESTED2("StatusSNS", "ENERGY", "Power", 70.0f);
+
+	// energy readings do not rebuild POWER
+	Test_Tasmota_SnapshotReply("POWER", "");
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_POWER, &prevHits, &prevMisses);
+	Sim_RunSeconds(2, false);
+	Test_Tasmota_SnapshotReply("POWER", "");
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_POWER, &hits, &misses);
+	SELFTEST_ASSERT(misses == prevMisses);
+	SELFTEST_ASSERT(hits == prevHits + 1);
+
+	// relay toggle is visible in POWER and STATE
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	SELFTEST_ASSERT(strstr(Test_Tasmota_SnapshotReply("POWER", ""), "\"POWER2\":\"OFF\"") != 0);
+	SELFTEST_ASSERT(strstr(Test_Tasmota_SnapshotReply("STATE", ""), "\"POWER2\":\"OFF\"") != 0);
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_POWER, &prevHits, &prevMisses);
+	CMD_ExecuteCommand("setChannel 2 1", 0);
+	SELFTEST_ASSERT(strstr(Test_Tasmota_SnapshotReply("STATE", ""), "\"POWER2\":\"ON\"") != 0);
+	SELFTEST_ASSERT(strstr(Test_Tasmota_SnapshotReply("POWER", ""), "\"POWER2\":\"ON\"") != 0);
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_POWER, &hits, &misses);
+	SELFTEST_ASSERT(misses == prevMisses + 1);
+	SELFTEST_ASSERT(hits == prevHits + 1);
+
+	// config change without a save is caught too
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_NET, &prevHits, &prevMisses);
+	Test_Tasmota_SnapshotReply("STATUS", "5");
+	CFG_SetShortDeviceName("snapshotTest");
+	SELFTEST_ASSERT(strstr(Test_Tasmota_SnapshotReply("STATUS", "5"), "\"Hostname\":\"snapshotTest\"") != 0);
+	Test_Tasmota_SnapshotReply("STATUS", "5");
+	JSON_GetSnapshotStats(JSON_SNAPSHOT_NET, &hits, &misses);
+	SELFTEST_ASSERT(misses == prevMisses + 2);
+	SELFTEST_ASSERT(hits == prevHits + 1);
+
+	CMD_ExecuteCommand("JSONSnapshot", 0);
+	CMD_ExecuteCommand("stopDriver TESTPOWER", 0);
+}
 void Test_Tasmota() {
 	Test_Tasmota_MQTT_Switch();
 	Test_Tasmota_MQTT_Switch_Double();
@@ -655,5 +745,6 @@ void Test_Tasmota() {
 	Test_Tasmota_MQTT_RGBCW();
 #endif
 	Test_Tasmota_Backlog();
+	Test_Tasmota_JSONSnapshot();
 }
 #endif
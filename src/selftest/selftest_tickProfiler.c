@@ -0,0 +1,83 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../tick_profiler.h"
+
+void Test_TickProfiler() {
+	int slot, ssdp, i;
+	unsigned int ticks;
+	const tickProfSlot_t *s;
+
+	SIM_ClearOBK(0);
+
+	slot = TickProf_GetSlotFor("TestSlot", TICKPROF_KIND_QUICK);
+	SELFTEST_ASSERT(slot >= TICKPROF_FIXED_SLOTS);
+	SELFTEST_ASSERT(TickProf_GetSlotFor("TestSlot", TICKPROF_KIND_QUICK) == slot);
+	SELFTEST_ASSERT(TickProf_GetSlotFor("TestSlot", TICKPROF_KIND_SECOND) != slot);
+
+	// 99% fast, 1% slow
+	for (i = 0; i < 990; i++) {
+		TickProf_Add(slot, 100);
+	}
+	for (i = 0; i < 10; i++) {
+		TickProf_Add(slot, 20000);
+	}
+	s = TickProf_GetSlot(slot);
+	SELFTEST_ASSERT(s->count == 1000);
+	SELFTEST_ASSERT(s->minUs == 100);
+	SELFTEST_ASSERT(s->maxUs == 20000);
+	SELFTEST_ASSERT(s->overruns == 0);
+	SELFTEST_ASSERT(s->totalUs / s->count == 299);
+	// 100 us is in 96..127 bucket
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 50) == 127);
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 99) == 127);
+	// capped by max
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 100) == 20000);
+	for (i = 0; i < 20; i++) {
+		TickProf_Add(slot, 20000);
+	}
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 99) == 20000);
+	// longer than quick tick period
+	TickProf_Add(slot, 30000);
+	SELFTEST_ASSERT(s->overruns == 1);
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 99) == 24575);
+	SELFTEST_ASSERT(s->maxUs == 30000);
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 100) == 30000);
+
+	// histogram counters saturate by halving, percentiles stay right
+	slot = TickProf_GetSlotFor("TestSlot", TICKPROF_KIND_SECOND);
+	for (i = 0; i < 70000; i++) {
+		TickProf_Add(slot, 5);
+	}
+	TickProf_Add(slot, 1000);
+	SELFTEST_ASSERT(TickProf_GetSlot(slot)->count == 70001);
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 99) == 5);
+	SELFTEST_ASSERT(TickProf_GetPercentile(slot, 100) == 1000);
+
+	// main loop and drivers are measured
+	CMD_ExecuteCommand("startDriver SSDP", 0);
+	ticks = TickProf_GetSlot(TICKPROF_QUICKTICK)->count;
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT(TickProf_GetSlot(TICKPROF_QUICKTICK)->count == ticks + 100);
+	ssdp = TickProf_GetSlotFor("SSDP", TICKPROF_KIND_QUICK);
+	SELFTEST_ASSERT(TickProf_GetSlot(ssdp)->count >= 100);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(TickProf_GetSlot(TICKPROF_EVERYSECOND)->count > 0);
+	SELFTEST_ASSERT(TickProf_GetSlot(TickProf_GetSlotFor("SSDP", TICKPROF_KIND_SECOND))->count > 0);
+
+	Test_FakeHTTPClientPacket_GET("api/tickprofile");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"name\":\"QuickTick\",\"kind\":\"quick\"");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"name\":\"SSDP\",\"kind\":\"second\"");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("{\"name\":\"TestSlot\",\"kind\":\"quick\",\"count\":1021,\"min\":100,");
+	// p99 falls in 16384..24575 bucket now
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"p99\":24575,\"max\":30000,\"overruns\":1}");
+
+	CMD_ExecuteCommand("tickProfile", 0);
+	CMD_ExecuteCommand("tickProfile reset", 0);
+	SELFTEST_ASSERT(TickProf_GetSlot(ssdp)->count == 0);
+	SELFTEST_ASSERT(TickProf_GetSlot(TICKPROF_QUICKTICK)->count == 0);
+
+	CMD_ExecuteCommand("stopDriver SSDP", 0);
+}
+
+#endif
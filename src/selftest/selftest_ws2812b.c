@@ -13,6 +13,8 @@ bool Strip_VerifyPixel5(uint32_t pixel, byte r, byte g, byte b, byte c, byte w);
 
 
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push);
+void Strip_GetPixel(uint32_t pixel, byte *dst);
+int PixelAnim_GetFrameCount();
 
 void Test_DMX_RGB() {
 	// reset whole device
@@ -600,6 +602,80 @@ void Test_WS2812B_misc() {
 
 }
 
+void Test_PixelAnim() {
+#if ENABLE_LED_BASIC
+	char cmd[16];
+	byte raw[5];
+	int i, lit, frames;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("startDriver SM16703P", 0);
+	CMD_ExecuteCommand("SM16703P_Init 500 GRB", 0);
+	CMD_ExecuteCommand("startDriver PixelAnim", 0);
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	CMD_ExecuteCommand("led_dimmer 100", 0);
+	CMD_ExecuteCommand("led_basecolor_rgb FF8000", 0);
+	// Theater Chase, every third pixel gets base color
+	CMD_ExecuteCommand("Anim 4", 0);
+	frames = PixelAnim_GetFrameCount();
+	while (PixelAnim_GetFrameCount() == frames) {
+		Sim_RunFrames(1, false);
+	}
+	// channel order is applied when frame is sent, up to the last pixel
+	lit = -1;
+	for (i = 0; i < 3; i++) {
+		Strip_GetPixel(i, raw);
+		if (raw[0] == 0x80 && raw[1] == 0xFF && raw[2] == 0)
+			lit = i;
+	}
+	SELFTEST_ASSERT(lit != -1);
+	for (i = lit; i < 500; i += 3) {
+		SELFTEST_ASSERT_PIXEL(i, 0x80, 0xFF, 0);
+	}
+
+	// brightness is applied to whole frame
+	CMD_ExecuteCommand("led_dimmer 50", 0);
+	frames = PixelAnim_GetFrameCount();
+	while (PixelAnim_GetFrameCount() == frames) {
+		Sim_RunFrames(1, false);
+	}
+	for (i = 0; i < 3; i++) {
+		Strip_GetPixel(i, raw);
+		SELFTEST_ASSERT(raw[1] <= 0x80);
+	}
+	CMD_ExecuteCommand("led_dimmer 100", 0);
+
+	// frames come at fixed rate, not on every quick tick
+	CMD_ExecuteCommand("AnimFPS 20", 0);
+	Sim_RunFrames(1, false);
+	frames = PixelAnim_GetFrameCount();
+	Sim_RunSeconds(1, false);
+	frames = PixelAnim_GetFrameCount() - frames;
+	SELFTEST_ASSERT(frames >= 19 && frames <= 21);
+	CMD_ExecuteCommand("AnimSpeed 2", 0);
+	frames = PixelAnim_GetFrameCount();
+	Sim_RunSeconds(1, false);
+	frames = PixelAnim_GetFrameCount() - frames;
+	SELFTEST_ASSERT(frames >= 9 && frames <= 11);
+	CMD_ExecuteCommand("AnimSpeed 0", 0);
+	CMD_ExecuteCommand("AnimFPS 30", 0);
+
+	// every effect runs on long strip
+	for (i = 0; i < 6; i++) {
+		snprintf(cmd, sizeof(cmd), "Anim %i", i);
+		CMD_ExecuteCommand(cmd, 0);
+		Sim_RunFrames(10, false);
+	}
+	CMD_ExecuteCommand("led_enableAll 0", 0);
+	Sim_RunFrames(5, false);
+	for (i = 0; i < 500; i++) {
+		SELFTEST_ASSERT_PIXEL(i, 0, 0, 0);
+	}
+#endif
+}
+
 void Test_LEDstrips() {
 	Test_WS2812B_misc();
 	Test_DMX_RGB();
@@ -609,6 +685,7 @@ void Test_LEDstrips() {
 	Test_WS2812B();
 	Test_WS2812B_and_PWM_CW();
 	Test_WS2812B_and_PWM_White();
+	Test_PixelAnim();
 }
 
 #endif
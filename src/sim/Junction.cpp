@@ -6,6 +6,8 @@ CJunction::~CJunction() {
 		CJunction *oj = linked[i];
 		oj->unlink(this);
 	}
+	CSolver::forgetJunction(this);
+	CSolver::markTopologyChanged();
 }
 CShape *CJunction::cloneShape() {
 	CJunction *r = new CJunction();
@@ -29,6 +31,7 @@ bool CJunction::isWireJunction() const {
 }
 void CJunction::unlink(class CJunction *o) {
 	linked.erase(std::remove(linked.begin(), linked.end(), o), linked.end());
+	CSolver::markTopologyChanged();
 }
 bool CJunction::hasLinkedOnlyWires() const {
 	for (int i = 0; i < linked.size(); i++) {
@@ -4,6 +4,7 @@
 #include "sim_local.h"
 #include "Shape.h"
 #include "Coord.h"
+#include "Solver.h"
 
 class CEdge : public CShape {
 	class CJunction *a, *b;
@@ -36,9 +37,13 @@ class CJunction : public CShape {
 	int visitCount;
 	bool bCurrentSource;
 	int depth;
+	int solverIndex;
+	bool bChangeQueued;
 public:
 	CJunction() {
 		depth = 0;
+		solverIndex = -1;
+		bChangeQueued = false;
 	}
 	CJunction(float _x, float _y, const char *s, int gpio = -1) {
 		this->setPosition(_x, _y);
@@ -49,11 +54,16 @@ public:
 		this->visitCount = 0;
 		this->bCurrentSource = false;
 		this->depth = 0;
+		this->solverIndex = -1;
+		this->bChangeQueued = false;
 	}
 	virtual ~CJunction();
 	virtual CShape *cloneShape();
 	void setCurrentSource(bool b) {
+		if (bCurrentSource == b)
+			return;
 		bCurrentSource = b;
+		CSolver::markJunctionChanged(this);
 	}
 	bool isCurrentSource() const {
 		return bCurrentSource;
@@ -83,17 +93,38 @@ public:
 		this->depth = d;
 	}
 	void setVoltage(float f) {
+		if (voltage == f)
+			return;
 		voltage = f;
+		CSolver::markJunctionChanged(this);
 	}
 	void setDuty(float f) {
+		if (duty == f)
+			return;
 		duty = f;
+		CSolver::markJunctionChanged(this);
 	}
 	void setVisitCount(int i) {
+		if (visitCount == i)
+			return;
 		visitCount = i;
+		CSolver::markJunctionChanged(this);
 	}
 	int getVisitCount() const {
 		return visitCount;
 	}
+	int getSolverIndex() const {
+		return solverIndex;
+	}
+	void setSolverIndex(int i) {
+		solverIndex = i;
+	}
+	bool isChangeQueued() const {
+		return bChangeQueued;
+	}
+	void setChangeQueued(bool b) {
+		bChangeQueued = b;
+	}
 	bool hasVoltage(float f) const {
 		if (visitCount <= 0)
 			return false;
@@ -114,6 +145,7 @@ public:
 	virtual bool isWireJunction() const;
 	void clearLinks() {
 		linked.clear();
+		CSolver::markTopologyChanged();
 	}
 	int getLinksCount() const {
 		return linked.size();
@@ -126,6 +158,7 @@ public:
 	}
 	void addEdge(CEdge *ed) {
 		myEdges.push_back(ed);
+		CSolver::markTopologyChanged();
 	}
 	class CEdge *getEdge(int i) {
 		return myEdges[i];
@@ -137,6 +170,7 @@ public:
 	virtual void translate(const Coord &o);
 	void addLink(CJunction *j) {
 		linked.add_unique(j);
+		CSolver::markTopologyChanged();
 	}
 	virtual void drawShape();
 };
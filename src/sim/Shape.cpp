@@ -8,6 +8,7 @@
 #include "Junction.h"
 #include "Controller_Base.h"
 #include "Controller_Button.h"
+#include "Solver.h"
 
 CShape::~CShape() {
 	for (unsigned int i = 0; i < shapes.size(); i++) {
@@ -156,6 +157,7 @@ void CShape::setController(CControllerBase *c) {
 	if (controller) {
 		controller->baseShape = this;
 	}
+	CSolver::markTopologyChanged();
 }
 Coord CShape::getAbsPosition() const {
 	Coord ofs = this->getPosition();
@@ -6,6 +6,7 @@
 #include "Text.h"
 #include "Simulator.h"
 #include "PrefabManager.h"
+#include "Solver.h"
 
 
 void CSimulation::removeJunctions(class CShape *s) {
@@ -26,6 +27,7 @@ void CSimulation::removeJunctions(class CShape *s) {
 }
 void CSimulation::removeJunction(class CJunction *ju) {
 	junctions.remove(ju);
+	CSolver::markTopologyChanged();
 }
 float CSimulation::drawTextStats(float h) {
 	h = drawText(NULL, 10, h, "Objects %i, wires %i", objects.size(), wires.size());
@@ -95,6 +97,7 @@ bool CSimulation::isJunctionOnList(class CJunction *ju) {
 }
 void CSimulation::registerJunction(class CJunction *ju) {
 	junctions.push_back(ju);
+	CSolver::markTopologyChanged();
 }
 void CSimulation::registerJunctions(class CWire *w) {
 	for (int i = 0; i < w->getJunctionsCount(); i++) {
@@ -200,6 +200,7 @@ void CSimulator::drawWindow() {
 	h = drawText(NULL, 10, h, "OpenBeken Simulator");
 	if (sim != 0) {
 		h = sim->drawTextStats(h);
+		h = solver->drawTextStats(h);
 	}
 	if (activeTool != 0) {
 		h = drawText(NULL, 10, h, "Active Tool: %s", activeTool->getName());
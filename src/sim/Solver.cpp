@@ -3,28 +3,328 @@
 #include "Junction.h"
 #include "Simulation.h"
 #include "Controller_Base.h"
+#include "sim_nets.h"
 
-void CSolver::solveVoltages() {
+// selftests are C, only the failure report is needed here
+extern "C" {
+	void SelfTest_Failed(const char *file, const char *function, int line, const char *exp);
+}
+#define SOLVER_ASSERT(expr) \
+	if (!(expr)) \
+	SelfTest_Failed(__FILE__, __FUNCTION__, __LINE__, #expr)
+
+#define SOLVER_FLAG_VDD		1
+#define SOLVER_FLAG_GND		2
+
+int CSolver::topologyVersion = 0;
+std::vector<class CJunction*> CSolver::changedJunctions;
+bool CSolver::bWriting = false;
+
+static inline bool bitGet(const std::vector<u32> &bits, int i) {
+	return (bits[i >> 5] >> (i & 31)) & 1;
+}
+static inline void bitSet(std::vector<u32> &bits, int i) {
+	bits[i >> 5] |= 1u << (i & 31);
+}
+static inline void bitClear(std::vector<u32> &bits, int i) {
+	bits[i >> 5] &= ~(1u << (i & 31));
+}
+
+void CSolver::markJunctionChanged(class CJunction *ju) {
+	if (bWriting || ju->isChangeQueued())
+		return;
+	ju->setChangeQueued(true);
+	changedJunctions.push_back(ju);
+}
+void CSolver::forgetJunction(class CJunction *ju) {
+	if (ju->isChangeQueued() == false)
+		return;
+	changedJunctions.erase(std::remove(changedJunctions.begin(), changedJunctions.end(), ju), changedJunctions.end());
+	ju->setChangeQueued(false);
+}
+CSolver::CSolver() {
+	sim = 0;
+	builtFor = 0;
+	builtVersion = -1;
+	bFullSolvePending = true;
+	netsCount = 0;
+	statNets = 0;
+	statComponents = 0;
+	statFloodedNets = 0;
+	statFullRebuilds = 0;
+}
+int CSolver::getJunctionIndex(class CJunction *ju) {
+	if (ju == 0)
+		return -1;
+	int idx = ju->getSolverIndex();
+	if (idx < 0 || idx >= (int)junctions.size())
+		return -1;
+	if (junctions[idx] != ju)
+		return -1;
+	return idx;
+}
+void CSolver::rebuildTopology() {
+	junctions.clear();
 	for (int i = 0; i < sim->getJunctionsCount(); i++) {
 		CJunction *ju = sim->getJunction(i);
+		// same junction may be registered twice
+		if (getJunctionIndex(ju) != -1)
+			continue;
+		ju->setSolverIndex(junctions.size());
+		junctions.push_back(ju);
+	}
+	int n = junctions.size();
+	junctionFlags.assign(n, 0);
+	for (int i = 0; i < n; i++) {
+		CJunction *ju = junctions[i];
+		if (ju->hasName("VDD"))
+			junctionFlags[i] = SOLVER_FLAG_VDD;
+		else if (ju->hasName("GND"))
+			junctionFlags[i] = SOLVER_FLAG_GND;
+	}
+	pairs.clear();
+	for (int i = 0; i < n; i++) {
+		CJunction *ju = junctions[i];
+		for (int j = 0; j < ju->getLinksCount(); j++) {
+			int o = getJunctionIndex(ju->getLink(j));
+			if (o != -1) {
+				pairs.push_back(i);
+				pairs.push_back(o);
+			}
+		}
+		for (int j = 0; j < ju->getEdgesCount(); j++) {
+			int o = getJunctionIndex(ju->getEdge(j)->getOther(ju));
+			if (o != -1) {
+				pairs.push_back(i);
+				pairs.push_back(o);
+			}
+		}
+	}
+	// number nets and list their junctions
+	unionParent.resize(n);
+	netOf.resize(n);
+	netsCount = SIM_Nets_Group(n, pairs.data(), pairs.size() / 2, unionParent.data(), netOf.data());
+	netJunctionStart.resize(netsCount + 1);
+	netJunctions.resize(n);
+	std::vector<int> fill(netsCount);
+	SIM_Nets_List(n, netOf.data(), netsCount, netJunctionStart.data(), netJunctions.data(), fill.data());
+	// every junction owned by a controller may let current through
+	gates.clear();
+	for (int i = 0; i < n; i++) {
+		CControllerBase *cntr = junctions[i]->findOwnerController_r();
+		if (cntr == 0)
+			continue;
+		SolverGate g;
+		g.junction = i;
+		g.cntr = cntr;
+		g.other = -1;
+		gates.push_back(g);
+	}
+	std::vector<int> gateNet(gates.size());
+	for (int i = 0; i < (int)gates.size(); i++)
+		gateNet[i] = netOf[gates[i].junction];
+	netGateStart.resize(netsCount + 1);
+	netGates.resize(gates.size());
+	SIM_Nets_List(gates.size(), gateNet.data(), netsCount, netGateStart.data(), netGates.data(), fill.data());
+	gateOtherNet.assign(gates.size(), -1);
+
+	compOf.assign(netsCount, 0);
+	netClaimed.assign((netsCount + 31) / 32, 0);
+	netVoltage.assign(netsCount, -1);
+	netDuty.assign(netsCount, -1);
+	netDepth.assign(netsCount, 0);
+	queue.resize(netsCount);
+	solved.resize(n);
+
+	statNets = netsCount;
+	statFullRebuilds++;
+	builtFor = sim;
+	builtVersion = topologyVersion;
+	bFullSolvePending = true;
+}
+void CSolver::rebuildComponents() {
+	pairs.clear();
+	for (int i = 0; i < (int)gates.size(); i++) {
+		if (gateOtherNet[i] != -1) {
+			pairs.push_back(netOf[gates[i].junction]);
+			pairs.push_back(gateOtherNet[i]);
+		}
+	}
+	unionParent.resize(netsCount);
+	statComponents = SIM_Nets_Group(netsCount, pairs.data(), pairs.size() / 2, unionParent.data(), compOf.data());
+	compNetStart.resize(statComponents + 1);
+	compNets.resize(netsCount);
+	std::vector<int> fill(statComponents);
+	SIM_Nets_List(netsCount, compOf.data(), statComponents, compNetStart.data(), compNets.data(), fill.data());
+	dirtyComps.assign((statComponents + 31) / 32, 0);
+	dirtyCompList.clear();
+}
+void CSolver::markComponentDirty(int comp) {
+	if (bitGet(dirtyComps, comp))
+		return;
+	bitSet(dirtyComps, comp);
+	dirtyCompList.push_back(comp);
+}
+void CSolver::captureJunction(int i) {
+	CJunction *ju = junctions[i];
+	SolverJunctionState &s = solved[i];
+	s.voltage = ju->getVoltage();
+	s.duty = ju->getDuty();
+	s.visitCount = ju->getVisitCount();
+	s.bCurrentSource = ju->isCurrentSource();
+}
+// puts back what a full flood would give to a passive junction
+void CSolver::restoreJunction(int i) {
+	CJunction *ju = junctions[i];
+	int net = netOf[i];
+	if (bitGet(netClaimed, net)) {
+		ju->setVoltage(netVoltage[net]);
+		ju->setDuty(netDuty[net]);
+		ju->setDepth(netDepth[net]);
+		ju->setVisitCount(1);
+	}
+	else {
+		ju->setVoltage(-1);
+		ju->setDuty(-1);
+		ju->setVisitCount(0);
+	}
+	captureJunction(i);
+}
+void CSolver::claimNet(int net, float voltage, float duty) {
+	int depth = netDepth[net];
+
+	netVoltage[net] = voltage;
+	netDuty[net] = duty;
+	for (int i = netJunctionStart[net]; i < netJunctionStart[net + 1]; i++) {
+		CJunction *ju = junctions[netJunctions[i]];
+		ju->setVisitCount(1);
+		ju->setVoltage(voltage);
+		ju->setDuty(duty);
+		ju->setDepth(depth);
+	}
+	statFloodedNets++;
+}
+// Breadth first, so depth is the number of passable controllers crossed
+void CSolver::floodNets(int startNet, float voltage, float duty) {
+	int count = SIM_Nets_Flood(startNet, netGateStart.data(), netGates.data(), gateOtherNet.data(),
+		netClaimed.data(), netDepth.data(), queue.data());
+	for (int k = 0; k < count; k++)
+		claimNet(queue[k], voltage, duty);
+}
+void CSolver::solveVoltages() {
+	if (sim == 0)
+		return;
+	if (builtFor != sim || builtVersion != topologyVersion) {
+		rebuildTopology();
+	}
+	bool bFull = bFullSolvePending;
+	bool bGatesChanged = bFull;
+	int n = junctions.size();
+
+	bWriting = true;
+	// gates that opened or closed since last frame
+	dirtyNets.clear();
+	for (int i = 0; i < (int)gates.size(); i++) {
+		SolverGate &g = gates[i];
+		int other = getJunctionIndex(g.cntr->findOtherJunctionIfPassable(junctions[g.junction]));
+		if (other == g.other)
+			continue;
+		dirtyNets.push_back(netOf[g.junction]);
+		if (g.other != -1)
+			dirtyNets.push_back(netOf[g.other]);
+		g.other = other;
+		gateOtherNet[i] = other == -1 ? -1 : netOf[other];
+		bGatesChanged = true;
+	}
+	if (bGatesChanged) {
+		rebuildComponents();
+	}
+	else {
+		for (int i = 0; i < (int)dirtyCompList.size(); i++)
+			bitClear(dirtyComps, dirtyCompList[i]);
+		dirtyCompList.clear();
+	}
+	if (bFull) {
+		for (int i = 0; i < statComponents; i++)
+			markComponentDirty(i);
+	}
+	for (int i = 0; i < (int)dirtyNets.size(); i++) {
+		markComponentDirty(compOf[dirtyNets[i]]);
+	}
+	// junctions changed by controllers or pins since last flood
+	for (int j = 0; j < (int)changedJunctions.size(); j++) {
+		CJunction *ju = changedJunctions[j];
+		ju->setChangeQueued(false);
+		int i = getJunctionIndex(ju);
+		if (i == -1 || bFull)
+			continue;
+		const SolverJunctionState &s = solved[i];
+		// written and put back within one frame
+		if (ju->isCurrentSource() == s.bCurrentSource && ju->getVoltage() == s.voltage
+			&& ju->getDuty() == s.duty && ju->getVisitCount() == s.visitCount)
+			continue;
+		int comp = compOf[netOf[i]];
+		if (bitGet(dirtyComps, comp))
+			continue;
+		if (ju->isCurrentSource() || s.bCurrentSource) {
+			// source changed, whole component must be flooded again
+			markComponentDirty(comp);
+		}
+		else {
+			restoreJunction(i);
+		}
+	}
+	changedJunctions.clear();
+	// flood dirty components from their sources, in simulation order
+	statFloodedNets = 0;
+	dirtyJunctions.clear();
+	if (bFull) {
+		for (int i = 0; i < n; i++)
+			dirtyJunctions.push_back(i);
+		std::fill(netClaimed.begin(), netClaimed.end(), 0);
+	}
+	else {
+		for (int c = 0; c < (int)dirtyCompList.size(); c++) {
+			int comp = dirtyCompList[c];
+			for (int k = compNetStart[comp]; k < compNetStart[comp + 1]; k++) {
+				int net = compNets[k];
+				bitClear(netClaimed, net);
+				for (int i = netJunctionStart[net]; i < netJunctionStart[net + 1]; i++)
+					dirtyJunctions.push_back(netJunctions[i]);
+			}
+		}
+		std::sort(dirtyJunctions.begin(), dirtyJunctions.end());
+	}
+	for (int k = 0; k < (int)dirtyJunctions.size(); k++) {
+		CJunction *ju = junctions[dirtyJunctions[k]];
 		if (ju->isCurrentSource() == false) {
 			ju->setVoltage(-1);
 			ju->setDuty(-1);
 		}
 		ju->setVisitCount(0);
 	}
-	for (int i = 0; i < sim->getJunctionsCount(); i++) {
-		CJunction *ju = sim->getJunction(i);
-		if (ju->hasName("VDD")) {
-			floodJunctions(ju, 3.3f, 100.0f);
+	for (int k = 0; k < (int)dirtyJunctions.size(); k++) {
+		int i = dirtyJunctions[k];
+		int net = netOf[i];
+		if (bitGet(netClaimed, net))
+			continue;
+		CJunction *ju = junctions[i];
+		if (junctionFlags[i] == SOLVER_FLAG_VDD) {
+			floodNets(net, 3.3f, 100.0f);
 		}
-		else if (ju->hasName("GND")) {
-			floodJunctions(ju, 0, 100.0f);
+		else if (junctionFlags[i] == SOLVER_FLAG_GND) {
+			floodNets(net, 0, 100.0f);
 		}
 		else if (ju->isCurrentSource()) {
-			floodJunctions(ju, ju->getVoltage(), ju->getDuty());
+			floodNets(net, ju->getVoltage(), ju->getDuty());
 		}
 	}
+	for (int k = 0; k < (int)dirtyJunctions.size(); k++) {
+		captureJunction(dirtyJunctions[k]);
+	}
+	bFullSolvePending = false;
+	bWriting = false;
+
 	for (int i = 0; i < sim->getObjectsCount(); i++) {
 		CShape *s = sim->getObject(i);
 		CControllerBase *cb = s->getController();
@@ -33,62 +333,82 @@ void CSolver::solveVoltages() {
 		}
 	}
 }
+// Wires and links only, passable controllers are not followed
 bool CSolver::hasPath(class CJunction *a, class CJunction *b) {
-	TArray<CJunction*> toVisit;
-	TArray<CJunction*> checked;
-	toVisit.push_back(a);
-	while (toVisit.size()) {
-		CJunction *j = toVisit.pop();
-		checked.push_back(j);
-		for (int i = 0; i < j->getEdgesCount(); i++) {
-			CJunction *other = j->getEdge(i)->getOther(j);
-			if (other == 0)
-				continue;
-			if (checked.contains(other))
-				continue;
-			if (other == b)
-				return true;
-			toVisit.push_back(other);
-		}
-		for (int i = 0; i < j->getLinksCount(); i++) {
-			CJunction *other = j->getLink(i);
-			if (other == 0)
-				continue;
-			if (checked.contains(other))
-				continue;
-			if (other == b)
-				return true;
-			toVisit.push_back(other);
-		}
+	if (a == 0 || b == 0)
+		return false;
+	if (a == b)
+		return true;
+	if (sim == 0)
+		return false;
+	if (builtFor != sim || builtVersion != topologyVersion) {
+		rebuildTopology();
 	}
-	return false;
+	int ia = getJunctionIndex(a);
+	int ib = getJunctionIndex(b);
+	if (ia == -1 || ib == -1)
+		return false;
+	return netOf[ia] == netOf[ib];
 }
-// Idea: count steps to VDD/GND and use it to support multiple objects on line?
-void CSolver::floodJunctions(CJunction *ju, float voltage, float duty, int depth) {
-	if (ju == 0)
-		return;
-	if (ju->getVisitCount() != 0)
-		return;
-	ju->setVisitCount(1);
-	ju->setVoltage(voltage);
-	ju->setDuty(duty);
-	ju->setDepth(depth);
-	for (int i = 0; i < ju->getLinksCount(); i++) {
-		CJunction *other = ju->getLink(i);
-		floodJunctions(other, voltage, duty, depth);
-	}
-	for (int i = 0; i < ju->getEdgesCount(); i++) {
-		CEdge *e = ju->getEdge(i);
-		CJunction *o = e->getOther(ju);
-		floodJunctions(o, voltage, duty, depth);
-	}
-	CControllerBase *cntr = ju->findOwnerController_r();
-	if (cntr != 0) {
-		CJunction *other = cntr->findOtherJunctionIfPassable(ju);
-		if (other) {
-			floodJunctions(other, voltage, duty, depth+1);
-		}
-	}
+float CSolver::drawTextStats(float h) {
+	h = drawText(NULL, 10, h, "Solver: nets %i, components %i, flooded %i, rebuilds %i",
+		statNets, statComponents, statFloodedNets, statFullRebuilds);
+	return h;
+}
+
+// Net graph is tested headless by Test_Sim_Solver, this one checks what
+// solver writes to junctions: a pin driven net, a VDD and a lone junction
+extern "C" void Test_Sim_SolverJunctions() {
+	CSimulation *s = new CSimulation();
+	CShape *o = new CShape();
+	CJunction *src = o->addJunction(0, 0, "");
+	CJunction *wire = o->addJunction(10, 0, "");
+	CJunction *vdd = o->addJunction(20, 0, "VDD");
+	CJunction *lone = o->addJunction(30, 0, "");
+	src->addLink(wire);
+	s->addObject(o);
+
+	CSolver solver;
+	solver.setSimulation(s);
+	solver.solveVoltages();
+	SOLVER_ASSERT(solver.hasPath(src, src));
+	SOLVER_ASSERT(solver.hasPath(src, wire));
+	SOLVER_ASSERT(solver.hasPath(src, lone) == false);
+	SOLVER_ASSERT(vdd->hasVoltage(3.3f));
+	SOLVER_ASSERT(wire->getVisitCount() == 0);
+
+	// nothing changed, nothing flooded
+	solver.solveVoltages();
+	SOLVER_ASSERT(solver.getFloodedNetsCount() == 0);
+
+	// new source floods only its own component
+	src->setCurrentSource(true);
+	src->setVoltage(3.3f);
+	src->setDuty(50);
+	solver.solveVoltages();
+	SOLVER_ASSERT(solver.getFloodedNetsCount() == 1);
+	SOLVER_ASSERT(wire->hasVoltage(3.3f));
+	SOLVER_ASSERT(wire->getDuty() == 50);
+	SOLVER_ASSERT(vdd->hasVoltage(3.3f));
+
+	// passive junction written from outside is put back without a flood
+	lone->setVoltage(1.0f);
+	lone->setVisitCount(1);
+	solver.solveVoltages();
+	SOLVER_ASSERT(solver.getFloodedNetsCount() == 0);
+	SOLVER_ASSERT(lone->getVisitCount() == 0);
+	SOLVER_ASSERT(lone->getVoltage() == -1);
+
+	// source removed, its net is left floating
+	src->setCurrentSource(false);
+	solver.solveVoltages();
+	SOLVER_ASSERT(solver.getFloodedNetsCount() == 0);
+	SOLVER_ASSERT(src->getVisitCount() == 0);
+	SOLVER_ASSERT(wire->getVisitCount() == 0);
+	SOLVER_ASSERT(vdd->hasVoltage(3.3f));
+
+	delete o;
+	delete s;
 }
 
 #endif
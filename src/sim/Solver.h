@@ -3,16 +3,101 @@
 
 #include "sim_local.h"
 
+// Voltages are solved per net (junctions joined by wires and links, found
+// with union-find, see sim_nets.c). Nets joined by passable controllers (buttons, switches)
+// form components, and only components with a changed gate or source are
+// flooded again on a frame. Junctions report their own changes, so a frame
+// where nothing happened costs only the gate checks.
+struct SolverGate {
+	int junction;
+	class CControllerBase *cntr;
+	// index of junction on the other side, or -1 if not passable
+	int other;
+};
+struct SolverJunctionState {
+	float voltage;
+	float duty;
+	int visitCount;
+	bool bCurrentSource;
+};
+
 class CSolver {
 	class CSimulation *sim;
+	class CSimulation *builtFor;
+	// bumped on every link, edge, junction or controller change
+	static int topologyVersion;
+	// junctions written by controllers or pins since the last solve
+	static std::vector<class CJunction*> changedJunctions;
+	// set while the solver writes its own results
+	static bool bWriting;
+	int builtVersion;
+	bool bFullSolvePending;
+
+	// junctions by solver index, in simulation order
+	std::vector<class CJunction*> junctions;
+	std::vector<byte> junctionFlags;
+	std::vector<int> unionParent;
+	std::vector<int> netOf;
+	// CSR lists: junctions of net, gates of net
+	std::vector<int> netJunctionStart;
+	std::vector<int> netJunctions;
+	std::vector<int> netGateStart;
+	std::vector<int> netGates;
+	std::vector<SolverGate> gates;
+	// net on the other side of each gate, -1 if closed
+	std::vector<int> gateOtherNet;
+	// scratch for grouping, pairs (a, b) to join
+	std::vector<int> pairs;
+	int netsCount;
+
+	// components over nets, rebuilt when a gate changes
+	std::vector<int> compOf;
+	// CSR list: nets of component
+	std::vector<int> compNetStart;
+	std::vector<int> compNets;
+	std::vector<u32> dirtyComps;
+	std::vector<int> dirtyCompList;
+	std::vector<int> dirtyNets;
+	std::vector<int> dirtyJunctions;
 
-	void floodJunctions(class CJunction *ju, float voltage, float duty, int depth = 0);
+	// solution of each net and junction state left by the last flood
+	std::vector<u32> netClaimed;
+	std::vector<float> netVoltage;
+	std::vector<float> netDuty;
+	std::vector<int> netDepth;
+	std::vector<SolverJunctionState> solved;
+	std::vector<int> queue;
+
+	// stats
+	int statNets;
+	int statComponents;
+	int statFloodedNets;
+	int statFullRebuilds;
+
+	int getJunctionIndex(class CJunction *ju);
+	void rebuildTopology();
+	void rebuildComponents();
+	void markComponentDirty(int comp);
+	void captureJunction(int i);
+	void restoreJunction(int i);
+	void claimNet(int net, float voltage, float duty);
+	void floodNets(int startNet, float voltage, float duty);
 public:
+	CSolver();
+	static void markTopologyChanged() {
+		topologyVersion++;
+	}
+	static void markJunctionChanged(class CJunction *ju);
+	static void forgetJunction(class CJunction *ju);
 	void setSimulation(class CSimulation *p) {
 		sim = p;
 	}
 	void solveVoltages();
 	bool hasPath(class CJunction *a, class CJunction *b);
+	int getFloodedNetsCount() const {
+		return statFloodedNets;
+	}
+	float drawTextStats(float h);
 };
 
-#endif
\ No newline at end of file
+#endif
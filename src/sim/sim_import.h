@@ -13,6 +13,11 @@ extern "C" {
 	void SIM_SetVoltageOnADCPin(int index, float v);
 	void SIM_SetIntegerValueADCPin(int index, int v);
 	int SIM_GetPWMValue(int index);
+	// square wave on input pin, falling edge every 1/hz seconds, 0 stops it.
+	// Edges are placed in simulated time, SIM_GetTimeUs tells it inside pin ISR.
+	void SIM_SetPinPulseFrequency(int index, float hz);
+	void SIM_RunPinPulses();
+	unsigned int SIM_GetTimeUs();
 	// flash control simulation
 	void SIM_SetupFlashFileReading(const char *flashPath);
 	void SIM_SaveFlashData(const char *flashPath);
@@ -22,6 +27,9 @@ extern "C" {
 	void SIM_ShutdownOBK();
 	void SIM_StartOBK(const char *flashPath);
 	bool SIM_IsFlashModified();
+	int SIM_GetFlashEraseCount();
+	int SIM_GetFlashReadCount();
+	int SIM_GetFlashWriteCount();
 	float SIM_GetDeltaTimeSeconds();
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+#ifdef WINDOWS
+
+#include "sim_nets.h"
+
+#define NETS_BIT_GET(bits, i)	(((bits)[(i) >> 5] >> ((i) & 31)) & 1)
+#define NETS_BIT_SET(bits, i)	((bits)[(i) >> 5] |= 1u << ((i) & 31))
+
+static int SIM_Nets_FindRoot(int *p, int x) {
+	while (p[x] != x) {
+		// path halving
+		p[x] = p[p[x]];
+		x = p[x];
+	}
+	return x;
+}
+
+static void SIM_Nets_Unite(int *p, int a, int b) {
+	a = SIM_Nets_FindRoot(p, a);
+	b = SIM_Nets_FindRoot(p, b);
+	if (a == b)
+		return;
+	// smaller index becomes the root, so it stays stable between rebuilds
+	if (a < b)
+		p[b] = a;
+	else
+		p[a] = b;
+}
+
+int SIM_Nets_Group(int count, const int *pairs, int pairsCount, int *parent, int *groupOf) {
+	int i, r, groups;
+
+	for (i = 0; i < count; i++)
+		parent[i] = i;
+	for (i = 0; i < pairsCount; i++)
+		SIM_Nets_Unite(parent, pairs[i * 2], pairs[i * 2 + 1]);
+	// root is the lowest item, so it is numbered before the rest of its group
+	groups = 0;
+	for (i = 0; i < count; i++) {
+		r = SIM_Nets_FindRoot(parent, i);
+		if (r == i)
+			groupOf[i] = groups++;
+		else
+			groupOf[i] = groupOf[r];
+	}
+	return groups;
+}
+
+void SIM_Nets_List(int count, const int *groupOf, int groups, int *start, int *items, int *fill) {
+	int i;
+
+	for (i = 0; i <= groups; i++)
+		start[i] = 0;
+	for (i = 0; i < count; i++)
+		start[groupOf[i] + 1]++;
+	for (i = 0; i < groups; i++) {
+		start[i + 1] += start[i];
+		fill[i] = start[i];
+	}
+	for (i = 0; i < count; i++)
+		items[fill[groupOf[i]]++] = i;
+}
+
+int SIM_Nets_Flood(int startNet, const int *netGateStart, const int *netGates,
+	const int *gateOtherNet, unsigned int *claimed, int *depth, int *queue) {
+	int head, count, net, on, i;
+
+	NETS_BIT_SET(claimed, startNet);
+	depth[startNet] = 0;
+	queue[0] = startNet;
+	count = 1;
+	for (head = 0; head < count; head++) {
+		net = queue[head];
+		for (i = netGateStart[net]; i < netGateStart[net + 1]; i++) {
+			on = gateOtherNet[netGates[i]];
+			if (on == -1 || NETS_BIT_GET(claimed, on))
+				continue;
+			NETS_BIT_SET(claimed, on);
+			depth[on] = depth[net] + 1;
+			queue[count++] = on;
+		}
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __SIM_NETS_H__
+#define __SIM_NETS_H__
+
+// Graph part of the circuit solver, on plain indices. CSolver feeds it
+// junctions and controllers; kept in C without SDL so the headless
+// simulator builds and tests it too.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Union-find of count items joined by pairsCount pairs (a, b) in pairs.
+// Groups are numbered in order of their lowest item, so numbering is stable
+// between rebuilds. parent is scratch of count ints. Returns groups count.
+int SIM_Nets_Group(int count, const int *pairs, int pairsCount, int *parent, int *groupOf);
+
+// CSR list of items per group: items of group g are items[start[g]] up to
+// items[start[g + 1]], in item order. start holds groups + 1 entries, fill
+// is scratch of groups ints.
+void SIM_Nets_List(int count, const int *groupOf, int groups, int *start, int *items, int *fill);
+
+// Breadth first from startNet over gates of each net (netGateStart/netGates,
+// CSR as above), gateOtherNet is net on the other side of a gate or -1 if
+// closed. Nets already set in claimed bitset are not entered. Claimed nets
+// are left in queue in visit order, depth is number of gates crossed.
+// Returns number of nets claimed.
+int SIM_Nets_Flood(int startNet, const int *netGateStart, const int *netGates,
+	const int *gateOtherNet, unsigned int *claimed, int *depth, int *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,192 @@
+#include "obk_config.h"
+
+#if ENABLE_TICK_PROFILER
+
+#include "new_common.h"
+#include "logging/logging.h"
+#include "cmnds/cmd_public.h"
+#include "quicktick.h"
+#include "tick_profiler.h"
+
+#define TICKPROF_BUDGET_US		(QUICK_TMR_DURATION * 1000)
+
+static tickProfSlot_t g_tickProf[TICKPROF_MAX_SLOTS] = {
+	{ .name = "QuickTick", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "PIN_ticks", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "Scripts", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "Berry", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "RepeatingEvents", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "Drivers", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "UartCmnd", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "MQTT", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "LEDLerp", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "ADC", .kind = TICKPROF_KIND_QUICK },
+	{ .name = "EverySecond", .kind = TICKPROF_KIND_SECOND },
+	{ .name = "MQTT", .kind = TICKPROF_KIND_SECOND },
+	{ .name = "LED", .kind = TICKPROF_KIND_SECOND },
+	{ .name = "Drivers", .kind = TICKPROF_KIND_SECOND },
+	{ .name = "DeviceClock", .kind = TICKPROF_KIND_SECOND },
+	{ .name = "CfgSave", .kind = TICKPROF_KIND_SECOND },
+};
+static int g_tickProfCount = TICKPROF_FIXED_SLOTS;
+
+static int TickProf_Bucket(unsigned int us) {
+	unsigned int v = us;
+	int msb = 0;
+	int idx;
+
+	if (us < 2)
+		return us;
+	if (v >= (1u << 16)) { v >>= 16; msb += 16; }
+	if (v >= (1u << 8)) { v >>= 8; msb += 8; }
+	if (v >= (1u << 4)) { v >>= 4; msb += 4; }
+	if (v >= (1u << 2)) { v >>= 2; msb += 2; }
+	if (v >= (1u << 1)) { msb += 1; }
+	idx = msb * 2 + ((us >> (msb - 1)) & 1);
+	if (idx >= TICKPROF_BUCKETS)
+		idx = TICKPROF_BUCKETS - 1;
+	return idx;
+}
+
+static unsigned int TickProf_BucketUpperBound(int idx) {
+	int msb;
+	unsigned int lower;
+
+	if (idx < 2)
+		return idx;
+	msb = idx >> 1;
+	lower = (2u + (idx & 1)) << (msb - 1);
+	return lower + (1u << (msb - 1)) - 1;
+}
+
+void TickProf_Add(int slot, unsigned int us) {
+	tickProfSlot_t *s;
+	int idx, i;
+
+	if (slot < 0 || slot >= g_tickProfCount)
+		return;
+	s = &g_tickProf[slot];
+	if (s->count == 0 || us < s->minUs)
+		s->minUs = us;
+	if (us > s->maxUs)
+		s->maxUs = us;
+	if (us > TICKPROF_BUDGET_US)
+		s->overruns++;
+	s->count++;
+	s->totalUs += us;
+	idx = TickProf_Bucket(us);
+	if (s->hist[idx] == 0xFFFF) {
+		// keep the shape, lose some history
+		for (i = 0; i < TICKPROF_BUCKETS; i++) {
+			s->hist[i] >>= 1;
+		}
+	}
+	s->hist[idx]++;
+}
+
+unsigned int TickProf_Mark(int slot, unsigned int start) {
+	unsigned int now = HAL_GetTimeUs();
+	TickProf_Add(slot, now - start);
+	return now;
+}
+
+int TickProf_GetSlotFor(const char *name, int kind) {
+	int i;
+
+	for (i = TICKPROF_FIXED_SLOTS; i < g_tickProfCount; i++) {
+		if (g_tickProf[i].kind == kind && !strcmp(g_tickProf[i].name, name))
+			return i;
+	}
+	if (g_tickProfCount >= TICKPROF_MAX_SLOTS)
+		return -1;
+	i = g_tickProfCount;
+	memset(&g_tickProf[i], 0, sizeof(g_tickProf[i]));
+	g_tickProf[i].name = name;
+	g_tickProf[i].kind = kind;
+	g_tickProfCount++;
+	return i;
+}
+
+int TickProf_GetSlotsCount() {
+	return g_tickProfCount;
+}
+
+const tickProfSlot_t *TickProf_GetSlot(int slot) {
+	if (slot < 0 || slot >= g_tickProfCount)
+		return 0;
+	return &g_tickProf[slot];
+}
+
+unsigned int TickProf_GetPercentile(int slot, int percent) {
+	const tickProfSlot_t *s = TickProf_GetSlot(slot);
+	unsigned int total = 0;
+	unsigned int target, sum;
+	unsigned int upper;
+	int i;
+
+	if (s == 0 || s->count == 0)
+		return 0;
+	for (i = 0; i < TICKPROF_BUCKETS; i++) {
+		total += s->hist[i];
+	}
+	target = (total * percent + 99) / 100;
+	sum = 0;
+	for (i = 0; i < TICKPROF_BUCKETS - 1; i++) {
+		sum += s->hist[i];
+		if (sum >= target)
+			break;
+	}
+	upper = TickProf_BucketUpperBound(i);
+	if (i == TICKPROF_BUCKETS - 1 || upper > s->maxUs)
+		upper = s->maxUs;
+	return upper;
+}
+
+void TickProf_Reset() {
+	int i;
+
+	for (i = 0; i < g_tickProfCount; i++) {
+		g_tickProf[i].count = 0;
+		g_tickProf[i].minUs = 0;
+		g_tickProf[i].maxUs = 0;
+		g_tickProf[i].overruns = 0;
+		g_tickProf[i].totalUs = 0;
+		memset(g_tickProf[i].hist, 0, sizeof(g_tickProf[i].hist));
+	}
+}
+
+void TickProf_LogReport() {
+	const tickProfSlot_t *s;
+	int i;
+
+	ADDLOG_INFO(LOG_FEATURE_MAIN, "Tick profile, times in us, budget %i", TICKPROF_BUDGET_US);
+	for (i = 0; i < g_tickProfCount; i++) {
+		s = &g_tickProf[i];
+		if (s->count == 0)
+			continue;
+		ADDLOG_INFO(LOG_FEATURE_MAIN, "%-16s %-6s n=%u min=%u avg=%u p99=%u max=%u over=%u",
+			s->name, s->kind == TICKPROF_KIND_QUICK ? "quick" : "second", s->count, s->minUs,
+			(unsigned int)(s->totalUs / s->count), TickProf_GetPercentile(i, 99), s->maxUs, s->overruns);
+	}
+}
+
+static commandResult_t CMD_TickProfile(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1 && !stricmp(Tokenizer_GetArg(0), "reset")) {
+		TickProf_Reset();
+		return CMD_RES_OK;
+	}
+	TickProf_LogReport();
+	return CMD_RES_OK;
+}
+
+void TickProf_AddCommands() {
+	//cmddetail:{"name":"tickProfile","args":"[reset]",
+	//cmddetail:"descr":"Prints min/avg/p99/max time spent in quick tick and every second handlers, per subsystem and per driver. Same data is at /api/tickprofile. With 'reset' argument, clears collected stats.",
+	//cmddetail:"fn":"CMD_TickProfile","file":"tick_profiler.c","requires":"",
+	//cmddetail:"examples":"tickProfile"}
+	CMD_RegisterCommand("tickProfile", CMD_TickProfile, NULL);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __TICK_PROFILER_H__
+#define __TICK_PROFILER_H__
+
+#include "obk_config.h"
+
+// Time spent in main loop subsystems and in every driver callback,
+// measured with HAL_GetTimeUs. See 'tickProfile' command and /api/tickprofile.
+
+#define TICKPROF_MAX_SLOTS		40
+// 2 buckets per power of two, last one collects everything above ~49 ms
+#define TICKPROF_BUCKETS		32
+
+#define TICKPROF_KIND_QUICK		0
+#define TICKPROF_KIND_SECOND	1
+
+// slots with fixed index, drivers get theirs at first call
+typedef enum {
+	TICKPROF_QUICKTICK,
+	TICKPROF_PINS,
+	TICKPROF_SCRIPTS,
+	TICKPROF_BERRY,
+	TICKPROF_REPEATINGEVENTS,
+	TICKPROF_DRIVERS,
+	TICKPROF_UARTCMD,
+	TICKPROF_MQTT,
+	TICKPROF_LEDLERP,
+	TICKPROF_ADC,
+	TICKPROF_EVERYSECOND,
+	TICKPROF_MQTT_SECOND,
+	TICKPROF_LED_SECOND,
+	TICKPROF_DRIVERS_SECOND,
+	TICKPROF_CLOCK_SECOND,
+	TICKPROF_CFGSAVE,
+	TICKPROF_FIXED_SLOTS,
+} tickProfFixedSlot_t;
+
+typedef struct tickProfSlot_s {
+	const char *name;
+	unsigned char kind;
+	unsigned int count;
+	unsigned int minUs;
+	unsigned int maxUs;
+	// samples longer than one quick tick period
+	unsigned int overruns;
+	unsigned long long totalUs;
+	unsigned short hist[TICKPROF_BUCKETS];
+} tickProfSlot_t;
+
+#if ENABLE_TICK_PROFILER
+
+#include "hal/hal_generic.h"
+
+#define TICKPROF_START(t)			t = HAL_GetTimeUs()
+#define TICKPROF_MARK(slot, t)		t = TickProf_Mark(slot, t)
+
+#else
+
+#define TICKPROF_START(t)
+#define TICKPROF_MARK(slot, t)
+
+#endif
+
+/// @brief Record one sample. Negative slot is ignored.
+void TickProf_Add(int slot, unsigned int us);
+/// @brief Record time since start and return current time, so marks can be chained.
+unsigned int TickProf_Mark(int slot, unsigned int start);
+/// @brief Find or allocate slot for given name and kind. Name must stay valid.
+/// @return slot index or -1 if table is full
+int TickProf_GetSlotFor(const char *name, int kind);
+int TickProf_GetSlotsCount();
+const tickProfSlot_t *TickProf_GetSlot(int slot);
+/// @brief Upper bound of the histogram bucket holding given percentile, capped by max.
+unsigned int TickProf_GetPercentile(int slot, int percent);
+void TickProf_Reset();
+void TickProf_LogReport();
+void TickProf_AddCommands();
+
+#endif
@@ -4,6 +4,9 @@
  //
 #include "hal/hal_wifi.h"
 #include "hal/hal_generic.h"
+#include "tick_profiler.h"
+#include "memory/mem_pool.h"
+#include "cJSON/cJSON_arena.h"
 #include "hal/hal_flashVars.h"
 #include "hal/hal_adc.h"
 #include "new_common.h"
@@ -12,6 +15,7 @@
 #include "driver/drv_public.h"
 #include "driver/drv_bl_shared.h"
 #include "driver/drv_hlw8112.h"
+#include "driver/drv_adcSampler.h"
 //#include "ir/ir_local.h"
 
 #include "driver/drv_deviceclock.h"
@@ -30,6 +34,7 @@
 #include "logging/logging.h"
 #include "httpserver/http_tcp_server.h"
 #include "httpserver/rest_interface.h"
+#include "httpclient/http_client.h"
 #include "mqtt/new_mqtt.h"
 #include "hal/hal_ota.h"
 
@@ -733,7 +738,11 @@ void Main_OnEverySecond()
 	int newMQTTState;
 	const char* safe;
 	int i;
+#if ENABLE_TICK_PROFILER
+	unsigned int profStart, prof;
+#endif
 
+	TICKPROF_START(profStart);
 #ifdef WINDOWS
 	g_bHasWiFiConnected = 1;
 #endif
@@ -771,7 +780,9 @@ void Main_OnEverySecond()
 
 #if ENABLE_MQTT
 	// run_adc_test();
+	TICKPROF_START(prof);
 	newMQTTState = MQTT_RunEverySecondUpdate();
+	TICKPROF_MARK(TICKPROF_MQTT_SECOND, prof);
 	if (newMQTTState != bMQTTconnected) {
 		bMQTTconnected = newMQTTState;
 		if (newMQTTState) {
@@ -802,8 +813,10 @@ void Main_OnEverySecond()
 #if ENABLE_MQTT
 	MQTT_Dedup_Tick();
 #endif
+	TICKPROF_START(prof);
 #if ENABLE_LED_BASIC
 	LED_RunOnEverySecond();
+	TICKPROF_MARK(TICKPROF_LED_SECOND, prof);
 #endif
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_OnEverySecond();
@@ -811,12 +824,15 @@ void Main_OnEverySecond()
  || defined (PLATFORM_RTL87X0C) || PLATFORM_ESP8266
 	UART_RunEverySecond();
 #endif
+	TICKPROF_MARK(TICKPROF_DRIVERS_SECOND, prof);
 #endif
 
 	if (OTA_GetProgress() == -1)
 	{
 		CFG_Save_IfThereArePendingChanges();
+		TICKPROF_MARK(TICKPROF_CFGSAVE, prof);
 	}
+	MemPool_OnEverySecond();
 
 	// On Beken, do reboot if we ran into heap size problem
 #if PLATFORM_BEKEN || PLATFORM_W800
@@ -874,23 +890,6 @@ void Main_OnEverySecond()
 		}
 	}
 
-	if (bSafeMode == 0)
-	{
-
-		for (i = 0; i < PLATFORM_GPIO_MAX; i++)
-		{
-			if (g_cfg.pins.roles[i] == IOR_ADC)
-			{
-				int value;
-
-				value = HAL_ADC_Read(i);
-
-				//	ADDLOGF_INFO("ADC %i=%i\r\n", i,value);
-				CHANNEL_Set(g_cfg.pins.channels[i], value, CHANNEL_SET_FLAG_SILENT);
-			}
-		}
-	}
-
 	// allow for up to 4 scheduled driver starts.
 	for (i = 0; i < 4; i++) {
 		if (scheduledDelay[i] > 0) {
@@ -1086,6 +1085,7 @@ void Main_OnEverySecond()
 	}
 #endif
 	HAL_Run_WDT();
+	TICKPROF_MARK(TICKPROF_EVERYSECOND, profStart);
 	// force it to sleep...  we MUST have some idle task processing
 	// else task memory doesn't get freed
 	rtos_delay_milliseconds(1);
@@ -1114,16 +1114,23 @@ unsigned int g_deltaTimeMS;
 // this is what we do in a qucik tick
 void QuickTick(void* param)
 {
+#if ENABLE_TICK_PROFILER
+	unsigned int profStart, prof;
+#endif
+
 	if (g_bWantPinDeepSleep) {
 		g_bWantPinDeepSleep = 0;
 		PINS_BeginDeepSleepWithPinWakeUp(g_pinDeepSleepWakeUp);
 		return;
 	}
+	TICKPROF_START(profStart);
+	TICKPROF_START(prof);
 
 #if defined(PLATFORM_BEKEN) && defined(BEKEN_PIN_GPI_INTERRUPTS)
 	// if using interrupt driven GPI for pins, don't call PIN_ticks() in QuickTick
 #else
 	PIN_ticks(param);
+	TICKPROF_MARK(TICKPROF_PINS, prof);
 #endif
 
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
@@ -1142,28 +1149,41 @@ void QuickTick(void* param)
 
 #if ENABLE_OBK_SCRIPTING
 	SVM_RunThreads(g_deltaTimeMS);
+	TICKPROF_MARK(TICKPROF_SCRIPTS, prof);
 #endif
 #if ENABLE_OBK_BERRY
 	extern void Berry_RunThreads(int deltaMS);
 	Berry_RunThreads(g_deltaTimeMS);
+	TICKPROF_MARK(TICKPROF_BERRY, prof);
 #endif
 	RepeatingEvents_RunUpdate(g_deltaTimeMS * 0.001f);
+	TICKPROF_MARK(TICKPROF_REPEATINGEVENTS, prof);
+	// IOR_ADC pins, ADC buttons, ADC smoother
+	if (bSafeMode == 0) {
+		ADCSampler_RunQuickTick(g_deltaTimeMS);
+		TICKPROF_MARK(TICKPROF_ADC, prof);
+	}
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_RunQuickTick();
+	TICKPROF_MARK(TICKPROF_DRIVERS, prof);
 #endif
 #ifdef WINDOWS
 	NewTuyaMCUSimulator_RunQuickTick(g_deltaTimeMS);
+	TICKPROF_START(prof);
 #endif
 	CMD_RunUartCmndIfRequired();
+	TICKPROF_MARK(TICKPROF_UARTCMD, prof);
 
 	// process received messages here..
 #if ENABLE_MQTT
 	MQTT_RunQuickTick();
+	TICKPROF_MARK(TICKPROF_MQTT, prof);
 #endif
 
 #if ENABLE_LED_BASIC
 	if (CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS) == true) {
 		LED_RunQuickColorLerp(g_deltaTimeMS);
+		TICKPROF_MARK(TICKPROF_LEDLERP, prof);
 	}
 #endif
 
@@ -1190,7 +1210,7 @@ void QuickTick(void* param)
 			PIN_set_wifi_led(g_wifi_ledState);
 		}
 	}
-
+	TICKPROF_MARK(TICKPROF_QUICKTICK, profStart);
 }
 
 #define QT_STACK_SIZE 2048
@@ -1302,7 +1322,7 @@ void Main_Init_AfterDelay_Unsafe(bool bStartAutoRunScripts) {
 #endif
 		CMD_ExecuteCommand("startScript autoexec.bat", COMMAND_FLAG_SOURCE_SCRIPT);
 #if ENABLE_OBK_BERRY
-		CMD_ExecuteCommand("berry import autoexec", COMMAND_FLAG_SOURCE_SCRIPT);
+		Berry_ImportFile("autoexec.be", COMMAND_FLAG_SOURCE_SCRIPT);
 #endif
 	}
 }
@@ -1347,6 +1367,7 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 	NewLED_InitCommands();
 #endif
 #if ENABLE_SEND_POSTANDGET
+	HTTPClient_Init();
 	CMD_InitSendCommands();
 #endif
 	CMD_InitChannelCommands();
@@ -1461,6 +1482,12 @@ void Main_ForceUnsafeInit() {
 void Main_Init_Before_Delay()
 {
 	ADDLOGF_INFO("%s", __func__);
+	// before anything allocates, so pools are not squeezed between other blocks
+	MemPool_Init();
+	JSONArena_Init();
+#if ENABLE_TASMOTA_JSON
+	JSON_Init();
+#endif
 	// read or initialise the boot count flash area
 	HAL_FlashVars_IncreaseBootCount();
 
@@ -1,2 +1,5 @@
 
 #include <fcntl.h>
+
+// real lwIP declares it, simulator implements it in win_rtos_stub.c
+int lwip_fcntl(int s, int cmd, int val);
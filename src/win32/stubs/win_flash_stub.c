@@ -64,10 +64,21 @@ void SIM_SetupNewFlashFile(const char *flashPath) {
 }
 
 
+// flash operation counters, for benchmarks
+int g_flashReads = 0;
+int g_flashWrites = 0;
+int SIM_GetFlashReadCount() {
+	return g_flashReads;
+}
+int SIM_GetFlashWriteCount() {
+	return g_flashWrites;
+}
+
 UINT32 flash_read(char *user_buf, UINT32 count, UINT32 address) {
 	//FILE *f;
 
 	allocFlashIfNeeded();
+	g_flashReads++;
 
 	memcpy(user_buf, g_flash + address, count);
 	//f = fopen(fname,"rb");
@@ -82,13 +93,29 @@ int beken_hal_flash_read(const uint32_t addr, uint8_t *dst, const uint32_t size)
 UINT32 flash_write(char *user_buf, UINT32 count, UINT32 address) {
 
 	allocFlashIfNeeded();
+	g_flashWrites++;
 	if (memcmp(g_flash + address, user_buf, count)) {
 		g_bFlashModified = true;
 		memcpy(g_flash + address, user_buf, count);
 	}
 	return 0;
 }
+int g_flashErases = 0;
+int SIM_GetFlashEraseCount() {
+	return g_flashErases;
+}
 UINT32 flash_ctrl(UINT32 cmd, void *parm) {
+	UINT32 address;
+
+	if (cmd == CMD_FLASH_ERASE_SECTOR) {
+		allocFlashIfNeeded();
+		address = *(UINT32*)parm & ~0xFFF;
+		if (address + 0x1000 <= FLASH_SIZE) {
+			memset(g_flash + address, 0xFF, 0x1000);
+			g_bFlashModified = true;
+			g_flashErases++;
+		}
+	}
 	return 0;
 }
 
@@ -35,10 +35,13 @@
 #include "driver/drv_public.h"
 #include "cmnds/cmd_public.h"
 #include "httpserver/new_http.h"
+#include "httpclient/http_client.h"
 #include "quicktick.h"
+#include "tick_profiler.h"
 #include "hal/hal_flashVars.h"
 #include "selftest/selftest_local.h"
 #include "new_pins.h"
+#include "driver/drv_uart.h"
 
 #define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
 
@@ -103,9 +106,13 @@ void Sim_RunFrame(int frameTime)
 	// this time counter is simulated, I need this for unit tests to work
 	g_simulatedTimeNow += frameTime;
 	accum_time += frameTime;
+	SIM_RunPinPulses();
 	QuickTick(0);
 	WIN_RunMQTTFrame();
 	HTTPServer_RunQuickTick();
+#if ENABLE_SEND_POSTANDGET
+	HTTPClient_Worker_RunOnce();
+#endif
 	if (accum_time > 1000)
 	{
 		accum_time -= 1000;
@@ -203,6 +210,8 @@ void Win_DoUnitTests()
 {
 	// SELFTEST_ASSERT_EXPRESSION("sqrt(4)", 2)
 
+	// first, so its stats reset does not cut the final report short
+	Test_TickProfiler();
 	Test_Command_If();
 	Test_MQTT();
 	Test_HTTP_Client();
@@ -211,11 +220,14 @@ void Win_DoUnitTests()
 	Test_MAX72XX();
 
 	Test_LEDstrips();
+	Test_DDPSend();
 	Test_Commands_Channels();
 
 	Test_Driver_TCL_AC();
 
 	Test_PIR();
+	Test_ADCSampler();
+	Test_MeterFrame();
 #if ENABLE_OBK_BERRY
 	Test_Berry();
 #endif
@@ -285,6 +297,7 @@ void Win_DoUnitTests()
 	Test_ChangeHandlers_EnsureThatChannelVariableIsExpandedAtHandlerRunTime();
 	Test_RepeatingEvents();
 	Test_ButtonEvents();
+	Test_ButtonEvents_EdgeQueue();
 	Test_Commands_Alias();
 	Test_Demo_SignAndValue();
 	Test_LEDDriver();
@@ -292,9 +305,21 @@ void Win_DoUnitTests()
 	Test_Scripting();
 	Test_Tokenizer();
 	Test_Pins();
+	Test_Pins_ChannelIndex();
 	Test_Http();
 	Test_Http_LED();
 	Test_DeviceGroups();
+#if ENABLE_DRIVER_DS1820_FULL
+	Test_DS1820();
+#endif
+	Test_OTA();
+	Test_SSDP();
+	Test_MemPool();
+	Test_Sim_Solver();
+#if ENABLE_SDL_WINDOW
+	// same solver on real junctions, needs SDL side of simulator
+	Test_Sim_SolverJunctions();
+#endif
 
 	// Just to be sure
 	// Must be last step
@@ -627,6 +652,10 @@ int __cdecl main(int argc, char **argv)
 		Win_DoUnitTests();
 		Sim_RunFrames(50, false);
 		g_bDoingUnitTestsNow = 0;
+#if ENABLE_TICK_PROFILER
+		// benchmark report of whole selftest run
+		TickProf_LogReport();
+#endif
 		if (g_selfTestsMode > 1)
 		{
 			return SelfTest_GetNumErrors();
@@ -696,9 +725,9 @@ void add_otadata(unsigned char *data, int len)
 }
 
 // finalise OTA flash (write last sector if incomplete)
-void close_ota()
+int close_ota()
 {
-	return;
+	return 0;
 }
 
 void otarequest(const char *urlin)